@@ -0,0 +1,485 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#define _GNU_SOURCE
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytes.h"
+#include "core_module.h"
+#include "memory.h"
+
+typedef enum {
+    ENCODING_UTF8,
+    ENCODING_LATIN1,   // Each byte is the character with the same value.
+} Encoding;
+
+static bool getEncoding(VM* vm, Value* args, int index, Encoding* encoding) {
+    if (IS_STRING(args[index])) {
+        const wchar_t* name = AS_STRING(args[index])->chars;
+        if (wcscmp(name, L"UTF-8") == 0) {
+            *encoding = ENCODING_UTF8;
+            return true;
+        } else if (wcscmp(name, L"拉丁1") == 0) {
+            *encoding = ENCODING_LATIN1;
+            return true;
+        }
+    }
+    return nativeError(vm, args, L"参数 %d（编码）必须是「UTF-8」或「拉丁1」。", index + 1);
+}
+
+// Finds the byte an index refers to, counting back from the end if it is
+// negative.
+bool getByteIndex(Value index, size_t count, size_t* byte) {
+    if (!IS_NUMBER(index)) return false;
+    double number = AS_NUMBER(index);
+    if (number < 0) number += (double)count;
+    if (number < 0 || number >= (double)count) return false;
+    *byte = (size_t)number;
+    return true;
+}
+
+// Like getByteIndex, but allows the end of the array for slice bounds.
+static bool getBound(VM* vm, Value* args, int index, size_t count, size_t* bound) {
+    if (!IS_NUMBER(args[index])) {
+        return nativeError(vm, args, L"参数 %d 的类型必须是「数字」，而不是「%ls」。",
+                           index + 1, getType(args[index]));
+    }
+    double number = AS_NUMBER(args[index]);
+    if (number < 0) number += (double)count;
+    if (number < 0 || number > (double)count) return nativeError(vm, args, L"参数 %d 不是有效索引。", index + 1);
+    *bound = (size_t)number;
+    return true;
+}
+
+static bool getByte(VM* vm, Value* args, int index, uint8_t* byte) {
+    if (!IS_NUMBER(args[index]) || AS_NUMBER(args[index]) != floor(AS_NUMBER(args[index])) ||
+        AS_NUMBER(args[index]) < 0 || AS_NUMBER(args[index]) > 255) {
+        return nativeError(vm, args, L"参数 %d 必须是 0 到 255 的整数。", index + 1);
+    }
+    *byte = (uint8_t)AS_NUMBER(args[index]);
+    return true;
+}
+
+// Strings made by some methods count their terminator in [length], so like
+// 打印, stop at the first zero character.
+static int textLength(ObjString* string) {
+    return (int)wcsnlen(string->chars, string->length);
+}
+
+size_t utf8Size(const wchar_t* chars, int length) {
+    size_t size = 0;
+    for (int i = 0; i < length; i++) {
+        uint32_t c = (uint32_t)chars[i];
+        if (c < 0x80) size += 1;
+        else if (c < 0x800) size += 2;
+        else if (c < 0x10000 || c > 0x10FFFF) size += 3;
+        else size += 4;
+    }
+    return size;
+}
+
+// Writes utf8Size() bytes to [out]. Surrogates and values past the last
+// code point become U+FFFD.
+void encodeUtf8(const wchar_t* chars, int length, uint8_t* out) {
+    for (int i = 0; i < length; i++) {
+        uint32_t c = (uint32_t)chars[i];
+        if (c < 0x80) {
+            *out++ = (uint8_t)c;
+            continue;
+        }
+        if ((c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) c = 0xFFFD;
+        if (c < 0x800) {
+            *out++ = (uint8_t)(0xC0 | (c >> 6));
+            *out++ = (uint8_t)(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            *out++ = (uint8_t)(0xE0 | (c >> 12));
+            *out++ = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+            *out++ = (uint8_t)(0x80 | (c & 0x3F));
+        } else {
+            *out++ = (uint8_t)(0xF0 | (c >> 18));
+            *out++ = (uint8_t)(0x80 | ((c >> 12) & 0x3F));
+            *out++ = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+            *out++ = (uint8_t)(0x80 | (c & 0x3F));
+        }
+    }
+}
+
+// Writes [string] to [path], which holds PATH_MAX bytes, as the UTF-8 the
+// file system is given whatever the locale. Returns false if it doesn't fit.
+bool encodePath(ObjString* string, char* path) {
+    int length = (int)wcsnlen(string->chars, string->length);
+    size_t size = utf8Size(string->chars, length);
+    if (size >= PATH_MAX) return false;
+    encodeUtf8(string->chars, length, (uint8_t*)path);
+    path[size] = '\0';
+    return true;
+}
+
+// Encodes a string into a new array, or returns NULL if a character has no
+// encoding.
+static ObjBytes* encodeString(VM* vm, ObjString* string, Encoding encoding) {
+    int length = textLength(string);
+    if (encoding == ENCODING_LATIN1) {
+        for (int i = 0; i < length; i++) {
+            if ((uint32_t)string->chars[i] > 0xFF) return NULL;
+        }
+        ObjBytes* bytes = newBytes(vm, (size_t)length);
+        for (int i = 0; i < length; i++) bytes->data[i] = (uint8_t)string->chars[i];
+        return bytes;
+    }
+    ObjBytes* bytes = newBytes(vm, utf8Size(string->chars, length));
+    encodeUtf8(string->chars, length, bytes->data);
+    return bytes;
+}
+
+static bool decodeBytes(VM* vm, ObjBytes* bytes, Encoding encoding, Value* args) {
+    if (bytes->count > INT_MAX) return nativeError(vm, args, L"字节太多，无法放入一个字符串。");
+    const uint8_t* data = bytesData(bytes);
+    int count = (int)bytes->count;
+    if (encoding == ENCODING_LATIN1) {
+        wchar_t* chars = ALLOCATE(vm, wchar_t, count + 1);
+        for (int i = 0; i < count; i++) chars[i] = data[i];
+        chars[count] = L'\0';
+        args[-1] = OBJ_VAL(takeString(vm, chars, count));
+        return true;
+    }
+    // copyUtf8 may look past a truncated sequence at the end, so give it a
+    // terminated copy.
+    char* text = (char*)malloc((size_t)count + 1);
+    if (text == NULL) exit(1);
+    if (count > 0) memcpy(text, data, (size_t)count);
+    text[count] = '\0';
+    ObjString* string = copyUtf8(vm, text, count);
+    free(text);
+    args[-1] = OBJ_VAL(string);
+    return true;
+}
+
+typedef struct {
+    const wchar_t* name;
+    int size;
+    bool isSigned;
+    bool isFloat;
+} NumberType;
+
+static const NumberType numberTypes[] = {
+    {L"i8", 1, true, false},
+    {L"u8", 1, false, false},
+    {L"i16", 2, true, false},
+    {L"u16", 2, false, false},
+    {L"i32", 4, true, false},
+    {L"u32", 4, false, false},
+    {L"f32", 4, true, true},
+    {L"f64", 8, true, true},
+};
+
+// Reads the type and offset arguments of 读数 and 写数, and the optional
+// byte order after them at [orderIndex].
+static bool getNumberLayout(VM* vm, Value* args, int argCount, int orderIndex,
+                            const NumberType** type, size_t* offset, bool* bigEndian) {
+    *type = NULL;
+    if (IS_STRING(args[0])) {
+        for (size_t i = 0; i < sizeof(numberTypes) / sizeof(numberTypes[0]); i++) {
+            if (wcscmp(AS_STRING(args[0])->chars, numberTypes[i].name) == 0) *type = &numberTypes[i];
+        }
+    }
+    if (*type == NULL) {
+        return nativeError(vm, args, L"参数 1（类型）必须是 i8、u8、i16、u16、i32、u32、f32 或 f64。");
+    }
+
+    ObjBytes* bytes = AS_BYTES(args[-1]);
+    if (!IS_NUMBER(args[1])) {
+        return nativeError(vm, args, L"参数 2（偏移）的类型必须是「数字」，而不是「%ls」。", getType(args[1]));
+    }
+    double number = AS_NUMBER(args[1]);
+    if (number < 0 || number != floor(number) || number + (*type)->size > (double)bytes->count) {
+        return nativeError(vm, args, L"偏移 %g 处放不下「%ls」。", number, (*type)->name);
+    }
+    *offset = (size_t)number;
+
+    *bigEndian = false;
+    if (argCount > orderIndex) {
+        if (IS_STRING(args[orderIndex]) && wcscmp(AS_STRING(args[orderIndex])->chars, L"大端") == 0) {
+            *bigEndian = true;
+        } else if (!IS_STRING(args[orderIndex]) || wcscmp(AS_STRING(args[orderIndex])->chars, L"小端") != 0) {
+            return nativeError(vm, args, L"参数 %d（端序）必须是「小端」或「大端」。", orderIndex + 1);
+        }
+    }
+    return true;
+}
+
+// 长度（） returns the number of bytes.
+static bool lengthNative(VM* vm, int argCount, Value* args) {
+    args[-1] = NUMBER_VAL((double)AS_BYTES(args[-1])->count);
+    return true;
+}
+
+// 切片（开头，结尾） returns a view of the bytes between two indexes. The
+// end is exclusive and defaults to the end of the array.
+static bool sliceNative(VM* vm, int argCount, Value* args) {
+    if (argCount < 1 || argCount > 2) {
+        return nativeError(vm, args, L"需要 1 到 2 个参数，但得到 %d。", argCount);
+    }
+    ObjBytes* bytes = AS_BYTES(args[-1]);
+    size_t start;
+    size_t end = bytes->count;
+    if (!getBound(vm, args, 0, bytes->count, &start)) return false;
+    if (argCount == 2 && !getBound(vm, args, 1, bytes->count, &end)) return false;
+    if (end < start) return nativeError(vm, args, L"结束索引不能在开始索引之前。");
+    args[-1] = OBJ_VAL(sliceBytes(vm, bytes, start, end - start));
+    return true;
+}
+
+// 复制（） returns a new array with a copy of the bytes.
+static bool copyNative(VM* vm, int argCount, Value* args) {
+    ObjBytes* bytes = AS_BYTES(args[-1]);
+    args[-1] = OBJ_VAL(copyBytes(vm, bytesData(bytes), bytes->count));
+    return true;
+}
+
+// 查找（目标，开头） returns the index of the first match at or after the
+// start, or -1. The target is a byte, a 字节 or a string, which is matched
+// as UTF-8.
+static bool findNative(VM* vm, int argCount, Value* args) {
+    if (argCount < 1 || argCount > 2) {
+        return nativeError(vm, args, L"需要 1 到 2 个参数，但得到 %d。", argCount);
+    }
+    ObjBytes* bytes = AS_BYTES(args[-1]);
+    size_t start = 0;
+    if (argCount == 2 && !getBound(vm, args, 1, bytes->count, &start)) return false;
+    const uint8_t* data = bytesData(bytes);
+
+    const uint8_t* found;
+    if (IS_NUMBER(args[0])) {
+        uint8_t byte;
+        if (!getByte(vm, args, 0, &byte)) return false;
+        found = memchr(data + start, byte, bytes->count - start);
+    } else if (IS_BYTES(args[0])) {
+        ObjBytes* target = AS_BYTES(args[0]);
+        found = memmem(data + start, bytes->count - start, bytesData(target), target->count);
+    } else if (IS_STRING(args[0])) {
+        ObjString* target = AS_STRING(args[0]);
+        int length = textLength(target);
+        size_t size = utf8Size(target->chars, length);
+        uint8_t* text = (uint8_t*)malloc(size + 1);
+        if (text == NULL) exit(1);
+        encodeUtf8(target->chars, length, text);
+        found = memmem(data + start, bytes->count - start, text, size);
+        free(text);
+    } else {
+        return nativeError(vm, args, L"参数 1（目标）的类型必须是「数字」、「字节」或「字符串」，而不是「%ls」。",
+                           getType(args[0]));
+    }
+    args[-1] = NUMBER_VAL(found == NULL ? -1 : (double)(found - data));
+    return true;
+}
+
+// 解码（编码） returns the bytes as a string. The encoding defaults to UTF-8,
+// and malformed sequences become U+FFFD.
+static bool decodeNative(VM* vm, int argCount, Value* args) {
+    if (argCount > 1) return nativeError(vm, args, L"需要 0 到 1 个参数，但得到 %d。", argCount);
+    Encoding encoding = ENCODING_UTF8;
+    if (argCount == 1 && !getEncoding(vm, args, 0, &encoding)) return false;
+    return decodeBytes(vm, AS_BYTES(args[-1]), encoding, args);
+}
+
+// 追加（值） adds a byte, the bytes of a 字节 or a string as UTF-8 to the
+// end. Slices can't grow.
+static bool appendNative(VM* vm, int argCount, Value* args) {
+    ObjBytes* bytes = AS_BYTES(args[-1]);
+    if (bytes->owner != NULL) return nativeError(vm, args, L"无法追加到切片。");
+
+    if (IS_NUMBER(args[0])) {
+        uint8_t byte;
+        if (!getByte(vm, args, 0, &byte)) return false;
+        appendBytes(vm, bytes, &byte, 1);
+    } else if (IS_BYTES(args[0])) {
+        ObjBytes* other = AS_BYTES(args[0]);
+        appendBytes(vm, bytes, bytesData(other), other->count);
+    } else if (IS_STRING(args[0])) {
+        ObjString* string = AS_STRING(args[0]);
+        int length = textLength(string);
+        size_t size = utf8Size(string->chars, length);
+        uint8_t* text = (uint8_t*)malloc(size + 1);
+        if (text == NULL) exit(1);
+        encodeUtf8(string->chars, length, text);
+        appendBytes(vm, bytes, text, size);
+        free(text);
+    } else {
+        return nativeError(vm, args, L"参数 1（值）的类型必须是「数字」、「字节」或「字符串」，而不是「%ls」。",
+                           getType(args[0]));
+    }
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+// 读数（类型，偏移，端序） reads a number stored at a byte offset. The byte
+// order is "小端" (the default) or "大端".
+static bool readNumberNative(VM* vm, int argCount, Value* args) {
+    if (argCount < 2 || argCount > 3) {
+        return nativeError(vm, args, L"需要 2 到 3 个参数，但得到 %d。", argCount);
+    }
+    const NumberType* type;
+    size_t offset;
+    bool bigEndian;
+    if (!getNumberLayout(vm, args, argCount, 2, &type, &offset, &bigEndian)) return false;
+
+    const uint8_t* data = bytesData(AS_BYTES(args[-1])) + offset;
+    uint64_t bits = 0;
+    for (int i = 0; i < type->size; i++) {
+        int shift = 8 * (bigEndian ? type->size - 1 - i : i);
+        bits |= (uint64_t)data[i] << shift;
+    }
+
+    double value;
+    if (type->isFloat && type->size == 4) {
+        uint32_t narrow = (uint32_t)bits;
+        float single;
+        memcpy(&single, &narrow, sizeof(single));
+        value = single;
+    } else if (type->isFloat) {
+        memcpy(&value, &bits, sizeof(value));
+    } else if (type->isSigned) {
+        // Sign-extend from the type's top bit.
+        uint64_t sign = (uint64_t)1 << (8 * type->size - 1);
+        value = (double)(int64_t)((bits ^ sign) - sign);
+    } else {
+        value = (double)bits;
+    }
+    args[-1] = NUMBER_VAL(value);
+    return true;
+}
+
+// 写数（类型，偏移，值，端序） stores a number at a byte offset. Integers
+// must fit the type.
+static bool writeNumberNative(VM* vm, int argCount, Value* args) {
+    if (argCount < 3 || argCount > 4) {
+        return nativeError(vm, args, L"需要 3 到 4 个参数，但得到 %d。", argCount);
+    }
+    const NumberType* type;
+    size_t offset;
+    bool bigEndian;
+    if (!getNumberLayout(vm, args, argCount, 3, &type, &offset, &bigEndian)) return false;
+    if (!IS_NUMBER(args[2])) {
+        return nativeError(vm, args, L"参数 3（值）的类型必须是「数字」，而不是「%ls」。", getType(args[2]));
+    }
+    double value = AS_NUMBER(args[2]);
+
+    uint64_t bits;
+    if (type->isFloat && type->size == 4) {
+        float single = (float)value;
+        uint32_t narrow;
+        memcpy(&narrow, &single, sizeof(narrow));
+        bits = narrow;
+    } else if (type->isFloat) {
+        memcpy(&bits, &value, sizeof(bits));
+    } else {
+        int width = 8 * type->size;
+        double low = type->isSigned ? -ldexp(1, width - 1) : 0;
+        double high = type->isSigned ? ldexp(1, width - 1) - 1 : ldexp(1, width) - 1;
+        if (value != floor(value) || value < low || value > high) {
+            return nativeError(vm, args, L"%g 超出了「%ls」的范围。", value, type->name);
+        }
+        bits = (uint64_t)(int64_t)value;
+    }
+
+    uint8_t* data = bytesData(AS_BYTES(args[-1])) + offset;
+    for (int i = 0; i < type->size; i++) {
+        int shift = 8 * (bigEndian ? type->size - 1 - i : i);
+        data[i] = (uint8_t)(bits >> shift);
+    }
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+typedef struct {
+    const wchar_t* name;
+    NativeFn function;
+    int arity;
+} BytesMethod;
+
+static const BytesMethod bytesMethods[] = {
+    {L"长度", lengthNative, 0},
+    {L"切片", sliceNative, -1},
+    {L"复制", copyNative, 0},
+    {L"查找", findNative, -1},
+    {L"解码", decodeNative, -1},
+    {L"追加", appendNative, 1},
+    {L"读数", readNumberNative, -1},
+    {L"写数", writeNumberNative, -1},
+};
+
+bool findBytesMethod(ObjString* name, NativeFn* function, int* arity) {
+    for (size_t i = 0; i < sizeof(bytesMethods) / sizeof(bytesMethods[0]); i++) {
+        if (wcscmp(name->chars, bytesMethods[i].name) == 0) {
+            *function = bytesMethods[i].function;
+            *arity = bytesMethods[i].arity;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 字节。新建（长度） returns an array of zero bytes.
+static bool newBytesNative(VM* vm, int argCount, Value* args) {
+    if (!IS_NUMBER(args[0]) || AS_NUMBER(args[0]) < 0 || AS_NUMBER(args[0]) != floor(AS_NUMBER(args[0]))) {
+        return nativeError(vm, args, L"参数 1（长度）必须是非负整数。");
+    }
+    args[-1] = OBJ_VAL(newBytes(vm, (size_t)AS_NUMBER(args[0])));
+    return true;
+}
+
+// 字节。编码（字符串，编码） returns the string's bytes. The encoding
+// defaults to UTF-8.
+static bool encodeNative(VM* vm, int argCount, Value* args) {
+    if (argCount < 1 || argCount > 2) {
+        return nativeError(vm, args, L"需要 1 到 2 个参数，但得到 %d。", argCount);
+    }
+    if (!IS_STRING(args[0])) {
+        return nativeError(vm, args, L"参数 1（字符串）的类型必须是「字符串」，而不是「%ls」。", getType(args[0]));
+    }
+    Encoding encoding = ENCODING_UTF8;
+    if (argCount == 2 && !getEncoding(vm, args, 1, &encoding)) return false;
+    ObjBytes* bytes = encodeString(vm, AS_STRING(args[0]), encoding);
+    if (bytes == NULL) return nativeError(vm, args, L"「拉丁1」只能编码 U+0000 到 U+00FF 的字符。");
+    args[-1] = OBJ_VAL(bytes);
+    return true;
+}
+
+// 字节。从列表（列表） returns an array of the numbers in a list.
+static bool fromListNative(VM* vm, int argCount, Value* args) {
+    if (!IS_LIST(args[0])) {
+        return nativeError(vm, args, L"参数 1（列表）的类型必须是「列表」，而不是「%ls」。", getType(args[0]));
+    }
+    ObjList* list = AS_LIST(args[0]);
+    for (int i = 0; i < list->count; i++) {
+        Value item = list->items[i];
+        if (!IS_NUMBER(item) || AS_NUMBER(item) != floor(AS_NUMBER(item)) ||
+            AS_NUMBER(item) < 0 || AS_NUMBER(item) > 255) {
+            return nativeError(vm, args, L"列表项 %d 必须是 0 到 255 的整数。", i);
+        }
+    }
+    ObjBytes* bytes = newBytes(vm, (size_t)list->count);
+    for (int i = 0; i < list->count; i++) bytes->data[i] = (uint8_t)AS_NUMBER(list->items[i]);
+    args[-1] = OBJ_VAL(bytes);
+    return true;
+}
+
+void initBytesClass(VM* vm) {
+    push(vm, OBJ_VAL(copyString(vm, L"字节", 2)));
+    ObjClass* bytesClass = newClass(vm, AS_STRING(vm->fiber->stackTop[-1]));
+    pop(vm);
+    push(vm, OBJ_VAL(bytesClass));
+    defineNative(vm, L"新建", newBytesNative, 1, bytesClass);
+    defineNative(vm, L"编码", encodeNative, -1, bytesClass);
+    defineNative(vm, L"从列表", fromListNative, 1, bytesClass);
+    ObjInstance* bytesClassInstance = newInstance(vm, bytesClass, true);
+    pop(vm);
+    push(vm, OBJ_VAL(bytesClassInstance));
+    defineNativeInstance(vm, L"字节", bytesClassInstance);
+    pop(vm);
+}
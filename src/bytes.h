@@ -0,0 +1,19 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_BYTES_H
+#define QI_BYTES_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+void initBytesClass(VM* vm);
+bool findBytesMethod(ObjString* name, NativeFn* function, int* arity);
+bool getByteIndex(Value index, size_t count, size_t* byte);
+size_t utf8Size(const wchar_t* chars, int length);
+void encodeUtf8(const wchar_t* chars, int length, uint8_t* out);
+bool encodePath(ObjString* string, char* path);
+
+#endif //QI_BYTES_H
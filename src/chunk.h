@@ -54,12 +54,18 @@ typedef enum {
     OP_CLOSURE,
     OP_CLOSE_UPVALUE,
     OP_RETURN,
+    OP_YIELD,
     OP_CLASS,
     OP_INHERIT,
     OP_METHOD,
     OP_DUP,
     OP_DOUBLE_DUP,
     OP_END,
+    OP_GET_MODULE,
+    OP_DEFINE_MODULE,
+    OP_SET_MODULE,
+    OP_GET_MODULE_MEMBER,
+    OP_IMPORT,
 } OpCode;
 
 typedef struct {
@@ -71,8 +77,8 @@ typedef struct {
 } Chunk;
 
 void initChunk(Chunk* chunk);
-void freeChunk(Chunk* chunk);
-void writeChunk(Chunk* chunk, uint8_t byte, int line);
-int addConstant(Chunk* chunk, Value value);
+void freeChunk(VM* vm, Chunk* chunk);
+void writeChunk(VM* vm, Chunk* chunk, uint8_t byte, int line);
+int addConstant(VM* vm, Chunk* chunk, Value value);
 
 #endif //QI_CHUNK_H
\ No newline at end of file
@@ -19,6 +19,8 @@
 
 #define UINT8_COUNT (UINT8_MAX + 1)
 
+typedef struct VM VM;
+
 #endif //QI_COMMON_H
 
 #undef DEBUG_PRINT_CODE
@@ -2,6 +2,7 @@
 // Created by Troy Zhong on 8/30/21.
 //
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,18 +10,15 @@
 #include "common.h"
 #include "compiler.h"
 #include "memory.h"
+#include "module.h"
 #include "scanner.h"
+#include "shared.h"
 
 #ifdef DEBUG_PRINT_CODE
 #include "debug.h"
 #endif
 
-typedef struct {
-    Token current;
-    Token previous;
-    bool hadError;
-    bool panicMode;
-} Parser;
+typedef struct Parser Parser;
 
 typedef enum {
     PREC_NONE,
@@ -40,7 +38,7 @@ typedef enum {
     PREC_SUBSCRIPT,   // 【】
 } Precedence;
 
-typedef void (*ParseFn)(bool canAssign);
+typedef void (*ParseFn)(Parser* parser, bool canAssign);
 
 typedef struct {
     ParseFn prefix;
@@ -82,21 +80,65 @@ typedef struct ClassCompiler {
     bool hasSuperclass;
 } ClassCompiler;
 
-Parser parser;
-Compiler* current = NULL;
-ClassCompiler* currentClass = NULL;
+// What the compiler knows about a module variable beyond its slot.
+typedef struct {
+    Token firstUse;
+    bool declared;
+} ModuleSlot;
+
+// A name bound by 导入, so members read through it can use their slots.
+typedef struct {
+    Token name;
+    ObjModule* module;
+} ImportBinding;
+
+struct Parser {
+    struct Parser* enclosing;
+    VM* vm;
+    Scanner scanner;
+    Token current;
+    Token previous;
+    bool hadError;
+    bool panicMode;
+
+    Compiler* compiler;
+    ClassCompiler* currentClass;
+
+    int innermostLoopStart;
+    int innermostLoopScopeDepth;
+    int innermostSwitchStart;
+
+    const char* path;        // The file being compiled, if any; imports are relative to it.
+    ObjModule* module;       // The module being compiled, or NULL for a script.
+    ModuleSlot* slots;
+    int slotCapacity;
+    ImportBinding* imports;
+    int importCount;
+    int importCapacity;
+    // The module whose value the last instruction emitted, at [moduleAt].
+    ObjModule* lastModule;
+    int moduleAt;
+};
 
-int innermostLoopStart = -1;
-int innermostLoopScopeDepth = 0;
-int innermostSwitchStart = -1;
+static Chunk* currentChunk(Parser* parser) {
+    return &parser->compiler->function->chunk;
+}
 
-static Chunk* currentChunk() {
-    return &current->function->chunk;
+// Decodes [length] bytes of UTF-8 into [chars] and returns the number of
+// characters. Passing NULL just counts them.
+static int decodeText(const char* start, int length, wchar_t* chars) {
+    int count = 0;
+    for (const char* c = start; c < start + length; count++) {
+        wchar_t codePoint;
+        c += decodeUtf8(c, &codePoint);
+        if (chars != NULL) chars[count] = codePoint;
+    }
+    return count;
 }
 
-static void errorAt(Token* token, const wchar_t* message) {
-    if (parser.panicMode) return;
-    parser.panicMode = true;
+static void errorAt(Parser* parser, Token* token, const wchar_t* message) {
+    if (parser->panicMode) return;
+    parser->panicMode = true;
     fwprintf(stderr, L"【行 %d】错误", token->line);
 
     if (token->type == TOKEN_EOF) {
@@ -104,193 +146,205 @@ static void errorAt(Token* token, const wchar_t* message) {
     } else if (token->type == TOKEN_ERROR) {
         // Nothing.
     } else {
-        fwprintf(stderr, L"在「%.*ls」", token->length, token->start);
+        wchar_t* text = (wchar_t*)malloc(sizeof(wchar_t) * (token->length + 1));
+        if (text == NULL) exit(1);
+        text[decodeText(token->start, token->length, text)] = L'\0';
+        fwprintf(stderr, L"在「%ls」", text);
+        free(text);
     }
 
     fwprintf(stderr, L"：%ls\n", message);
-    parser.hadError = true;
+    parser->hadError = true;
 }
 
-static void error(const wchar_t* message) {
-    errorAt(&parser.previous, message);
+static void error(Parser* parser, const wchar_t* message) {
+    errorAt(parser, &parser->previous, message);
 }
 
-static void errorAtCurrent(const wchar_t* message) {
-    errorAt(&parser.current, message);
+static void errorAtCurrent(Parser* parser, const wchar_t* message) {
+    errorAt(parser, &parser->current, message);
 }
 
-static void advance() {
-    parser.previous = parser.current;
+static ObjString* copyText(Parser* parser, const char* start, int length) {
+    return copyUtf8(parser->vm, start, length);
+}
+
+static void advance(Parser* parser) {
+    parser->previous = parser->current;
 
     for (;;) {
-        parser.current = scanToken();
-        if (parser.current.type != TOKEN_ERROR) break;
+        parser->current = scanToken(&parser->scanner);
+        if (parser->current.type != TOKEN_ERROR) break;
 
-        errorAtCurrent(parser.current.start);
+        // The scanner's error messages are all short literals.
+        wchar_t message[64];
+        message[decodeText(parser->current.start, parser->current.length, message)] = L'\0';
+        errorAtCurrent(parser, message);
     }
 }
 
-static void consume(TokenType type, const wchar_t* message) {
-    if (parser.current.type == type) {
-        advance();
+static void consume(Parser* parser, TokenType type, const wchar_t* message) {
+    if (parser->current.type == type) {
+        advance(parser);
         return;
     }
 
-    errorAtCurrent(message);
+    errorAtCurrent(parser, message);
 }
 
-static bool check(TokenType type) {
-    return parser.current.type == type;
+static bool check(Parser* parser, TokenType type) {
+    return parser->current.type == type;
 }
 
-static bool match(TokenType type) {
-    if (!check(type)) return false;
-    advance();
+static bool match(Parser* parser, TokenType type) {
+    if (!check(parser, type)) return false;
+    advance(parser);
     return true;
 }
 
-static void emitByte(uint8_t byte) {
-    writeChunk(currentChunk(), byte, parser.previous.line);
+static void emitByte(Parser* parser, uint8_t byte) {
+    writeChunk(parser->vm, currentChunk(parser), byte, parser->previous.line);
 }
 
-static void emitBytes(uint8_t byte1, uint8_t byte2) {
-    emitByte(byte1);
-    emitByte(byte2);
+static void emitBytes(Parser* parser, uint8_t byte1, uint8_t byte2) {
+    emitByte(parser, byte1);
+    emitByte(parser, byte2);
 }
 
-static void emitLoop(int loopStart) {
-    emitByte(OP_LOOP);
+static void emitLoop(Parser* parser, int loopStart) {
+    emitByte(parser, OP_LOOP);
 
-    int offset = currentChunk()->count - loopStart + 2;
-    if (offset > UINT16_MAX) error(L"循环太大。");
+    int offset = currentChunk(parser)->count - loopStart + 2;
+    if (offset > UINT16_MAX) error(parser, L"循环太大。");
 
-    emitByte((offset >> 8) & 0xff);
-    emitByte(offset & 0xff);
+    emitByte(parser, (offset >> 8) & 0xff);
+    emitByte(parser, offset & 0xff);
 }
 
-static int emitJump(uint8_t instruction) {
-    emitByte(instruction);
-    emitByte(0xff);
-    emitByte(0xff);
-    return currentChunk()->count - 2;
+static int emitJump(Parser* parser, uint8_t instruction) {
+    emitByte(parser, instruction);
+    emitByte(parser, 0xff);
+    emitByte(parser, 0xff);
+    return currentChunk(parser)->count - 2;
 }
 
-static void emitReturn() {
-    if (current->type == TYPE_INITIALIZER) {
-        emitBytes(OP_GET_LOCAL, 0);
+static void emitReturn(Parser* parser) {
+    if (parser->compiler->type == TYPE_INITIALIZER) {
+        emitBytes(parser, OP_GET_LOCAL, 0);
     } else {
-        emitByte(OP_NIL);
+        emitByte(parser, OP_NIL);
     }
 
-    emitByte(OP_RETURN);
+    emitByte(parser, OP_RETURN);
 }
 
-static uint8_t makeConstant(Value value) {
-    int constant = addConstant(currentChunk(), value);
+static uint8_t makeConstant(Parser* parser, Value value) {
+    int constant = addConstant(parser->vm, currentChunk(parser), value);
     if (constant > UINT8_MAX) {
-        error(L"太多常量在一个块中里面。");
+        error(parser, L"太多常量在一个块中里面。");
         return 0;
     }
 
     return (uint8_t)constant;
 }
 
-static void emitConstant(Value value) {
-    emitBytes(OP_CONSTANT, makeConstant(value));
+static void emitConstant(Parser* parser, Value value) {
+    emitBytes(parser, OP_CONSTANT, makeConstant(parser, value));
 }
 
-static void patchJump(int offset) {
+static void patchJump(Parser* parser, int offset) {
     // -2 to adjust for the bytecode for the jump offset itself.
-    int jump = currentChunk()->count - offset - 2;
+    int jump = currentChunk(parser)->count - offset - 2;
 
     if (jump > UINT16_MAX) {
-        error(L"代码太多，无法跳过。");
+        error(parser, L"代码太多，无法跳过。");
     }
 
-    currentChunk()->code[offset] = (jump >> 8) & 0xff;
-    currentChunk()->code[offset + 1] = jump & 0xff;
+    currentChunk(parser)->code[offset] = (jump >> 8) & 0xff;
+    currentChunk(parser)->code[offset + 1] = jump & 0xff;
 }
 
-static void initCompiler(Compiler* compiler, FunctionType type) {
-    compiler->enclosing = current;
+static void initCompiler(Parser* parser, Compiler* compiler, FunctionType type) {
+    compiler->enclosing = parser->compiler;
     compiler->function = NULL;
     compiler->type = type;
     compiler->localCount = 0;
     compiler->scopeDepth = 0;
-    compiler->function = newFunction();
-    current = compiler;
+    compiler->function = newFunction(parser->vm);
+    compiler->function->module = parser->module;
+    parser->compiler = compiler;
     if (type != TYPE_SCRIPT) {
-        current->function->name = copyString(parser.previous.start,
-                                             parser.previous.length);
+        parser->compiler->function->name = copyText(parser, parser->previous.start,
+                                                    parser->previous.length);
     }
 
-    Local* local = &current->locals[current->localCount++];
+    Local* local = &parser->compiler->locals[parser->compiler->localCount++];
     local->depth = 0;
     local->isCaptured = false;
     if (type != TYPE_FUNCTION) {
-        local->name.start = L"这";
-        local->name.length = 1;
+        local->name.start = "这";
+        local->name.length = (int)strlen("这");
     } else {
-        local->name.start = L"";
+        local->name.start = "";
         local->name.length = 0;
     }
 }
 
-static ObjFunction* endCompiler() {
-    emitReturn();
-    ObjFunction* function = current->function;
+static ObjFunction* endCompiler(Parser* parser) {
+    emitReturn(parser);
+    ObjFunction* function = parser->compiler->function;
 
 #ifdef DEBUG_PRINT_CODE
-    if (!parser.hadError) {
-        disassembleChunk(currentChunk(), function->name != NULL
+    if (!parser->hadError) {
+        disassembleChunk(currentChunk(parser), function->name != NULL
             ? function->name->chars : L"《脚本》");
     }
 #endif
 
-    current = current->enclosing;
+    parser->compiler = parser->compiler->enclosing;
     return function;
 }
 
-static void beginScope() {
-    current->scopeDepth++;
+static void beginScope(Parser* parser) {
+    parser->compiler->scopeDepth++;
 }
 
-static void endScope() {
-    current->scopeDepth--;
+static void endScope(Parser* parser) {
+    parser->compiler->scopeDepth--;
 
-    while (current->localCount > 0 &&
-           current->locals[current->localCount - 1].depth >
-           current->scopeDepth) {
-        if (current->locals[current->localCount - 1].isCaptured) {
-            emitByte(OP_CLOSE_UPVALUE);
+    while (parser->compiler->localCount > 0 &&
+           parser->compiler->locals[parser->compiler->localCount - 1].depth >
+           parser->compiler->scopeDepth) {
+        if (parser->compiler->locals[parser->compiler->localCount - 1].isCaptured) {
+            emitByte(parser, OP_CLOSE_UPVALUE);
         } else {
-            emitByte(OP_POP);
+            emitByte(parser, OP_POP);
         }
-        current->localCount--;
+        parser->compiler->localCount--;
     }
 }
 
-static void expression();
-static void statement();
-static void declaration();
+static void expression(Parser* parser);
+static void statement(Parser* parser);
+static void declaration(Parser* parser);
 static ParseRule* getRule(TokenType type);
-static void parsePrecedence(Precedence precedence);
+static void parsePrecedence(Parser* parser, Precedence precedence);
 
-static uint8_t identifierConstant(Token* name) {
-    return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
+static uint8_t identifierConstant(Parser* parser, Token* name) {
+    return makeConstant(parser, OBJ_VAL(copyText(parser, name->start, name->length)));
 }
 
 static bool identifiersEqual(Token* a, Token* b) {
     if (a->length != b->length) return false;
-    return memcmp(a->start, b->start, a->length * sizeof(wchar_t)) == 0;
+    return memcmp(a->start, b->start, a->length) == 0;
 }
 
-static int resolveLocal(Compiler* compiler, Token* name) {
+static int resolveLocal(Parser* parser, Compiler* compiler, Token* name) {
     for (int i = compiler->localCount - 1; i >= 0; i--) {
         Local* local = &compiler->locals[i];
         if (identifiersEqual(name, &local->name)) {
             if (local->depth == -1) {
-                error(L"无法在自己的初始化器中读取局部变量。");
+                error(parser, L"无法在自己的初始化器中读取局部变量。");
             }
             return i;
         }
@@ -299,7 +353,7 @@ static int resolveLocal(Compiler* compiler, Token* name) {
     return -1;
 }
 
-static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal) {
+static int addUpvalue(Parser* parser, Compiler* compiler, uint8_t index, bool isLocal) {
     int upvalueCount = compiler->function->upvalueCount;
 
     for (int i = 0; i < upvalueCount; i++) {
@@ -310,7 +364,7 @@ static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal) {
     }
 
     if (upvalueCount == UINT8_COUNT) {
-        error(L"功能中的闭包变量太多。");
+        error(parser, L"功能中的闭包变量太多。");
         return 0;
     }
 
@@ -319,230 +373,312 @@ static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal) {
     return compiler->function->upvalueCount++;
 }
 
-static int resolveUpvalue(Compiler* compiler, Token* name) {
+static int resolveUpvalue(Parser* parser, Compiler* compiler, Token* name) {
     if (compiler->enclosing == NULL) return -1;
 
-    int local = resolveLocal(compiler->enclosing, name);
+    int local = resolveLocal(parser, compiler->enclosing, name);
     if (local != -1) {
         compiler->enclosing->locals[local].isCaptured = true;
-        return addUpvalue(compiler, (uint8_t)local, true);
+        return addUpvalue(parser, compiler, (uint8_t)local, true);
     }
 
-    int upvalue = resolveUpvalue(compiler->enclosing, name);
+    int upvalue = resolveUpvalue(parser, compiler->enclosing, name);
     if (upvalue != -1) {
-        return addUpvalue(compiler, (uint8_t)upvalue, false);
+        return addUpvalue(parser, compiler, (uint8_t)upvalue, false);
     }
 
     return -1;
 }
 
-static void addLocal(Token name) {
-    if (current->localCount == UINT8_COUNT) {
-        error(L"功能中的局部变量太多。");
+// Flags each function from the assignment out to the one owning the
+// variable (exclusive) as writing to a captured variable.
+static void markUpvalueWrite(Compiler* compiler, int index) {
+    for (;;) {
+        compiler->function->writesUpvalues = true;
+        Upvalue* upvalue = &compiler->upvalues[index];
+        if (upvalue->isLocal) return;
+        index = upvalue->index;
+        compiler = compiler->enclosing;
+    }
+}
+
+static void addLocal(Parser* parser, Token name) {
+    if (parser->compiler->localCount == UINT8_COUNT) {
+        error(parser, L"功能中的局部变量太多。");
         return;
     }
 
-    Local* local = &current->locals[current->localCount++];
+    Local* local = &parser->compiler->locals[parser->compiler->localCount++];
     local->name = name;
     local->depth = -1;
     local->isCaptured = false;
 }
 
-static void declareVariable() {
-    if (current->scopeDepth == 0) return;
+static void declareNamedVariable(Parser* parser, Token* name) {
+    if (parser->compiler->scopeDepth == 0) return;
 
-    Token* name = &parser.previous;
-    for (int i = current->localCount - 1; i >= 0; i--) {
-        Local* local = &current->locals[i];
-        if (local->depth != -1 && local->depth < current->scopeDepth) {
+    for (int i = parser->compiler->localCount - 1; i >= 0; i--) {
+        Local* local = &parser->compiler->locals[i];
+        if (local->depth != -1 && local->depth < parser->compiler->scopeDepth) {
             break;
         }
 
         if (identifiersEqual(name, &local->name)) {
-            error(L"在这个范围内已经有了这个名字的变量。");
+            error(parser, L"在这个范围内已经有了这个名字的变量。");
         }
     }
 
-    addLocal(*name);
+    addLocal(parser, *name);
+}
+
+static void declareVariable(Parser* parser) {
+    declareNamedVariable(parser, &parser->previous);
 }
 
-static uint8_t parseVariable(const wchar_t* errorMessage) {
-    consume(TOKEN_IDENTIFIER, errorMessage);
+// Returns the slot of the module variable [name], adding one if this is the
+// first time the module mentions it.
+static int moduleSlot(Parser* parser, Token* name) {
+    ObjModule* module = parser->module;
+    ObjString* string = copyText(parser, name->start, name->length);
+    Value slot;
+    if (tableGet(&module->slots, string, &slot)) return (int)AS_NUMBER(slot);
+
+    if (module->names.count == UINT8_COUNT) {
+        error(parser, L"模块中的变量太多。");
+        return 0;
+    }
+    if (parser->slotCapacity < module->names.count + 1) {
+        parser->slotCapacity = GROW_CAPACITY(parser->slotCapacity);
+        parser->slots = (ModuleSlot*)realloc(parser->slots, sizeof(ModuleSlot) * parser->slotCapacity);
+        if (parser->slots == NULL) exit(1);
+    }
+    int index = module->names.count;
+    parser->slots[index].firstUse = *name;
+    parser->slots[index].declared = false;
+
+    push(parser->vm, OBJ_VAL(string));
+    writeValueArray(parser->vm, &module->names, OBJ_VAL(string));
+    writeValueArray(parser->vm, &module->values, NIL_VAL);
+    tableSet(parser->vm, &module->slots, string, NUMBER_VAL(index));
+    pop(parser->vm);
+    return index;
+}
 
-    declareVariable();
-    if (current->scopeDepth > 0) return 0;
+// Resolves a name that isn't local to a slot of the module being compiled.
+// Core globals stay globals unless the module declares its own.
+static int resolveModuleVariable(Parser* parser, Token* name) {
+    ObjString* string = copyText(parser, name->start, name->length);
+    Value value;
+    if (!tableGet(&parser->module->slots, string, &value) && isCoreGlobal(string)) return -1;
+    return moduleSlot(parser, name);
+}
 
-    return identifierConstant(&parser.previous);
+// The operand naming a top-level variable: its slot in a module, or the
+// constant holding its name in a script.
+static uint8_t globalOperand(Parser* parser, Token* name) {
+    if (parser->module == NULL) return identifierConstant(parser, name);
+    int slot = moduleSlot(parser, name);
+    parser->slots[slot].declared = true;
+    return (uint8_t)slot;
 }
 
-static void markInitialized() {
-    if (current->scopeDepth == 0) return;
-    current->locals[current->localCount - 1].depth = current->scopeDepth;
+static uint8_t parseVariable(Parser* parser, const wchar_t* errorMessage) {
+    consume(parser, TOKEN_IDENTIFIER, errorMessage);
+
+    declareVariable(parser);
+    if (parser->compiler->scopeDepth > 0) return 0;
+
+    return globalOperand(parser, &parser->previous);
 }
 
-static void defineVariable(uint8_t global) {
-    if (current->scopeDepth > 0) {
-        markInitialized();
+static void markInitialized(Parser* parser) {
+    if (parser->compiler->scopeDepth == 0) return;
+    parser->compiler->locals[parser->compiler->localCount - 1].depth = parser->compiler->scopeDepth;
+}
+
+static void defineVariable(Parser* parser, uint8_t global) {
+    if (parser->compiler->scopeDepth > 0) {
+        markInitialized(parser);
         return;
     }
 
-    emitBytes(OP_DEFINE_GLOBAL, global);
+    emitBytes(parser, parser->module != NULL ? OP_DEFINE_MODULE : OP_DEFINE_GLOBAL, global);
 }
 
-static uint8_t argumentList() {
+static uint8_t argumentList(Parser* parser) {
     uint8_t argCount = 0;
-    if (!check(TOKEN_RIGHT_PAREN)) {
+    if (!check(parser, TOKEN_RIGHT_PAREN)) {
         do {
-            expression();
+            expression(parser);
             if (argCount == 255) {
-                error(L"不能有超过255个参数。");
+                error(parser, L"不能有超过255个参数。");
             }
             argCount++;
-        } while (match(TOKEN_COMMA));
+        } while (match(parser, TOKEN_COMMA));
     }
-    consume(TOKEN_RIGHT_PAREN, L"参数后期待「 ）」");
+    consume(parser, TOKEN_RIGHT_PAREN, L"参数后期待「 ）」");
     return argCount;
 }
 
-static void and_(bool canAssign) {
-    int endJump = emitJump(OP_JUMP_IF_FALSE);
+static void and_(Parser* parser, bool canAssign) {
+    int endJump = emitJump(parser, OP_JUMP_IF_FALSE);
 
-    emitByte(OP_POP);
-    parsePrecedence(PREC_AND);
+    emitByte(parser, OP_POP);
+    parsePrecedence(parser, PREC_AND);
 
-    patchJump(endJump);
+    patchJump(parser, endJump);
 }
 
-static void binary(bool canAssign) {
-    TokenType operatorType = parser.previous.type;
+static void binary(Parser* parser, bool canAssign) {
+    TokenType operatorType = parser->previous.type;
     ParseRule* rule = getRule(operatorType);
-    parsePrecedence((Precedence)(rule->precedence + 1));
+    parsePrecedence(parser, (Precedence)(rule->precedence + 1));
 
     switch (operatorType) {
-        case TOKEN_BANG_EQUAL:          emitBytes(OP_EQUAL, OP_NOT); break;
-        case TOKEN_EQUAL_EQUAL:         emitByte(OP_EQUAL); break;
-        case TOKEN_GREATER:             emitByte(OP_GREATER); break;
-        case TOKEN_GREATER_EQUAL:       emitBytes(OP_LESS, OP_NOT); break;
-        case TOKEN_LESS:                emitByte(OP_LESS); break;
-        case TOKEN_LESS_EQUAL:          emitBytes(OP_GREATER, OP_NOT); break;
-        case TOKEN_PLUS:                emitByte(OP_ADD); break;
-        case TOKEN_MINUS:               emitByte(OP_SUBTRACT); break;
-        case TOKEN_STAR:                emitByte(OP_MULTIPLY); break;
-        case TOKEN_SLASH:               emitByte(OP_DIVIDE); break;
-        case TOKEN_PERCENT:             emitByte(OP_MODULO); break;
-        case TOKEN_BITWISE_OR:          emitByte(OP_BITWISE_OR); break;
-        case TOKEN_BITWISE_XOR:         emitByte(OP_BITWISE_XOR); break;
-        case TOKEN_BITWISE_AND:         emitByte(OP_BITWISE_AND); break;
-        case TOKEN_BITWISE_LEFT_SHIFT:  emitByte(OP_BITWISE_LEFT_SHIFT); break;
-        case TOKEN_BITWISE_RIGHT_SHIFT: emitByte(OP_BITWISE_RIGHT_SHIFT); break;
+        case TOKEN_BANG_EQUAL:          emitBytes(parser, OP_EQUAL, OP_NOT); break;
+        case TOKEN_EQUAL_EQUAL:         emitByte(parser, OP_EQUAL); break;
+        case TOKEN_GREATER:             emitByte(parser, OP_GREATER); break;
+        case TOKEN_GREATER_EQUAL:       emitBytes(parser, OP_LESS, OP_NOT); break;
+        case TOKEN_LESS:                emitByte(parser, OP_LESS); break;
+        case TOKEN_LESS_EQUAL:          emitBytes(parser, OP_GREATER, OP_NOT); break;
+        case TOKEN_PLUS:                emitByte(parser, OP_ADD); break;
+        case TOKEN_MINUS:               emitByte(parser, OP_SUBTRACT); break;
+        case TOKEN_STAR:                emitByte(parser, OP_MULTIPLY); break;
+        case TOKEN_SLASH:               emitByte(parser, OP_DIVIDE); break;
+        case TOKEN_PERCENT:             emitByte(parser, OP_MODULO); break;
+        case TOKEN_BITWISE_OR:          emitByte(parser, OP_BITWISE_OR); break;
+        case TOKEN_BITWISE_XOR:         emitByte(parser, OP_BITWISE_XOR); break;
+        case TOKEN_BITWISE_AND:         emitByte(parser, OP_BITWISE_AND); break;
+        case TOKEN_BITWISE_LEFT_SHIFT:  emitByte(parser, OP_BITWISE_LEFT_SHIFT); break;
+        case TOKEN_BITWISE_RIGHT_SHIFT: emitByte(parser, OP_BITWISE_RIGHT_SHIFT); break;
         default: return; // Unreachable.
     }
 }
 
-static void postfix(bool canAssign) {
-    TokenType operatorType = parser.previous.type;
+static void postfix(Parser* parser, bool canAssign) {
+    TokenType operatorType = parser->previous.type;
 
-    switch (parser.previous.type) {
+    switch (parser->previous.type) {
         case TOKEN_PLUS_PLUS:
         case TOKEN_MINUS_MINUS: {
             uint8_t op1 = -1, op2 = -1;
-            if (currentChunk()->count - 2 >= 0) {
-                op1 = currentChunk()->code[currentChunk()->count - 2];
-                op2 = currentChunk()->code[currentChunk()->count - 1];
+            if (currentChunk(parser)->count - 2 >= 0) {
+                op1 = currentChunk(parser)->code[currentChunk(parser)->count - 2];
+                op2 = currentChunk(parser)->code[currentChunk(parser)->count - 1];
             }
             if (op1 == OP_GET_PROPERTY) {
-                emitByte(op2);
-                currentChunk()->code[currentChunk()->count - 2] = OP_GET_PROPERTY;
-                currentChunk()->code[currentChunk()->count - 3] = OP_DUP;
-                emitByte(operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
-                emitBytes(OP_SET_PROPERTY, op2);
-                emitByte(operatorType == TOKEN_PLUS_PLUS ? OP_DECREMENT : OP_INCREMENT);
+                emitByte(parser, op2);
+                currentChunk(parser)->code[currentChunk(parser)->count - 2] = OP_GET_PROPERTY;
+                currentChunk(parser)->code[currentChunk(parser)->count - 3] = OP_DUP;
+                emitByte(parser, operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
+                emitBytes(parser, OP_SET_PROPERTY, op2);
+                emitByte(parser, operatorType == TOKEN_PLUS_PLUS ? OP_DECREMENT : OP_INCREMENT);
                 break;
-            } else if (op1 == OP_GET_GLOBAL || op1 == OP_GET_LOCAL || op1 == OP_GET_UPVALUE) {
-                emitByte(operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
-                emitBytes(op1 == OP_GET_GLOBAL ? OP_SET_GLOBAL
-                                               : op1 == OP_GET_LOCAL ? OP_SET_LOCAL : OP_SET_UPVALUE, op2);
-                emitByte(operatorType == TOKEN_PLUS_PLUS ? OP_DECREMENT : OP_INCREMENT);
+            } else if (op1 == OP_GET_GLOBAL || op1 == OP_GET_LOCAL || op1 == OP_GET_UPVALUE || op1 == OP_GET_MODULE) {
+                if (op1 == OP_GET_UPVALUE) markUpvalueWrite(parser->compiler, op2);
+                emitByte(parser, operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
+                emitBytes(parser, op1 == OP_GET_GLOBAL ? OP_SET_GLOBAL
+                                : op1 == OP_GET_LOCAL ? OP_SET_LOCAL
+                                : op1 == OP_GET_UPVALUE ? OP_SET_UPVALUE : OP_SET_MODULE, op2);
+                emitByte(parser, operatorType == TOKEN_PLUS_PLUS ? OP_DECREMENT : OP_INCREMENT);
                 break;
             } else if (op2 == OP_INDEX_SUBSCR) {
-                emitByte(op2);
-                currentChunk()->code[currentChunk()->count - 2] = OP_DOUBLE_DUP;
-                emitByte(operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
-                emitByte(OP_STORE_SUBSCR);
-                emitByte(operatorType == TOKEN_PLUS_PLUS ? OP_DECREMENT : OP_INCREMENT);
+                emitByte(parser, op2);
+                currentChunk(parser)->code[currentChunk(parser)->count - 2] = OP_DOUBLE_DUP;
+                emitByte(parser, operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
+                emitByte(parser, OP_STORE_SUBSCR);
+                emitByte(parser, operatorType == TOKEN_PLUS_PLUS ? OP_DECREMENT : OP_INCREMENT);
                 break;
             }
-            error(L"表达式不可赋值。");
+            error(parser, L"表达式不可赋值。");
             break;
         }
         default: return; // Unreachable.
     }
 }
 
-static void call(bool canAssign) {
-    uint8_t argCount = argumentList();
-    emitBytes(OP_CALL, argCount);
-}
-
-static void dot(bool canAssign) {
-    consume(TOKEN_IDENTIFIER, L"期待在「 。」之后的属性名称。");
-    uint8_t name = identifierConstant(&parser.previous);
-    if (canAssign && match(TOKEN_EQUAL)) {
-        expression();
-        emitBytes(OP_SET_PROPERTY, name);
-    } else if (canAssign && (match(TOKEN_PLUS_EQUAL) || match(TOKEN_MINUS_EQUAL))) {
-        TokenType type = parser.previous.type;
-        emitByte(OP_DUP);
-        emitBytes(OP_GET_PROPERTY, name);
-        expression();
-        emitByte(type == TOKEN_PLUS_EQUAL ? OP_ADD : OP_SUBTRACT);
-        emitBytes(OP_SET_PROPERTY, name);
-    } else if (match(TOKEN_LEFT_PAREN)) {
-        uint8_t argCount = argumentList();
-        emitBytes(OP_INVOKE, name);
-        emitByte(argCount);
+static void call(Parser* parser, bool canAssign) {
+    uint8_t argCount = argumentList(parser);
+    emitBytes(parser, OP_CALL, argCount);
+}
+
+static void dot(Parser* parser, bool canAssign) {
+    ObjModule* module = parser->moduleAt == currentChunk(parser)->count ? parser->lastModule : NULL;
+    parser->lastModule = NULL;
+
+    consume(parser, TOKEN_IDENTIFIER, L"期待在「 。」之后的属性名称。");
+    uint8_t name = identifierConstant(parser, &parser->previous);
+    Value slot;
+    bool isMember = module != NULL && !check(parser, TOKEN_EQUAL) &&
+                    !check(parser, TOKEN_PLUS_EQUAL) && !check(parser, TOKEN_MINUS_EQUAL) &&
+                    !check(parser, TOKEN_PLUS_PLUS) && !check(parser, TOKEN_MINUS_MINUS) &&
+                    tableGet(&module->slots, AS_STRING(currentChunk(parser)->constants.values[name]), &slot);
+
+    if (isMember) {
+        // The receiver is known to be an imported module, so the member is
+        // read from its slot; the VM checks that guess as it goes.
+        emitBytes(parser, OP_GET_MODULE_MEMBER, name);
+        emitByte(parser, (uint8_t)AS_NUMBER(slot));
+        if (match(parser, TOKEN_LEFT_PAREN)) {
+            uint8_t argCount = argumentList(parser);
+            emitBytes(parser, OP_CALL, argCount);
+        }
+    } else if (canAssign && match(parser, TOKEN_EQUAL)) {
+        expression(parser);
+        emitBytes(parser, OP_SET_PROPERTY, name);
+    } else if (canAssign && (match(parser, TOKEN_PLUS_EQUAL) || match(parser, TOKEN_MINUS_EQUAL))) {
+        TokenType type = parser->previous.type;
+        emitByte(parser, OP_DUP);
+        emitBytes(parser, OP_GET_PROPERTY, name);
+        expression(parser);
+        emitByte(parser, type == TOKEN_PLUS_EQUAL ? OP_ADD : OP_SUBTRACT);
+        emitBytes(parser, OP_SET_PROPERTY, name);
+    } else if (match(parser, TOKEN_LEFT_PAREN)) {
+        uint8_t argCount = argumentList(parser);
+        emitBytes(parser, OP_INVOKE, name);
+        emitByte(parser, argCount);
     } else {
-        emitBytes(OP_GET_PROPERTY, name);
+        emitBytes(parser, OP_GET_PROPERTY, name);
     }
 }
 
-static void literal(bool canAssign) {
-    switch (parser.previous.type) {
-        case TOKEN_FALSE: emitByte(OP_FALSE); break;
-        case TOKEN_NIL: emitByte(OP_NIL); break;
-        case TOKEN_TRUE: emitByte(OP_TRUE); break;
+static void literal(Parser* parser, bool canAssign) {
+    switch (parser->previous.type) {
+        case TOKEN_FALSE: emitByte(parser, OP_FALSE); break;
+        case TOKEN_NIL: emitByte(parser, OP_NIL); break;
+        case TOKEN_TRUE: emitByte(parser, OP_TRUE); break;
         default: return; // Unreachable.
     }
 }
 
-static void grouping(bool canAssign) {
-    expression();
-    consume(TOKEN_RIGHT_PAREN, L"表达式后期待「)」。");
+static void grouping(Parser* parser, bool canAssign) {
+    expression(parser);
+    consume(parser, TOKEN_RIGHT_PAREN, L"表达式后期待「)」。");
 }
 
-static void number(bool canAssign) {
-    switch (parser.previous.type) {
+static void number(Parser* parser, bool canAssign) {
+    switch (parser->previous.type) {
         case TOKEN_DECIMAL: {
-            double value = wcstod(parser.previous.start, NULL);
-            emitConstant(NUMBER_VAL(value));
+            double value = strtod(parser->previous.start, NULL);
+            emitConstant(parser, NUMBER_VAL(value));
             break;
         }
         case TOKEN_HEXADECIMAL: {
             // Skip past the "0x" so that it doesn't trip up the conversion
-            double value = (double)wcstol(parser.previous.start + 2, NULL, 16);
-            emitConstant(NUMBER_VAL(value));
+            double value = (double)strtol(parser->previous.start + 2, NULL, 16);
+            emitConstant(parser, NUMBER_VAL(value));
             break;
         }
         case TOKEN_OCTAL: {
             // Skip past the "0O" so that it doesn't trip up the conversion
-            double value = (double)wcstol(parser.previous.start + 2, NULL, 8);
-            emitConstant(NUMBER_VAL(value));
+            double value = (double)strtol(parser->previous.start + 2, NULL, 8);
+            emitConstant(parser, NUMBER_VAL(value));
             break;
         }
         case TOKEN_BINARY: {
             // Skip past the "0B" so that it doesn't trip up the conversion
-            double value = (double)wcstol(parser.previous.start + 2, NULL, 2);
-            emitConstant(NUMBER_VAL(value));
+            double value = (double)strtol(parser->previous.start + 2, NULL, 2);
+            emitConstant(parser, NUMBER_VAL(value));
             break;
         }
         default: return; // Unreachable.
@@ -550,175 +686,188 @@ static void number(bool canAssign) {
 
 }
 
-static void or_(bool canAssign) {
-    int elseJump = emitJump(OP_JUMP_IF_FALSE);
-    int endJump = emitJump(OP_JUMP);
+static void or_(Parser* parser, bool canAssign) {
+    int elseJump = emitJump(parser, OP_JUMP_IF_FALSE);
+    int endJump = emitJump(parser, OP_JUMP);
 
-    patchJump(elseJump);
-    emitByte(OP_POP);
+    patchJump(parser, elseJump);
+    emitByte(parser, OP_POP);
 
-    parsePrecedence(PREC_OR);
-    patchJump(endJump);
+    parsePrecedence(parser, PREC_OR);
+    patchJump(parser, endJump);
 }
 
-static void string(bool canAssign) {
-    emitConstant(OBJ_VAL(handleEscapeSequences(copyString(parser.previous.start + 1,
-                                    parser.previous.length - 2))));
+static void string(Parser* parser, bool canAssign) {
+    emitConstant(parser, OBJ_VAL(handleEscapeSequences(copyText(parser, parser->previous.start + 1,
+                                    parser->previous.length - 2))));
 }
 
-static void list(bool canAssign) {
+static void list(Parser* parser, bool canAssign) {
     int itemCount = 0;
-    if (!check(TOKEN_RIGHT_BRACKET)) {
+    if (!check(parser, TOKEN_RIGHT_BRACKET)) {
         do {
-            if (check(TOKEN_RIGHT_BRACKET)) {
+            if (check(parser, TOKEN_RIGHT_BRACKET)) {
                 // Trailing comma case
                 break;
             }
 
-            parsePrecedence(PREC_OR);
+            parsePrecedence(parser, PREC_OR);
 
             if (itemCount == UINT8_COUNT) {
-                error(L"列表中的项目不能超过256个。");
+                error(parser, L"列表中的项目不能超过256个。");
             }
             itemCount++;
-        } while (match(TOKEN_COMMA));
+        } while (match(parser, TOKEN_COMMA));
     }
 
-    consume(TOKEN_RIGHT_BRACKET, L"在列表后期待「 】」。");
+    consume(parser, TOKEN_RIGHT_BRACKET, L"在列表后期待「 】」。");
 
-    emitByte(OP_BUILD_LIST);
-    emitByte(itemCount);
+    emitByte(parser, OP_BUILD_LIST);
+    emitByte(parser, itemCount);
 }
 
-static void subscript(bool canAssign) {
-    parsePrecedence(PREC_OR);
-    consume(TOKEN_RIGHT_BRACKET, L"索引后应有「【 」。");
+static void subscript(Parser* parser, bool canAssign) {
+    parsePrecedence(parser, PREC_OR);
+    consume(parser, TOKEN_RIGHT_BRACKET, L"索引后应有「【 」。");
 
-    if (canAssign && match(TOKEN_EQUAL)) {
-        expression();
-        emitByte(OP_STORE_SUBSCR);
-    } else if (canAssign && (match(TOKEN_PLUS_EQUAL) || match(TOKEN_MINUS_EQUAL))) {
-        TokenType type = parser.previous.type;
-        emitByte(OP_DOUBLE_DUP);
-        emitByte(OP_INDEX_SUBSCR);
-        expression();
-        emitByte(type == TOKEN_PLUS_EQUAL ? OP_ADD : OP_SUBTRACT);
-        emitByte(OP_STORE_SUBSCR);
+    if (canAssign && match(parser, TOKEN_EQUAL)) {
+        expression(parser);
+        emitByte(parser, OP_STORE_SUBSCR);
+    } else if (canAssign && (match(parser, TOKEN_PLUS_EQUAL) || match(parser, TOKEN_MINUS_EQUAL))) {
+        TokenType type = parser->previous.type;
+        emitByte(parser, OP_DOUBLE_DUP);
+        emitByte(parser, OP_INDEX_SUBSCR);
+        expression(parser);
+        emitByte(parser, type == TOKEN_PLUS_EQUAL ? OP_ADD : OP_SUBTRACT);
+        emitByte(parser, OP_STORE_SUBSCR);
     } else {
-        emitByte(OP_INDEX_SUBSCR);
+        emitByte(parser, OP_INDEX_SUBSCR);
     }
 }
 
-static void namedVariable(Token name, bool canAssign) {
+static void namedVariable(Parser* parser, Token name, bool canAssign) {
     uint8_t getOp, setOp;
-    int arg = resolveLocal(current, &name);
+    int arg = resolveLocal(parser, parser->compiler, &name);
     if (arg != -1) {
         getOp = OP_GET_LOCAL;
         setOp = OP_SET_LOCAL;
-    } else if ((arg = resolveUpvalue(current, &name)) != -1) {
+    } else if ((arg = resolveUpvalue(parser, parser->compiler, &name)) != -1) {
         getOp = OP_GET_UPVALUE;
         setOp = OP_SET_UPVALUE;
+    } else if (parser->module != NULL && (arg = resolveModuleVariable(parser, &name)) != -1) {
+        getOp = OP_GET_MODULE;
+        setOp = OP_SET_MODULE;
     } else {
-        arg = identifierConstant(&name);
+        arg = identifierConstant(parser, &name);
         getOp = OP_GET_GLOBAL;
         setOp = OP_SET_GLOBAL;
     }
 
-    if (canAssign && match(TOKEN_EQUAL)) {
-        expression();
-        emitBytes(setOp, (uint8_t) arg);
-    } else if (canAssign && (match(TOKEN_PLUS_EQUAL) || match(TOKEN_MINUS_EQUAL))) {
-        TokenType type = parser.previous.type;
-        emitBytes(getOp, (uint8_t) arg);
-        expression();
-        emitByte(type == TOKEN_PLUS_EQUAL ? OP_ADD : OP_SUBTRACT);
-        emitBytes(setOp, (uint8_t) arg);
+    if (canAssign && match(parser, TOKEN_EQUAL)) {
+        if (setOp == OP_SET_UPVALUE) markUpvalueWrite(parser->compiler, arg);
+        expression(parser);
+        emitBytes(parser, setOp, (uint8_t) arg);
+    } else if (canAssign && (match(parser, TOKEN_PLUS_EQUAL) || match(parser, TOKEN_MINUS_EQUAL))) {
+        if (setOp == OP_SET_UPVALUE) markUpvalueWrite(parser->compiler, arg);
+        TokenType type = parser->previous.type;
+        emitBytes(parser, getOp, (uint8_t) arg);
+        expression(parser);
+        emitByte(parser, type == TOKEN_PLUS_EQUAL ? OP_ADD : OP_SUBTRACT);
+        emitBytes(parser, setOp, (uint8_t) arg);
     } else {
-        emitBytes(getOp, (uint8_t)arg);
+        emitBytes(parser, getOp, (uint8_t)arg);
+        for (int i = parser->importCount - 1; i >= 0; i--) {
+            if (!identifiersEqual(&name, &parser->imports[i].name)) continue;
+            parser->lastModule = parser->imports[i].module;
+            parser->moduleAt = currentChunk(parser)->count;
+            break;
+        }
     }
 }
 
-static void variable(bool canAssign) {
-    namedVariable(parser.previous, canAssign);
+static void variable(Parser* parser, bool canAssign) {
+    namedVariable(parser, parser->previous, canAssign);
 }
 
-static Token syntheticToken(const wchar_t* text) {
+static Token syntheticToken(const char* text) {
     Token token;
     token.start = text;
-    token.length = (int)wcslen(text);
+    token.length = (int)strlen(text);
     return token;
 }
 
-static void super_(bool canAssign) {
-    if (currentClass == NULL) {
-        error(L"不能在类之外使用「超」。");
-    } else if (!currentClass->hasSuperclass) {
-        error(L"不能在没有超类的类中使用「超」。");
+static void super_(Parser* parser, bool canAssign) {
+    if (parser->currentClass == NULL) {
+        error(parser, L"不能在类之外使用「超」。");
+    } else if (!parser->currentClass->hasSuperclass) {
+        error(parser, L"不能在没有超类的类中使用「超」。");
     }
 
-    consume(TOKEN_DOT, L"期待「 。」在「超」之后。");
-    consume(TOKEN_IDENTIFIER, L"期待超类方法名。");
-    uint8_t name = identifierConstant(&parser.previous);
+    consume(parser, TOKEN_DOT, L"期待「 。」在「超」之后。");
+    consume(parser, TOKEN_IDENTIFIER, L"期待超类方法名。");
+    uint8_t name = identifierConstant(parser, &parser->previous);
 
-    namedVariable(syntheticToken(L"这"), false);
-    if (match(TOKEN_LEFT_PAREN)) {
-        uint8_t argCount = argumentList();
-        namedVariable(syntheticToken(L"超"), false);
-        emitBytes(OP_SUPER_INVOKE, name);
-        emitByte(argCount);
+    namedVariable(parser, syntheticToken("这"), false);
+    if (match(parser, TOKEN_LEFT_PAREN)) {
+        uint8_t argCount = argumentList(parser);
+        namedVariable(parser, syntheticToken("超"), false);
+        emitBytes(parser, OP_SUPER_INVOKE, name);
+        emitByte(parser, argCount);
     } else {
-        namedVariable(syntheticToken(L"超"), false);
-        emitBytes(OP_GET_SUPER, name);
+        namedVariable(parser, syntheticToken("超"), false);
+        emitBytes(parser, OP_GET_SUPER, name);
     }
 }
 
-static void this_(bool canAssign) {
-    if (currentClass == NULL) {
-        error(L"不能在类之外使用「这」。");
+static void this_(Parser* parser, bool canAssign) {
+    if (parser->currentClass == NULL) {
+        error(parser, L"不能在类之外使用「这」。");
         return;
     }
 
-    variable(false);
+    variable(parser, false);
 }
 
-static void unary(bool canAssign) {
-    TokenType operatorType = parser.previous.type;
+static void unary(Parser* parser, bool canAssign) {
+    TokenType operatorType = parser->previous.type;
 
     // Compile the operand.
-    parsePrecedence(PREC_UNARY);
+    parsePrecedence(parser, PREC_UNARY);
 
     // Emit the operator instruction.
     switch (operatorType) {
-        case TOKEN_BANG: emitByte(OP_NOT); break;
-        case TOKEN_MINUS: emitByte(OP_NEGATE); break;
-        case TOKEN_BITWISE_NOT: emitByte(OP_BITWISE_NOT); break;
+        case TOKEN_BANG: emitByte(parser, OP_NOT); break;
+        case TOKEN_MINUS: emitByte(parser, OP_NEGATE); break;
+        case TOKEN_BITWISE_NOT: emitByte(parser, OP_BITWISE_NOT); break;
         case TOKEN_PLUS_PLUS:
         case TOKEN_MINUS_MINUS: {
             uint8_t op1 = -1, op2 = -1;
-            if (currentChunk()->count - 2 >= 0) {
-                op1 = currentChunk()->code[currentChunk()->count - 2];
-                op2 = currentChunk()->code[currentChunk()->count - 1];
+            if (currentChunk(parser)->count - 2 >= 0) {
+                op1 = currentChunk(parser)->code[currentChunk(parser)->count - 2];
+                op2 = currentChunk(parser)->code[currentChunk(parser)->count - 1];
             }
             if (op1 == OP_GET_PROPERTY) {
-                emitByte(op2);
-                currentChunk()->code[currentChunk()->count - 2] = OP_GET_PROPERTY;
-                currentChunk()->code[currentChunk()->count - 3] = OP_DUP;
-                emitByte(operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
-                emitBytes(OP_SET_PROPERTY, op2);
+                emitByte(parser, op2);
+                currentChunk(parser)->code[currentChunk(parser)->count - 2] = OP_GET_PROPERTY;
+                currentChunk(parser)->code[currentChunk(parser)->count - 3] = OP_DUP;
+                emitByte(parser, operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
+                emitBytes(parser, OP_SET_PROPERTY, op2);
                 break;
-            } else if (op1 == OP_GET_GLOBAL || op1 == OP_GET_LOCAL || op1 == OP_GET_UPVALUE) {
-                emitByte(operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
-                emitBytes(op1 == OP_GET_GLOBAL ? OP_SET_GLOBAL
-                                               : op1 == OP_GET_LOCAL ? OP_SET_LOCAL : OP_SET_UPVALUE, op2);
+            } else if (op1 == OP_GET_GLOBAL || op1 == OP_GET_LOCAL || op1 == OP_GET_UPVALUE || op1 == OP_GET_MODULE) {
+                if (op1 == OP_GET_UPVALUE) markUpvalueWrite(parser->compiler, op2);
+                emitByte(parser, operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
+                emitBytes(parser, op1 == OP_GET_GLOBAL ? OP_SET_GLOBAL
+                                : op1 == OP_GET_LOCAL ? OP_SET_LOCAL
+                                : op1 == OP_GET_UPVALUE ? OP_SET_UPVALUE : OP_SET_MODULE, op2);
                 break;
             } else if (op2 == OP_INDEX_SUBSCR) {
-                emitByte(op2);
-                currentChunk()->code[currentChunk()->count - 2] = OP_DOUBLE_DUP;
-                emitByte(operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
-                emitByte(OP_STORE_SUBSCR);
+                emitByte(parser, op2);
+                currentChunk(parser)->code[currentChunk(parser)->count - 2] = OP_DOUBLE_DUP;
+                emitByte(parser, operatorType == TOKEN_PLUS_PLUS ? OP_INCREMENT : OP_DECREMENT);
+                emitByte(parser, OP_STORE_SUBSCR);
                 break;
             }
-            error(L"表达式不可赋值。");
+            error(parser, L"表达式不可赋值。");
             break;
         }
         default: return; // Unreachable.
@@ -774,6 +923,7 @@ ParseRule rules[] = {
         [TOKEN_BITWISE_OR]    = {NULL,     binary, PREC_BIT_OR},
         [TOKEN_BITWISE_XOR]   = {NULL,     binary, PREC_BIT_XOR},
         [TOKEN_RETURN]        = {NULL,     NULL,   PREC_NONE},
+        [TOKEN_YIELD]         = {NULL,     NULL,   PREC_NONE},
         [TOKEN_SUPER]         = {super_,   NULL,   PREC_NONE},
         [TOKEN_THIS]          = {this_,    NULL,   PREC_NONE},
         [TOKEN_TRUE]          = {literal,  NULL,   PREC_NONE},
@@ -783,26 +933,26 @@ ParseRule rules[] = {
         [TOKEN_EOF]           = {NULL,     NULL,   PREC_NONE},
 };
 
-static void parsePrecedence(Precedence precedence) {
-    advance();
-    ParseFn prefixRule = getRule(parser.previous.type)->prefix;
+static void parsePrecedence(Parser* parser, Precedence precedence) {
+    advance(parser);
+    ParseFn prefixRule = getRule(parser->previous.type)->prefix;
     if (prefixRule == NULL) {
-        error(L"期待表达式。");
+        error(parser, L"期待表达式。");
         return;
     }
 
     bool canAssign = precedence <= PREC_ASSIGNMENT;
-    prefixRule(canAssign);
+    prefixRule(parser, canAssign);
 
-    while (precedence <= getRule(parser.current.type)->precedence) {
-        if (parser.current.line > parser.previous.line) break;
-        advance();
-        ParseFn infixRule = getRule(parser.previous.type)->infix;
-        infixRule(canAssign);
+    while (precedence <= getRule(parser->current.type)->precedence) {
+        if (parser->current.line > parser->previous.line) break;
+        advance(parser);
+        ParseFn infixRule = getRule(parser->previous.type)->infix;
+        infixRule(parser, canAssign);
     }
 
-    if (canAssign && (match(TOKEN_EQUAL) || match(TOKEN_PLUS_EQUAL) || match(TOKEN_MINUS_EQUAL))) {
-        error(L"分配目标无效。");
+    if (canAssign && (match(parser, TOKEN_EQUAL) || match(parser, TOKEN_PLUS_EQUAL) || match(parser, TOKEN_MINUS_EQUAL))) {
+        error(parser, L"分配目标无效。");
     }
 }
 
@@ -810,8 +960,8 @@ static ParseRule* getRule(TokenType type) {
     return &rules[type];
 }
 
-static int getByteCountForArguments(int ip) {
-    OpCode instruction = (OpCode)current->function->chunk.code[ip];
+static int getByteCountForArguments(Parser* parser, int ip) {
+    OpCode instruction = (OpCode)parser->compiler->function->chunk.code[ip];
     switch (instruction) {
         case OP_NIL:
         case OP_TRUE:
@@ -829,6 +979,7 @@ static int getByteCountForArguments(int ip) {
         case OP_NEGATE:
         case OP_CLOSE_UPVALUE:
         case OP_RETURN:
+        case OP_YIELD:
         case OP_INHERIT:
         case OP_DUP:
         case OP_END:
@@ -848,9 +999,14 @@ static int getByteCountForArguments(int ip) {
         case OP_GET_UPVALUE:
         case OP_SET_UPVALUE:
         case OP_CALL:
+        case OP_GET_MODULE:
+        case OP_DEFINE_MODULE:
+        case OP_SET_MODULE:
+        case OP_IMPORT:
             return 1;
 
         case OP_INVOKE:
+        case OP_GET_MODULE_MEMBER:
         case OP_SUPER_INVOKE:
         case OP_JUMP_IF_FALSE:
         case OP_JUMP:
@@ -858,7 +1014,7 @@ static int getByteCountForArguments(int ip) {
             return 2;
 
         case OP_CLOSURE:
-            return 2 + (current->function->upvalueCount);
+            return 2 + (parser->compiler->function->upvalueCount);
 
         default:
             // Unreachable.
@@ -866,388 +1022,501 @@ static int getByteCountForArguments(int ip) {
     }
 }
 
-static void expression() {
-    parsePrecedence(PREC_ASSIGNMENT);
+static void expression(Parser* parser) {
+    parsePrecedence(parser, PREC_ASSIGNMENT);
 }
 
-static void block() {
-    while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
-        declaration();
+static void block(Parser* parser) {
+    while (!check(parser, TOKEN_RIGHT_BRACE) && !check(parser, TOKEN_EOF)) {
+        declaration(parser);
     }
 
-    consume(TOKEN_RIGHT_BRACE, L"块后期待「 」」。");
+    consume(parser, TOKEN_RIGHT_BRACE, L"块后期待「 」」。");
 }
 
-static void function(FunctionType type) {
+static void function(Parser* parser, FunctionType type) {
     Compiler compiler;
-    initCompiler(&compiler, type);
-    beginScope();
+    initCompiler(parser, &compiler, type);
+    beginScope(parser);
 
-    consume(TOKEN_LEFT_PAREN, L"功能名后期待「（ 」。");
-    if (!check(TOKEN_RIGHT_PAREN)) {
+    consume(parser, TOKEN_LEFT_PAREN, L"功能名后期待「（ 」。");
+    if (!check(parser, TOKEN_RIGHT_PAREN)) {
         do {
-            current->function->arity++;
-            if (current->function->arity > 255) {
-                errorAtCurrent(L"参数不能超过255个。");
+            parser->compiler->function->arity++;
+            if (parser->compiler->function->arity > 255) {
+                errorAtCurrent(parser, L"参数不能超过255个。");
             }
-            uint8_t constant = parseVariable(L"期待参数名。");
-            defineVariable(constant);
-        } while (match(TOKEN_COMMA));
+            uint8_t constant = parseVariable(parser, L"期待参数名。");
+            defineVariable(parser, constant);
+        } while (match(parser, TOKEN_COMMA));
     }
-    consume(TOKEN_RIGHT_PAREN, L"参数后期待「 ）」。");
-    consume(TOKEN_LEFT_BRACE, L"函数体之前期待「「 」。");
-    block();
+    consume(parser, TOKEN_RIGHT_PAREN, L"参数后期待「 ）」。");
+    consume(parser, TOKEN_LEFT_BRACE, L"函数体之前期待「「 」。");
+    block(parser);
 
-    ObjFunction* function = endCompiler();
-    emitBytes(OP_CLOSURE, makeConstant(OBJ_VAL(function)));
+    ObjFunction* function = endCompiler(parser);
+    emitBytes(parser, OP_CLOSURE, makeConstant(parser, OBJ_VAL(function)));
 
     for (int i = 0; i < function->upvalueCount; i++) {
-        emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
-        emitByte(compiler.upvalues[i].index);
+        emitByte(parser, compiler.upvalues[i].isLocal ? 1 : 0);
+        emitByte(parser, compiler.upvalues[i].index);
     }
 }
 
-static void method() {
-    consume(TOKEN_IDENTIFIER, L"期待方法名。");
-    uint8_t constant = identifierConstant(&parser.previous);
+static void method(Parser* parser) {
+    consume(parser, TOKEN_IDENTIFIER, L"期待方法名。");
+    uint8_t constant = identifierConstant(parser, &parser->previous);
 
     FunctionType type = TYPE_METHOD;
-    if (parser.previous.length == 3 &&
-        memcmp(parser.previous.start, L"初始化", 3) == 0) {
+    if (parser->previous.length == (int)strlen("初始化") &&
+        memcmp(parser->previous.start, "初始化", parser->previous.length) == 0) {
         type = TYPE_INITIALIZER;
     }
 
-    function(type);
-    emitBytes(OP_METHOD, constant);
+    function(parser, type);
+    emitBytes(parser, OP_METHOD, constant);
 }
 
-static void classDeclaration() {
-    consume(TOKEN_IDENTIFIER, L"期待类名。");
-    Token className = parser.previous;
-    uint8_t  nameConstant = identifierConstant(&parser.previous);
-    declareVariable();
+static void classDeclaration(Parser* parser) {
+    consume(parser, TOKEN_IDENTIFIER, L"期待类名。");
+    Token className = parser->previous;
+    uint8_t  nameConstant = identifierConstant(parser, &parser->previous);
+    declareVariable(parser);
 
-    emitBytes(OP_CLASS, nameConstant);
-    defineVariable(nameConstant);
+    emitBytes(parser, OP_CLASS, nameConstant);
+    defineVariable(parser, parser->compiler->scopeDepth > 0 ? 0 : globalOperand(parser, &className));
 
     ClassCompiler classCompiler;
     classCompiler.hasSuperclass = false;
-    classCompiler.enclosing = currentClass;
-    currentClass = &classCompiler;
+    classCompiler.enclosing = parser->currentClass;
+    parser->currentClass = &classCompiler;
 
-    if (match(TOKEN_COLON)) {
-        consume(TOKEN_IDENTIFIER, L"期待超类名。");
-        variable(false);
+    if (match(parser, TOKEN_COLON)) {
+        consume(parser, TOKEN_IDENTIFIER, L"期待超类名。");
+        variable(parser, false);
 
-        if (identifiersEqual(&className, &parser.previous)) {
-            error(L"类不能从自身继承。");
+        if (identifiersEqual(&className, &parser->previous)) {
+            error(parser, L"类不能从自身继承。");
         }
 
-        beginScope();
-        addLocal(syntheticToken(L"超"));
-        defineVariable(0);
+        beginScope(parser);
+        addLocal(parser, syntheticToken("超"));
+        defineVariable(parser, 0);
 
-        namedVariable(className, false);
-        emitByte(OP_INHERIT);
+        namedVariable(parser, className, false);
+        emitByte(parser, OP_INHERIT);
         classCompiler.hasSuperclass = true;
     }
 
-    namedVariable(className, false);
-    consume(TOKEN_LEFT_BRACE, L"在类主体之前期待「「 」。");
-    while (!check(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
-        method();
+    namedVariable(parser, className, false);
+    consume(parser, TOKEN_LEFT_BRACE, L"在类主体之前期待「「 」。");
+    while (!check(parser, TOKEN_RIGHT_BRACE) && !check(parser, TOKEN_EOF)) {
+        method(parser);
     }
-    consume(TOKEN_RIGHT_BRACE, L"在类主体之后期待「 」」。");
-    emitByte(OP_POP);
+    consume(parser, TOKEN_RIGHT_BRACE, L"在类主体之后期待「 」」。");
+    emitByte(parser, OP_POP);
 
     if (classCompiler.hasSuperclass) {
-        endScope();
+        endScope(parser);
     }
 
-    currentClass = currentClass->enclosing;
+    parser->currentClass = parser->currentClass->enclosing;
 }
 
-static void funDeclaration() {
-    uint8_t global = parseVariable(L"期待功能名。");
-    markInitialized();
-    function(TYPE_FUNCTION);
-    defineVariable(global);
+static void funDeclaration(Parser* parser) {
+    uint8_t global = parseVariable(parser, L"期待功能名。");
+    markInitialized(parser);
+    function(parser, TYPE_FUNCTION);
+    defineVariable(parser, global);
 }
 
-static void varDeclaration() {
-    uint8_t global = parseVariable(L"期待变量名。");
+static void varDeclaration(Parser* parser) {
+    uint8_t global = parseVariable(parser, L"期待变量名。");
 
-    if (match(TOKEN_EQUAL)) {
-        expression();
+    if (match(parser, TOKEN_EQUAL)) {
+        expression(parser);
     } else {
-        emitByte(OP_NIL);
+        emitByte(parser, OP_NIL);
     }
-//    consume(TOKEN_SEMICOLON, L"在变量声明之后期待「 ；」。");
-    match(TOKEN_SEMICOLON);
+//    consume(parser, TOKEN_SEMICOLON, L"在变量声明之后期待「 ；」。");
+    match(parser, TOKEN_SEMICOLON);
 
-    defineVariable(global);
+    defineVariable(parser, global);
 }
 
-static void expressionStatement() {
-    expression();
-//    consume(TOKEN_SEMICOLON, L"表达式后期待「 ；」。");
-    emitByte(OP_POP);
-    match(TOKEN_SEMICOLON);
+// The name a module is bound to when 导入 isn't given one: its file name up
+// to the extension. The token points into the path's string literal.
+static Token moduleName(Token* path) {
+    const char* start = path->start + 1;
+    const char* end = path->start + path->length - 1;
+    for (const char* c = start; c < end; c++) {
+        if (*c == '/') start = c + 1;
+    }
+    for (const char* c = end - 1; c > start; c--) {
+        if (*c == '.') {
+            end = c;
+            break;
+        }
+    }
+
+    Token name = *path;
+    name.type = TOKEN_IDENTIFIER;
+    name.start = start;
+    name.length = (int)(end - start);
+    return name;
+}
+
+static bool isIdentifier(Token* name) {
+    char text[256];
+    if (name->length == 0 || name->length >= (int)sizeof(text)) return false;
+    memcpy(text, name->start, name->length);
+    text[name->length] = '\0';
+    Scanner scanner;
+    initScanner(&scanner, text);
+    Token token = scanToken(&scanner);
+    return token.type == TOKEN_IDENTIFIER && token.length == name->length;
+}
+
+static void addImport(Parser* parser, Token name, ObjModule* module) {
+    if (parser->importCapacity < parser->importCount + 1) {
+        parser->importCapacity = GROW_CAPACITY(parser->importCapacity);
+        parser->imports = (ImportBinding*)realloc(parser->imports, sizeof(ImportBinding) * parser->importCapacity);
+        if (parser->imports == NULL) exit(1);
+    }
+    parser->imports[parser->importCount].name = name;
+    parser->imports[parser->importCount].module = module;
+    parser->importCount++;
+}
+
+// 导入 "路径" 为 名字 compiles the module now, unless this VM already has,
+// and runs it the first time the statement is reached.
+static void importDeclaration(Parser* parser) {
+    consume(parser, TOKEN_STRING, L"期待「导入」之后的模块路径。");
+    Token pathToken = parser->previous;
+
+    Token name;
+    if (check(parser, TOKEN_IDENTIFIER) && parser->current.length == (int)strlen("为") &&
+        memcmp(parser->current.start, "为", parser->current.length) == 0) {
+        advance(parser);
+        consume(parser, TOKEN_IDENTIFIER, L"期待「为」之后的模块名。");
+        name = parser->previous;
+    } else {
+        name = moduleName(&pathToken);
+        if (!isIdentifier(&name)) {
+            errorAt(parser, &pathToken, L"模块的文件名不能用作变量名，请用「为」给它命名。");
+            return;
+        }
+    }
+    match(parser, TOKEN_SEMICOLON);
+
+    char relative[PATH_MAX];
+    int length = pathToken.length - 2;
+    if (length <= 0 || length >= (int)sizeof(relative)) {
+        errorAt(parser, &pathToken, L"无效的模块路径。");
+        return;
+    }
+    memcpy(relative, pathToken.start + 1, length);
+    relative[length] = '\0';
+
+    ObjString* path = resolveModule(parser->vm, parser->path, relative);
+    ObjModule* module = path == NULL ? NULL : loadModule(parser->vm, path);
+    if (module == NULL) {
+        errorAt(parser, &pathToken, path == NULL ? L"找不到模块。" : L"无法导入模块。");
+        return;
+    }
+
+    declareNamedVariable(parser, &name);
+    uint8_t global = parser->compiler->scopeDepth > 0 ? 0 : globalOperand(parser, &name);
+    emitBytes(parser, OP_IMPORT, makeConstant(parser, OBJ_VAL(module->path)));
+    // Leaves the module under whatever its body returned.
+    emitByte(parser, OP_POP);
+    defineVariable(parser, global);
+    addImport(parser, name, module);
+}
+
+static void expressionStatement(Parser* parser) {
+    expression(parser);
+//    consume(parser, TOKEN_SEMICOLON, L"表达式后期待「 ；」。");
+    emitByte(parser, OP_POP);
+    match(parser, TOKEN_SEMICOLON);
 }
 
-static void forStatement() {
-    beginScope();
+static void forStatement(Parser* parser) {
+    beginScope(parser);
 
-    consume(TOKEN_LEFT_PAREN, L"在「对于」之后期待「（ 」。");
-    if (match(TOKEN_VAR)) {
-        varDeclaration();
-    } else if (match(TOKEN_SEMICOLON)) {
+    consume(parser, TOKEN_LEFT_PAREN, L"在「对于」之后期待「（ 」。");
+    if (match(parser, TOKEN_VAR)) {
+        varDeclaration(parser);
+    } else if (match(parser, TOKEN_SEMICOLON)) {
         // No initializer.
     } else {
-        expressionStatement();
+        expressionStatement(parser);
     }
 
-    int surroundingLoopStart = innermostLoopStart;
-    int surroundingLoopScopeDepth = innermostLoopScopeDepth;
-    innermostLoopStart = currentChunk()->count;
-    innermostLoopScopeDepth = current->scopeDepth;
+    int surroundingLoopStart = parser->innermostLoopStart;
+    int surroundingLoopScopeDepth = parser->innermostLoopScopeDepth;
+    parser->innermostLoopStart = currentChunk(parser)->count;
+    parser->innermostLoopScopeDepth = parser->compiler->scopeDepth;
 
     int exitJump = -1;
-    if (!match(TOKEN_SEMICOLON)) {
-        expression();
-        consume(TOKEN_SEMICOLON, L"循环条件后期待「 ；」。");
+    if (!match(parser, TOKEN_SEMICOLON)) {
+        expression(parser);
+        consume(parser, TOKEN_SEMICOLON, L"循环条件后期待「 ；」。");
 
         // Jump out of the loop if the condition is false.
-        exitJump = emitJump(OP_JUMP_IF_FALSE);
-        emitByte(OP_POP); // Condition.
+        exitJump = emitJump(parser, OP_JUMP_IF_FALSE);
+        emitByte(parser, OP_POP); // Condition.
     }
 
-    if (!match(TOKEN_RIGHT_PAREN)) {
-        int bodyJump = emitJump(OP_JUMP);
+    if (!match(parser, TOKEN_RIGHT_PAREN)) {
+        int bodyJump = emitJump(parser, OP_JUMP);
 
-        int incrementStart = currentChunk()->count;
-        expression();
-        emitByte(OP_POP);
-        consume(TOKEN_RIGHT_PAREN, L"在对于句之后期待「 ）」。");
+        int incrementStart = currentChunk(parser)->count;
+        expression(parser);
+        emitByte(parser, OP_POP);
+        consume(parser, TOKEN_RIGHT_PAREN, L"在对于句之后期待「 ）」。");
 
-        emitLoop(innermostLoopStart);
-        innermostLoopStart = incrementStart;
-        patchJump(bodyJump);
+        emitLoop(parser, parser->innermostLoopStart);
+        parser->innermostLoopStart = incrementStart;
+        patchJump(parser, bodyJump);
     }
 
-    int loopBody = current->function->chunk.count;
-    statement();
+    int loopBody = parser->compiler->function->chunk.count;
+    statement(parser);
 
-    emitLoop(innermostLoopStart);
+    emitLoop(parser, parser->innermostLoopStart);
 
     if (exitJump != -1) {
-        patchJump(exitJump);
-        emitByte(OP_POP); // Condition.
+        patchJump(parser, exitJump);
+        emitByte(parser, OP_POP); // Condition.
     }
 
     int i = loopBody;
-    while (i < current->function->chunk.count) {
-        if (current->function->chunk.code[i] == OP_END) {
-            current->function->chunk.code[i] = OP_JUMP;
-            patchJump(i + 1);
+    while (i < parser->compiler->function->chunk.count) {
+        if (parser->compiler->function->chunk.code[i] == OP_END) {
+            parser->compiler->function->chunk.code[i] = OP_JUMP;
+            patchJump(parser, i + 1);
             i += 3;
         } else {
-            i += 1 + getByteCountForArguments(i);
+            i += 1 + getByteCountForArguments(parser, i);
         }
     }
 
-    innermostLoopStart = surroundingLoopStart;
-    innermostLoopScopeDepth = surroundingLoopScopeDepth;
+    parser->innermostLoopStart = surroundingLoopStart;
+    parser->innermostLoopScopeDepth = surroundingLoopScopeDepth;
 
-    endScope();
+    endScope(parser);
 }
 
-static void ifStatement() {
-    consume(TOKEN_LEFT_PAREN, L"在「如果」之后期待「（ 」。");
-    expression();
-    consume(TOKEN_RIGHT_PAREN, L"套件后期待「 ）」。");
+static void ifStatement(Parser* parser) {
+    consume(parser, TOKEN_LEFT_PAREN, L"在「如果」之后期待「（ 」。");
+    expression(parser);
+    consume(parser, TOKEN_RIGHT_PAREN, L"套件后期待「 ）」。");
 
-    int thenJump = emitJump(OP_JUMP_IF_FALSE);
-    emitByte(OP_POP);
-    statement();
+    int thenJump = emitJump(parser, OP_JUMP_IF_FALSE);
+    emitByte(parser, OP_POP);
+    statement(parser);
 
-    int elseJump = emitJump(OP_JUMP);
+    int elseJump = emitJump(parser, OP_JUMP);
 
-    patchJump(thenJump);
-    emitByte(OP_POP);
+    patchJump(parser, thenJump);
+    emitByte(parser, OP_POP);
 
-    if (match(TOKEN_ELSE)) statement();
-    patchJump(elseJump);
+    if (match(parser, TOKEN_ELSE)) statement(parser);
+    patchJump(parser, elseJump);
 }
 
-static void returnStatement() {
-    if (current->type == TYPE_SCRIPT) {
-        error(L"无法从顶级代码返回。");
+static void returnStatement(Parser* parser) {
+    if (parser->compiler->type == TYPE_SCRIPT) {
+        error(parser, L"无法从顶级代码返回。");
     }
 
-    if (match(TOKEN_SEMICOLON) || parser.previous.line != parser.current.line) {
-        emitReturn();
+    if (match(parser, TOKEN_SEMICOLON) || parser->previous.line != parser->current.line) {
+        emitReturn(parser);
     } else {
-        if (current->type == TYPE_INITIALIZER) {
-            error(L"不能从初始值设定项返回值。");
+        if (parser->compiler->type == TYPE_INITIALIZER) {
+            error(parser, L"不能从初始值设定项返回值。");
         }
 
-        expression();
-        match(TOKEN_SEMICOLON);
+        expression(parser);
+        match(parser, TOKEN_SEMICOLON);
+
+        emitByte(parser, OP_RETURN);
+    }
+}
+
+static void yieldStatement(Parser* parser) {
+    if (parser->compiler->type == TYPE_SCRIPT) {
+        error(parser, L"无法在顶级代码中产出。");
+    } else if (parser->compiler->type == TYPE_INITIALIZER) {
+        error(parser, L"无法在初始值设定项中产出。");
+    }
+
+    // Any function that yields is a generator: calling it returns a
+    // suspended fiber instead of running the body.
+    parser->compiler->function->isGenerator = true;
 
-        emitByte(OP_RETURN);
+    if (match(parser, TOKEN_SEMICOLON) || parser->previous.line != parser->current.line) {
+        emitByte(parser, OP_NIL);
+    } else {
+        expression(parser);
+        match(parser, TOKEN_SEMICOLON);
     }
+
+    // OP_YIELD leaves its slot for the resume value, which is discarded.
+    emitByte(parser, OP_YIELD);
+    emitByte(parser, OP_POP);
 }
 
-static void whileStatement() {
-    int surroundingLoopStart = innermostLoopStart;
-    int surroundingLoopScopeDepth = innermostLoopScopeDepth;
-    innermostLoopStart = currentChunk()->count;
-    innermostLoopScopeDepth = current->scopeDepth;
+static void whileStatement(Parser* parser) {
+    int surroundingLoopStart = parser->innermostLoopStart;
+    int surroundingLoopScopeDepth = parser->innermostLoopScopeDepth;
+    parser->innermostLoopStart = currentChunk(parser)->count;
+    parser->innermostLoopScopeDepth = parser->compiler->scopeDepth;
 
-    consume(TOKEN_LEFT_PAREN, L"在「而」之后期待「（ 」。");
-    expression();
-    consume(TOKEN_RIGHT_PAREN, L"条件后期待「 ）」。");
+    consume(parser, TOKEN_LEFT_PAREN, L"在「而」之后期待「（ 」。");
+    expression(parser);
+    consume(parser, TOKEN_RIGHT_PAREN, L"条件后期待「 ）」。");
 
-    int exitJump = emitJump(OP_JUMP_IF_FALSE);
-    emitByte(OP_POP);
-    int loopBody = current->function->chunk.count;
-    statement();
-    emitLoop(innermostLoopStart);
+    int exitJump = emitJump(parser, OP_JUMP_IF_FALSE);
+    emitByte(parser, OP_POP);
+    int loopBody = parser->compiler->function->chunk.count;
+    statement(parser);
+    emitLoop(parser, parser->innermostLoopStart);
 
-    patchJump(exitJump);
-    emitByte(OP_POP);
+    patchJump(parser, exitJump);
+    emitByte(parser, OP_POP);
 
-    innermostLoopStart = surroundingLoopStart;
-    innermostLoopScopeDepth = surroundingLoopScopeDepth;
+    parser->innermostLoopStart = surroundingLoopStart;
+    parser->innermostLoopScopeDepth = surroundingLoopScopeDepth;
 
     int i = loopBody;
-    while (i < current->function->chunk.count) {
-        if (current->function->chunk.code[i] == OP_END) {
-            current->function->chunk.code[i] = OP_JUMP;
-            patchJump(i + 1);
+    while (i < parser->compiler->function->chunk.count) {
+        if (parser->compiler->function->chunk.code[i] == OP_END) {
+            parser->compiler->function->chunk.code[i] = OP_JUMP;
+            patchJump(parser, i + 1);
             i += 3;
         } else {
-            i += 1 + getByteCountForArguments(i);
+            i += 1 + getByteCountForArguments(parser, i);
         }
     }
 }
 
-static void switchStatement() {
-    int surroundingSwitchStart = innermostSwitchStart;
-    innermostSwitchStart = currentChunk()->count;
+static void switchStatement(Parser* parser) {
+    int surroundingSwitchStart = parser->innermostSwitchStart;
+    parser->innermostSwitchStart = currentChunk(parser)->count;
 
-    consume(TOKEN_LEFT_PAREN, L"在「切换」之后期待「（ 」。");
-    expression();
-    consume(TOKEN_RIGHT_PAREN, L"在值之后期待「 ）」。");
-    consume(TOKEN_LEFT_BRACE, L"在切换案例之前期待「「 」。");
+    consume(parser, TOKEN_LEFT_PAREN, L"在「切换」之后期待「（ 」。");
+    expression(parser);
+    consume(parser, TOKEN_RIGHT_PAREN, L"在值之后期待「 ）」。");
+    consume(parser, TOKEN_LEFT_BRACE, L"在切换案例之前期待「「 」。");
 
     int state = 0; // 0: before all cases, 1: before default, 2: after default.
     int caseCount = 0;
     int previousCaseSkip = -1;
     int previousCaseFallthrough = -1;
-    int switchBody = current->function->chunk.count;
+    int switchBody = parser->compiler->function->chunk.count;
 
-    while (!match(TOKEN_RIGHT_BRACE) && !check(TOKEN_EOF)) {
-        if (match(TOKEN_CASE) || match(TOKEN_DEFAULT)) {
-            TokenType caseType = parser.previous.type;
+    while (!match(parser, TOKEN_RIGHT_BRACE) && !check(parser, TOKEN_EOF)) {
+        if (match(parser, TOKEN_CASE) || match(parser, TOKEN_DEFAULT)) {
+            TokenType caseType = parser->previous.type;
 
             if (state == 2) {
-                error(L"在预设之后不能有另一个案例或预设。");
+                error(parser, L"在预设之后不能有另一个案例或预设。");
             }
 
             if (state == 1) {
-                    previousCaseFallthrough = emitJump(OP_JUMP);
+                    previousCaseFallthrough = emitJump(parser, OP_JUMP);
                 caseCount++;
                 // Patch its condition to jump to the next case (this one).
-                patchJump(previousCaseSkip);
-                emitByte(OP_POP);
+                patchJump(parser, previousCaseSkip);
+                emitByte(parser, OP_POP);
             }
 
             if (caseType == TOKEN_CASE) {
                 state = 1;
 
                 // See if the case is equal to the value.
-                emitByte(OP_DUP);
-                expression();
+                emitByte(parser, OP_DUP);
+                expression(parser);
 
-                consume(TOKEN_COLON, L"在案例值之后期得「 ：」。");
+                consume(parser, TOKEN_COLON, L"在案例值之后期得「 ：」。");
 
-                emitByte(OP_EQUAL);
-                previousCaseSkip = emitJump(OP_JUMP_IF_FALSE);
+                emitByte(parser, OP_EQUAL);
+                previousCaseSkip = emitJump(parser, OP_JUMP_IF_FALSE);
 
                 // Pop the comparison result.
-                emitByte(OP_POP);
+                emitByte(parser, OP_POP);
             } else {
                 state = 2;
-                consume(TOKEN_COLON, L"在案例之后期待「 ：」。");
+                consume(parser, TOKEN_COLON, L"在案例之后期待「 ：」。");
                 previousCaseSkip = -1;
             }
 
-            emitByte(OP_POP);
+            emitByte(parser, OP_POP);
             if (caseCount > 0) {
-                patchJump(previousCaseFallthrough);
+                patchJump(parser, previousCaseFallthrough);
             }
         } else {
-            // Otherwise, it's a statement inside the current case.
+            // Otherwise, it's a statement inside the parser->compiler case.
             if (state == 0) {
-                error(L"在任何案件之前不能有语句。");
+                error(parser, L"在任何案件之前不能有语句。");
             }
-            statement();
+            statement(parser);
         }
     }
 
     // If we ended without a default case, patch its condition jump.
     if (state == 1) {
-        patchJump(previousCaseSkip);
-        emitByte(OP_POP);
+        patchJump(parser, previousCaseSkip);
+        emitByte(parser, OP_POP);
     }
 
-    emitByte(OP_POP); // The switch value.
+    emitByte(parser, OP_POP); // The switch value.
 
-    innermostSwitchStart = surroundingSwitchStart;
+    parser->innermostSwitchStart = surroundingSwitchStart;
 
     int i = switchBody;
-    while (i < current->function->chunk.count) {
-        if (current->function->chunk.code[i] == OP_END) {
-            current->function->chunk.code[i] = OP_JUMP;
-            patchJump(i + 1);
+    while (i < parser->compiler->function->chunk.count) {
+        if (parser->compiler->function->chunk.code[i] == OP_END) {
+            parser->compiler->function->chunk.code[i] = OP_JUMP;
+            patchJump(parser, i + 1);
             i += 3;
         } else {
-            i += 1 + getByteCountForArguments(i);
+            i += 1 + getByteCountForArguments(parser, i);
         }
     }
 }
 
-static void continueStatement() {
-    if (innermostLoopStart == -1) {
-        error(L"不能在循环外使用「继续」。");
+static void continueStatement(Parser* parser) {
+    if (parser->innermostLoopStart == -1) {
+        error(parser, L"不能在循环外使用「继续」。");
     }
 
-//    consume(TOKEN_SEMICOLON, L"在「继续」之后期待「 ；」。");
-    match(TOKEN_SEMICOLON);
+//    consume(parser, TOKEN_SEMICOLON, L"在「继续」之后期待「 ；」。");
+    match(parser, TOKEN_SEMICOLON);
 
     // Discard any locals created inside the loop.
-    for (int i = current->localCount - 1; i >= 0 && current->locals[i].depth > innermostLoopScopeDepth; i--) {
-        emitByte(OP_POP);
+    for (int i = parser->compiler->localCount - 1; i >= 0 && parser->compiler->locals[i].depth > parser->innermostLoopScopeDepth; i--) {
+        emitByte(parser, OP_POP);
     }
 
-    // Jump to top of current innermost loop.
-    emitLoop(innermostLoopStart);
+    // Jump to top of parser->compiler innermost loop.
+    emitLoop(parser, parser->innermostLoopStart);
 }
 
-static void breakStatement() {
-    if (innermostLoopStart == -1 && innermostSwitchStart == -1) {
-        error(L"不能在循环外或切换使用「打断」。");
+static void breakStatement(Parser* parser) {
+    if (parser->innermostLoopStart == -1 && parser->innermostSwitchStart == -1) {
+        error(parser, L"不能在循环外或切换使用「打断」。");
     }
 
-//    consume(TOKEN_SEMICOLON, L"在「打断」之后期待「 ；」。");
-    match(TOKEN_SEMICOLON);
+//    consume(parser, TOKEN_SEMICOLON, L"在「打断」之后期待「 ；」。");
+    match(parser, TOKEN_SEMICOLON);
 
-    if (innermostLoopStart > innermostSwitchStart) {
+    if (parser->innermostLoopStart > parser->innermostSwitchStart) {
         // Discard any locals created inside the loop.
-        for (int i = current->localCount - 1; i >= 0 && current->locals[i].depth > innermostLoopScopeDepth; i--) {
-            emitByte(OP_POP);
+        for (int i = parser->compiler->localCount - 1; i >= 0 && parser->compiler->locals[i].depth > parser->innermostLoopScopeDepth; i--) {
+            emitByte(parser, OP_POP);
         }
     }
 
@@ -1256,16 +1525,16 @@ static void breakStatement() {
     // replace these with `OP_END` instructions with appropriate offsets.
     // We use `OP_END` here because that can't occur in the middle of
     // bytecode.
-    emitJump(OP_END);
+    emitJump(parser, OP_END);
 }
 
-static void synchronize() {
-    parser.panicMode = false;
+static void synchronize(Parser* parser) {
+    parser->panicMode = false;
 
-    while (parser.current.type != TOKEN_EOF) {
-        if (parser.previous.type == TOKEN_SEMICOLON) return;
-        else if (parser.previous.line != parser.current.line) return;
-        switch (parser.current.type) {
+    while (parser->current.type != TOKEN_EOF) {
+        if (parser->previous.type == TOKEN_SEMICOLON) return;
+        else if (parser->previous.line != parser->current.line) return;
+        switch (parser->current.type) {
             case TOKEN_CLASS:
             case TOKEN_FUN:
             case TOKEN_VAR:
@@ -1274,77 +1543,125 @@ static void synchronize() {
             case TOKEN_SWITCH:
             case TOKEN_WHILE:
             case TOKEN_RETURN:
+            case TOKEN_YIELD:
+            case TOKEN_IMPORT:
                 return;
 
             default:
                 ; // Do nothing.
         }
 
-        advance();
+        advance(parser);
     }
 }
 
-static void declaration() {
-    if (match(TOKEN_CLASS)) {
-        classDeclaration();
-    } else if (match(TOKEN_FUN)) {
-        funDeclaration();
-    } else if (match(TOKEN_VAR)) {
-        varDeclaration();
+static void declaration(Parser* parser) {
+    if (match(parser, TOKEN_CLASS)) {
+        classDeclaration(parser);
+    } else if (match(parser, TOKEN_FUN)) {
+        funDeclaration(parser);
+    } else if (match(parser, TOKEN_VAR)) {
+        varDeclaration(parser);
+    } else if (match(parser, TOKEN_IMPORT)) {
+        importDeclaration(parser);
     } else {
-        statement();
-    }
-
-    if (parser.panicMode) synchronize();
-}
-
-static void statement() {
-    if (match(TOKEN_FOR)) {
-        forStatement();
-    } else if (match(TOKEN_IF)) {
-        ifStatement();
-    } else if (match(TOKEN_RETURN)) {
-        returnStatement();
-    } else if (match(TOKEN_WHILE)) {
-        whileStatement();
-    } else if (match(TOKEN_SWITCH)) {
-        switchStatement();
-    } else if (match(TOKEN_CONTINUE)) {
-        continueStatement();
-    } else if (match(TOKEN_BREAK)) {
-        breakStatement();
-    } else if (match(TOKEN_LEFT_BRACE)) {
-        beginScope();
-        block();
-        endScope();
+        statement(parser);
+    }
+
+    if (parser->panicMode) synchronize(parser);
+}
+
+static void statement(Parser* parser) {
+    if (match(parser, TOKEN_FOR)) {
+        forStatement(parser);
+    } else if (match(parser, TOKEN_IF)) {
+        ifStatement(parser);
+    } else if (match(parser, TOKEN_RETURN)) {
+        returnStatement(parser);
+    } else if (match(parser, TOKEN_YIELD)) {
+        yieldStatement(parser);
+    } else if (match(parser, TOKEN_WHILE)) {
+        whileStatement(parser);
+    } else if (match(parser, TOKEN_SWITCH)) {
+        switchStatement(parser);
+    } else if (match(parser, TOKEN_CONTINUE)) {
+        continueStatement(parser);
+    } else if (match(parser, TOKEN_BREAK)) {
+        breakStatement(parser);
+    } else if (match(parser, TOKEN_LEFT_BRACE)) {
+        beginScope(parser);
+        block(parser);
+        endScope(parser);
     }
     else {
-        expressionStatement();
+        expressionStatement(parser);
     }
 }
 
-ObjFunction* compile(const wchar_t* source) {
-    initScanner(source);
-    Compiler compiler;
-    initCompiler(&compiler, TYPE_SCRIPT);
-
+static ObjFunction* compileFile(VM* vm, const char* source, const char* path, ObjModule* module) {
+    Parser parser;
+    parser.enclosing = vm->parser;
+    parser.vm = vm;
+    parser.compiler = NULL;
+    parser.currentClass = NULL;
+    parser.innermostLoopStart = -1;
+    parser.innermostLoopScopeDepth = 0;
+    parser.innermostSwitchStart = -1;
     parser.hadError = false;
     parser.panicMode = false;
+    parser.path = path;
+    parser.module = module;
+    parser.slots = NULL;
+    parser.slotCapacity = 0;
+    parser.imports = NULL;
+    parser.importCount = 0;
+    parser.importCapacity = 0;
+    parser.lastModule = NULL;
+    parser.moduleAt = -1;
+    initScanner(&parser.scanner, source);
+
+    vm->parser = &parser;
 
-    advance();
+    Compiler compiler;
+    initCompiler(&parser, &compiler, TYPE_SCRIPT);
+
+    advance(&parser);
+
+    while (!match(&parser, TOKEN_EOF)) {
+        declaration(&parser);
+    }
 
-    while (!match(TOKEN_EOF)) {
-        declaration();
+    // A module can't see its importer's globals, so every name it uses
+    // must be declared somewhere at its top level.
+    for (int i = 0; module != NULL && i < module->names.count; i++) {
+        if (parser.slots[i].declared) continue;
+        parser.panicMode = false;
+        errorAt(&parser, &parser.slots[i].firstUse, L"模块中没有定义这个变量。");
     }
 
-    ObjFunction* function = endCompiler();
+    ObjFunction* function = endCompiler(&parser);
+    vm->parser = parser.enclosing;
+    free(parser.slots);
+    free(parser.imports);
     return parser.hadError ? NULL : function;
 }
 
-void markCompilerRoots() {
-    Compiler* compiler = current;
-    while (compiler != NULL) {
-        markObject((Obj*)compiler->function);
-        compiler = compiler->enclosing;
+// Compiles a script. [path] is the file it came from, or NULL if none.
+ObjFunction* compile(VM* vm, const char* source, const char* path) {
+    return compileFile(vm, source, path, NULL);
+}
+
+// Compiles the file at [path] as the body of [module].
+ObjFunction* compileModule(VM* vm, ObjModule* module, const char* source, const char* path) {
+    return compileFile(vm, source, path, module);
+}
+
+void markCompilerRoots(VM* vm) {
+    for (Parser* parser = vm->parser; parser != NULL; parser = parser->enclosing) {
+        Compiler* compiler = parser->compiler;
+        while (compiler != NULL) {
+            markObject(vm, (Obj*)compiler->function);
+            compiler = compiler->enclosing;
+        }
     }
-}
\ No newline at end of file
+}
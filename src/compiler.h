@@ -8,7 +8,8 @@
 #include "object.h"
 #include "vm.h"
 
-ObjFunction* compile(const wchar_t* source);
-void markCompilerRoots();
+ObjFunction* compile(VM* vm, const char* source, const char* path);
+ObjFunction* compileModule(VM* vm, ObjModule* module, const char* source, const char* path);
+void markCompilerRoots(VM* vm);
 
 #endif //QI_COMPILER_H
\ No newline at end of file
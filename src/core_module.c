@@ -4,24 +4,60 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <errno.h>
 #include <string.h>
 #include <float.h>
 #include <time.h>
 #include <math.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "core_module.h"
+#include "embed.h"
+#include "image.h"
+#include "reader.h"
 
-static bool nativeError(Value* args, wchar_t* msg, ...) {
-    va_list list;
-    wchar_t error[100];
-    va_start(list, msg);
-    vswprintf(error, sizeof(error), msg, list);
-    args[-1] = OBJ_VAL(copyString(error, 100));
-    va_end(list);
+// The longest message a native can raise, in characters.
+#define MAX_ERROR 65536
+
+// Sets the native's result to the formatted message and returns false, which
+// a native returns to raise it as a runtime error. Messages that outgrow the
+// stack buffer are formatted again into a larger one.
+bool nativeError(VM* vm, Value* args, wchar_t* msg, ...) {
+    wchar_t buffer[256];
+    wchar_t* error = buffer;
+    int capacity = sizeof(buffer) / sizeof(wchar_t);
+    for (;;) {
+        va_list list;
+        va_start(list, msg);
+        int length = vswprintf(error, capacity, msg, list);
+        va_end(list);
+        if (length >= 0 || capacity >= MAX_ERROR) break;
+        if (error != buffer) free(error);
+        capacity *= 2;
+        error = (wchar_t*)malloc(sizeof(wchar_t) * capacity);
+        if (error == NULL) exit(1);
+    }
+    error[capacity - 1] = L'\0';
+    args[-1] = OBJ_VAL(copyString(vm, error, (int)wcslen(error)));
+    if (error != buffer) free(error);
     return false;
 }
 
+static locale_t cLocale;
+static pthread_once_t cLocaleOnce = PTHREAD_ONCE_INIT;
+
+static void initCLocale(void) {
+    cLocale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+}
+
+// The "C" locale, for data formats whose numbers always use a '.' whatever
+// LC_NUMERIC the user has.
+locale_t numberLocale(void) {
+    pthread_once(&cLocaleOnce, initCLocale);
+    return cLocale;
+}
+
 wchar_t* getType(Value value) {
     if (IS_BOOL(value)) return L"布尔";
     else if (IS_NUMBER(value)) return L"数字";
@@ -37,90 +73,91 @@ wchar_t* getType(Value value) {
             case OBJ_UPVALUE: return L"升值";
             case OBJ_CLOSURE: return L"关闭";
             case OBJ_CLASS: return L"类";
+            case OBJ_FIBER: return L"纤程";
+            case OBJ_WORKER: return L"工作者";
+            case OBJ_MODULE: return L"模块";
+            case OBJ_READER: return L"读取器";
+            case OBJ_FILE: return L"文件";
+            case OBJ_BYTES: return L"字节";
+            case OBJ_CSV: return L"CSV";
+            case OBJ_REGEX: return L"正则";
+            case OBJ_FOREIGN: return AS_FOREIGN(value)->klass->name->chars;
         }
     }
     // Unreachable.
     return L"未知";
 }
 
-bool printNative(int argCount, Value* args) {
-    printValue(args[0]);
+bool printNative(VM* vm, int argCount, Value* args) {
+    outputValue(&vm->output, args[0]);
     args[-1] = NIL_VAL;
     return true;
 }
 
-bool printlnNative(int argCount, Value* args) {
-    printValue(args[0]);
-    wprintf(L"\n");
+bool printlnNative(VM* vm, int argCount, Value* args) {
+    outputValue(&vm->output, args[0]);
+    outputChars(&vm->output, L"\n", 1);
     args[-1] = NIL_VAL;
     return true;
 }
 
-bool scanNative(int argCount, Value* args) {
-    char input[100];
-    while (fgets(input, 100, stdin) == NULL) {}
-    input[ strlen(input)-1] = '\0';
-    wchar_t* winput = ALLOCATE(wchar_t, strlen(input));
-    mbstowcs(winput, input, strlen(input));
-    args[-1] = OBJ_VAL(copyString(winput, wcslen(winput)));
+// Output to a reader that has gone away is dropped silently; other
+// failures, such as a full disk, are reported.
+bool flushNative(VM* vm, int argCount, Value* args) {
+    if (!flushOutput(&vm->output)) {
+        int error = vm->output.error;
+        vm->output.error = 0;
+        if (error != EPIPE) return nativeError(vm, args, L"写入失败：%s。", strerror(error));
+    }
+    args[-1] = NIL_VAL;
     return true;
 }
 
-bool clockNative(int argCount, Value* args) {
-    args[-1] = NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
+// Reads a line from standard input, or returns 空 at the end of it.
+bool scanNative(VM* vm, int argCount, Value* args) {
+    // Show any prompt before waiting for input.
+    flushOutput(&vm->output);
+    args[-1] = OBJ_VAL(standardInput(vm));
+    return readerReadLineNative(vm, 0, args);
+}
+
+bool clockNative(VM* vm, int argCount, Value* args) {
+    // Wall-clock time, so work spread across worker threads isn't summed.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    args[-1] = NUMBER_VAL(now.tv_sec + now.tv_nsec / 1e9 - vm->startTime);
     return true;
 }
 
-bool typeofNative(int argCount, Value* args) {
+bool typeofNative(VM* vm, int argCount, Value* args) {
     wchar_t* type = getType(args[0]);
-    args[-1] = OBJ_VAL(copyString(type, wcslen(type)));
+    args[-1] = OBJ_VAL(copyString(vm, type, wcslen(type)));
     return true;
 }
 
-bool sqrtNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
+// The number natives are defined with signatures, so their arguments are
+// numbers by the time they run.
+
+bool sqrtNative(VM* vm, int argCount, Value* args) {
     args[-1] = NUMBER_VAL(sqrt(AS_NUMBER(args[0])));
     return true;
 }
 
-bool powNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（基数）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
-    if (!IS_NUMBER(args[1])) {
-        return nativeError(args,
-                           L"参数 2（次方）的类型必须是「数字」，而不是「%ls」。", getType(args[1]));
-    }
+bool powNative(VM* vm, int argCount, Value* args) {
     args[-1] = NUMBER_VAL(pow(AS_NUMBER(args[0]), AS_NUMBER(args[1])));
     return true;
 }
 
-bool minNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1 的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
-    if (!IS_NUMBER(args[1])) {
-        return nativeError(args,
-                           L"参数 2 的类型必须是「数字」，而不是「%ls」。", getType(args[1]));
-    }
+bool minNative(VM* vm, int argCount, Value* args) {
     double a = AS_NUMBER(args[0]);
     double b = AS_NUMBER(args[1]);
     args[-1] = NUMBER_VAL(a < b ? a : b);
     return true;
 }
 
-bool maxNative(int argCount, Value* args) {
-    double max = DBL_MIN;
-    for (int i = 0; i < argCount; i++) {
-        if (!IS_NUMBER(args[i])) {
-            return nativeError(args,
-                               L"参数 %d 的类型必须是「数字」，而不是「%ls」。", i + 1, getType(args[0]));
-        }
+bool maxNative(VM* vm, int argCount, Value* args) {
+    double max = AS_NUMBER(args[0]);
+    for (int i = 1; i < argCount; i++) {
         double a = AS_NUMBER(args[i]);
         max = a > max ? a : max;
     }
@@ -128,135 +165,66 @@ bool maxNative(int argCount, Value* args) {
     return true;
 }
 
-bool roundNative(int argCount, Value* args) {
-    if (argCount < 1 || argCount > 2) {
-        return nativeError(args, L"需要 1 到 2 个参数，但得到%d。", argCount);
-    }
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
-    if (argCount == 2 && !IS_NUMBER(args[1])) {
-        return nativeError(args,
-                           L"参数 2（精度）的类型必须是「数字」，而不是「%ls」。", getType(args[1]));
-    }
-    double shift =  pow(10.0, AS_NUMBER(args[1]));
+bool roundNative(VM* vm, int argCount, Value* args) {
+    double shift = argCount == 2 ? pow(10.0, AS_NUMBER(args[1])) : 1;
     args[-1] = NUMBER_VAL(round(AS_NUMBER(args[0]) * shift) / shift);
     return true;
 }
 
-bool ntosNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
+bool ntosNative(VM* vm, int argCount, Value* args) {
     wchar_t str[100];
-    swprintf(str, sizeof(str), L"%g", AS_NUMBER(args[0]));
-    args[-1] = OBJ_VAL(copyString(str, wcslen(str)));
+    swprintf(str, sizeof(str) / sizeof(wchar_t), L"%g", AS_NUMBER(args[0]));
+    args[-1] = OBJ_VAL(copyString(vm, str, wcslen(str)));
     return true;
 }
 
-bool logNative(int argCount, Value* args) {
-    if (argCount < 1 || argCount > 2) {
-        return nativeError(args, L"需要 1 到 2 个参数，但得到%d。", argCount);
-    }
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
-    if (argCount == 2 && !IS_NUMBER(args[1])) {
-        return nativeError(args,
-                           L"参数 2（精度）的类型必须是「数字」，而不是「%ls」。", getType(args[1]));
-    }
-    double base = argCount == 1 ? M_E : AS_NUMBER(args[1]);
-    args[-1] = NUMBER_VAL(log(args[0]) / log(base));
+bool logNative(VM* vm, int argCount, Value* args) {
+    double base = argCount == 2 ? AS_NUMBER(args[1]) : 10;
+    args[-1] = NUMBER_VAL(log(AS_NUMBER(args[0])) / log(base));
     return true;
 }
 
-bool sinNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
+bool sinNative(VM* vm, int argCount, Value* args) {
     args[-1] = NUMBER_VAL(sin(AS_NUMBER(args[0])));
     return true;
 }
 
-bool cosNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
+bool cosNative(VM* vm, int argCount, Value* args) {
     args[-1] = NUMBER_VAL(cos(AS_NUMBER(args[0])));
     return true;
 }
 
-bool tanNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
+bool tanNative(VM* vm, int argCount, Value* args) {
     args[-1] = NUMBER_VAL(tan(AS_NUMBER(args[0])));
     return true;
 }
 
-bool asinNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
+bool asinNative(VM* vm, int argCount, Value* args) {
     args[-1] = NUMBER_VAL(asin(AS_NUMBER(args[0])));
     return true;
 }
 
-bool acosNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
+bool acosNative(VM* vm, int argCount, Value* args) {
     args[-1] = NUMBER_VAL(acos(AS_NUMBER(args[0])));
     return true;
 }
 
-bool atanNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
+bool atanNative(VM* vm, int argCount, Value* args) {
     args[-1] = NUMBER_VAL(atan(AS_NUMBER(args[0])));
     return true;
 }
 
-bool ceilNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
+bool ceilNative(VM* vm, int argCount, Value* args) {
     args[-1] = NUMBER_VAL(ceil(AS_NUMBER(args[0])));
     return true;
 }
 
-bool floorNative(int argCount, Value* args) {
-    if (!IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
+bool floorNative(VM* vm, int argCount, Value* args) {
     args[-1] = NUMBER_VAL(floor(AS_NUMBER(args[0])));
     return true;
 }
 
-bool randNative(int argCount, Value* args) {
-    if (argCount < 0 || argCount > 2) {
-        return nativeError(args, L"需要 0 到 2 个参数，但得到%d。", argCount);
-    }
-    if (argCount == 1 && !IS_NUMBER(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
-    }
-    if (argCount == 2 && !IS_NUMBER(args[1])) {
-        return nativeError(args,
-                           L"参数 2（精度）的类型必须是「数字」，而不是「%ls」。", getType(args[1]));
-    }
+bool randNative(VM* vm, int argCount, Value* args) {
     int min, max;
     if (argCount == 0) {
         min = 0;
@@ -276,58 +244,95 @@ bool randNative(int argCount, Value* args) {
     return true;
 }
 
-bool stonNative(int argCount, Value* args) {
-    if (!IS_STRING(args[0])) {
-        return nativeError(args,
-                           L"参数 1（输入）的类型必须是「字符串」，而不是「%ls」。", getType(args[0]));
-    }
+bool stonNative(VM* vm, int argCount, Value* args) {
     args[-1] = NUMBER_VAL(wcstod(AS_WCSTRING(args[0]), NULL));
     return true;
 }
 
-void initCoreClass() {
+bool fiberNewNative(VM* vm, int argCount, Value* args) {
+    if (!IS_CLOSURE(args[0])) {
+        return nativeError(vm, args,
+                           L"参数 1（功能）的类型必须是「关闭」，而不是「%ls」。", getType(args[0]));
+    }
+    ObjClosure* closure = AS_CLOSURE(args[0]);
+    if (closure->function->arity > 1) {
+        return nativeError(vm, args, L"纤程功能需要 0 或 1 个参数，但得到 %d。", closure->function->arity);
+    }
+    // Calling a generator makes one instead of running its body.
+    if (closure->function->isGenerator) return nativeError(vm, args, L"纤程功能不能是生成器。");
+    args[-1] = OBJ_VAL(newFiber(vm, closure));
+    return true;
+}
+
+bool fiberYieldNative(VM* vm, int argCount, Value* args) {
+    ObjFiber* fiber = vm->fiber;
+    if (fiber->caller == NULL) {
+        return nativeError(vm, args, L"无法在主纤程中让出。");
+    }
+    if (fiber->nativeCalls > 0) {
+        return nativeError(vm, args, L"无法跨越本地调用让出。");
+    }
+    // The VM notices the suspended state once this call returns and unwinds
+    // back to 恢复, which overwrites args[-1] with the next resume value.
+    fiber->transfer = argCount == 1 ? args[0] : NIL_VAL;
+    fiber->state = FIBER_SUSPENDED;
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+void initCoreClass(VM* vm) {
     // System Core Class
-    ObjClass* systemClass = newClass(copyString(L"系统", 2));
-    defineNative(L"打印", printNative, 1, systemClass);
-    defineNative(L"打印行", printlnNative, 1, systemClass);
-    defineNative(L"扫描", scanNative, 0, systemClass);
-    defineNative(L"时钟", clockNative, 0, systemClass);
-    defineNative(L"型", typeofNative, 1, systemClass);
-    ObjInstance* systemInstance = newInstance(systemClass, true);
-    defineNativeInstance(L"系统", systemInstance);
+    ObjClass* systemClass = newClass(vm, copyString(vm, L"系统", 2));
+    defineTypedNative(vm, L"打印", printNative, "(any)", systemClass);
+    defineTypedNative(vm, L"打印行", printlnNative, "(any)", systemClass);
+    defineTypedNative(vm, L"刷新", flushNative, "()", systemClass);
+    defineTypedNative(vm, L"扫描", scanNative, "()", systemClass);
+    defineTypedNative(vm, L"时钟", clockNative, "() -> num", systemClass);
+    defineTypedNative(vm, L"型", typeofNative, "(any) -> str", systemClass);
+    defineTypedNative(vm, L"快照", snapshotNative, "(str 路径)", systemClass);
+    defineTypedNative(vm, L"加载扩展", loadExtensionNative, "(str 路径)", systemClass);
+    ObjInstance* systemInstance = newInstance(vm, systemClass, true);
+    defineNativeInstance(vm, L"系统", systemInstance);
 
     // Number Core Class
-    ObjClass* numberClass = newClass(copyString(L"数字", 2));
-    defineNative(L"平方根", sqrtNative, 1, numberClass);
-    defineNative(L"次方", powNative, 2, numberClass);
-    defineNative(L"最小", minNative, 2, numberClass);
-    defineNative(L"最大", maxNative, -1, numberClass);
-    defineNative(L"四舍五入", roundNative, -1, numberClass);
-    defineNative(L"数到串", ntosNative, 1, numberClass);
-    defineNative(L"对数", logNative, -1, numberClass);
-    defineNative(L"正弦", sinNative, 1, numberClass);
-    defineNative(L"余弦", cosNative, 1, numberClass);
-    defineNative(L"正切", tanNative, 1, numberClass);
-    defineNative(L"反正弦", asinNative, 1, numberClass);
-    defineNative(L"反余弦", acosNative, 1, numberClass);
-    defineNative(L"反正切", atanNative, 1, numberClass);
-    defineNative(L"上限", ceilNative, 1, numberClass);
-    defineNative(L"下限", floorNative, 1, numberClass);
-    defineNative(L"随机", randNative, -1, numberClass);
-    ObjInstance* numberInstance = newInstance(numberClass, true);
-    defineProperty(L"圆周率", NUMBER_VAL(M_PI), numberInstance);
-    defineProperty(L"欧拉数", NUMBER_VAL(M_E), numberInstance);
-    defineProperty(L"无穷大", NUMBER_VAL(INFINITY), numberInstance);
-    defineProperty(L"不数字", NUMBER_VAL(NAN), numberInstance);
-    defineProperty(L"最大值", NUMBER_VAL(DBL_MAX), numberInstance);
-    defineProperty(L"最小值", NUMBER_VAL(DBL_MIN), numberInstance);
-    defineProperty(L"最大安全", NUMBER_VAL(9007199254740991), numberInstance);
-    defineProperty(L"最小安全", NUMBER_VAL(-9007199254740991), numberInstance);
-    defineNativeInstance(L"数字", numberInstance);
+    ObjClass* numberClass = newClass(vm, copyString(vm, L"数字", 2));
+    defineTypedNative(vm, L"平方根", sqrtNative, "(num 输入) -> num", numberClass);
+    defineTypedNative(vm, L"次方", powNative, "(num 基数, num 次方) -> num", numberClass);
+    defineTypedNative(vm, L"最小", minNative, "(num, num) -> num", numberClass);
+    defineTypedNative(vm, L"最大", maxNative, "(num, num...) -> num", numberClass);
+    defineTypedNative(vm, L"四舍五入", roundNative, "(num 输入, num 精度?) -> num", numberClass);
+    defineTypedNative(vm, L"数到串", ntosNative, "(num 输入) -> str", numberClass);
+    defineTypedNative(vm, L"对数", logNative, "(num 输入, num 底数?) -> num", numberClass);
+    defineTypedNative(vm, L"正弦", sinNative, "(num 输入) -> num", numberClass);
+    defineTypedNative(vm, L"余弦", cosNative, "(num 输入) -> num", numberClass);
+    defineTypedNative(vm, L"正切", tanNative, "(num 输入) -> num", numberClass);
+    defineTypedNative(vm, L"反正弦", asinNative, "(num 输入) -> num", numberClass);
+    defineTypedNative(vm, L"反余弦", acosNative, "(num 输入) -> num", numberClass);
+    defineTypedNative(vm, L"反正切", atanNative, "(num 输入) -> num", numberClass);
+    defineTypedNative(vm, L"上限", ceilNative, "(num 输入) -> num", numberClass);
+    defineTypedNative(vm, L"下限", floorNative, "(num 输入) -> num", numberClass);
+    defineTypedNative(vm, L"随机", randNative, "(num?, num?) -> num", numberClass);
+    ObjInstance* numberInstance = newInstance(vm, numberClass, true);
+    defineProperty(vm, L"圆周率", NUMBER_VAL(M_PI), numberInstance);
+    defineProperty(vm, L"欧拉数", NUMBER_VAL(M_E), numberInstance);
+    defineProperty(vm, L"无穷大", NUMBER_VAL(INFINITY), numberInstance);
+    defineProperty(vm, L"不数字", NUMBER_VAL(NAN), numberInstance);
+    defineProperty(vm, L"最大值", NUMBER_VAL(DBL_MAX), numberInstance);
+    defineProperty(vm, L"最小值", NUMBER_VAL(DBL_MIN), numberInstance);
+    defineProperty(vm, L"最大安全", NUMBER_VAL(9007199254740991), numberInstance);
+    defineProperty(vm, L"最小安全", NUMBER_VAL(-9007199254740991), numberInstance);
+    defineNativeInstance(vm, L"数字", numberInstance);
 
     // String Core Class
-    ObjClass* stringClass = newClass(copyString(L"字符串", 3));
-    defineNative(L"串到数", stonNative, 1, stringClass);
-    ObjInstance* stringInstance = newInstance(stringClass, true);
-    defineNativeInstance(L"字符串", stringInstance);
+    ObjClass* stringClass = newClass(vm, copyString(vm, L"字符串", 3));
+    defineTypedNative(vm, L"串到数", stonNative, "(str 输入) -> num", stringClass);
+    ObjInstance* stringInstance = newInstance(vm, stringClass, true);
+    defineNativeInstance(vm, L"字符串", stringInstance);
+
+    // Fiber Core Class
+    ObjClass* fiberClass = newClass(vm, copyString(vm, L"纤程", 2));
+    defineNative(vm, L"创建", fiberNewNative, 1, fiberClass);
+    defineTypedNative(vm, L"让出", fiberYieldNative, "(any 值?)", fiberClass);
+    ObjInstance* fiberInstance = newInstance(vm, fiberClass, true);
+    defineNativeInstance(vm, L"纤程", fiberInstance);
 }
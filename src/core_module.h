@@ -5,24 +5,31 @@
 #ifndef QI_CORE_MODULE_H
 #define QI_CORE_MODULE_H
 
+#include <locale.h>
+
 #include "common.h"
 #include "object.h"
 #include "memory.h"
 #include "vm.h"
 
 wchar_t* getType(Value value);
-bool printNative(int argCount, Value* args);
-bool printlnNative(int argCount, Value* args);
-bool scanNative(int argCount, Value* args);
-bool clockNative(__attribute__((unused)) int argCount, Value* args);
-bool sqrtNative(int argCount, Value* args);
-bool powNative(int argCount, Value* args);
-bool minNative(int argCount, Value* args);
-bool maxNative(int argCount, Value* args);
-bool roundNative(int argCount, Value* args);
-bool stonNative(int argCount, Value* args);
-bool ntosNative(int argCount, Value* args);
-bool typeofNative(int argCount, Value* args);
-void initCoreClass();
+bool nativeError(VM* vm, Value* args, wchar_t* msg, ...);
+locale_t numberLocale(void);
+bool printNative(VM* vm, int argCount, Value* args);
+bool printlnNative(VM* vm, int argCount, Value* args);
+bool flushNative(VM* vm, int argCount, Value* args);
+bool scanNative(VM* vm, int argCount, Value* args);
+bool clockNative(VM* vm, __attribute__((unused)) int argCount, Value* args);
+bool sqrtNative(VM* vm, int argCount, Value* args);
+bool powNative(VM* vm, int argCount, Value* args);
+bool minNative(VM* vm, int argCount, Value* args);
+bool maxNative(VM* vm, int argCount, Value* args);
+bool roundNative(VM* vm, int argCount, Value* args);
+bool stonNative(VM* vm, int argCount, Value* args);
+bool ntosNative(VM* vm, int argCount, Value* args);
+bool typeofNative(VM* vm, int argCount, Value* args);
+bool fiberNewNative(VM* vm, int argCount, Value* args);
+bool fiberYieldNative(VM* vm, int argCount, Value* args);
+void initCoreClass(VM* vm);
 
 #endif //QI_CORE_MODULE_H
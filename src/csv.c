@@ -0,0 +1,531 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "core_module.h"
+#include "csv.h"
+#include "memory.h"
+#include "reader.h"
+#include "scanner.h"
+
+void freeCsv(VM* vm, ObjCsv* csv) {
+    freeTable(vm, &csv->header);
+    FREE_ARRAY(vm, int, csv->slots, csv->columns);
+    FREE_ARRAY(vm, char, csv->unquoted, csv->unquotedCapacity);
+    FREE_ARRAY(vm, wchar_t, csv->chars, csv->charsCapacity);
+}
+
+static bool checkOpen(VM* vm, ObjCsv* csv, Value* args) {
+    if (csv->input == NULL) return nativeError(vm, args, L"CSV 读取器已关闭。");
+    return true;
+}
+
+// Finds the next record, reading more input until a newline outside quotes
+// turns up. The record is [*length] bytes from the input's start, and the
+// next one begins [*next] bytes in. Blank lines are skipped. [*found] is
+// false at the end of the input.
+static bool findRecord(VM* vm, ObjCsv* csv, Value* args, size_t* length, size_t* next, bool* found) {
+    ObjReader* input = csv->input;
+    size_t scanned = 0;
+    bool quoted = false;
+    bool closed = false;       // The last byte scanned ended a quote.
+    for (;;) {
+        const char* record = input->buffer + input->start;
+        size_t unread = input->end - input->start;
+        if (!csv->began) {
+            // Excel starts UTF-8 files with a byte order mark, which would
+            // otherwise end up in the first column's name.
+            if (unread < 3 && !input->ended) {
+                if (!fillReader(vm, input, args)) return false;
+                continue;
+            }
+            if (unread >= 3 && memcmp(record, "\xEF\xBB\xBF", 3) == 0) input->start += 3;
+            csv->began = true;
+            continue;
+        }
+        // Only newlines and quotes matter here, and memchr finds both
+        // faster than looking at each byte.
+        while (scanned < unread) {
+            const char* at = record + scanned;
+            size_t left = unread - scanned;
+            if (quoted) {
+                const char* quote = memchr(at, '"', left);
+                if (quote == NULL) {
+                    scanned = unread;
+                    break;
+                }
+                // A doubled quote leaves and reenters the quotes.
+                scanned = quote - record + 1;
+                quoted = false;
+                closed = true;
+                continue;
+            }
+            const char* newline = memchr(at, '\n', left);
+            const char* line = newline == NULL ? at + left : newline;
+            // Like splitRecord, only a quote that starts a field opens
+            // one. Anywhere else it is part of the text.
+            const char* quote = at;
+            while ((quote = memchr(quote, '"', line - quote)) != NULL) {
+                if (quote == record || quote[-1] == csv->delimiter || (closed && quote == at)) break;
+                quote++;
+            }
+            closed = false;
+            if (quote != NULL) {
+                scanned = quote - record + 1;
+                quoted = true;
+                continue;
+            }
+            if (newline == NULL) {
+                scanned = unread;
+                break;
+            }
+            size_t end = newline - record;
+            if (end == 0 || (end == 1 && record[0] == '\r')) {
+                // A blank line.
+                input->start += end + 1;
+                record += end + 1;
+                unread -= end + 1;
+                scanned = 0;
+                continue;
+            }
+            *length = end;
+            *next = end + 1;
+            *found = true;
+            return true;
+        }
+
+        if (input->ended) {
+            if (quoted) return nativeError(vm, args, L"CSV 第 %d 条记录的引号没有结束。", csv->records + 1);
+            *length = unread;
+            *next = unread;
+            *found = unread > 0;
+            return true;
+        }
+        if (!fillReader(vm, input, args)) return false;
+    }
+}
+
+// Whether a field is a number the way JSON writes them. Anything else,
+// including zip codes like 007, stays text.
+static bool parseNumber(const char* c, size_t length, double* number) {
+    const char* end = c + length;
+    const char* p = c;
+    if (p < end && *p == '-') p++;
+    const char* digits = p;
+    if (p < end && *p == '0') {
+        p++;
+    } else {
+        while (p < end && *p >= '0' && *p <= '9') p++;
+        if (p == digits) return false;
+    }
+
+    // Integers that fit in a double exactly skip strtod.
+    if (p == end && p - digits <= 15) {
+        int64_t integer = 0;
+        for (const char* d = digits; d < end; d++) integer = integer * 10 + (*d - '0');
+        *number = (double)(*c == '-' ? -integer : integer);
+        return true;
+    }
+    if (p < end && *p == '.') {
+        const char* fraction = ++p;
+        while (p < end && *p >= '0' && *p <= '9') p++;
+        if (p == fraction) return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) p++;
+        const char* exponent = p;
+        while (p < end && *p >= '0' && *p <= '9') p++;
+        if (p == exponent) return false;
+    }
+    if (p != end) return false;
+
+    char text[64];
+    if (length >= sizeof(text)) return false;
+    memcpy(text, c, length);
+    text[length] = '\0';
+    *number = strtod_l(text, NULL, numberLocale());
+    return true;
+}
+
+// Decodes a field into the reusable [chars] buffer and looks it up, so a
+// value seen before costs no allocation at all.
+static ObjString* decodeField(VM* vm, ObjCsv* csv, const char* bytes, size_t length) {
+    if ((int)length + 1 > csv->charsCapacity) {
+        int capacity = csv->charsCapacity < 64 ? 64 : csv->charsCapacity;
+        while (capacity < (int)length + 1) capacity *= 2;
+        csv->chars = GROW_ARRAY(vm, wchar_t, csv->chars, csv->charsCapacity, capacity);
+        csv->charsCapacity = capacity;
+    }
+
+    const unsigned char* c = (const unsigned char*)bytes;
+    const unsigned char* end = c + length;
+    wchar_t* chars = csv->chars;
+    int count = 0;
+    while (c < end) {
+        uint64_t word;
+        if (end - c >= 8 && (memcpy(&word, c, 8), (word & 0x8080808080808080ull) == 0)) {
+            for (int i = 0; i < 8; i++) chars[count + i] = c[i];
+            count += 8;
+            c += 8;
+            continue;
+        }
+        if (*c < 0x80) {
+            chars[count++] = *c++;
+            continue;
+        }
+        // The byte after a field never continues a sequence.
+        c += decodeUtf8((const char*)c, &chars[count++]);
+    }
+    return copyString(vm, chars, count);
+}
+
+// Copies a quoted field with each doubled quote made single into the
+// reusable [unquoted] buffer, followed by a zero byte.
+static size_t unquote(VM* vm, ObjCsv* csv, const char* bytes, size_t length) {
+    if (length + 1 > csv->unquotedCapacity) {
+        size_t capacity = csv->unquotedCapacity < 64 ? 64 : csv->unquotedCapacity;
+        while (capacity < length + 1) capacity *= 2;
+        csv->unquoted = GROW_ARRAY(vm, char, csv->unquoted, csv->unquotedCapacity, capacity);
+        csv->unquotedCapacity = capacity;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++) {
+        csv->unquoted[count++] = bytes[i];
+        if (bytes[i] == '"') i++;
+    }
+    csv->unquoted[count] = '\0';
+    return count;
+}
+
+typedef struct {
+    ObjList* list;             // The fields, without a header.
+    ObjInstance* instance;     // The fields, with a header.
+    ObjBytes* bytes;           // A copy of the record that raw fields slice.
+    const char* record;
+} Row;
+
+static bool addField(VM* vm, ObjCsv* csv, Row* row, int column, const char* bytes, size_t length,
+                     bool unquoted, bool text, Value* args) {
+    Value value;
+    double number;
+    if (!text && csv->numbers && parseNumber(bytes, length, &number)) {
+        value = NUMBER_VAL(number);
+    } else if (!text && csv->raw) {
+        value = unquoted ? OBJ_VAL(copyBytes(vm, bytes, length))
+                         : OBJ_VAL(sliceBytes(vm, row->bytes, (size_t)(bytes - row->record), length));
+    } else {
+        value = OBJ_VAL(decodeField(vm, csv, bytes, length));
+    }
+
+    if (row->instance == NULL) {
+        insertToList(vm, row->list, value, row->list->count);
+        return true;
+    }
+    if (column >= csv->columns) {
+        return nativeError(vm, args, L"CSV 第 %d 条记录的列比表头多。", csv->records);
+    }
+    row->instance->fields.entries[csv->slots[column]].value = value;
+    return true;
+}
+
+// Splits a record into fields. [text] keeps every field a string, for
+// headers.
+static bool splitRecord(VM* vm, ObjCsv* csv, Row* row, const char* record, size_t length, bool text, Value* args) {
+    if (length > 0 && record[length - 1] == '\r') length--;
+    const char* c = record;
+    const char* end = record + length;
+    char delimiter = csv->delimiter;
+    row->record = record;
+
+    for (int column = 0;; column++) {
+        if (c < end && *c == '"') {
+            const char* start = c + 1;
+            const char* quote = start;
+            bool doubled = false;
+            for (;;) {
+                quote = memchr(quote, '"', end - quote);
+                if (quote == NULL) return nativeError(vm, args, L"CSV 第 %d 条记录的引号没有结束。", csv->records);
+                if (quote + 1 < end && quote[1] == '"') {
+                    doubled = true;
+                    quote += 2;
+                    continue;
+                }
+                break;
+            }
+            c = quote + 1;
+            if (c < end && *c != delimiter) {
+                return nativeError(vm, args, L"CSV 第 %d 条记录的引号后需要分隔符。", csv->records);
+            }
+            bool added;
+            if (doubled) {
+                size_t size = unquote(vm, csv, start, quote - start);
+                added = addField(vm, csv, row, column, csv->unquoted, size, true, text, args);
+            } else {
+                added = addField(vm, csv, row, column, start, quote - start, false, text, args);
+            }
+            if (!added) return false;
+        } else {
+            const char* stop = memchr(c, delimiter, end - c);
+            if (stop == NULL) stop = end;
+            if (!addField(vm, csv, row, column, c, stop - c, false, text, args)) return false;
+            c = stop;
+        }
+        if (c == end) return true;
+        c++;
+    }
+}
+
+// Reads the next record into args[-1] as a list, or an instance once a
+// header has been read. [text] reads every field as a string.
+static bool readRecord(VM* vm, ObjCsv* csv, bool text, Value* args) {
+    if (!checkOpen(vm, csv, args)) return false;
+    size_t length, next;
+    bool found;
+    if (!findRecord(vm, csv, args, &length, &next, &found)) return false;
+    if (!found) {
+        args[-1] = NIL_VAL;
+        return true;
+    }
+    if (length > INT_MAX) return nativeError(vm, args, L"CSV 第 %d 条记录太长。", csv->records + 1);
+
+    ObjReader* input = csv->input;
+    const char* record = input->buffer + input->start;
+    input->start += next;
+    csv->records++;
+
+    // The row and everything in it stay live, so nothing made here needs
+    // to be rooted while it is built.
+    vm->gcPaused++;
+    Row row;
+    row.list = NULL;
+    row.instance = NULL;
+    row.bytes = NULL;
+    if (csv->columns > 0 && !text) {
+        row.instance = newInstance(vm, csv->rowClass, false);
+        tableCopy(vm, &csv->header, &row.instance->fields);
+    } else {
+        row.list = newList(vm);
+    }
+    if (csv->raw && !text) row.bytes = copyBytes(vm, record, length);
+    bool split = splitRecord(vm, csv, &row, record, length, text, args);
+    if (split) args[-1] = row.instance != NULL ? OBJ_VAL(row.instance) : OBJ_VAL(row.list);
+    resumeGC(vm);
+    return split;
+}
+
+// 下一个（） returns the next row, or 空 once there are none.
+static bool nextNative(VM* vm, int argCount, Value* args) {
+    return readRecord(vm, AS_CSV(args[-1]), false, args);
+}
+
+// 完成（） returns whether every row has been read.
+static bool doneNative(VM* vm, int argCount, Value* args) {
+    ObjCsv* csv = AS_CSV(args[-1]);
+    if (csv->input == NULL) {
+        args[-1] = BOOL_VAL(true);
+        return true;
+    }
+    size_t length, next;
+    bool found;
+    if (!findRecord(vm, csv, args, &length, &next, &found)) return false;
+    args[-1] = BOOL_VAL(!found);
+    return true;
+}
+
+// 表头（） reads the next row as column names and returns them. Later rows
+// are CSV。行 instances with a field for each column.
+static bool headerNative(VM* vm, int argCount, Value* args) {
+    ObjCsv* csv = AS_CSV(args[-1]);
+    // Keep the reader reachable once the names replace it in args[-1].
+    push(vm, args[-1]);
+    bool read = readRecord(vm, csv, true, args);
+    pop(vm);
+    if (!read) return false;
+    if (IS_NIL(args[-1])) return nativeError(vm, args, L"CSV 没有表头。");
+    ObjList* names = AS_LIST(args[-1]);
+    push(vm, OBJ_VAL(csv));
+
+    freeTable(vm, &csv->header);
+    FREE_ARRAY(vm, int, csv->slots, csv->columns);
+    csv->slots = NULL;
+    csv->columns = 0;
+    for (int i = 0; i < names->count; i++) {
+        tableSet(vm, &csv->header, AS_STRING(names->items[i]), NIL_VAL);
+    }
+    int* slots = ALLOCATE(vm, int, names->count);
+    for (int i = 0; i < names->count; i++) {
+        for (int slot = 0; slot < csv->header.capacity; slot++) {
+            if (csv->header.entries[slot].key == AS_STRING(names->items[i])) {
+                slots[i] = slot;
+                break;
+            }
+        }
+    }
+    csv->slots = slots;
+    csv->columns = names->count;
+    pop(vm);
+    return true;
+}
+
+// 转数字（） makes fields written as numbers come back as numbers.
+static bool numbersNative(VM* vm, int argCount, Value* args) {
+    AS_CSV(args[-1])->numbers = true;
+    return true;
+}
+
+// 原始（） makes fields come back as 字节, sliced from one copy of each
+// record, instead of being decoded and interned as strings.
+static bool rawNative(VM* vm, int argCount, Value* args) {
+    AS_CSV(args[-1])->raw = true;
+    return true;
+}
+
+static bool closeNative(VM* vm, int argCount, Value* args) {
+    ObjCsv* csv = AS_CSV(args[-1]);
+    if (csv->input != NULL) closeReader(vm, csv->input);
+    csv->input = NULL;
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+typedef struct {
+    const wchar_t* name;
+    NativeFn function;
+    int arity;
+} CsvMethod;
+
+static const CsvMethod csvMethods[] = {
+    {L"下一个", nextNative, 0},
+    {L"完成", doneNative, 0},
+    {L"表头", headerNative, 0},
+    {L"转数字", numbersNative, 0},
+    {L"原始", rawNative, 0},
+    {L"关闭", closeNative, 0},
+};
+
+bool findCsvMethod(ObjString* name, NativeFn* function, int* arity) {
+    for (size_t i = 0; i < sizeof(csvMethods) / sizeof(csvMethods[0]); i++) {
+        if (wcscmp(name->chars, csvMethods[i].name) == 0) {
+            *function = csvMethods[i].function;
+            *arity = csvMethods[i].arity;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Checks the optional delimiter after the first argument, a comma unless
+// given.
+static bool getDelimiter(VM* vm, int argCount, Value* args, char* delimiter) {
+    if (argCount < 1 || argCount > 2) {
+        return nativeError(vm, args, L"需要 1 到 2 个参数，但得到 %d。", argCount);
+    }
+    *delimiter = ',';
+    if (argCount == 1) return true;
+    // Escapes leave a string's length as written, so measure to the end.
+    if (!IS_STRING(args[1]) || wcsnlen(AS_STRING(args[1])->chars, AS_STRING(args[1])->length) != 1) {
+        return nativeError(vm, args, L"参数 2（分隔符）必须是一个字符。");
+    }
+    wchar_t c = AS_STRING(args[1])->chars[0];
+    if (c >= 0x80 || c == L'"' || c == L'\n' || c == L'\r') {
+        return nativeError(vm, args, L"分隔符必须是引号和换行以外的 ASCII 字符。");
+    }
+    *delimiter = (char)c;
+    return true;
+}
+
+// The interned name is already in the table, so this doesn't allocate.
+static ObjClass* getRowClass(VM* vm, Value csvInstance) {
+    Value rowClass = NIL_VAL;
+    if (IS_INSTANCE(csvInstance)) {
+        tableGet(&AS_INSTANCE(csvInstance)->fields, copyString(vm, L"行", 1), &rowClass);
+    }
+    return IS_CLASS(rowClass) ? AS_CLASS(rowClass) : NULL;
+}
+
+// CSV。打开（路径，分隔符） reads rows from a file as they are asked for.
+static bool openNative(VM* vm, int argCount, Value* args) {
+    char delimiter;
+    if (!getDelimiter(vm, argCount, args, &delimiter)) return false;
+    ObjClass* rowClass = getRowClass(vm, args[-1]);
+    if (rowClass == NULL) return nativeError(vm, args, L"「CSV。行」必须是一个类。");
+    if (!IS_STRING(args[0])) {
+        return nativeError(vm, args, L"参数 1（路径）的类型必须是「字符串」，而不是「%ls」。", getType(args[0]));
+    }
+    char path[PATH_MAX];
+    if (!encodePath(AS_STRING(args[0]), path)) {
+        return nativeError(vm, args, L"无效的路径。");
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nativeError(vm, args, L"无法打开文件「%ls」：%s。", AS_STRING(args[0])->chars, strerror(errno));
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    ObjReader* input = newReader(vm, fd, true);
+    push(vm, OBJ_VAL(input));
+    ObjCsv* csv = newCsv(vm, input, rowClass, delimiter);
+    pop(vm);
+    args[-1] = OBJ_VAL(csv);
+    return true;
+}
+
+// CSV。解析（文本，分隔符） reads rows from a string or a 字节 of UTF-8.
+static bool parseNative(VM* vm, int argCount, Value* args) {
+    char delimiter;
+    if (!getDelimiter(vm, argCount, args, &delimiter)) return false;
+    ObjClass* rowClass = getRowClass(vm, args[-1]);
+    if (rowClass == NULL) return nativeError(vm, args, L"「CSV。行」必须是一个类。");
+
+    ObjReader* input;
+    if (IS_BYTES(args[0])) {
+        ObjBytes* bytes = AS_BYTES(args[0]);
+        input = textReader(vm, (const char*)bytesData(bytes), bytes->count);
+    } else if (IS_STRING(args[0])) {
+        ObjString* string = AS_STRING(args[0]);
+        int length = (int)wcsnlen(string->chars, string->length);
+        size_t size = utf8Size(string->chars, length);
+        char* text = (char*)malloc(size + 1);
+        if (text == NULL) exit(1);
+        encodeUtf8(string->chars, length, (uint8_t*)text);
+        input = textReader(vm, text, size);
+        free(text);
+    } else {
+        return nativeError(vm, args, L"参数 1（文本）的类型必须是「字符串」或「字节」，而不是「%ls」。", getType(args[0]));
+    }
+    push(vm, OBJ_VAL(input));
+    ObjCsv* csv = newCsv(vm, input, rowClass, delimiter);
+    pop(vm);
+    args[-1] = OBJ_VAL(csv);
+    return true;
+}
+
+void initCsvClass(VM* vm) {
+    push(vm, OBJ_VAL(copyString(vm, L"CSV", 3)));
+    ObjClass* csvClass = newClass(vm, AS_STRING(vm->fiber->stackTop[-1]));
+    pop(vm);
+    push(vm, OBJ_VAL(csvClass));
+    defineNative(vm, L"打开", openNative, -1, csvClass);
+    defineNative(vm, L"解析", parseNative, -1, csvClass);
+    ObjInstance* csvInstance = newInstance(vm, csvClass, true);
+    pop(vm);
+    push(vm, OBJ_VAL(csvInstance));
+
+    // The class of rows read after a header, kept where 打开 can find it.
+    push(vm, OBJ_VAL(copyString(vm, L"行", 1)));
+    ObjClass* rowClass = newClass(vm, AS_STRING(vm->fiber->stackTop[-1]));
+    pop(vm);
+    push(vm, OBJ_VAL(rowClass));
+    defineProperty(vm, L"行", OBJ_VAL(rowClass), csvInstance);
+    pop(vm);
+    defineNativeInstance(vm, L"CSV", csvInstance);
+    pop(vm);
+}
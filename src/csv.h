@@ -0,0 +1,16 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_CSV_H
+#define QI_CSV_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+void initCsvClass(VM* vm);
+bool findCsvMethod(ObjString* name, NativeFn* function, int* arity);
+void freeCsv(VM* vm, ObjCsv* csv);
+
+#endif //QI_CSV_H
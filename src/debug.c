@@ -33,6 +33,15 @@ static int invokeInstruction(const wchar_t* name, Chunk* chunk, int offset) {
     return offset + 3;
 }
 
+static int memberInstruction(const wchar_t* name, Chunk* chunk, int offset) {
+    uint8_t constant = chunk->code[offset + 1];
+    uint8_t slot = chunk->code[offset + 2];
+    wprintf(L"%-16ls %4d '", name, constant);
+    printValue(chunk->constants.values[constant]);
+    wprintf(L"' -> %d\n", slot);
+    return offset + 3;
+}
+
 static int simpleInstruction(const wchar_t* name, int offset) {
     wprintf(L"%ls\n", name);
     return offset + 1;
@@ -158,12 +167,24 @@ int disassembleInstruction(Chunk* chunk, int offset) {
             return simpleInstruction(L"OP_CLOSE_UPVALUE", offset);
         case OP_RETURN:
             return simpleInstruction(L"OP_RETURN", offset);
+        case OP_YIELD:
+            return simpleInstruction(L"OP_YIELD", offset);
         case OP_CLASS:
             return constantInstruction(L"OP_CLASS", chunk, offset);
         case OP_INHERIT:
             return simpleInstruction(L"OP_INHERIT", offset);
         case OP_METHOD:
             return constantInstruction(L"OP_METHOD", chunk, offset);
+        case OP_GET_MODULE:
+            return byteInstruction(L"OP_GET_MODULE", chunk, offset);
+        case OP_DEFINE_MODULE:
+            return byteInstruction(L"OP_DEFINE_MODULE", chunk, offset);
+        case OP_SET_MODULE:
+            return byteInstruction(L"OP_SET_MODULE", chunk, offset);
+        case OP_GET_MODULE_MEMBER:
+            return memberInstruction(L"OP_GET_MODULE_MEMBER", chunk, offset);
+        case OP_IMPORT:
+            return constantInstruction(L"OP_IMPORT", chunk, offset);
         default:
             wprintf(L"Unknown opcode %d\n", instruction);
             return offset + 1;
@@ -0,0 +1,490 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#include <dlfcn.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytes.h"
+#include "core_module.h"
+#include "embed.h"
+#include "memory.h"
+#include "qi.h"
+
+#define TEXT_BLOCK 65536
+
+struct QiHandle {
+    Value value;
+    QiHandle* previous;
+    QiHandle* next;
+};
+
+// Strings handed back to the host are written into blocks that never move,
+// so the later results of a batch don't invalidate the earlier ones.
+typedef struct TextBlock {
+    struct TextBlock* next;
+    size_t used;
+    size_t capacity;
+    char chars[];
+} TextBlock;
+
+struct Host {
+    QiHandle* handles;
+    TextBlock* text;   // The block being filled, followed by the full ones.
+    int depth;         // Extension natives under way.
+    ValueArray made;   // Foreign objects not yet returned to the VM.
+    ValueArray results;   // Foreign objects the last calls returned to the host.
+    QiBudgetFn onBudget;
+    void* budgetData;
+};
+
+static Host* getHost(VM* vm) {
+    if (vm->host == NULL) {
+        vm->host = (Host*)calloc(1, sizeof(Host));
+        if (vm->host == NULL) exit(1);
+        initValueArray(&vm->host->made);
+        initValueArray(&vm->host->results);
+    }
+    return vm->host;
+}
+
+void markHost(VM* vm) {
+    if (vm->host == NULL) return;
+    for (QiHandle* handle = vm->host->handles; handle != NULL; handle = handle->next) {
+        markValue(vm, handle->value);
+    }
+    for (int i = 0; i < vm->host->made.count; i++) {
+        markValue(vm, vm->host->made.values[i]);
+    }
+    for (int i = 0; i < vm->host->results.count; i++) {
+        markValue(vm, vm->host->results.values[i]);
+    }
+}
+
+void freeHost(VM* vm) {
+    Host* host = vm->host;
+    if (host == NULL) return;
+    while (host->handles != NULL) {
+        QiHandle* next = host->handles->next;
+        free(host->handles);
+        host->handles = next;
+    }
+    while (host->text != NULL) {
+        TextBlock* next = host->text->next;
+        free(host->text);
+        host->text = next;
+    }
+    freeValueArray(vm, &host->made);
+    freeValueArray(vm, &host->results);
+    free(host);
+    vm->host = NULL;
+}
+
+// Lets the strings of the next call reuse the newest block.
+static void resetText(Host* host) {
+    if (host->text == NULL) return;
+    while (host->text->next != NULL) {
+        TextBlock* next = host->text->next->next;
+        free(host->text->next);
+        host->text->next = next;
+    }
+    host->text->used = 0;
+}
+
+// Frees the text written since the newest block was [block] with [used]
+// bytes in it, keeping one block for next time.
+static void releaseText(Host* host, TextBlock* block, size_t used) {
+    while (host->text != block && !(block == NULL && host->text->next == NULL)) {
+        TextBlock* next = host->text->next;
+        free(host->text);
+        host->text = next;
+    }
+    if (host->text != NULL) host->text->used = block == NULL ? 0 : used;
+}
+
+static char* allocateText(Host* host, size_t size) {
+    TextBlock* block = host->text;
+    if (block == NULL || block->capacity - block->used < size) {
+        size_t capacity = size > TEXT_BLOCK ? size : TEXT_BLOCK;
+        block = (TextBlock*)malloc(sizeof(TextBlock) + capacity);
+        if (block == NULL) exit(1);
+        block->next = host->text;
+        block->used = 0;
+        block->capacity = capacity;
+        host->text = block;
+    }
+    char* chars = block->chars + block->used;
+    block->used += size;
+    return chars;
+}
+
+static QiHandle* newHandle(VM* vm, Value value) {
+    Host* host = getHost(vm);
+    QiHandle* handle = (QiHandle*)malloc(sizeof(QiHandle));
+    if (handle == NULL) exit(1);
+    handle->value = value;
+    handle->previous = NULL;
+    handle->next = host->handles;
+    if (host->handles != NULL) host->handles->previous = handle;
+    host->handles = handle;
+    return handle;
+}
+
+static ObjForeign* foreignOf(void* data) {
+    return (ObjForeign*)((uint8_t*)data - offsetof(ObjForeign, data));
+}
+
+// Strings are allocated, so the caller pauses the GC until the result is
+// somewhere it can see.
+static Value toValue(VM* vm, QiValue value) {
+    switch (value.type) {
+        case QI_BOOL: return BOOL_VAL(value.as.boolean);
+        case QI_NUMBER: return NUMBER_VAL(value.as.number);
+        case QI_STRING:
+            return OBJ_VAL(copyUtf8(vm, value.as.string.chars, (int)value.as.string.length));
+        case QI_HANDLE: return value.as.handle->value;
+        case QI_FOREIGN: return OBJ_VAL(foreignOf(value.as.foreign.data));
+        default: return NIL_VAL;
+    }
+}
+
+static QiValue fromValue(VM* vm, Value value) {
+    if (IS_NIL(value)) return qiNil();
+    if (IS_BOOL(value)) return qiBool(AS_BOOL(value));
+    if (IS_NUMBER(value)) return qiNumber(AS_NUMBER(value));
+    if (IS_STRING(value)) {
+        // Strings made by some methods count their terminator in [length].
+        ObjString* string = AS_STRING(value);
+        int length = (int)wcsnlen(string->chars, string->length);
+        QiValue result = {.type = QI_STRING};
+        result.as.string.length = utf8Size(string->chars, length);
+        char* chars = allocateText(getHost(vm), result.as.string.length);
+        encodeUtf8(string->chars, length, (uint8_t*)chars);
+        result.as.string.chars = chars;
+        return result;
+    }
+    if (IS_FOREIGN(value)) {
+        QiValue result = {.type = QI_FOREIGN};
+        result.as.foreign.data = AS_FOREIGN(value)->data;
+        result.as.foreign.type = AS_FOREIGN(value)->type;
+        return result;
+    }
+    return qiHandle(newHandle(vm, value));
+}
+
+QiVM* qiNewVM(void) {
+    return newVM();
+}
+
+void qiFreeVM(QiVM* vm) {
+    freeVM(vm);
+}
+
+static QiResult toResult(InterpretResult result) {
+    switch (result) {
+        case INTERPRET_OK: return QI_OK;
+        case INTERPRET_COMPILE_ERROR: return QI_COMPILE_ERROR;
+        case INTERPRET_PAUSED: return QI_PAUSED;
+        default: return QI_RUNTIME_ERROR;
+    }
+}
+
+QiResult qiRun(QiVM* vm, const char* source, const char* path) {
+    return toResult(interpret(vm, source, path));
+}
+
+QiResult qiResume(QiVM* vm) {
+    return toResult(continueInterpret(vm));
+}
+
+static BudgetAction onBudget(VM* vm, void* data) {
+    Host* host = (Host*)data;
+    switch (host->onBudget(vm, host->budgetData)) {
+        case QI_BUDGET_CONTINUE: return BUDGET_CONTINUE;
+        case QI_BUDGET_PAUSE: return BUDGET_PAUSE;
+        case QI_BUDGET_YIELD: return BUDGET_YIELD;
+        default: return BUDGET_ABORT;
+    }
+}
+
+void qiSetBudget(QiVM* vm, long long budget, QiBudgetFn callback, void* data) {
+    Host* host = getHost(vm);
+    host->onBudget = callback;
+    host->budgetData = data;
+    setBudget(vm, budget > 0 ? budget : 0, callback == NULL ? NULL : onBudget, host);
+}
+
+QiHandle* qiCompile(QiVM* vm, const char* source, const char* path) {
+    ObjFunction* function = compileSource(vm, source, path);
+    if (function == NULL) return NULL;
+    push(vm, OBJ_VAL(function));
+    ObjClosure* closure = newClosure(vm, function);
+    pop(vm);
+    return newHandle(vm, OBJ_VAL(closure));
+}
+
+QiHandle* qiGetGlobal(QiVM* vm, const char* name) {
+    Value value;
+    if (!tableGet(&vm->globals, copyUtf8(vm, name, (int)strlen(name)), &value)) return NULL;
+    return newHandle(vm, value);
+}
+
+QiHandle* qiHold(QiVM* vm, QiValue value) {
+    vm->gcPaused++;
+    QiHandle* handle = newHandle(vm, toValue(vm, value));
+    resumeGC(vm);
+    return handle;
+}
+
+void qiRelease(QiVM* vm, QiHandle* handle) {
+    if (handle->previous != NULL) {
+        handle->previous->next = handle->next;
+    } else {
+        vm->host->handles = handle->next;
+    }
+    if (handle->next != NULL) handle->next->previous = handle->previous;
+    free(handle);
+}
+
+// Checks once what every call in a batch would otherwise check again.
+static ObjClosure* checkFunction(QiHandle* function, int argCount) {
+    if (!IS_CLOSURE(function->value)) {
+        fwprintf(stderr, L"只能调用功能。\n");
+        return NULL;
+    }
+    ObjClosure* closure = AS_CLOSURE(function->value);
+    if (argCount != closure->function->arity) {
+        fwprintf(stderr, L"需要 %d 个参数，但得到 %d。\n", closure->function->arity, argCount);
+        return NULL;
+    }
+    return closure;
+}
+
+// The arguments are converted with the GC paused and then go straight onto
+// the stack, where it finds them.
+static InterpretResult callOnce(VM* vm, ObjClosure* closure, int argCount, const QiValue* args, Value* result) {
+    Value values[UINT8_COUNT];
+    vm->gcPaused++;
+    for (int i = 0; i < argCount; i++) {
+        values[i] = toValue(vm, args[i]);
+    }
+    vm->gcPaused--;
+    return runClosure(vm, closure, result, values, argCount);
+}
+
+QiResult qiCall(QiVM* vm, QiHandle* function, int argCount, const QiValue* args, QiValue* result) {
+    return qiCallBatch(vm, function, argCount, args, 1, result);
+}
+
+QiResult qiCallBatch(QiVM* vm, QiHandle* function, int argCount, const QiValue* args,
+                     int count, QiValue* results) {
+    for (int i = 0; i < count; i++) {
+        results[i] = qiNil();
+    }
+    ObjClosure* closure = checkFunction(function, argCount);
+    if (closure == NULL) return QI_RUNTIME_ERROR;
+    // Called back from an extension native, whose strings are still needed.
+    Host* host = getHost(vm);
+    if (host->depth == 0) resetText(host);
+
+    int previous = host->results.count;
+    QiResult status = QI_OK;
+    for (int i = 0; i < count; i++) {
+        Value result;
+        status = toResult(callOnce(vm, closure, argCount, args + (size_t)i * argCount, &result));
+        if (status != QI_OK) break;
+        results[i] = fromValue(vm, result);
+        // The host reads the data of a foreign result directly, so it's
+        // kept alive like the strings are.
+        if (IS_FOREIGN(result)) {
+            vm->gcPaused++;
+            writeValueArray(vm, &host->results, result);
+            resumeGC(vm);
+        }
+    }
+    if (host->depth == 0) {
+        // The foreign objects the host made for the arguments are done
+        // with, and so are the results of the calls before this one, which
+        // it may have passed back as arguments.
+        host->made.count = 0;
+        int kept = host->results.count - previous;
+        memmove(host->results.values, host->results.values + previous, kept * sizeof(Value));
+        host->results.count = kept;
+    }
+    return status;
+}
+
+// Natives can be defined on extensions and on their classes, which are
+// static instances, and on foreign classes.
+static ObjClass* targetClass(QiHandle* target) {
+    if (IS_INSTANCE(target->value)) return AS_INSTANCE(target->value)->klass;
+    if (IS_CLASS(target->value) && AS_CLASS(target->value)->foreign != NULL) return AS_CLASS(target->value);
+    return NULL;
+}
+
+bool qiDefineNative(QiVM* vm, QiHandle* target, const char* name, const char* signature,
+                    QiNativeFn function) {
+    ObjClass* klass = targetClass(target);
+    if (klass == NULL) return false;
+    Signature* parsed = newSignature(vm, signature);
+    if (parsed == NULL) return false;
+    // A native can't tell how many arguments a rest parameter got.
+    if (parsed->rest) {
+        freeSignature(vm, parsed);
+        return false;
+    }
+
+    push(vm, OBJ_VAL(copyUtf8(vm, name, (int)strlen(name))));
+    ObjNative* native = newNative(vm, NULL, signatureArity(parsed));
+    native->signature = parsed;
+    native->extension = (void*)function;
+    push(vm, OBJ_VAL(native));
+    tableSet(vm, &klass->methods, AS_STRING(vm->fiber->stackTop[-2]), vm->fiber->stackTop[-1]);
+    pop(vm);
+    pop(vm);
+    return true;
+}
+
+QiHandle* qiDefineClass(QiVM* vm, QiHandle* target, const char* name) {
+    if (!IS_INSTANCE(target->value)) return NULL;
+    ObjString* string = copyUtf8(vm, name, (int)strlen(name));
+    push(vm, OBJ_VAL(string));
+    push(vm, OBJ_VAL(newClass(vm, string)));
+    ObjInstance* instance = newInstance(vm, AS_CLASS(vm->fiber->stackTop[-1]), true);
+    push(vm, OBJ_VAL(instance));
+    tableSet(vm, &AS_INSTANCE(target->value)->fields, string, OBJ_VAL(instance));
+    QiHandle* handle = newHandle(vm, OBJ_VAL(instance));
+    vm->fiber->stackTop -= 3;
+    return handle;
+}
+
+QiHandle* qiDefineForeignClass(QiVM* vm, const char* name, const QiForeignClass* type) {
+    push(vm, OBJ_VAL(copyUtf8(vm, name, (int)strlen(name))));
+    ObjClass* klass = newClass(vm, AS_STRING(vm->fiber->stackTop[-1]));
+    klass->foreign = type;
+    QiHandle* handle = newHandle(vm, OBJ_VAL(klass));
+    pop(vm);
+    return handle;
+}
+
+QiValue qiNewForeign(QiVM* vm, QiHandle* klass) {
+    ObjClass* foreignClass = AS_CLASS(klass->value);
+    Host* host = getHost(vm);
+    vm->gcPaused++;
+    ObjForeign* foreign = newForeign(vm, foreignClass, foreignClass->foreign->size);
+    writeValueArray(vm, &host->made, OBJ_VAL(foreign));
+    resumeGC(vm);
+    return fromValue(vm, OBJ_VAL(foreign));
+}
+
+void qiMark(QiVM* vm, QiValue value) {
+    if (value.type == QI_FOREIGN) {
+        markObject(vm, (Obj*)foreignOf(value.as.foreign.data));
+    } else if (value.type == QI_HANDLE) {
+        markValue(vm, value.as.handle->value);
+    }
+}
+
+// Calls an extension native whose arguments the VM has checked. Handles
+// and strings made for the arguments only last until it returns.
+bool callExtension(VM* vm, ObjNative* native, int argCount, Value* args) {
+    Host* host = getHost(vm);
+    TextBlock* block = host->text;
+    size_t used = block == NULL ? 0 : block->used;
+    int made = host->made.count;
+    int returned = host->results.count;
+    // The object a foreign class's native is called on goes before the
+    // arguments, where the VM keeps it too.
+    QiValue values[SIGNATURE_MAX + 1];
+    values[0] = IS_FOREIGN(args[-1]) ? fromValue(vm, args[-1]) : qiNil();
+    for (int i = 0; i < argCount; i++) {
+        values[i + 1] = fromValue(vm, args[i]);
+    }
+    // Optional parameters left out are 空.
+    for (int i = argCount; i < native->signature->count; i++) {
+        values[i + 1] = qiNil();
+    }
+
+    // A call back into the VM may grow the stack, so find [args] again after.
+    ObjFiber* fiber = vm->fiber;
+    ptrdiff_t base = args - fiber->stack;
+    QiValue result = qiNil();
+    host->depth++;
+    bool succeeded = ((QiNativeFn)native->extension)(vm, values + 1, &result);
+    host->depth--;
+    args = fiber->stack + base;
+
+    // A runtime error in a call back into the VM has unwound the stack.
+    if (vm->fiber->frameCount == 0) {
+        succeeded = false;
+    } else if (!succeeded) {
+        if (result.type == QI_STRING) {
+            args[-1] = toValue(vm, result);
+        } else {
+            nativeError(vm, args, L"扩展功能失败了。");
+        }
+    } else {
+        vm->gcPaused++;
+        Value value = toValue(vm, result);
+        uint8_t type = native->signature->result;
+        if (hasParamType(value, type)) {
+            args[-1] = value;
+        } else {
+            succeeded = nativeError(vm, args, L"扩展功能返回的类型必须是「%ls」，而不是「%ls」。",
+                                    paramTypeName(type), getType(value));
+        }
+        resumeGC(vm);
+    }
+
+    for (int i = 1; i <= argCount; i++) {
+        if (values[i].type == QI_HANDLE) qiRelease(vm, values[i].as.handle);
+    }
+    host->made.count = made;
+    host->results.count = returned;
+    releaseText(host, block, used);
+    return succeeded;
+}
+
+// 系统。加载扩展（路径）opens a shared library and has it define its
+// natives on a fresh instance, which it returns.
+bool loadExtensionNative(VM* vm, int argCount, Value* args) {
+    ObjString* path = AS_STRING(args[0]);
+    int length = (int)wcsnlen(path->chars, path->length);
+    size_t size = utf8Size(path->chars, length);
+    char* name = (char*)malloc(size + 1);
+    if (name == NULL) exit(1);
+    encodeUtf8(path->chars, length, (uint8_t*)name);
+    name[size] = '\0';
+    void* library = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+    free(name);
+    if (library == NULL) return nativeError(vm, args, L"无法加载扩展「%ls」。", path->chars);
+
+    bool (*init)(QiVM*, QiHandle*) = (bool (*)(QiVM*, QiHandle*))dlsym(library, "qiExtensionInit");
+    if (init == NULL) {
+        dlclose(library);
+        return nativeError(vm, args, L"扩展「%ls」没有 qiExtensionInit。", path->chars);
+    }
+
+    ObjClass* klass = newClass(vm, path);
+    push(vm, OBJ_VAL(klass));
+    ObjInstance* instance = newInstance(vm, klass, true);
+    push(vm, OBJ_VAL(instance));
+    ObjFiber* fiber = vm->fiber;
+    ptrdiff_t base = args - fiber->stack;
+    QiHandle* handle = newHandle(vm, OBJ_VAL(instance));
+    bool succeeded = init(vm, handle);
+    qiRelease(vm, handle);
+    if (vm->fiber->frameCount == 0) return false;
+
+    args = fiber->stack + base;
+    vm->fiber->stackTop -= 2;
+    if (!succeeded) {
+        dlclose(library);
+        return nativeError(vm, args, L"扩展「%ls」初始化失败。", path->chars);
+    }
+    args[-1] = OBJ_VAL(instance);
+    return true;
+}
@@ -0,0 +1,19 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_EMBED_H
+#define QI_EMBED_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+typedef struct Host Host;
+
+void markHost(VM* vm);
+void freeHost(VM* vm);
+bool callExtension(VM* vm, ObjNative* native, int argCount, Value* args);
+bool loadExtensionNative(VM* vm, int argCount, Value* args);
+
+#endif //QI_EMBED_H
@@ -0,0 +1,789 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#define _GNU_SOURCE
+
+#include "event_loop.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+#include "bytes.h"
+#include "memory.h"
+#include "core_module.h"
+
+#define READ_CHUNK 4096
+#define MAX_EVENTS 64
+
+typedef enum {
+    WAIT_READ,
+    WAIT_WRITE,
+    WAIT_SLEEP,
+    WAIT_TIMER,
+    WAIT_PROCESS,
+} WaitKind;
+
+// Something a fiber (or a timer callback) is waiting on. Each wait owns
+// exactly one registration with epoll.
+typedef struct Wait {
+    WaitKind kind;
+    int fd;                 // The fd registered with epoll.
+    int target;             // The fd being read or written, or the child pid.
+    bool ownsFd;            // Close [fd] when the wait completes.
+    ObjFiber* fiber;        // Fiber to resume, or NULL for timer callbacks.
+    ObjClosure* callback;   // Closure to start when a timer fires.
+    char* bytes;            // Encoded data still to be written.
+    size_t length;          // Excluding the terminator encodeString adds.
+    size_t offset;
+    struct Wait* next;
+} Wait;
+
+typedef struct {
+    ObjFiber* fiber;
+    Value value;
+} ReadyTask;
+
+// A multibyte sequence cut off at the end of a read, kept until the next
+// read from the same fd completes it.
+typedef struct Pending {
+    int fd;
+    int count;
+    char bytes[4];
+    struct Pending* next;
+} Pending;
+
+struct EventLoop {
+    int epollFd;
+    bool running;
+    ObjFiber* owner;   // The fiber that called 事件。运行.
+    Wait* waits;
+    ReadyTask* ready;
+    int readyCount;
+    int readyCapacity;
+    Pending* pending;
+};
+
+static EventLoop* getLoop(VM* vm) {
+    if (vm->eventLoop != NULL) return vm->eventLoop;
+
+    EventLoop* loop = ALLOCATE(vm, EventLoop, 1);
+    loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    loop->running = false;
+    loop->owner = NULL;
+    loop->waits = NULL;
+    loop->ready = NULL;
+    loop->readyCount = 0;
+    loop->readyCapacity = 0;
+    loop->pending = NULL;
+    vm->eventLoop = loop;
+    return loop;
+}
+
+// Whether the running fiber is a task driven directly by 事件。运行, and so
+// may suspend instead of blocking the whole process.
+static bool canSuspend(VM* vm) {
+    EventLoop* loop = vm->eventLoop;
+    return loop != NULL && loop->running && vm->fiber->caller == loop->owner &&
+           vm->fiber->nativeCalls == 0;
+}
+
+static void suspend(VM* vm, Value* args) {
+    vm->fiber->transfer = NIL_VAL;
+    vm->fiber->state = FIBER_SUSPENDED;
+    args[-1] = NIL_VAL;
+}
+
+static void schedule(VM* vm, EventLoop* loop, ObjFiber* fiber, Value value) {
+    if (loop->readyCapacity < loop->readyCount + 1) {
+        int oldCapacity = loop->readyCapacity;
+        loop->readyCapacity = GROW_CAPACITY(oldCapacity);
+        loop->ready = GROW_ARRAY(vm, ReadyTask, loop->ready, oldCapacity, loop->readyCapacity);
+    }
+    loop->ready[loop->readyCount].fiber = fiber;
+    loop->ready[loop->readyCount].value = value;
+    loop->readyCount++;
+}
+
+static Wait* newWait(VM* vm, WaitKind kind, int fd, int target) {
+    Wait* wait = ALLOCATE(vm, Wait, 1);
+    wait->kind = kind;
+    wait->fd = fd;
+    wait->target = target;
+    wait->ownsFd = false;
+    wait->fiber = NULL;
+    wait->callback = NULL;
+    wait->bytes = NULL;
+    wait->length = 0;
+    wait->offset = 0;
+    wait->next = NULL;
+    return wait;
+}
+
+static void freeWait(VM* vm, Wait* wait) {
+    if (wait->ownsFd) close(wait->fd);
+    if (wait->bytes != NULL) FREE_ARRAY(vm, char, wait->bytes, wait->length + 1);
+    FREE(vm, Wait, wait);
+}
+
+// Registers [wait] with epoll and links it into the loop. Returns false if
+// the fd can't be watched, e.g. another fiber is already waiting on it.
+static bool addWait(EventLoop* loop, Wait* wait, uint32_t events) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = wait;
+    if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, wait->fd, &event) == -1) return false;
+
+    wait->next = loop->waits;
+    loop->waits = wait;
+    return true;
+}
+
+static void removeWait(VM* vm, EventLoop* loop, Wait* wait) {
+    epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, wait->fd, NULL);
+    Wait** link = &loop->waits;
+    while (*link != wait) link = &(*link)->next;
+    *link = wait->next;
+    freeWait(vm, wait);
+}
+
+// Drops every pending wait and task, e.g. after a runtime error unwound
+// the fibers that were waiting.
+static void resetLoop(VM* vm, EventLoop* loop) {
+    while (loop->waits != NULL) removeWait(vm, loop, loop->waits);
+    loop->readyCount = 0;
+    loop->running = false;
+    loop->owner = NULL;
+}
+
+static Pending** findPending(EventLoop* loop, int fd) {
+    Pending** link = &loop->pending;
+    while (*link != NULL && (*link)->fd != fd) link = &(*link)->next;
+    return link;
+}
+
+static void dropPending(VM* vm, EventLoop* loop, int fd) {
+    Pending** link = findPending(loop, fd);
+    if (*link == NULL) return;
+    Pending* pending = *link;
+    *link = pending->next;
+    FREE(vm, Pending, pending);
+}
+
+// How many bytes at the end of [bytes] begin a UTF-8 sequence that the
+// next read has to finish.
+static size_t incompleteTail(const char* bytes, size_t length) {
+    for (size_t back = 1; back <= 3 && back <= length; back++) {
+        unsigned char c = (unsigned char)bytes[length - back];
+        if ((c & 0xC0) == 0x80) continue;
+        size_t size = (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 1;
+        return size > back ? back : 0;
+    }
+    return 0;
+}
+
+// Decodes [length] bytes read from [fd] as UTF-8, carrying an incomplete
+// trailing sequence over to the next read.
+static ObjString* decodeBytes(VM* vm, EventLoop* loop, int fd, const char* bytes, size_t length) {
+    Pending** link = findPending(loop, fd);
+    int carried = *link == NULL ? 0 : (*link)->count;
+
+    char* input = ALLOCATE(vm, char, carried + length);
+    if (carried > 0) memcpy(input, (*link)->bytes, carried);
+    memcpy(input + carried, bytes, length);
+    size_t total = carried + length;
+
+    size_t left = incompleteTail(input, total);
+    if (left > 0) {
+        if (*link == NULL) {
+            Pending* pending = ALLOCATE(vm, Pending, 1);
+            pending->fd = fd;
+            pending->next = loop->pending;
+            loop->pending = pending;
+            link = &loop->pending;
+        }
+        memcpy((*link)->bytes, input + total - left, left);
+        (*link)->count = (int)left;
+    } else {
+        dropPending(vm, loop, fd);
+    }
+
+    ObjString* string = copyUtf8(vm, input, (int)(total - left));
+    FREE_ARRAY(vm, char, input, total);
+    return string;
+}
+
+// Reads whatever is available. Returns the string, or 空 at end of file or
+// on error; sets [wouldBlock] instead when nothing is ready yet.
+static Value readAvailable(VM* vm, EventLoop* loop, int fd, bool* wouldBlock) {
+    char buffer[READ_CHUNK];
+    *wouldBlock = false;
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0) return OBJ_VAL(decodeBytes(vm, loop, fd, buffer, (size_t)n));
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            *wouldBlock = true;
+            return NIL_VAL;
+        }
+        dropPending(vm, loop, fd);
+        return NIL_VAL;
+    }
+}
+
+// Writes without raising SIGPIPE, so a reader going away surfaces as a
+// failed write instead of killing the host, whose signal handling isn't
+// ours to change. Sockets take a flag for it; for pipes the signal is
+// blocked around the write, and one the write raised is taken back.
+static ssize_t writeQuietly(int fd, const char* bytes, size_t length) {
+    ssize_t n = send(fd, bytes, length, MSG_NOSIGNAL);
+    if (n != -1 || errno != ENOTSOCK) return n;
+
+    sigset_t pipe, old, pending;
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe, &old);
+    sigpending(&pending);
+    bool wasPending = sigismember(&pending, SIGPIPE);
+    n = write(fd, bytes, length);
+    int error = errno;
+    if (n == -1 && error == EPIPE && !wasPending) {
+        struct timespec zero = {0, 0};
+        while (sigtimedwait(&pipe, NULL, &zero) == -1 && errno == EINTR);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    errno = error;
+    return n;
+}
+
+// Writes as much of the wait's buffer as the fd will take. Returns true
+// once the whole buffer is written or the write failed for good.
+static bool writeAvailable(Wait* wait) {
+    while (wait->offset < wait->length) {
+        ssize_t n = writeQuietly(wait->target, wait->bytes + wait->offset, wait->length - wait->offset);
+        if (n > 0) {
+            wait->offset += n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return false;
+        } else {
+            return true;
+        }
+    }
+    return true;
+}
+
+static int exitStatus(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return -1;
+}
+
+static bool getFd(VM* vm, Value* args, int index, const wchar_t* name, int* fd) {
+    Value value = args[index];
+    if (!IS_NUMBER(value)) {
+        return nativeError(vm, args, L"参数 %d（%ls）的类型必须是「数字」，而不是「%ls」。",
+                           index + 1, name, getType(value));
+    }
+    double number = AS_NUMBER(value);
+    if (number < 0 || number != floor(number) || number > 0x7fffffff) {
+        return nativeError(vm, args, L"无效的文件描述符 %g。", number);
+    }
+    *fd = (int)number;
+    return true;
+}
+
+static bool getSeconds(VM* vm, Value* args, int index, double* seconds) {
+    if (!IS_NUMBER(args[index])) {
+        return nativeError(vm, args, L"参数 %d（秒）的类型必须是「数字」，而不是「%ls」。",
+                           index + 1, getType(args[index]));
+    }
+    *seconds = AS_NUMBER(args[index]);
+    if (*seconds < 0 || isnan(*seconds)) *seconds = 0;
+    return true;
+}
+
+// Encodes [string] as UTF-8 with a terminator, which [length] excludes.
+// Like the string's other users, it stops at the first NUL.
+static char* encodeString(VM* vm, ObjString* string, size_t* length) {
+    int count = (int)wcsnlen(string->chars, string->length);
+    size_t size = utf8Size(string->chars, count);
+    char* bytes = ALLOCATE(vm, char, size + 1);
+    encodeUtf8(string->chars, count, (uint8_t*)bytes);
+    bytes[size] = '\0';
+    *length = size;
+    return bytes;
+}
+
+static void setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags != -1) fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int newTimer(double seconds) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) return -1;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = (time_t)seconds;
+    spec.it_value.tv_nsec = (long)((seconds - (double)spec.it_value.tv_sec) * 1e9);
+    // An all-zero value disarms the timer, so fire "now" as 1ns.
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) spec.it_value.tv_nsec = 1;
+    timerfd_settime(fd, 0, &spec, NULL);
+    return fd;
+}
+
+// Handles a readiness event. Returns true if [wait] is finished and should
+// be removed from the loop.
+static bool completeWait(VM* vm, EventLoop* loop, Wait* wait) {
+    switch (wait->kind) {
+        case WAIT_READ: {
+            bool wouldBlock;
+            Value value = readAvailable(vm, loop, wait->target, &wouldBlock);
+            if (wouldBlock) return false;
+            // Keep the string reachable until the fiber is resumed.
+            push(vm, value);
+            schedule(vm, loop, wait->fiber, value);
+            pop(vm);
+            return true;
+        }
+        case WAIT_WRITE:
+            if (!writeAvailable(wait)) return false;
+            schedule(vm, loop, wait->fiber, NIL_VAL);
+            return true;
+        case WAIT_SLEEP:
+            schedule(vm, loop, wait->fiber, NIL_VAL);
+            return true;
+        case WAIT_TIMER: {
+            ObjFiber* fiber = newFiber(vm, wait->callback);
+            push(vm, OBJ_VAL(fiber));
+            schedule(vm, loop, fiber, NIL_VAL);
+            pop(vm);
+            return true;
+        }
+        case WAIT_PROCESS: {
+            int status;
+            if (waitpid(wait->target, &status, WNOHANG) <= 0) return false;
+            schedule(vm, loop, wait->fiber, NUMBER_VAL(exitStatus(status)));
+            return true;
+        }
+    }
+    return true;
+}
+
+static bool startNative(VM* vm, int argCount, Value* args) {
+    if (!IS_CLOSURE(args[0])) {
+        return nativeError(vm, args,
+                           L"参数 1（功能）的类型必须是「关闭」，而不是「%ls」。", getType(args[0]));
+    }
+    ObjClosure* closure = AS_CLOSURE(args[0]);
+    if (closure->function->arity != 0) {
+        return nativeError(vm, args, L"任务功能需要 0 个参数，但得到 %d。", closure->function->arity);
+    }
+    if (closure->function->isGenerator) return nativeError(vm, args, L"任务功能不能是生成器。");
+    EventLoop* loop = getLoop(vm);
+    ObjFiber* fiber = newFiber(vm, closure);
+    args[-1] = OBJ_VAL(fiber);
+    schedule(vm, loop, fiber, NIL_VAL);
+    return true;
+}
+
+static bool runNative(VM* vm, int argCount, Value* args) {
+    EventLoop* loop = getLoop(vm);
+    if (loop->running) return nativeError(vm, args, L"事件循环已在运行。");
+
+    loop->running = true;
+    loop->owner = vm->fiber;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (loop->readyCount > 0 || loop->waits != NULL) {
+        // Tasks scheduled while draining, including ones preempted by the
+        // budget, run on the next pass, after the fds have been polled.
+        int ready = loop->readyCount;
+        for (int i = 0; i < ready; i++) {
+            ReadyTask task = loop->ready[i];
+            FiberState state = task.fiber->state;
+            if (state != FIBER_NEW && state != FIBER_SUSPENDED && state != FIBER_PREEMPTED) continue;
+            if (resumeFiber(vm, task.fiber, task.value) != INTERPRET_OK) {
+                // The error has been reported and every fiber unwound.
+                resetLoop(vm, loop);
+                return false;
+            }
+            task.fiber->transfer = NIL_VAL;
+        }
+        loop->readyCount -= ready;
+        if (loop->readyCount > 0) {
+            memmove(loop->ready, loop->ready + ready, sizeof(ReadyTask) * loop->readyCount);
+        }
+
+        if (loop->waits == NULL) continue;
+
+        // Only wait for events when no task is ready to run.
+        int count = epoll_wait(loop->epollFd, events, MAX_EVENTS, loop->readyCount > 0 ? 0 : -1);
+        if (count == -1) {
+            if (errno == EINTR) continue;
+            resetLoop(vm, loop);
+            return nativeError(vm, args, L"事件循环失败：%s。", strerror(errno));
+        }
+        for (int i = 0; i < count; i++) {
+            Wait* wait = (Wait*)events[i].data.ptr;
+            if (completeWait(vm, loop, wait)) removeWait(vm, loop, wait);
+        }
+    }
+
+    loop->running = false;
+    loop->owner = NULL;
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+static bool sleepNative(VM* vm, int argCount, Value* args) {
+    double seconds;
+    if (!getSeconds(vm, args, 0, &seconds)) return false;
+
+    if (!canSuspend(vm)) {
+        struct timespec spec;
+        spec.tv_sec = (time_t)seconds;
+        spec.tv_nsec = (long)((seconds - (double)spec.tv_sec) * 1e9);
+        while (nanosleep(&spec, &spec) == -1 && errno == EINTR);
+        args[-1] = NIL_VAL;
+        return true;
+    }
+
+    int fd = newTimer(seconds);
+    if (fd == -1) return nativeError(vm, args, L"无法创建定时器：%s。", strerror(errno));
+    EventLoop* loop = vm->eventLoop;
+    Wait* wait = newWait(vm, WAIT_SLEEP, fd, fd);
+    wait->ownsFd = true;
+    wait->fiber = vm->fiber;
+    if (!addWait(loop, wait, EPOLLIN)) {
+        int error = errno;
+        freeWait(vm, wait);
+        return nativeError(vm, args, L"无法等待定时器：%s。", strerror(error));
+    }
+    suspend(vm, args);
+    return true;
+}
+
+static bool timerNative(VM* vm, int argCount, Value* args) {
+    double seconds;
+    if (!getSeconds(vm, args, 0, &seconds)) return false;
+    if (!IS_CLOSURE(args[1])) {
+        return nativeError(vm, args,
+                           L"参数 2（功能）的类型必须是「关闭」，而不是「%ls」。", getType(args[1]));
+    }
+    if (AS_CLOSURE(args[1])->function->arity != 0) {
+        return nativeError(vm, args, L"定时器功能需要 0 个参数，但得到 %d。",
+                           AS_CLOSURE(args[1])->function->arity);
+    }
+    if (AS_CLOSURE(args[1])->function->isGenerator) return nativeError(vm, args, L"定时器功能不能是生成器。");
+
+    EventLoop* loop = getLoop(vm);
+    int fd = newTimer(seconds);
+    if (fd == -1) return nativeError(vm, args, L"无法创建定时器：%s。", strerror(errno));
+    Wait* wait = newWait(vm, WAIT_TIMER, fd, fd);
+    wait->ownsFd = true;
+    wait->callback = AS_CLOSURE(args[1]);
+    if (!addWait(loop, wait, EPOLLIN)) {
+        int error = errno;
+        freeWait(vm, wait);
+        return nativeError(vm, args, L"无法等待定时器：%s。", strerror(error));
+    }
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+static bool pipeNative(VM* vm, int argCount, Value* args) {
+    getLoop(vm);
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) == -1) {
+        return nativeError(vm, args, L"无法创建管道：%s。", strerror(errno));
+    }
+    ObjList* list = newList(vm);
+    args[-1] = OBJ_VAL(list);
+    insertToList(vm, list, NUMBER_VAL(fds[0]), 0);
+    insertToList(vm, list, NUMBER_VAL(fds[1]), 1);
+    return true;
+}
+
+static bool openNative(VM* vm, int argCount, Value* args) {
+    if (!IS_STRING(args[0])) {
+        return nativeError(vm, args,
+                           L"参数 1（路径）的类型必须是「字符串」，而不是「%ls」。", getType(args[0]));
+    }
+    if (!IS_STRING(args[1])) {
+        return nativeError(vm, args,
+                           L"参数 2（模式）的类型必须是「字符串」，而不是「%ls」。", getType(args[1]));
+    }
+
+    const wchar_t* mode = AS_WCSTRING(args[1]);
+    int flags;
+    if (wcscmp(mode, L"读") == 0) flags = O_RDONLY;
+    else if (wcscmp(mode, L"写") == 0) flags = O_WRONLY | O_CREAT | O_TRUNC;
+    else if (wcscmp(mode, L"追加") == 0) flags = O_WRONLY | O_CREAT | O_APPEND;
+    else return nativeError(vm, args, L"未知的模式「%ls」，必须是「读」、「写」或「追加」。", mode);
+
+    size_t length;
+    char* path = encodeString(vm, AS_STRING(args[0]), &length);
+    int fd = open(path, flags | O_CLOEXEC | O_NONBLOCK, 0644);
+    int error = errno;
+    FREE_ARRAY(vm, char, path, length + 1);
+    if (fd == -1) {
+        return nativeError(vm, args, L"无法打开「%ls」：%s。", AS_WCSTRING(args[0]), strerror(error));
+    }
+    args[-1] = NUMBER_VAL(fd);
+    return true;
+}
+
+static bool readNative(VM* vm, int argCount, Value* args) {
+    int fd;
+    if (!getFd(vm, args, 0, L"描述符", &fd)) return false;
+    EventLoop* loop = getLoop(vm);
+
+    bool wouldBlock;
+    Value value = readAvailable(vm, loop, fd, &wouldBlock);
+    if (!wouldBlock) {
+        args[-1] = value;
+        return true;
+    }
+
+    if (canSuspend(vm)) {
+        Wait* wait = newWait(vm, WAIT_READ, fd, fd);
+        wait->fiber = vm->fiber;
+        if (!addWait(loop, wait, EPOLLIN)) {
+            int error = errno;
+            freeWait(vm, wait);
+            return nativeError(vm, args, L"无法等待文件描述符 %d：%s。", fd, strerror(error));
+        }
+        suspend(vm, args);
+        return true;
+    }
+
+    // Outside a task there is nothing else to run, so just block.
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+    value = readAvailable(vm, loop, fd, &wouldBlock);
+    fcntl(fd, F_SETFL, flags);
+    args[-1] = value;
+    return true;
+}
+
+static bool writeNative(VM* vm, int argCount, Value* args) {
+    int fd;
+    if (!getFd(vm, args, 0, L"描述符", &fd)) return false;
+    if (!IS_STRING(args[1])) {
+        return nativeError(vm, args,
+                           L"参数 2（数据）的类型必须是「字符串」，而不是「%ls」。", getType(args[1]));
+    }
+    EventLoop* loop = getLoop(vm);
+
+    Wait* wait = newWait(vm, WAIT_WRITE, fd, fd);
+    wait->bytes = encodeString(vm, AS_STRING(args[1]), &wait->length);
+
+    bool suspendable = canSuspend(vm);
+    int flags = 0;
+    if (!suspendable) {
+        flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+    }
+    bool done = writeAvailable(wait);
+    if (!suspendable) fcntl(fd, F_SETFL, flags);
+
+    if (done) {
+        freeWait(vm, wait);
+        args[-1] = NIL_VAL;
+        return true;
+    }
+
+    wait->fiber = vm->fiber;
+    if (!addWait(loop, wait, EPOLLOUT)) {
+        int error = errno;
+        freeWait(vm, wait);
+        return nativeError(vm, args, L"无法等待文件描述符 %d：%s。", fd, strerror(error));
+    }
+    suspend(vm, args);
+    return true;
+}
+
+static bool closeNative(VM* vm, int argCount, Value* args) {
+    int fd;
+    if (!getFd(vm, args, 0, L"描述符", &fd)) return false;
+    if (vm->eventLoop != NULL) dropPending(vm, vm->eventLoop, fd);
+    close(fd);
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+static bool execNative(VM* vm, int argCount, Value* args) {
+    if (!IS_STRING(args[0])) {
+        return nativeError(vm, args,
+                           L"参数 1（命令）的类型必须是「字符串」，而不是「%ls」。", getType(args[0]));
+    }
+    getLoop(vm);
+
+    size_t length;
+    char* command = encodeString(vm, AS_STRING(args[0]), &length);
+
+    int input[2], output[2];
+    if (pipe2(input, O_CLOEXEC) == -1) {
+        FREE_ARRAY(vm, char, command, length + 1);
+        return nativeError(vm, args, L"无法创建管道：%s。", strerror(errno));
+    }
+    if (pipe2(output, O_CLOEXEC) == -1) {
+        close(input[0]);
+        close(input[1]);
+        FREE_ARRAY(vm, char, command, length + 1);
+        return nativeError(vm, args, L"无法创建管道：%s。", strerror(errno));
+    }
+
+    flushOutput(&vm->output);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(input[0], STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+        execl("/bin/sh", "sh", "-c", command, (char*)NULL);
+        _exit(127);
+    }
+    int error = errno;
+    FREE_ARRAY(vm, char, command, length + 1);
+    close(input[0]);
+    close(output[1]);
+    if (pid == -1) {
+        close(input[1]);
+        close(output[0]);
+        return nativeError(vm, args, L"无法启动进程：%s。", strerror(error));
+    }
+    setNonBlocking(input[1]);
+    setNonBlocking(output[0]);
+
+    ObjList* list = newList(vm);
+    args[-1] = OBJ_VAL(list);
+    insertToList(vm, list, NUMBER_VAL(pid), 0);
+    insertToList(vm, list, NUMBER_VAL(input[1]), 1);
+    insertToList(vm, list, NUMBER_VAL(output[0]), 2);
+    return true;
+}
+
+static bool waitNative(VM* vm, int argCount, Value* args) {
+    int pid;
+    if (!getFd(vm, args, 0, L"进程号", &pid)) return false;
+
+    int status;
+    pid_t result = waitpid(pid, &status, WNOHANG);
+    if (result == -1) return nativeError(vm, args, L"无法等待进程 %d：%s。", pid, strerror(errno));
+    if (result == pid) {
+        args[-1] = NUMBER_VAL(exitStatus(status));
+        return true;
+    }
+
+    if (canSuspend(vm)) {
+        int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+        if (fd != -1) {
+            Wait* wait = newWait(vm, WAIT_PROCESS, fd, pid);
+            wait->ownsFd = true;
+            wait->fiber = vm->fiber;
+            if (!addWait(vm->eventLoop, wait, EPOLLIN)) {
+                int error = errno;
+                freeWait(vm, wait);
+                return nativeError(vm, args, L"无法等待进程 %d：%s。", pid, strerror(error));
+            }
+            suspend(vm, args);
+            return true;
+        }
+    }
+
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) return nativeError(vm, args, L"无法等待进程 %d：%s。", pid, strerror(errno));
+    }
+    args[-1] = NUMBER_VAL(exitStatus(status));
+    return true;
+}
+
+void initEventClass(VM* vm) {
+    // Keep the class and instance on the stack while the natives are
+    // allocated so a collection can't free them halfway through.
+    push(vm, OBJ_VAL(copyString(vm, L"事件", 2)));
+    ObjClass* eventClass = newClass(vm, AS_STRING(vm->fiber->stackTop[-1]));
+    pop(vm);
+    push(vm, OBJ_VAL(eventClass));
+    defineNative(vm, L"启动", startNative, 1, eventClass);
+    defineNative(vm, L"运行", runNative, 0, eventClass);
+    defineNative(vm, L"睡眠", sleepNative, 1, eventClass);
+    defineNative(vm, L"定时器", timerNative, 2, eventClass);
+    defineNative(vm, L"管道", pipeNative, 0, eventClass);
+    defineNative(vm, L"打开", openNative, 2, eventClass);
+    defineNative(vm, L"读取", readNative, 1, eventClass);
+    defineNative(vm, L"写入", writeNative, 2, eventClass);
+    defineNative(vm, L"关闭", closeNative, 1, eventClass);
+    defineNative(vm, L"执行", execNative, 1, eventClass);
+    defineNative(vm, L"等待", waitNative, 1, eventClass);
+    ObjInstance* eventInstance = newInstance(vm, eventClass, true);
+    pop(vm);
+    push(vm, OBJ_VAL(eventInstance));
+    defineNativeInstance(vm, L"事件", eventInstance);
+    pop(vm);
+}
+
+void markEventLoop(VM* vm) {
+    EventLoop* loop = vm->eventLoop;
+    if (loop == NULL) return;
+
+    markObject(vm, (Obj*)loop->owner);
+    for (Wait* wait = loop->waits; wait != NULL; wait = wait->next) {
+        markObject(vm, (Obj*)wait->fiber);
+        markObject(vm, (Obj*)wait->callback);
+    }
+    for (int i = 0; i < loop->readyCount; i++) {
+        markObject(vm, (Obj*)loop->ready[i].fiber);
+        markValue(vm, loop->ready[i].value);
+    }
+}
+
+void freeEventLoop(VM* vm) {
+    EventLoop* loop = vm->eventLoop;
+    if (loop == NULL) return;
+
+    resetLoop(vm, loop);
+    while (loop->pending != NULL) dropPending(vm, loop, loop->pending->fd);
+    FREE_ARRAY(vm, ReadyTask, loop->ready, loop->readyCapacity);
+    close(loop->epollFd);
+    FREE(vm, EventLoop, loop);
+    vm->eventLoop = NULL;
+}
+
+// Stops the running task where it is and queues it behind the others, for
+// an instruction budget that ran out. Returns false if it isn't a task.
+bool preemptTask(VM* vm) {
+    if (!canSuspend(vm)) return false;
+    vm->fiber->state = FIBER_PREEMPTED;
+    vm->fiber->transfer = NIL_VAL;
+    schedule(vm, vm->eventLoop, vm->fiber, NIL_VAL);
+    return true;
+}
+
+#else
+
+// The event loop needs epoll and timerfd; elsewhere 事件 is simply absent.
+void initEventClass(VM* vm) {}
+void markEventLoop(VM* vm) {}
+void freeEventLoop(VM* vm) {}
+bool preemptTask(VM* vm) { return false; }
+
+#endif
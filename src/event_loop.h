@@ -0,0 +1,19 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_EVENT_LOOP_H
+#define QI_EVENT_LOOP_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+typedef struct EventLoop EventLoop;
+
+void initEventClass(VM* vm);
+void markEventLoop(VM* vm);
+void freeEventLoop(VM* vm);
+bool preemptTask(VM* vm);
+
+#endif //QI_EVENT_LOOP_H
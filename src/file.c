@@ -0,0 +1,449 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "core_module.h"
+#include "file.h"
+#include "memory.h"
+#include "output.h"
+#include "reader.h"
+#include "source.h"
+
+static bool getPath(VM* vm, Value* args, int index, char* path) {
+    if (!IS_STRING(args[index])) {
+        return nativeError(vm, args, L"参数 %d（路径）的类型必须是「字符串」，而不是「%ls」。",
+                           index + 1, getType(args[index]));
+    }
+    if (!encodePath(AS_STRING(args[index]), path)) {
+        return nativeError(vm, args, L"无效的路径。");
+    }
+    return true;
+}
+
+// Parses a mode such as "读" or "追加字节" into flags for open().
+static bool getMode(VM* vm, Value* args, int index, int* flags, bool* bytes) {
+    if (!IS_STRING(args[index])) {
+        return nativeError(vm, args, L"参数 %d（模式）的类型必须是「字符串」，而不是「%ls」。",
+                           index + 1, getType(args[index]));
+    }
+    const wchar_t* mode = AS_STRING(args[index])->chars;
+    size_t length = wcslen(mode);
+    *bytes = length >= 2 && wcscmp(mode + length - 2, L"字节") == 0;
+    if (*bytes) length -= 2;
+
+    if (length == 1 && wcsncmp(mode, L"读", 1) == 0) {
+        *flags = O_RDONLY;
+    } else if (length == 1 && wcsncmp(mode, L"写", 1) == 0) {
+        *flags = O_WRONLY | O_CREAT | O_TRUNC;
+    } else if (length == 2 && wcsncmp(mode, L"追加", 2) == 0) {
+        *flags = O_WRONLY | O_CREAT | O_APPEND;
+    } else if (length == 2 && wcsncmp(mode, L"读写", 2) == 0) {
+        *flags = O_RDWR | O_CREAT;
+    } else {
+        return nativeError(vm, args, L"未知的文件模式「%ls」。", mode);
+    }
+    return true;
+}
+
+static int openPath(const char* path, int flags) {
+    int fd;
+    do {
+        fd = open(path, flags | O_CLOEXEC, 0666);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+}
+
+void closeFile(VM* vm, ObjFile* file) {
+    if (file->output != NULL) {
+        flushOutput(file->output);
+        FREE(vm, Output, file->output);
+        file->output = NULL;
+    }
+    if (file->fd >= 0) close(file->fd);
+    file->fd = -1;
+}
+
+static bool checkOpen(VM* vm, ObjFile* file, Value* args) {
+    if (file->fd < 0) return nativeError(vm, args, L"文件已关闭。");
+    return true;
+}
+
+// Moves the file position back over input that was read ahead but not
+// used, so the next write or seek starts where the script left off.
+static void unreadInput(ObjFile* file) {
+    if (file->input == NULL) return;
+    size_t unread = file->input->end - file->input->start;
+    if (unread > 0) lseek(file->fd, -(off_t)unread, SEEK_CUR);
+    discardInput(file->input);
+}
+
+// Raises the error of a write that failed since the last check, if any.
+static bool checkWritten(VM* vm, Output* output, Value* args) {
+    if (output->error == 0) return true;
+    int error = output->error;
+    output->error = 0;
+    return nativeError(vm, args, L"写入失败：%s。", strerror(error));
+}
+
+static ObjReader* startReading(VM* vm, ObjFile* file, Value* args) {
+    if (!checkOpen(vm, file, args)) return NULL;
+    if (!file->readable) {
+        nativeError(vm, args, L"文件不是以可读的模式打开的。");
+        return NULL;
+    }
+    if (file->output != NULL) flushOutput(file->output);
+    if (file->input == NULL) {
+        file->input = newReader(vm, file->fd, false);
+        file->input->bytes = file->bytes;
+    }
+    return file->input;
+}
+
+static Output* startWriting(VM* vm, ObjFile* file, Value* args) {
+    if (!checkOpen(vm, file, args)) return NULL;
+    if (!file->writable) {
+        nativeError(vm, args, L"文件不是以可写的模式打开的。");
+        return NULL;
+    }
+    unreadInput(file);
+    if (file->output == NULL) {
+        file->output = ALLOCATE(vm, Output, 1);
+        initOutput(file->output, file->fd);
+    }
+    return file->output;
+}
+
+static bool fileReadLineNative(VM* vm, int argCount, Value* args) {
+    ObjReader* input = startReading(vm, AS_FILE(args[-1]), args);
+    return input != NULL && readLine(vm, input, args);
+}
+
+static bool fileReadNative(VM* vm, int argCount, Value* args) {
+    if (!IS_NUMBER(args[0]) || AS_NUMBER(args[0]) < 1) {
+        return nativeError(vm, args, L"参数 1（数量）必须是正数。");
+    }
+    ObjReader* input = startReading(vm, AS_FILE(args[-1]), args);
+    return input != NULL && readSome(vm, input, (size_t)AS_NUMBER(args[0]), args);
+}
+
+static bool fileReadIntoNative(VM* vm, int argCount, Value* args) {
+    ObjBytes* bytes;
+    size_t offset;
+    if (!getReadTarget(vm, argCount, args, &bytes, &offset)) return false;
+    ObjReader* input = startReading(vm, AS_FILE(args[-1]), args);
+    return input != NULL && readInto(vm, input, bytes, offset, args);
+}
+
+static bool fileReadAllNative(VM* vm, int argCount, Value* args) {
+    ObjReader* input = startReading(vm, AS_FILE(args[-1]), args);
+    return input != NULL && readAll(vm, input, args);
+}
+
+static bool fileDoneNative(VM* vm, int argCount, Value* args) {
+    ObjReader* input = startReading(vm, AS_FILE(args[-1]), args);
+    return input != NULL && readDone(vm, input, args);
+}
+
+static bool writeValue(VM* vm, ObjFile* file, Value value, Value* args) {
+    Output* output = startWriting(vm, file, args);
+    if (output == NULL) return false;
+    if (IS_BYTES(value)) {
+        outputBytes(output, bytesData(AS_BYTES(value)), AS_BYTES(value)->count);
+        return checkWritten(vm, output, args);
+    }
+    if (file->bytes) {
+        return nativeError(vm, args, L"字节模式只能写入「字节」，而不是「%ls」。", getType(value));
+    }
+    outputValue(output, value);
+    return checkWritten(vm, output, args);
+}
+
+// Writes the value as 系统。打印 would, or a 字节 as it is. In byte mode it
+// must be a 字节.
+static bool fileWriteNative(VM* vm, int argCount, Value* args) {
+    if (!writeValue(vm, AS_FILE(args[-1]), args[0], args)) return false;
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+static bool fileWriteLineNative(VM* vm, int argCount, Value* args) {
+    ObjFile* file = AS_FILE(args[-1]);
+    if (!writeValue(vm, file, args[0], args)) return false;
+    outputBytes(file->output, "\n", 1);
+    if (!checkWritten(vm, file->output, args)) return false;
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+static bool fileFlushNative(VM* vm, int argCount, Value* args) {
+    ObjFile* file = AS_FILE(args[-1]);
+    if (!checkOpen(vm, file, args)) return false;
+    if (file->output != NULL) {
+        flushOutput(file->output);
+        if (!checkWritten(vm, file->output, args)) return false;
+    }
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+// Moves to an offset in bytes from "开始", "当前" or "末尾", and returns the
+// new position.
+static bool fileSeekNative(VM* vm, int argCount, Value* args) {
+    if (argCount < 1 || argCount > 2) {
+        return nativeError(vm, args, L"需要 1 到 2 个参数，但得到 %d。", argCount);
+    }
+    if (!IS_NUMBER(args[0])) {
+        return nativeError(vm, args, L"参数 1（偏移）的类型必须是「数字」，而不是「%ls」。", getType(args[0]));
+    }
+    int whence = SEEK_SET;
+    if (argCount == 2) {
+        if (!IS_STRING(args[1])) {
+            return nativeError(vm, args, L"参数 2（起点）的类型必须是「字符串」，而不是「%ls」。", getType(args[1]));
+        }
+        const wchar_t* origin = AS_STRING(args[1])->chars;
+        if (wcscmp(origin, L"开始") == 0) whence = SEEK_SET;
+        else if (wcscmp(origin, L"当前") == 0) whence = SEEK_CUR;
+        else if (wcscmp(origin, L"末尾") == 0) whence = SEEK_END;
+        else return nativeError(vm, args, L"起点必须是「开始」、「当前」或「末尾」。");
+    }
+
+    ObjFile* file = AS_FILE(args[-1]);
+    if (!checkOpen(vm, file, args)) return false;
+    if (file->output != NULL) flushOutput(file->output);
+    unreadInput(file);
+    off_t position = lseek(file->fd, (off_t)AS_NUMBER(args[0]), whence);
+    if (position < 0) return nativeError(vm, args, L"无法定位：%s。", strerror(errno));
+    args[-1] = NUMBER_VAL((double)position);
+    return true;
+}
+
+static bool filePositionNative(VM* vm, int argCount, Value* args) {
+    ObjFile* file = AS_FILE(args[-1]);
+    if (!checkOpen(vm, file, args)) return false;
+    off_t position = lseek(file->fd, 0, SEEK_CUR);
+    if (position < 0) return nativeError(vm, args, L"无法获取位置：%s。", strerror(errno));
+    if (file->input != NULL) position -= (off_t)(file->input->end - file->input->start);
+    if (file->output != NULL) position += file->output->count;
+    args[-1] = NUMBER_VAL((double)position);
+    return true;
+}
+
+static bool fileCloseNative(VM* vm, int argCount, Value* args) {
+    ObjFile* file = AS_FILE(args[-1]);
+    if (file->input != NULL) closeReader(vm, file->input);
+    // Report what the last flush couldn't write, but close the file anyway.
+    int error = 0;
+    if (file->output != NULL && !flushOutput(file->output)) error = file->output->error;
+    closeFile(vm, file);
+    if (error != 0) return nativeError(vm, args, L"写入失败：%s。", strerror(error));
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+typedef struct {
+    const wchar_t* name;
+    NativeFn function;
+    int arity;
+} FileMethod;
+
+static const FileMethod fileMethods[] = {
+    {L"读行", fileReadLineNative, 0},
+    {L"下一个", fileReadLineNative, 0},
+    {L"读", fileReadNative, 1},
+    {L"读入", fileReadIntoNative, -1},
+    {L"读全部", fileReadAllNative, 0},
+    {L"完成", fileDoneNative, 0},
+    {L"写", fileWriteNative, 1},
+    {L"写行", fileWriteLineNative, 1},
+    {L"刷新", fileFlushNative, 0},
+    {L"定位", fileSeekNative, -1},
+    {L"位置", filePositionNative, 0},
+    {L"关闭", fileCloseNative, 0},
+};
+
+bool findFileMethod(ObjString* name, NativeFn* function, int* arity) {
+    for (size_t i = 0; i < sizeof(fileMethods) / sizeof(fileMethods[0]); i++) {
+        if (wcscmp(name->chars, fileMethods[i].name) == 0) {
+            *function = fileMethods[i].function;
+            *arity = fileMethods[i].arity;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 文件。打开（路径，模式） opens a file; the mode defaults to "读".
+static bool openNative(VM* vm, int argCount, Value* args) {
+    if (argCount < 1 || argCount > 2) {
+        return nativeError(vm, args, L"需要 1 到 2 个参数，但得到 %d。", argCount);
+    }
+    char path[PATH_MAX];
+    if (!getPath(vm, args, 0, path)) return false;
+    int flags = O_RDONLY;
+    bool bytes = false;
+    if (argCount == 2 && !getMode(vm, args, 1, &flags, &bytes)) return false;
+
+    int fd = openPath(path, flags);
+    if (fd < 0) return nativeError(vm, args, L"无法打开文件「%ls」：%s。", AS_STRING(args[0])->chars, strerror(errno));
+    int access = flags & O_ACCMODE;
+    args[-1] = OBJ_VAL(newFile(vm, fd, access != O_WRONLY, access != O_RDONLY, bytes));
+    return true;
+}
+
+// 文件。读取（路径） returns a whole file as a string, decoded straight from
+// its mapped pages. With "字节" it returns a 字节 read in one call.
+static bool readFileNative(VM* vm, int argCount, Value* args) {
+    if (argCount < 1 || argCount > 2) {
+        return nativeError(vm, args, L"需要 1 到 2 个参数，但得到 %d。", argCount);
+    }
+    char path[PATH_MAX];
+    if (!getPath(vm, args, 0, path)) return false;
+    bool bytes = false;
+    if (argCount == 2) {
+        if (IS_STRING(args[1]) && wcscmp(AS_STRING(args[1])->chars, L"字节") == 0) bytes = true;
+        else if (!IS_STRING(args[1]) || wcscmp(AS_STRING(args[1])->chars, L"文本") != 0) {
+            return nativeError(vm, args, L"参数 2（编码）必须是「文本」或「字节」。");
+        }
+    }
+
+    int fd = openPath(path, O_RDONLY);
+    if (fd < 0) return nativeError(vm, args, L"无法打开文件「%ls」：%s。", AS_STRING(args[0])->chars, strerror(errno));
+    if (bytes) {
+        // Keeping the mapping would fault if the file were truncated while
+        // the array lives, so read straight into the array's storage.
+        ObjReader* reader = newReader(vm, fd, false);
+        reader->bytes = true;
+        push(vm, OBJ_VAL(reader));
+        bool read = readAll(vm, reader, args);
+        pop(vm);
+        close(fd);
+        return read;
+    }
+    Source source;
+    bool loaded = readSource(fd, &source);
+    int error = errno;
+    close(fd);
+    if (!loaded) return nativeError(vm, args, L"无法读取文件「%ls」：%s。", AS_STRING(args[0])->chars, strerror(error));
+    if (source.length > INT_MAX) {
+        freeSource(&source);
+        return nativeError(vm, args, L"文件太大，无法放入一个字符串。");
+    }
+
+    ObjString* text = copyUtf8(vm, source.text, (int)source.length);
+    freeSource(&source);
+    args[-1] = OBJ_VAL(text);
+    return true;
+}
+
+// 文件。写入（路径，值，模式） writes a value to a file; the mode defaults
+// to "写", which replaces what the file held.
+static bool writeFileNative(VM* vm, int argCount, Value* args) {
+    if (argCount < 2 || argCount > 3) {
+        return nativeError(vm, args, L"需要 2 到 3 个参数，但得到 %d。", argCount);
+    }
+    char path[PATH_MAX];
+    if (!getPath(vm, args, 0, path)) return false;
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    bool bytes = false;
+    if (argCount == 3) {
+        if (!getMode(vm, args, 2, &flags, &bytes)) return false;
+        if ((flags & O_ACCMODE) != O_WRONLY) return nativeError(vm, args, L"写入的模式必须是「写」或「追加」。");
+    }
+    if (bytes && !IS_BYTES(args[1])) {
+        return nativeError(vm, args, L"字节模式只能写入「字节」，而不是「%ls」。", getType(args[1]));
+    }
+
+    int fd = openPath(path, flags);
+    if (fd < 0) return nativeError(vm, args, L"无法打开文件「%ls」：%s。", AS_STRING(args[0])->chars, strerror(errno));
+    Output output;
+    initOutput(&output, fd);
+    if (IS_BYTES(args[1])) {
+        outputBytes(&output, bytesData(AS_BYTES(args[1])), AS_BYTES(args[1])->count);
+    } else {
+        outputValue(&output, args[1]);
+    }
+    bool written = flushOutput(&output);
+    close(fd);
+    if (!written) return nativeError(vm, args, L"写入失败：%s。", strerror(output.error));
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+static bool existsNative(VM* vm, int argCount, Value* args) {
+    char path[PATH_MAX];
+    if (!getPath(vm, args, 0, path)) return false;
+    struct stat info;
+    args[-1] = BOOL_VAL(stat(path, &info) == 0);
+    return true;
+}
+
+static int compareNames(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+// 文件。列出（目录） returns the names in a directory, sorted.
+static bool listNative(VM* vm, int argCount, Value* args) {
+    char path[PATH_MAX];
+    if (!getPath(vm, args, 0, path)) return false;
+    DIR* directory = opendir(path);
+    if (directory == NULL) {
+        return nativeError(vm, args, L"无法打开目录「%ls」：%s。", AS_STRING(args[0])->chars, strerror(errno));
+    }
+
+    int count = 0;
+    int capacity = 0;
+    char** names = NULL;
+    for (struct dirent* entry = readdir(directory); entry != NULL; entry = readdir(directory)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (count == capacity) {
+            capacity = capacity < 16 ? 16 : capacity * 2;
+            names = (char**)realloc(names, sizeof(char*) * capacity);
+            if (names == NULL) exit(1);
+        }
+        names[count] = strdup(entry->d_name);
+        if (names[count] == NULL) exit(1);
+        count++;
+    }
+    closedir(directory);
+    qsort(names, count, sizeof(char*), compareNames);
+
+    // The list stays in args[-1] while its names are made.
+    ObjList* list = newList(vm);
+    args[-1] = OBJ_VAL(list);
+    for (int i = 0; i < count; i++) {
+        push(vm, OBJ_VAL(copyUtf8(vm, names[i], (int)strlen(names[i]))));
+        insertToList(vm, list, vm->fiber->stackTop[-1], list->count);
+        pop(vm);
+        free(names[i]);
+    }
+    free(names);
+    return true;
+}
+
+void initFileClass(VM* vm) {
+    push(vm, OBJ_VAL(copyString(vm, L"文件", 2)));
+    ObjClass* fileClass = newClass(vm, AS_STRING(vm->fiber->stackTop[-1]));
+    pop(vm);
+    push(vm, OBJ_VAL(fileClass));
+    defineNative(vm, L"打开", openNative, -1, fileClass);
+    defineNative(vm, L"读取", readFileNative, -1, fileClass);
+    defineNative(vm, L"写入", writeFileNative, -1, fileClass);
+    defineNative(vm, L"存在", existsNative, 1, fileClass);
+    defineNative(vm, L"列出", listNative, 1, fileClass);
+    ObjInstance* fileClassInstance = newInstance(vm, fileClass, true);
+    pop(vm);
+    push(vm, OBJ_VAL(fileClassInstance));
+    defineNativeInstance(vm, L"文件", fileClassInstance);
+    pop(vm);
+}
@@ -0,0 +1,16 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_FILE_H
+#define QI_FILE_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+void initFileClass(VM* vm);
+void closeFile(VM* vm, ObjFile* file);
+bool findFileMethod(ObjString* name, NativeFn* function, int* arity);
+
+#endif //QI_FILE_H
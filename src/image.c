@@ -0,0 +1,1006 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "bytes.h"
+#include "core_module.h"
+#include "memory.h"
+#include "shared.h"
+
+// An image is a header, then every object reachable from the globals and
+// the root fiber, then the globals and modules tables. Objects refer to each
+// other by their position in the image, and to core objects by their
+// position in the shared heap, so nothing in the file depends on where it
+// was loaded. A module cache uses the same records, starting from the
+// module, after a header identifying the source it was compiled from.
+//
+// Loading trusts the bytecode it finds, so the header ends with a checksum
+// of everything after it, and a file that has been damaged is rejected.
+#define IMAGE_MAGIC 0x474d4951u   // "QIMG"
+#define MODULE_MAGIC 0x434d4951u  // "QIMC"
+#define IMAGE_VERSION 3
+
+typedef enum {
+    IMAGE_NIL,
+    IMAGE_FALSE,
+    IMAGE_TRUE,
+    IMAGE_NUMBER,
+    IMAGE_OBJECT,
+    IMAGE_CORE,
+} ValueTag;
+
+#define CORE_BIT 0x80000000u
+
+// Maps objects to their index in the image (or CORE_BIT | core index).
+typedef struct {
+    Obj* key;
+    uint32_t value;
+} PointerEntry;
+
+typedef struct {
+    PointerEntry* entries;
+    int count;
+    int capacity;
+} PointerMap;
+
+static uint32_t hashPointer(Obj* pointer) {
+    return (uint32_t)(((uintptr_t)pointer >> 3) * 2654435761u);
+}
+
+static PointerEntry* findEntry(PointerEntry* entries, int capacity, Obj* key) {
+    uint32_t index = hashPointer(key) & (capacity - 1);
+    while (entries[index].key != NULL && entries[index].key != key) {
+        index = (index + 1) & (capacity - 1);
+    }
+    return &entries[index];
+}
+
+static bool mapGet(PointerMap* map, Obj* key, uint32_t* value) {
+    if (map->count == 0) return false;
+    PointerEntry* entry = findEntry(map->entries, map->capacity, key);
+    if (entry->key == NULL) return false;
+    *value = entry->value;
+    return true;
+}
+
+static void mapSet(PointerMap* map, Obj* key, uint32_t value) {
+    if (map->count + 1 > map->capacity / 2) {
+        int capacity = map->capacity < 64 ? 64 : map->capacity * 2;
+        PointerEntry* entries = (PointerEntry*)calloc(capacity, sizeof(PointerEntry));
+        if (entries == NULL) exit(1);
+        for (int i = 0; i < map->capacity; i++) {
+            if (map->entries[i].key == NULL) continue;
+            *findEntry(entries, capacity, map->entries[i].key) = map->entries[i];
+        }
+        free(map->entries);
+        map->entries = entries;
+        map->capacity = capacity;
+    }
+    PointerEntry* entry = findEntry(map->entries, map->capacity, key);
+    if (entry->key == NULL) map->count++;
+    entry->key = key;
+    entry->value = value;
+}
+
+typedef struct {
+    PointerMap indices;
+    PointerMap owners;        // Open upvalue to the index of its fiber.
+    Obj** objects;            // In image order.
+    int count;
+    int capacity;
+
+    uint8_t* bytes;
+    size_t length;
+    size_t size;
+    size_t checksumAt;        // Where the header's checksum goes.
+
+    ObjFiber* root;
+    Value* rootTop;           // Where the root fiber's stack is cut off.
+    const wchar_t* error;
+} Writer;
+
+static void addObject(Writer* writer, Obj* object) {
+    if (object == NULL) return;
+    uint32_t index;
+    if (mapGet(&writer->indices, object, &index)) return;
+
+    if (writer->capacity < writer->count + 1) {
+        writer->capacity = GROW_CAPACITY(writer->capacity);
+        writer->objects = (Obj**)realloc(writer->objects, sizeof(Obj*) * writer->capacity);
+        if (writer->objects == NULL) exit(1);
+    }
+    mapSet(&writer->indices, object, (uint32_t)writer->count);
+    writer->objects[writer->count++] = object;
+}
+
+static void addValue(Writer* writer, Value value) {
+    if (IS_OBJ(value)) addObject(writer, AS_OBJ(value));
+}
+
+static void addTable(Writer* writer, Table* table) {
+    for (int i = 0; i < table->capacity; i++) {
+        if (table->entries[i].key == NULL) continue;
+        addObject(writer, (Obj*)table->entries[i].key);
+        addValue(writer, table->entries[i].value);
+    }
+}
+
+// Adds everything [object] refers to, the same edges the collector follows.
+static void addReferences(Writer* writer, Obj* object) {
+    switch (object->type) {
+        case OBJ_BOUND_METHOD: {
+            ObjBoundMethod* bound = (ObjBoundMethod*)object;
+            addValue(writer, bound->receiver);
+            addObject(writer, (Obj*)bound->method);
+            addObject(writer, (Obj*)bound->native);
+            break;
+        }
+        case OBJ_CLASS:
+            addObject(writer, (Obj*)((ObjClass*)object)->name);
+            addTable(writer, &((ObjClass*)object)->methods);
+            break;
+        case OBJ_CLOSURE: {
+            ObjClosure* closure = (ObjClosure*)object;
+            addObject(writer, (Obj*)closure->function);
+            for (int i = 0; i < closure->upvalueCount; i++) addObject(writer, (Obj*)closure->upvalues[i]);
+            break;
+        }
+        case OBJ_FUNCTION: {
+            ObjFunction* function = (ObjFunction*)object;
+            addObject(writer, (Obj*)function->name);
+            addObject(writer, (Obj*)function->module);
+            for (int i = 0; i < function->chunk.constants.count; i++) {
+                addValue(writer, function->chunk.constants.values[i]);
+            }
+            break;
+        }
+        case OBJ_INSTANCE:
+            addObject(writer, (Obj*)((ObjInstance*)object)->klass);
+            addTable(writer, &((ObjInstance*)object)->fields);
+            break;
+        case OBJ_LIST: {
+            ObjList* list = (ObjList*)object;
+            for (int i = 0; i < list->count; i++) addValue(writer, list->items[i]);
+            break;
+        }
+        case OBJ_UPVALUE:
+            // An open upvalue whose fiber isn't saved is written as closed.
+            addValue(writer, *((ObjUpvalue*)object)->location);
+            addObject(writer, (Obj*)((ObjUpvalue*)object)->next);
+            break;
+        case OBJ_FIBER: {
+            ObjFiber* fiber = (ObjFiber*)object;
+            Value* top = fiber == writer->root ? writer->rootTop : fiber->stackTop;
+            addObject(writer, (Obj*)fiber->closure);
+            for (Value* slot = fiber->stack; slot < top; slot++) addValue(writer, *slot);
+            for (int i = 0; i < fiber->frameCount; i++) addObject(writer, (Obj*)fiber->frames[i].closure);
+            uint32_t index;
+            mapGet(&writer->indices, object, &index);
+            for (ObjUpvalue* upvalue = fiber->openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
+                addObject(writer, (Obj*)upvalue);
+                mapSet(&writer->owners, (Obj*)upvalue, index);
+            }
+            addObject(writer, (Obj*)fiber->caller);
+            addValue(writer, fiber->transfer);
+            break;
+        }
+        case OBJ_MODULE: {
+            ObjModule* module = (ObjModule*)object;
+            addObject(writer, (Obj*)module->path);
+            addObject(writer, (Obj*)module->body);
+            for (int i = 0; i < module->names.count; i++) {
+                addValue(writer, module->names.values[i]);
+                addValue(writer, module->values.values[i]);
+            }
+            break;
+        }
+        case OBJ_NATIVE:
+            if (((ObjNative*)object)->extension != NULL) writer->error = L"映像不能包含扩展。";
+            break;
+        case OBJ_STRING:
+            break;
+        case OBJ_WORKER:
+            writer->error = L"映像不能包含工作者。";
+            break;
+        case OBJ_READER:
+            writer->error = L"映像不能包含读取器。";
+            break;
+        case OBJ_FILE:
+            writer->error = L"映像不能包含文件。";
+            break;
+        case OBJ_BYTES:
+            writer->error = L"映像不能包含字节。";
+            break;
+        case OBJ_CSV:
+            writer->error = L"映像不能包含 CSV 读取器。";
+            break;
+        case OBJ_REGEX:
+            writer->error = L"映像不能包含正则表达式。";
+            break;
+        case OBJ_FOREIGN:
+            writer->error = L"映像不能包含外部对象。";
+            break;
+    }
+}
+
+static void writeBytes(Writer* writer, const void* bytes, size_t length) {
+    if (writer->size < writer->length + length) {
+        while (writer->size < writer->length + length) writer->size = writer->size < 1024 ? 1024 : writer->size * 2;
+        writer->bytes = (uint8_t*)realloc(writer->bytes, writer->size);
+        if (writer->bytes == NULL) exit(1);
+    }
+    memcpy(writer->bytes + writer->length, bytes, length);
+    writer->length += length;
+}
+
+static void writeU8(Writer* writer, uint8_t value) {
+    writeBytes(writer, &value, sizeof(value));
+}
+
+static void writeU32(Writer* writer, uint32_t value) {
+    writeBytes(writer, &value, sizeof(value));
+}
+
+static void writeRef(Writer* writer, Obj* object) {
+    uint32_t index;
+    if (object == NULL) {
+        writeU8(writer, IMAGE_NIL);
+    } else if (mapGet(&writer->indices, object, &index)) {
+        writeU8(writer, index & CORE_BIT ? IMAGE_CORE : IMAGE_OBJECT);
+        writeU32(writer, index & ~CORE_BIT);
+    }
+}
+
+static void writeValue(Writer* writer, Value value) {
+    if (IS_NIL(value)) {
+        writeU8(writer, IMAGE_NIL);
+    } else if (IS_BOOL(value)) {
+        writeU8(writer, AS_BOOL(value) ? IMAGE_TRUE : IMAGE_FALSE);
+    } else if (IS_NUMBER(value)) {
+        double number = AS_NUMBER(value);
+        writeU8(writer, IMAGE_NUMBER);
+        writeBytes(writer, &number, sizeof(number));
+    } else {
+        writeRef(writer, AS_OBJ(value));
+    }
+}
+
+static void writeTable(Writer* writer, Table* table) {
+    uint32_t count = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        if (table->entries[i].key != NULL) count++;
+    }
+    writeU32(writer, count);
+    for (int i = 0; i < table->capacity; i++) {
+        if (table->entries[i].key == NULL) continue;
+        writeRef(writer, (Obj*)table->entries[i].key);
+        writeValue(writer, table->entries[i].value);
+    }
+}
+
+static void writeObject(Writer* writer, Obj* object) {
+    switch (object->type) {
+        case OBJ_BOUND_METHOD: {
+            ObjBoundMethod* bound = (ObjBoundMethod*)object;
+            writeValue(writer, bound->receiver);
+            writeRef(writer, (Obj*)bound->method);
+            writeRef(writer, (Obj*)bound->native);
+            break;
+        }
+        case OBJ_CLASS:
+            writeRef(writer, (Obj*)((ObjClass*)object)->name);
+            writeTable(writer, &((ObjClass*)object)->methods);
+            break;
+        case OBJ_CLOSURE: {
+            ObjClosure* closure = (ObjClosure*)object;
+            writeRef(writer, (Obj*)closure->function);
+            for (int i = 0; i < closure->upvalueCount; i++) writeRef(writer, (Obj*)closure->upvalues[i]);
+            break;
+        }
+        case OBJ_FUNCTION: {
+            ObjFunction* function = (ObjFunction*)object;
+            Chunk* chunk = &function->chunk;
+            writeU32(writer, (uint32_t)function->arity);
+            writeU32(writer, (uint32_t)function->upvalueCount);
+            writeU8(writer, function->isGenerator);
+            writeU8(writer, function->writesUpvalues);
+            writeU32(writer, (uint32_t)chunk->count);
+            writeBytes(writer, chunk->code, chunk->count);
+            writeBytes(writer, chunk->lines, sizeof(int) * chunk->count);
+            writeRef(writer, (Obj*)function->name);
+            writeRef(writer, (Obj*)function->module);
+            writeU32(writer, (uint32_t)chunk->constants.count);
+            for (int i = 0; i < chunk->constants.count; i++) writeValue(writer, chunk->constants.values[i]);
+            break;
+        }
+        case OBJ_INSTANCE:
+            writeRef(writer, (Obj*)((ObjInstance*)object)->klass);
+            writeU8(writer, ((ObjInstance*)object)->isStatic);
+            writeTable(writer, &((ObjInstance*)object)->fields);
+            break;
+        case OBJ_LIST: {
+            ObjList* list = (ObjList*)object;
+            writeU32(writer, (uint32_t)list->count);
+            for (int i = 0; i < list->count; i++) writeValue(writer, list->items[i]);
+            break;
+        }
+        case OBJ_STRING: {
+            ObjString* string = (ObjString*)object;
+            writeU32(writer, (uint32_t)string->length);
+            for (int i = 0; i < string->length; i++) writeU32(writer, (uint32_t)string->chars[i]);
+            break;
+        }
+        case OBJ_UPVALUE: {
+            ObjUpvalue* upvalue = (ObjUpvalue*)object;
+            uint32_t owner;
+            if (upvalue->location != &upvalue->closed && mapGet(&writer->owners, object, &owner)) {
+                ObjFiber* fiber = (ObjFiber*)writer->objects[owner];
+                writeU8(writer, true);
+                writeU32(writer, owner);
+                writeU32(writer, (uint32_t)(upvalue->location - fiber->stack));
+            } else {
+                writeU8(writer, false);
+                writeValue(writer, *upvalue->location);
+            }
+            writeRef(writer, (Obj*)upvalue->next);
+            break;
+        }
+        case OBJ_FIBER: {
+            ObjFiber* fiber = (ObjFiber*)object;
+            Value* top = fiber == writer->root ? writer->rootTop : fiber->stackTop;
+            writeU32(writer, (uint32_t)fiber->stackCapacity);
+            writeU8(writer, (uint8_t)fiber->state);
+            writeRef(writer, (Obj*)fiber->closure);
+            writeU32(writer, (uint32_t)fiber->frameCount);
+            for (int i = 0; i < fiber->frameCount; i++) {
+                CallFrame* frame = &fiber->frames[i];
+                writeRef(writer, (Obj*)frame->closure);
+                writeU32(writer, (uint32_t)(frame->ip - frame->closure->function->chunk.code));
+                writeU32(writer, (uint32_t)(frame->slots - fiber->stack));
+                writeU8(writer, frame->callClosure);
+            }
+            writeU32(writer, (uint32_t)(top - fiber->stack));
+            for (Value* slot = fiber->stack; slot < top; slot++) writeValue(writer, *slot);
+            writeRef(writer, (Obj*)fiber->openUpvalues);
+            writeRef(writer, (Obj*)fiber->caller);
+            writeValue(writer, fiber->transfer);
+            writeU32(writer, (uint32_t)fiber->nativeCalls);
+            break;
+        }
+        case OBJ_MODULE: {
+            ObjModule* module = (ObjModule*)object;
+            writeRef(writer, (Obj*)module->path);
+            writeRef(writer, (Obj*)module->body);
+            writeU8(writer, module->executed);
+            writeU32(writer, (uint32_t)module->names.count);
+            for (int i = 0; i < module->names.count; i++) {
+                writeValue(writer, module->names.values[i]);
+                writeValue(writer, module->values.values[i]);
+            }
+            break;
+        }
+        case OBJ_NATIVE:
+        case OBJ_WORKER:
+        case OBJ_READER:
+        case OBJ_FILE:
+        case OBJ_BYTES:
+        case OBJ_CSV:
+        case OBJ_REGEX:
+        case OBJ_FOREIGN:
+            // The natives left are all core objects, and extension natives,
+            // workers, readers, files, bytes, CSV readers, regular
+            // expressions and foreign objects are refused above.
+            break;
+    }
+}
+
+static void initWriter(Writer* writer) {
+    memset(writer, 0, sizeof(Writer));
+    int coreCount;
+    uint32_t fingerprint;
+    Obj** core = sharedCoreObjects(&coreCount, &fingerprint);
+    for (int i = 0; i < coreCount; i++) mapSet(&writer->indices, core[i], CORE_BIT | (uint32_t)i);
+}
+
+static void freeWriter(Writer* writer) {
+    free(writer->indices.entries);
+    free(writer->owners.entries);
+    free(writer->objects);
+    free(writer->bytes);
+}
+
+// Finds everything reachable from the objects added so far.
+static bool addReachable(Writer* writer) {
+    for (int i = 0; i < writer->count && writer->error == NULL; i++) {
+        addReferences(writer, writer->objects[i]);
+    }
+    return writer->error == NULL;
+}
+
+static void writeHeader(Writer* writer, uint32_t magic) {
+    int coreCount;
+    uint32_t fingerprint;
+    sharedCoreObjects(&coreCount, &fingerprint);
+    writeU32(writer, magic);
+    writeU32(writer, IMAGE_VERSION);
+    writeU32(writer, (uint32_t)sizeof(wchar_t));
+    writeU32(writer, fingerprint);
+    writer->checksumAt = writer->length;
+    writeU32(writer, 0);
+}
+
+// FNV-1a, which any change to a single byte is sure to alter.
+static uint32_t checksum(const uint8_t* bytes, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Fills in the header's checksum once everything after it is written.
+static void sealWriter(Writer* writer) {
+    size_t body = writer->checksumAt + sizeof(uint32_t);
+    uint32_t sum = checksum(writer->bytes + body, writer->length - body);
+    memcpy(writer->bytes + writer->checksumAt, &sum, sizeof(sum));
+}
+
+static void writeObjects(Writer* writer) {
+    writeU32(writer, (uint32_t)writer->count);
+    for (int i = 0; i < writer->count; i++) {
+        // Each record carries its length so loading can skip ahead.
+        writeU8(writer, (uint8_t)writer->objects[i]->type);
+        size_t lengthAt = writer->length;
+        writeU32(writer, 0);
+        writeObject(writer, writer->objects[i]);
+        uint32_t length = (uint32_t)(writer->length - lengthAt - sizeof(uint32_t));
+        memcpy(writer->bytes + lengthAt, &length, sizeof(length));
+    }
+}
+
+// 系统。快照（路径） writes the heap to an image and returns 假. When a
+// process resumes from that image, the call returns 真 instead.
+bool snapshotNative(VM* vm, int argCount, Value* args) {
+    // Only the root fiber's frames are all on the heap; a fiber or a native
+    // callback has C frames of its own that an image can't hold.
+    if (vm->fiber->closure != NULL || vm->fiber->nativeCalls != 0) {
+        return nativeError(vm, args, L"只能在主程序中创建快照。");
+    }
+
+    char path[PATH_MAX];
+    if (!encodePath(AS_STRING(args[0]), path)) {
+        return nativeError(vm, args, L"无效的路径。");
+    }
+
+    Writer writer;
+    initWriter(&writer);
+    writer.root = vm->fiber;
+    writer.rootTop = args - 1;
+
+    addObject(&writer, (Obj*)vm->fiber);
+    addTable(&writer, &vm->globals);
+    addTable(&writer, &vm->modules);
+    if (!addReachable(&writer)) {
+        const wchar_t* error = writer.error;
+        freeWriter(&writer);
+        return nativeError(vm, args, L"%ls", error);
+    }
+
+    writeHeader(&writer, IMAGE_MAGIC);
+    writeObjects(&writer);
+    writeTable(&writer, &vm->globals);
+    writeTable(&writer, &vm->modules);
+    sealWriter(&writer);
+
+    FILE* file = fopen(path, "wb");
+    bool written = file != NULL && fwrite(writer.bytes, 1, writer.length, file) == writer.length;
+    if (file != NULL && fclose(file) != 0) written = false;
+    freeWriter(&writer);
+    if (!written) return nativeError(vm, args, L"无法写入映像「%s」。", path);
+
+    args[-1] = BOOL_VAL(false);
+    return true;
+}
+
+typedef struct {
+    const uint8_t* bytes;
+    size_t length;
+    size_t offset;
+    bool failed;
+
+    Obj** objects;
+    uint32_t count;
+    Obj** core;
+    int coreCount;
+} Reader;
+
+static const uint8_t* readBytes(Reader* reader, size_t length) {
+    if (reader->failed || reader->length - reader->offset < length) {
+        reader->failed = true;
+        return NULL;
+    }
+    const uint8_t* bytes = reader->bytes + reader->offset;
+    reader->offset += length;
+    return bytes;
+}
+
+static uint8_t readU8(Reader* reader) {
+    const uint8_t* bytes = readBytes(reader, sizeof(uint8_t));
+    return bytes == NULL ? 0 : *bytes;
+}
+
+static uint32_t readU32(Reader* reader) {
+    uint32_t value = 0;
+    const uint8_t* bytes = readBytes(reader, sizeof(value));
+    if (bytes != NULL) memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static Obj* readTaggedRef(Reader* reader, uint8_t tag) {
+    if (tag == IMAGE_NIL) return NULL;
+    uint32_t index = readU32(reader);
+    if (tag == IMAGE_OBJECT && index < reader->count) return reader->objects[index];
+    if (tag == IMAGE_CORE && index < (uint32_t)reader->coreCount) return reader->core[index];
+    reader->failed = true;
+    return NULL;
+}
+
+// Reads a reference that must be null or an object of [type].
+static Obj* readRef(Reader* reader, ObjType type) {
+    Obj* object = readTaggedRef(reader, readU8(reader));
+    if (object != NULL && object->type != type) {
+        reader->failed = true;
+        return NULL;
+    }
+    return object;
+}
+
+static Value readValue(Reader* reader) {
+    uint8_t tag = readU8(reader);
+    switch (tag) {
+        case IMAGE_NIL: return NIL_VAL;
+        case IMAGE_FALSE: return BOOL_VAL(false);
+        case IMAGE_TRUE: return BOOL_VAL(true);
+        case IMAGE_NUMBER: {
+            double number = 0;
+            const uint8_t* bytes = readBytes(reader, sizeof(number));
+            if (bytes != NULL) memcpy(&number, bytes, sizeof(number));
+            return NUMBER_VAL(number);
+        }
+        case IMAGE_OBJECT:
+        case IMAGE_CORE: {
+            Obj* object = readTaggedRef(reader, tag);
+            return object == NULL ? NIL_VAL : OBJ_VAL(object);
+        }
+        default:
+            reader->failed = true;
+            return NIL_VAL;
+    }
+}
+
+static void readTable(VM* vm, Reader* reader, Table* table) {
+    uint32_t count = readU32(reader);
+    for (uint32_t i = 0; i < count && !reader->failed; i++) {
+        ObjString* key = (ObjString*)readRef(reader, OBJ_STRING);
+        Value value = readValue(reader);
+        if (key == NULL) reader->failed = true;
+        if (!reader->failed) tableSet(vm, table, key, value);
+    }
+}
+
+// First pass: allocates the object with whatever needs no references.
+static Obj* readShell(VM* vm, Reader* reader, ObjType type) {
+    switch (type) {
+        case OBJ_STRING: {
+            uint32_t length = readU32(reader);
+            const uint8_t* bytes = readBytes(reader, (size_t)length * sizeof(uint32_t));
+            if (bytes == NULL) return NULL;
+            wchar_t* chars = ALLOCATE(vm, wchar_t, length + 1);
+            for (uint32_t i = 0; i < length; i++) {
+                uint32_t c;
+                memcpy(&c, bytes + i * sizeof(uint32_t), sizeof(c));
+                chars[i] = (wchar_t)c;
+            }
+            chars[length] = L'\0';
+            return (Obj*)takeString(vm, chars, (int)length);
+        }
+        case OBJ_FUNCTION: {
+            ObjFunction* function = newFunction(vm);
+            function->arity = (int)readU32(reader);
+            function->upvalueCount = (int)readU32(reader);
+            function->isGenerator = readU8(reader);
+            function->writesUpvalues = readU8(reader);
+            // Frames point into the code, so it's loaded up front as well.
+            uint32_t count = readU32(reader);
+            const uint8_t* code = readBytes(reader, count);
+            const uint8_t* lines = readBytes(reader, sizeof(int) * (size_t)count);
+            if (reader->failed) return (Obj*)function;
+            Chunk* chunk = &function->chunk;
+            push(vm, OBJ_VAL(function));
+            chunk->code = GROW_ARRAY(vm, uint8_t, chunk->code, 0, count);
+            chunk->lines = GROW_ARRAY(vm, int, chunk->lines, 0, count);
+            pop(vm);
+            memcpy(chunk->code, code, count);
+            memcpy(chunk->lines, lines, sizeof(int) * count);
+            chunk->count = chunk->capacity = (int)count;
+            return (Obj*)function;
+        }
+        case OBJ_CLOSURE:
+            return NULL;   // Made once its function exists.
+        case OBJ_UPVALUE: return (Obj*)newUpvalue(vm, NULL);
+        case OBJ_CLASS: return (Obj*)newClass(vm, NULL);
+        case OBJ_INSTANCE: return (Obj*)newInstance(vm, NULL, false);
+        case OBJ_BOUND_METHOD: return (Obj*)newBoundMethod(vm, NIL_VAL, NULL);
+        case OBJ_LIST: return (Obj*)newList(vm);
+        case OBJ_MODULE: return (Obj*)newModule(vm, NULL);
+        case OBJ_FIBER: {
+            // Open upvalues point into the stack, so it gets its final size
+            // before anything refers to it.
+            uint32_t capacity = readU32(reader);
+            if (reader->failed || capacity > reader->length) return NULL;
+            ObjFiber* fiber = newFiber(vm, NULL);
+            if ((int)capacity > fiber->stackCapacity) {
+                push(vm, OBJ_VAL(fiber));
+                Value* stack = GROW_ARRAY(vm, Value, fiber->stack, fiber->stackCapacity, capacity);
+                pop(vm);
+                fiber->stack = stack;
+                fiber->stackTop = fiber->stack;
+                fiber->stackCapacity = (int)capacity;
+            }
+            return (Obj*)fiber;
+        }
+        default:
+            reader->failed = true;
+            return NULL;
+    }
+}
+
+// Second pass: fills in the object's references.
+static void readObject(VM* vm, Reader* reader, Obj* object) {
+    switch (object->type) {
+        case OBJ_STRING:
+            break;
+        case OBJ_FUNCTION: {
+            ObjFunction* function = (ObjFunction*)object;
+            Chunk* chunk = &function->chunk;
+            readBytes(reader, sizeof(uint32_t) * 3 + 2 + chunk->count + sizeof(int) * (size_t)chunk->count);
+            function->name = (ObjString*)readRef(reader, OBJ_STRING);
+            function->module = (ObjModule*)readRef(reader, OBJ_MODULE);
+            uint32_t constants = readU32(reader);
+            for (uint32_t i = 0; i < constants && !reader->failed; i++) {
+                writeValueArray(vm, &chunk->constants, readValue(reader));
+            }
+            break;
+        }
+        case OBJ_CLOSURE: {
+            ObjClosure* closure = (ObjClosure*)object;
+            readRef(reader, OBJ_FUNCTION);
+            for (int i = 0; i < closure->upvalueCount; i++) {
+                closure->upvalues[i] = (ObjUpvalue*)readRef(reader, OBJ_UPVALUE);
+            }
+            break;
+        }
+        case OBJ_UPVALUE: {
+            ObjUpvalue* upvalue = (ObjUpvalue*)object;
+            if (readU8(reader)) {
+                uint32_t owner = readU32(reader);
+                uint32_t slot = readU32(reader);
+                if (owner >= reader->count || reader->objects[owner]->type != OBJ_FIBER ||
+                    slot >= (uint32_t)((ObjFiber*)reader->objects[owner])->stackCapacity) {
+                    reader->failed = true;
+                    return;
+                }
+                upvalue->location = ((ObjFiber*)reader->objects[owner])->stack + slot;
+            } else {
+                upvalue->closed = readValue(reader);
+                upvalue->location = &upvalue->closed;
+            }
+            upvalue->next = (ObjUpvalue*)readRef(reader, OBJ_UPVALUE);
+            break;
+        }
+        case OBJ_CLASS: {
+            ObjClass* klass = (ObjClass*)object;
+            klass->name = (ObjString*)readRef(reader, OBJ_STRING);
+            readTable(vm, reader, &klass->methods);
+            break;
+        }
+        case OBJ_INSTANCE: {
+            ObjInstance* instance = (ObjInstance*)object;
+            instance->klass = (ObjClass*)readRef(reader, OBJ_CLASS);
+            instance->isStatic = readU8(reader);
+            if (instance->klass == NULL) reader->failed = true;
+            readTable(vm, reader, &instance->fields);
+            break;
+        }
+        case OBJ_BOUND_METHOD: {
+            ObjBoundMethod* bound = (ObjBoundMethod*)object;
+            bound->receiver = readValue(reader);
+            bound->method = (ObjClosure*)readRef(reader, OBJ_CLOSURE);
+            bound->native = (ObjNative*)readRef(reader, OBJ_NATIVE);
+            if (bound->method == NULL && bound->native == NULL) reader->failed = true;
+            break;
+        }
+        case OBJ_LIST: {
+            ObjList* list = (ObjList*)object;
+            uint32_t count = readU32(reader);
+            for (uint32_t i = 0; i < count && !reader->failed; i++) {
+                insertToList(vm, list, readValue(reader), list->count);
+            }
+            break;
+        }
+        case OBJ_MODULE: {
+            ObjModule* module = (ObjModule*)object;
+            module->path = (ObjString*)readRef(reader, OBJ_STRING);
+            module->body = (ObjFunction*)readRef(reader, OBJ_FUNCTION);
+            module->executed = readU8(reader);
+            uint32_t count = readU32(reader);
+            if (module->path == NULL || count > UINT8_COUNT) reader->failed = true;
+            for (uint32_t i = 0; i < count && !reader->failed; i++) {
+                Value name = readValue(reader);
+                Value value = readValue(reader);
+                if (!IS_STRING(name)) {
+                    reader->failed = true;
+                    break;
+                }
+                writeValueArray(vm, &module->names, name);
+                writeValueArray(vm, &module->values, value);
+                tableSet(vm, &module->slots, AS_STRING(name), NUMBER_VAL(i));
+            }
+            break;
+        }
+        case OBJ_FIBER: {
+            ObjFiber* fiber = (ObjFiber*)object;
+            readU32(reader);
+            uint8_t state = readU8(reader);
+            fiber->closure = (ObjClosure*)readRef(reader, OBJ_CLOSURE);
+            uint32_t frameCount = readU32(reader);
+            if (state > FIBER_PREEMPTED || frameCount > FRAMES_MAX) {
+                reader->failed = true;
+                return;
+            }
+            fiber->state = (FiberState)state;
+
+            for (uint32_t i = 0; i < frameCount; i++) {
+                CallFrame* frame = &fiber->frames[i];
+                frame->closure = (ObjClosure*)readRef(reader, OBJ_CLOSURE);
+                uint32_t ip = readU32(reader);
+                uint32_t slots = readU32(reader);
+                frame->callClosure = readU8(reader);
+                if (frame->closure == NULL || ip > (uint32_t)frame->closure->function->chunk.count ||
+                    slots > (uint32_t)fiber->stackCapacity) {
+                    reader->failed = true;
+                    return;
+                }
+                frame->ip = frame->closure->function->chunk.code + ip;
+                frame->slots = fiber->stack + slots;
+            }
+            fiber->frameCount = (int)frameCount;
+
+            uint32_t count = readU32(reader);
+            if (reader->failed || count > (uint32_t)fiber->stackCapacity) {
+                reader->failed = true;
+                return;
+            }
+            for (uint32_t i = 0; i < count; i++) fiber->stack[i] = readValue(reader);
+            fiber->stackTop = fiber->stack + count;
+            fiber->openUpvalues = (ObjUpvalue*)readRef(reader, OBJ_UPVALUE);
+            fiber->caller = (ObjFiber*)readRef(reader, OBJ_FIBER);
+            fiber->transfer = readValue(reader);
+            fiber->nativeCalls = (int)readU32(reader);
+            break;
+        }
+        default:
+            reader->failed = true;
+            break;
+    }
+}
+
+static bool readHeader(Reader* reader, uint32_t magic) {
+    int coreCount;
+    uint32_t fingerprint;
+    reader->core = sharedCoreObjects(&coreCount, &fingerprint);
+    reader->coreCount = coreCount;
+
+    if (readU32(reader) != magic || readU32(reader) != IMAGE_VERSION ||
+        readU32(reader) != sizeof(wchar_t) || readU32(reader) != fingerprint) {
+        return false;
+    }
+    uint32_t sum = readU32(reader);
+    return !reader->failed && sum == checksum(reader->bytes + reader->offset, reader->length - reader->offset);
+}
+
+// Reads the object records into [reader->objects], keeping each object in
+// [loaded] until the caller has somewhere else to keep it.
+static bool readObjects(VM* vm, Reader* reader, ObjList* loaded) {
+    reader->count = readU32(reader);
+    if (reader->failed || reader->count == 0 || reader->count > reader->length) {
+        reader->failed = true;
+        return false;
+    }
+
+    reader->objects = (Obj**)calloc(reader->count, sizeof(Obj*));
+    size_t* offsets = (size_t*)malloc(sizeof(size_t) * reader->count);
+    if (reader->objects == NULL || offsets == NULL) exit(1);
+
+    // Make every object but the closures, then the closures, then fill
+    // them all in, so references can point anywhere in the image.
+    for (uint32_t i = 0; i < reader->count && !reader->failed; i++) {
+        uint8_t type = readU8(reader);
+        uint32_t length = readU32(reader);
+        offsets[i] = reader->offset;
+        size_t end = reader->offset + length;
+        if (reader->failed || length > reader->length - reader->offset) break;
+        Obj* object = readShell(vm, reader, (ObjType)type);
+        if (object != NULL) {
+            reader->objects[i] = object;
+            push(vm, OBJ_VAL(object));
+            insertToList(vm, loaded, OBJ_VAL(object), loaded->count);
+            pop(vm);
+        } else if (type != OBJ_CLOSURE) {
+            reader->failed = true;
+        }
+        reader->offset = end;
+    }
+    size_t recordsEnd = reader->offset;
+
+    for (uint32_t i = 0; i < reader->count && !reader->failed; i++) {
+        if (reader->objects[i] != NULL) continue;
+        reader->offset = offsets[i];
+        ObjFunction* function = (ObjFunction*)readRef(reader, OBJ_FUNCTION);
+        if (function == NULL) {
+            reader->failed = true;
+            break;
+        }
+        reader->objects[i] = (Obj*)newClosure(vm, function);
+        push(vm, OBJ_VAL(reader->objects[i]));
+        insertToList(vm, loaded, OBJ_VAL(reader->objects[i]), loaded->count);
+        pop(vm);
+    }
+
+    for (uint32_t i = 0; i < reader->count && !reader->failed; i++) {
+        reader->offset = offsets[i];
+        readObject(vm, reader, reader->objects[i]);
+    }
+    reader->offset = recordsEnd;
+    free(offsets);
+    return !reader->failed;
+}
+
+static bool readImage(VM* vm, Reader* reader) {
+    if (!readHeader(reader, IMAGE_MAGIC)) return false;
+
+    // Everything loaded is kept in this list until the globals refer to it.
+    ObjList* loaded = newList(vm);
+    push(vm, OBJ_VAL(loaded));
+
+    if (readObjects(vm, reader, loaded) && reader->objects[0]->type != OBJ_FIBER) reader->failed = true;
+    ObjFiber* root = reader->failed ? NULL : (ObjFiber*)reader->objects[0];
+
+    if (!reader->failed) readTable(vm, reader, &vm->globals);
+    if (!reader->failed) readTable(vm, reader, &vm->modules);
+    // The image's root fiber was saved inside 系统。快照; finish that call
+    // and carry on from it.
+    if (!reader->failed && (root->closure != NULL || root->frameCount == 0 ||
+                            root->stackTop >= root->stack + root->stackCapacity)) {
+        reader->failed = true;
+    }
+    pop(vm);
+    if (!reader->failed) {
+        *root->stackTop++ = BOOL_VAL(true);
+        root->state = FIBER_RUNNING;
+        vm->fiber = root;
+    }
+
+    free(reader->objects);
+    return !reader->failed;
+}
+
+// Maps the file at [path] for reading; returns NULL if it can't.
+static const uint8_t* mapImage(const char* path, size_t* length) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void* bytes = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (bytes == MAP_FAILED) return NULL;
+    *length = info.st_size;
+    return (const uint8_t*)bytes;
+}
+
+bool loadImage(VM* vm, const char* path) {
+    Reader reader;
+    memset(&reader, 0, sizeof(reader));
+    reader.bytes = mapImage(path, &reader.length);
+    if (reader.bytes == NULL) return false;
+    bool loaded = readImage(vm, &reader);
+    munmap((void*)reader.bytes, reader.length);
+    return loaded;
+}
+
+static void writeSourceStamp(Writer* writer, const struct stat* source) {
+    uint64_t size = (uint64_t)source->st_size;
+    int64_t seconds = (int64_t)source->st_mtim.tv_sec;
+    writeBytes(writer, &size, sizeof(size));
+    writeBytes(writer, &seconds, sizeof(seconds));
+    writeU32(writer, (uint32_t)source->st_mtim.tv_nsec);
+}
+
+static bool readSourceStamp(Reader* reader, const struct stat* source) {
+    uint64_t size = 0;
+    int64_t seconds = 0;
+    const uint8_t* bytes = readBytes(reader, sizeof(size));
+    if (bytes != NULL) memcpy(&size, bytes, sizeof(size));
+    bytes = readBytes(reader, sizeof(seconds));
+    if (bytes != NULL) memcpy(&seconds, bytes, sizeof(seconds));
+    uint32_t nanoseconds = readU32(reader);
+    return !reader->failed && size == (uint64_t)source->st_size &&
+           seconds == (int64_t)source->st_mtim.tv_sec && nanoseconds == (uint32_t)source->st_mtim.tv_nsec;
+}
+
+// Writes the compiled, not yet run [module] to [path], stamped with the
+// size and modification time of its [source]. The file is renamed into
+// place, so other processes never read half of it. Failing is harmless:
+// the module is compiled again next time.
+void saveModuleCache(VM* vm, ObjModule* module, const char* path, const struct stat* source) {
+    Writer writer;
+    initWriter(&writer);
+    addObject(&writer, (Obj*)module);
+    if (!addReachable(&writer)) {
+        freeWriter(&writer);
+        return;
+    }
+
+    writeHeader(&writer, MODULE_MAGIC);
+    writeSourceStamp(&writer, source);
+    writeObjects(&writer);
+    sealWriter(&writer);
+
+    char temporary[PATH_MAX];
+    int fd = -1;
+    if (snprintf(temporary, sizeof(temporary), "%s.XXXXXX", path) < (int)sizeof(temporary)) {
+        fd = mkstemp(temporary);
+    }
+    if (fd >= 0) {
+        bool written = write(fd, writer.bytes, writer.length) == (ssize_t)writer.length;
+        if (close(fd) != 0) written = false;
+        if (!written || rename(temporary, path) != 0) unlink(temporary);
+    }
+    freeWriter(&writer);
+}
+
+// Loads the module cached at [path] if it was compiled from [source] as it
+// is now, by this build of the interpreter.
+ObjModule* loadModuleCache(VM* vm, const char* path, const struct stat* source) {
+    Reader reader;
+    memset(&reader, 0, sizeof(reader));
+    reader.bytes = mapImage(path, &reader.length);
+    if (reader.bytes == NULL) return NULL;
+
+    ObjModule* module = NULL;
+    if (readHeader(&reader, MODULE_MAGIC) && readSourceStamp(&reader, source)) {
+        ObjList* loaded = newList(vm);
+        push(vm, OBJ_VAL(loaded));
+        if (readObjects(vm, &reader, loaded) && reader.objects[0]->type == OBJ_MODULE) {
+            module = (ObjModule*)reader.objects[0];
+            if (module->body == NULL || module->executed) module = NULL;
+        }
+        pop(vm);
+        free(reader.objects);
+    }
+    munmap((void*)reader.bytes, reader.length);
+    return module;
+}
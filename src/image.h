@@ -0,0 +1,19 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_IMAGE_H
+#define QI_IMAGE_H
+
+#include <sys/stat.h>
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+bool snapshotNative(VM* vm, int argCount, Value* args);
+bool loadImage(VM* vm, const char* path);
+void saveModuleCache(VM* vm, ObjModule* module, const char* path, const struct stat* source);
+ObjModule* loadModuleCache(VM* vm, const char* path, const struct stat* source);
+
+#endif //QI_IMAGE_H
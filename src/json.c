@@ -0,0 +1,705 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#define _GNU_SOURCE
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytes.h"
+#include "core_module.h"
+#include "json.h"
+#include "memory.h"
+#include "scanner.h"
+
+// Deeper nesting is refused rather than risking the C stack, and stops
+// 字符串化 on a list that contains itself.
+#define JSON_MAX_DEPTH 1000
+
+#define ONES 0x0101010101010101ull
+#define HIGHS 0x8080808080808080ull
+
+static inline uint64_t zeroBytes(uint64_t word) {
+    return (word - ONES) & ~word & HIGHS;
+}
+
+// Whether any of eight bytes ends a run of plain string characters: a
+// quote, a backslash or a control character.
+static inline bool endsPlainRun(uint64_t word) {
+    return (zeroBytes(word ^ (ONES * '"')) | zeroBytes(word ^ (ONES * '\\')) |
+            ((word - ONES * 0x20) & ~word & HIGHS)) != 0;
+}
+
+typedef struct {
+    VM* vm;
+    const char* start;
+    const char* current;
+    const char* end;
+    ObjClass* objectClass;
+    int depth;
+    const wchar_t* error;
+} JsonParser;
+
+static bool parseError(JsonParser* parser, const wchar_t* message) {
+    if (parser->error == NULL) parser->error = message;
+    return false;
+}
+
+static void skipWhitespace(JsonParser* parser) {
+    const char* c = parser->current;
+    // Indented documents have long runs of spaces.
+    while (parser->end - c >= 8) {
+        uint64_t word;
+        memcpy(&word, c, 8);
+        if (word != ONES * ' ') break;
+        c += 8;
+    }
+    while (c < parser->end && (*c == ' ' || *c == '\n' || *c == '\r' || *c == '\t')) c++;
+    parser->current = c;
+}
+
+static bool parseValue(JsonParser* parser, Value* value);
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parseHex(JsonParser* parser, const char* c, uint32_t* value) {
+    if (parser->end - c < 4) return parseError(parser, L"「\\u」后需要四个十六进制数字");
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hexDigit(c[i]);
+        if (digit < 0) return parseError(parser, L"「\\u」后需要四个十六进制数字");
+        *value = (*value << 4) | (uint32_t)digit;
+    }
+    return true;
+}
+
+// Decodes a string with escapes, starting from its first byte. Slower than
+// the plain case, so only used once a backslash turns up.
+static bool parseEscapedString(JsonParser* parser, const char* start, ObjString** string) {
+    VM* vm = parser->vm;
+    int capacity = 16;
+    int count = 0;
+    wchar_t* chars = ALLOCATE(vm, wchar_t, capacity + 1);
+
+    const char* c = start;
+    for (;;) {
+        if (c == parser->end) {
+            FREE_ARRAY(vm, wchar_t, chars, capacity + 1);
+            return parseError(parser, L"字符串没有结束");
+        }
+        if (count == capacity) {
+            if (capacity > INT_MAX / 2 - 1) {
+                FREE_ARRAY(vm, wchar_t, chars, capacity + 1);
+                return parseError(parser, L"字符串太长");
+            }
+            chars = GROW_ARRAY(vm, wchar_t, chars, capacity + 1, capacity * 2 + 1);
+            capacity *= 2;
+        }
+
+        unsigned char byte = (unsigned char)*c;
+        if (byte == '"') break;
+        if (byte < 0x20) {
+            FREE_ARRAY(vm, wchar_t, chars, capacity + 1);
+            return parseError(parser, L"字符串中有控制字符");
+        }
+        if (byte < 0x80 && byte != '\\') {
+            chars[count++] = byte;
+            c++;
+            continue;
+        }
+        if (byte >= 0x80) {
+            // The closing quote stops decodeUtf8 from running off the end,
+            // unless the input ends first.
+            if (parser->end - c < 4) {
+                char tail[4] = {0};
+                memcpy(tail, c, parser->end - c);
+                c += decodeUtf8(tail, &chars[count++]);
+            } else {
+                c += decodeUtf8(c, &chars[count++]);
+            }
+            continue;
+        }
+
+        // An escape.
+        if (parser->end - c < 2) {
+            FREE_ARRAY(vm, wchar_t, chars, capacity + 1);
+            return parseError(parser, L"字符串没有结束");
+        }
+        wchar_t escaped;
+        switch (c[1]) {
+            case '"': escaped = L'"'; break;
+            case '\\': escaped = L'\\'; break;
+            case '/': escaped = L'/'; break;
+            case 'b': escaped = L'\b'; break;
+            case 'f': escaped = L'\f'; break;
+            case 'n': escaped = L'\n'; break;
+            case 'r': escaped = L'\r'; break;
+            case 't': escaped = L'\t'; break;
+            case 'u': {
+                uint32_t value;
+                if (!parseHex(parser, c + 2, &value)) {
+                    FREE_ARRAY(vm, wchar_t, chars, capacity + 1);
+                    return false;
+                }
+                c += 6;
+                // Join a surrogate pair. A lone surrogate can't be encoded.
+                if (value >= 0xD800 && value <= 0xDBFF && parser->end - c >= 6 && c[0] == '\\' && c[1] == 'u') {
+                    uint32_t low;
+                    if (parseHex(parser, c + 2, &low) && low >= 0xDC00 && low <= 0xDFFF) {
+                        value = 0x10000 + ((value - 0xD800) << 10) + (low - 0xDC00);
+                        c += 6;
+                    }
+                    parser->error = NULL;
+                }
+                if (value >= 0xD800 && value <= 0xDFFF) value = 0xFFFD;
+                chars[count++] = (wchar_t)value;
+                continue;
+            }
+            default:
+                FREE_ARRAY(vm, wchar_t, chars, capacity + 1);
+                return parseError(parser, L"无效的转义序列");
+        }
+        chars[count++] = escaped;
+        c += 2;
+    }
+
+    parser->current = c + 1;
+    chars = GROW_ARRAY(vm, wchar_t, chars, capacity + 1, count + 1);
+    chars[count] = L'\0';
+    *string = takeString(vm, chars, count);
+    return true;
+}
+
+// Parses a string after its opening quote. Runs of plain characters are
+// found eight bytes at a time and decoded straight from the input.
+static bool parseString(JsonParser* parser, ObjString** string) {
+    const char* start = parser->current;
+    const char* c = start;
+    while (parser->end - c >= 8) {
+        uint64_t word;
+        memcpy(&word, c, 8);
+        if (endsPlainRun(word)) break;
+        c += 8;
+    }
+    while (c < parser->end && *c != '"' && *c != '\\' && (unsigned char)*c >= 0x20) c++;
+
+    if (c == parser->end) return parseError(parser, L"字符串没有结束");
+    if (*c != '"') return parseEscapedString(parser, start, string);
+    if (c - start > INT_MAX) return parseError(parser, L"字符串太长");
+    // The closing quote can't continue a UTF-8 sequence, as copyUtf8 needs.
+    *string = copyUtf8(parser->vm, start, (int)(c - start));
+    parser->current = c + 1;
+    return true;
+}
+
+static const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Parses a number. When the digits fit in 53 bits and the exponent is
+// small, one multiplication or division gives the correctly rounded
+// result; anything else goes to strtod in the "C" locale.
+static bool parseNumber(JsonParser* parser, Value* value) {
+    const char* start = parser->current;
+    const char* c = start;
+    const char* end = parser->end;
+    bool negative = c < end && *c == '-';
+    if (negative) c++;
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    if (c < end && *c == '0') {
+        c++;
+    } else if (c < end && *c >= '1' && *c <= '9') {
+        while (c < end && *c >= '0' && *c <= '9') {
+            if (digits < 19) mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+            else exponent++;
+            if (mantissa != 0) digits++;
+            c++;
+        }
+    } else {
+        return parseError(parser, L"无效的值");
+    }
+    if (c < end && *c == '.') {
+        c++;
+        if (c == end || *c < '0' || *c > '9') return parseError(parser, L"小数点后需要数字");
+        while (c < end && *c >= '0' && *c <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+                exponent--;
+                if (mantissa != 0) digits++;
+            }
+            c++;
+        }
+    }
+    if (c < end && (*c == 'e' || *c == 'E')) {
+        c++;
+        bool negativeExponent = c < end && *c == '-';
+        if (c < end && (*c == '-' || *c == '+')) c++;
+        if (c == end || *c < '0' || *c > '9') return parseError(parser, L"指数需要数字");
+        int written = 0;
+        while (c < end && *c >= '0' && *c <= '9') {
+            if (written < 100000) written = written * 10 + (*c - '0');
+            c++;
+        }
+        exponent += negativeExponent ? -written : written;
+    }
+    parser->current = c;
+
+    double number;
+    if (digits < 19 && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        number = (double)mantissa;
+        number = exponent < 0 ? number / powersOfTen[-exponent] : number * powersOfTen[exponent];
+    } else {
+        // strtod needs the text terminated.
+        size_t length = (size_t)(c - start);
+        char small[64];
+        char* text = length < sizeof(small) ? small : (char*)malloc(length + 1);
+        if (text == NULL) exit(1);
+        memcpy(text, start, length);
+        text[length] = '\0';
+        number = strtod_l(text, NULL, numberLocale());
+        if (text != small) free(text);
+        negative = false;
+    }
+    *value = NUMBER_VAL(negative ? -number : number);
+    return true;
+}
+
+static bool matchWord(JsonParser* parser, const char* word, size_t length) {
+    if ((size_t)(parser->end - parser->current) < length || memcmp(parser->current, word, length) != 0) {
+        return parseError(parser, L"无效的值");
+    }
+    parser->current += length;
+    return true;
+}
+
+static bool parseArray(JsonParser* parser, Value* value) {
+    ObjList* list = newList(parser->vm);
+    *value = OBJ_VAL(list);
+    skipWhitespace(parser);
+    if (parser->current < parser->end && *parser->current == ']') {
+        parser->current++;
+        return true;
+    }
+    for (;;) {
+        Value item;
+        if (!parseValue(parser, &item)) return false;
+        insertToList(parser->vm, list, item, list->count);
+        skipWhitespace(parser);
+        if (parser->current == parser->end) return parseError(parser, L"数组没有结束");
+        char c = *parser->current++;
+        if (c == ']') return true;
+        if (c != ',') return parseError(parser, L"数组中需要「,」或「]」");
+    }
+}
+
+// Objects become instances of JSON。对象 with a field for each member.
+static bool parseObject(JsonParser* parser, Value* value) {
+    ObjInstance* instance = newInstance(parser->vm, parser->objectClass, false);
+    *value = OBJ_VAL(instance);
+    skipWhitespace(parser);
+    if (parser->current < parser->end && *parser->current == '}') {
+        parser->current++;
+        return true;
+    }
+    for (;;) {
+        skipWhitespace(parser);
+        if (parser->current == parser->end || *parser->current != '"') return parseError(parser, L"需要字符串作为键");
+        parser->current++;
+        ObjString* key;
+        if (!parseString(parser, &key)) return false;
+        skipWhitespace(parser);
+        if (parser->current == parser->end || *parser->current != ':') return parseError(parser, L"键后需要「:」");
+        parser->current++;
+
+        Value member;
+        if (!parseValue(parser, &member)) return false;
+        tableSet(parser->vm, &instance->fields, key, member);
+        skipWhitespace(parser);
+        if (parser->current == parser->end) return parseError(parser, L"对象没有结束");
+        char c = *parser->current++;
+        if (c == '}') return true;
+        if (c != ',') return parseError(parser, L"对象中需要「,」或「}」");
+    }
+}
+
+static bool parseValue(JsonParser* parser, Value* value) {
+    skipWhitespace(parser);
+    if (parser->current == parser->end) return parseError(parser, L"需要一个值");
+
+    switch (*parser->current) {
+        case '{':
+        case '[': {
+            if (++parser->depth > JSON_MAX_DEPTH) return parseError(parser, L"嵌套过深");
+            bool isObject = *parser->current++ == '{';
+            bool parsed = isObject ? parseObject(parser, value) : parseArray(parser, value);
+            parser->depth--;
+            return parsed;
+        }
+        case '"': {
+            parser->current++;
+            ObjString* string;
+            if (!parseString(parser, &string)) return false;
+            *value = OBJ_VAL(string);
+            return true;
+        }
+        case 't':
+            *value = BOOL_VAL(true);
+            return matchWord(parser, "true", 4);
+        case 'f':
+            *value = BOOL_VAL(false);
+            return matchWord(parser, "false", 5);
+        case 'n':
+            *value = NIL_VAL;
+            return matchWord(parser, "null", 4);
+        default:
+            return parseNumber(parser, value);
+    }
+}
+
+// Parses [length] bytes of UTF-8 into args[-1], or leaves an error there.
+static bool parseJson(VM* vm, ObjClass* objectClass, const char* text, size_t length, Value* args) {
+    JsonParser parser;
+    parser.vm = vm;
+    parser.start = text;
+    parser.current = text;
+    parser.end = text + length;
+    parser.objectClass = objectClass;
+    parser.depth = 0;
+    parser.error = NULL;
+
+    // Everything made while parsing ends up in the result, so a collection
+    // part way through would free nothing and only has to trace it all.
+    vm->gcPaused++;
+    Value value = NIL_VAL;
+    bool parsed = parseValue(&parser, &value);
+    if (parsed) {
+        skipWhitespace(&parser);
+        if (parser.current != parser.end) parsed = parseError(&parser, L"值后有多余的内容");
+    }
+    args[-1] = value;
+    resumeGC(vm);
+    if (parsed) return true;
+
+    int line = 1;
+    for (const char* c = parser.start; c < parser.current && c < parser.end; c++) line += *c == '\n';
+    return nativeError(vm, args, L"无效的 JSON（行 %d）：%ls。", line, parser.error);
+}
+
+// The interned name is already in the table, so this doesn't allocate.
+static ObjClass* getObjectClass(VM* vm, Value jsonInstance) {
+    Value objectClass = NIL_VAL;
+    tableGet(&AS_INSTANCE(jsonInstance)->fields, copyString(vm, L"对象", 2), &objectClass);
+    return IS_CLASS(objectClass) ? AS_CLASS(objectClass) : NULL;
+}
+
+// JSON。解析（文本） parses a string or a 字节 of UTF-8. Arrays become lists,
+// objects become JSON。对象 instances and null becomes 空.
+static bool parseNative(VM* vm, int argCount, Value* args) {
+    if (!IS_INSTANCE(args[-1])) return nativeError(vm, args, L"「JSON。对象」必须是一个类。");
+    ObjClass* objectClass = getObjectClass(vm, args[-1]);
+    if (objectClass == NULL) return nativeError(vm, args, L"「JSON。对象」必须是一个类。");
+    if (IS_BYTES(args[0])) {
+        ObjBytes* bytes = AS_BYTES(args[0]);
+        return parseJson(vm, objectClass, (const char*)bytesData(bytes), bytes->count, args);
+    }
+    if (!IS_STRING(args[0])) {
+        return nativeError(vm, args, L"参数 1（文本）的类型必须是「字符串」或「字节」，而不是「%ls」。", getType(args[0]));
+    }
+    // Parsing UTF-8 keeps one scanner for both; 字节 skip this step.
+    ObjString* string = AS_STRING(args[0]);
+    int length = (int)wcsnlen(string->chars, string->length);
+    size_t size = utf8Size(string->chars, length);
+    char* text = (char*)malloc(size + 1);
+    if (text == NULL) exit(1);
+    encodeUtf8(string->chars, length, (uint8_t*)text);
+    bool parsed = parseJson(vm, objectClass, text, size, args);
+    free(text);
+    return parsed;
+}
+
+typedef struct {
+    VM* vm;
+    uint8_t* data;
+    size_t count;
+    size_t capacity;
+    int indent;   // Spaces per level, or 0 for no whitespace.
+    int depth;
+    Value bad;    // The value that couldn't be written, if any.
+} JsonWriter;
+
+static void reserve(JsonWriter* writer, size_t needed) {
+    if (writer->capacity - writer->count >= needed) return;
+    size_t capacity = GROW_CAPACITY(writer->capacity);
+    if (capacity < writer->count + needed) capacity = writer->count + needed;
+    writer->data = GROW_ARRAY(writer->vm, uint8_t, writer->data, writer->capacity, capacity);
+    writer->capacity = capacity;
+}
+
+static void writeRaw(JsonWriter* writer, const char* text, size_t length) {
+    reserve(writer, length);
+    memcpy(writer->data + writer->count, text, length);
+    writer->count += length;
+}
+
+static void writeNewline(JsonWriter* writer) {
+    if (writer->indent == 0) return;
+    size_t spaces = (size_t)writer->indent * writer->depth;
+    reserve(writer, spaces + 1);
+    writer->data[writer->count++] = '\n';
+    memset(writer->data + writer->count, ' ', spaces);
+    writer->count += spaces;
+}
+
+static const char hexDigits[] = "0123456789abcdef";
+
+static void writeString(JsonWriter* writer, ObjString* string) {
+    int length = (int)wcsnlen(string->chars, string->length);
+    reserve(writer, 1);
+    writer->data[writer->count++] = '"';
+    // Work in blocks so the worst case, six bytes a character, only needs
+    // to be reserved for one block at a time.
+    for (int i = 0; i < length;) {
+        int stop = length - i > 4096 ? i + 4096 : length;
+        reserve(writer, (size_t)(stop - i) * 6);
+        uint8_t* out = writer->data + writer->count;
+        for (; i < stop; i++) {
+            uint32_t c = (uint32_t)string->chars[i];
+            if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+                *out++ = (uint8_t)c;
+            } else if (c >= 0x80) {
+                int size = (int)utf8Size(&string->chars[i], 1);
+                encodeUtf8(&string->chars[i], 1, out);
+                out += size;
+            } else {
+                *out++ = '\\';
+                switch (c) {
+                    case '"': *out++ = '"'; break;
+                    case '\\': *out++ = '\\'; break;
+                    case '\b': *out++ = 'b'; break;
+                    case '\f': *out++ = 'f'; break;
+                    case '\n': *out++ = 'n'; break;
+                    case '\r': *out++ = 'r'; break;
+                    case '\t': *out++ = 't'; break;
+                    default:
+                        *out++ = 'u';
+                        *out++ = '0';
+                        *out++ = '0';
+                        *out++ = (uint8_t)hexDigits[c >> 4];
+                        *out++ = (uint8_t)hexDigits[c & 0xF];
+                }
+            }
+        }
+        writer->count = out - writer->data;
+    }
+    reserve(writer, 1);
+    writer->data[writer->count++] = '"';
+}
+
+// Writes integers digit by digit and anything else with the fewest
+// significant digits that read back as the same number.
+static bool writeNumber(JsonWriter* writer, double number) {
+    if (!isfinite(number)) return false;
+    char text[32];
+    int length;
+    if (number == floor(number) && fabs(number) < 1e15) {
+        uint64_t integer = (uint64_t)fabs(number);
+        char* end = text + sizeof(text);
+        char* c = end;
+        do {
+            *--c = (char)('0' + integer % 10);
+            integer /= 10;
+        } while (integer != 0);
+        if (number < 0) *--c = '-';
+        writeRaw(writer, c, (size_t)(end - c));
+        return true;
+    }
+    locale_t previous = uselocale(numberLocale());
+    for (int precision = 15; precision <= 17; precision++) {
+        length = snprintf(text, sizeof(text), "%.*g", precision, number);
+        if (strtod(text, NULL) == number) break;
+    }
+    uselocale(previous);
+    writeRaw(writer, text, (size_t)length);
+    return true;
+}
+
+static bool writeValue(JsonWriter* writer, Value value) {
+    if (IS_NIL(value)) {
+        writeRaw(writer, "null", 4);
+        return true;
+    }
+    if (IS_BOOL(value)) {
+        if (AS_BOOL(value)) writeRaw(writer, "true", 4);
+        else writeRaw(writer, "false", 5);
+        return true;
+    }
+    if (IS_NUMBER(value)) {
+        if (writeNumber(writer, AS_NUMBER(value))) return true;
+        writer->bad = value;
+        return false;
+    }
+    if (IS_STRING(value)) {
+        writeString(writer, AS_STRING(value));
+        return true;
+    }
+    if (!IS_LIST(value) && !IS_INSTANCE(value)) {
+        writer->bad = value;
+        return false;
+    }
+    if (writer->depth >= JSON_MAX_DEPTH) {
+        writer->bad = value;
+        return false;
+    }
+
+    bool isList = IS_LIST(value);
+    writeRaw(writer, isList ? "[" : "{", 1);
+    writer->depth++;
+    bool empty = true;
+    if (isList) {
+        ObjList* list = AS_LIST(value);
+        for (int i = 0; i < list->count; i++) {
+            if (!empty) writeRaw(writer, ",", 1);
+            empty = false;
+            writeNewline(writer);
+            if (!writeValue(writer, list->items[i])) return false;
+        }
+    } else {
+        Table* fields = &AS_INSTANCE(value)->fields;
+        for (int i = 0; i < fields->capacity; i++) {
+            Entry* entry = &fields->entries[i];
+            if (entry->key == NULL) continue;
+            if (!empty) writeRaw(writer, ",", 1);
+            empty = false;
+            writeNewline(writer);
+            writeString(writer, entry->key);
+            writeRaw(writer, ": ", writer->indent == 0 ? 1 : 2);
+            if (!writeValue(writer, entry->value)) return false;
+        }
+    }
+    writer->depth--;
+    if (!empty) writeNewline(writer);
+    writeRaw(writer, isList ? "]" : "}", 1);
+    return true;
+}
+
+// Writes args[0] into a buffer of UTF-8, indented by the optional args[1].
+// On failure the buffer is freed and the error left in args[-1].
+static bool writeJson(VM* vm, int argCount, Value* args, JsonWriter* writer) {
+    if (argCount < 1 || argCount > 2) {
+        return nativeError(vm, args, L"需要 1 到 2 个参数，但得到 %d。", argCount);
+    }
+    writer->vm = vm;
+    writer->data = NULL;
+    writer->count = 0;
+    writer->capacity = 0;
+    writer->indent = 0;
+    writer->depth = 0;
+    writer->bad = NIL_VAL;
+    if (argCount == 2) {
+        if (!IS_NUMBER(args[1]) || AS_NUMBER(args[1]) < 0 || AS_NUMBER(args[1]) > 10) {
+            return nativeError(vm, args, L"参数 2（缩进）必须是 0 到 10 的数字。");
+        }
+        writer->indent = (int)AS_NUMBER(args[1]);
+    }
+
+    if (writeValue(writer, args[0])) return true;
+    FREE_ARRAY(vm, uint8_t, writer->data, writer->capacity);
+    if (writer->depth >= JSON_MAX_DEPTH) return nativeError(vm, args, L"JSON 嵌套过深。");
+    if (IS_NUMBER(writer->bad)) return nativeError(vm, args, L"JSON 不能表示「%g」。", AS_NUMBER(writer->bad));
+    return nativeError(vm, args, L"无法把「%ls」转换为 JSON。", getType(writer->bad));
+}
+
+// JSON。字符串化（值，缩进） returns the value as JSON text. Lists become
+// arrays and instances objects of their fields.
+static bool stringifyNative(VM* vm, int argCount, Value* args) {
+    JsonWriter writer;
+    if (!writeJson(vm, argCount, args, &writer)) return false;
+    if (writer.count > INT_MAX) {
+        FREE_ARRAY(vm, uint8_t, writer.data, writer.capacity);
+        return nativeError(vm, args, L"JSON 太长，无法放入一个字符串。");
+    }
+    // copyUtf8 needs a byte after the text that can't continue a sequence.
+    reserve(&writer, 1);
+    writer.data[writer.count] = '\0';
+    ObjString* string = copyUtf8(vm, (const char*)writer.data, (int)writer.count);
+    FREE_ARRAY(vm, uint8_t, writer.data, writer.capacity);
+    args[-1] = OBJ_VAL(string);
+    return true;
+}
+
+// JSON。编码（值，缩进） returns the JSON text as a 字节 of UTF-8. The
+// buffer it was written into becomes the array, so nothing is decoded or
+// copied.
+static bool encodeNative(VM* vm, int argCount, Value* args) {
+    JsonWriter writer;
+    if (!writeJson(vm, argCount, args, &writer)) return false;
+    args[-1] = OBJ_VAL(takeBytes(vm, writer.data, writer.count, writer.capacity));
+    return true;
+}
+
+// JSON。键（对象） returns a list of an instance's field names.
+static bool keysNative(VM* vm, int argCount, Value* args) {
+    if (!IS_INSTANCE(args[0])) {
+        return nativeError(vm, args, L"参数 1（对象）的类型必须是「实例」，而不是「%ls」。", getType(args[0]));
+    }
+    Table* fields = &AS_INSTANCE(args[0])->fields;
+    ObjList* list = newList(vm);
+    args[-1] = OBJ_VAL(list);
+    for (int i = 0; i < fields->capacity; i++) {
+        if (fields->entries[i].key == NULL) continue;
+        insertToList(vm, list, OBJ_VAL(fields->entries[i].key), list->count);
+    }
+    return true;
+}
+
+// JSON。取（对象，键） returns a field by name, or 空 if there is none, for
+// keys that aren't valid names.
+static bool getNative(VM* vm, int argCount, Value* args) {
+    if (!IS_INSTANCE(args[0])) {
+        return nativeError(vm, args, L"参数 1（对象）的类型必须是「实例」，而不是「%ls」。", getType(args[0]));
+    }
+    if (!IS_STRING(args[1])) {
+        return nativeError(vm, args, L"参数 2（键）的类型必须是「字符串」，而不是「%ls」。", getType(args[1]));
+    }
+    Value value = NIL_VAL;
+    tableGet(&AS_INSTANCE(args[0])->fields, AS_STRING(args[1]), &value);
+    args[-1] = value;
+    return true;
+}
+
+void initJsonClass(VM* vm) {
+    push(vm, OBJ_VAL(copyString(vm, L"JSON", 4)));
+    ObjClass* jsonClass = newClass(vm, AS_STRING(vm->fiber->stackTop[-1]));
+    pop(vm);
+    push(vm, OBJ_VAL(jsonClass));
+    defineNative(vm, L"解析", parseNative, 1, jsonClass);
+    defineNative(vm, L"字符串化", stringifyNative, -1, jsonClass);
+    defineNative(vm, L"编码", encodeNative, -1, jsonClass);
+    defineNative(vm, L"键", keysNative, 1, jsonClass);
+    defineNative(vm, L"取", getNative, 2, jsonClass);
+    ObjInstance* jsonInstance = newInstance(vm, jsonClass, true);
+    pop(vm);
+    push(vm, OBJ_VAL(jsonInstance));
+
+    // The class of parsed objects, kept where 解析 can find it.
+    push(vm, OBJ_VAL(copyString(vm, L"对象", 2)));
+    ObjClass* objectClass = newClass(vm, AS_STRING(vm->fiber->stackTop[-1]));
+    pop(vm);
+    push(vm, OBJ_VAL(objectClass));
+    defineProperty(vm, L"对象", OBJ_VAL(objectClass), jsonInstance);
+    pop(vm);
+    defineNativeInstance(vm, L"JSON", jsonInstance);
+    pop(vm);
+}
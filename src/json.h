@@ -0,0 +1,14 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_JSON_H
+#define QI_JSON_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+void initJsonClass(VM* vm);
+
+#endif //QI_JSON_H
@@ -5,73 +5,72 @@
 
 #include "common.h"
 #include "vm.h"
+#include "image.h"
+#include "server.h"
+#include "source.h"
 
-static void repl() {
+static void repl(VM* vm) {
     char line[1024];
     for (;;) {
-        wprintf(L"》");
+        // The prompt goes through the same buffer as the program's output,
+        // so the two stay in order when stdout is a pipe.
+        outputChars(&vm->output, L"》", 1);
+        flushOutput(&vm->output);
 
         if (!fgets(line, sizeof(line), stdin)) {
-            wprintf(L"\n");
+            outputChars(&vm->output, L"\n", 1);
+            flushOutput(&vm->output);
             break;
         }
 
-        interpret(line);
+        interpret(vm, line, NULL);
     }
 }
 
-static char* readFile(const char* path) {
-    FILE* file = fopen(path, "rb");
-
-    if (file == NULL) {
+static void runFile(VM* vm, const char* path) {
+    Source source;
+    if (!loadSource(path, &source)) {
         fwprintf(stderr, L"无法打开文件「%s」。\n", path);
         exit(74);
     }
-    fseek(file, 0L, SEEK_END);
-    size_t fileSize = ftell(file);
-    rewind(file);
+    InterpretResult result = interpret(vm, source.text, strcmp(path, "-") == 0 ? NULL : path);
+    freeSource(&source);
 
-    char* buffer = (char*)malloc(fileSize + 1);
-    if (buffer == NULL) {
-        fwprintf(stderr, L"没有足够的内存来读取「%s」。\n", path);
-        exit(74);
-    }
+    if (result == INTERPRET_COMPILE_ERROR) exit(65);
+    if (result == INTERPRET_RUNTIME_ERROR) exit(70);
+}
 
-    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
-    if (bytesRead < fileSize) {
-        fwprintf(stderr, L"无法读取文件「%s」。\n", path);
+static void runImage(VM* vm, const char* path) {
+    if (!loadImage(vm, path)) {
+        fwprintf(stderr, L"无法加载映像「%s」。\n", path);
         exit(74);
     }
-
-    buffer[bytesRead] = L'\0';
-
-    fclose(file);
-    return buffer;
-}
-
-static void runFile(const char* path) {
-    char* source = readFile(path);
-    InterpretResult result = interpret(source);
-    free(source);
-
-    if (result == INTERPRET_COMPILE_ERROR) exit(65);
+    InterpretResult result = continueInterpret(vm);
     if (result == INTERPRET_RUNTIME_ERROR) exit(70);
 }
 
 int main(int argc, const char* argv[]) {
     setlocale(LC_ALL, "");
 
-    initVM();
+    if (argc >= 3 && strcmp(argv[1], "--serve") == 0) return serve(argc - 2, argv + 2);
+
+    VM* vm = newVM();
+    if (vm == NULL) {
+        fwprintf(stderr, L"没有足够的内存来启动虚拟机。\n");
+        exit(74);
+    }
 
     if (argc == 1) {
-        repl();
+        repl(vm);
     } else if (argc == 2) {
-        runFile(argv[1]);
+        runFile(vm, argv[1]);
+    } else if (argc == 3 && strcmp(argv[1], "--image") == 0) {
+        runImage(vm, argv[2]);
     } else {
-        fwprintf(stderr, L"用法：qi【文件路径】\n");
+        fwprintf(stderr, L"用法：qi【文件路径】、qi --image【映像路径】 或 qi --serve【套接字路径】\n");
         exit(64);
     }
 
-    freeVM();
+    freeVM(vm);
     return 0;
 }
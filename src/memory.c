@@ -5,7 +5,15 @@
 #include <stdlib.h>
 
 #include "compiler.h"
+#include "event_loop.h"
+#include "embed.h"
+#include "worker.h"
+#include "reader.h"
+#include "file.h"
+#include "csv.h"
+#include "regex.h"
 #include "memory.h"
+#include "qi.h"
 #include "vm.h"
 
 #ifdef DEBUG_LOG_GC
@@ -15,15 +23,15 @@
 
 #define GC_HEAP_GROW_FACTOR 2
 
-void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
-    vm.bytesAllocated += newSize - oldSize;
-    if (newSize > oldSize) {
+void* reallocate(VM* vm, void* pointer, size_t oldSize, size_t newSize) {
+    vm->bytesAllocated += newSize - oldSize;
+    if (newSize > oldSize && vm->gcPaused == 0) {
 #ifdef DEBUG_STRESS_GC
-        collectGarbage();
+        collectGarbage(vm);
 #endif
 
-        if (vm.bytesAllocated > vm.nextGC) {
-            collectGarbage();
+        if (vm->bytesAllocated > vm->nextGC) {
+            collectGarbage(vm);
         }
     }
 
@@ -37,7 +45,18 @@ void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
     return result;
 }
 
-void markObject(Obj* object) {
+// Ends a pause begun with vm->gcPaused++, collecting now if the heap grew
+// past the next collection while it was paused. Whatever the native built
+// must be reachable by then.
+void resumeGC(VM* vm) {
+    if (--vm->gcPaused > 0) return;
+#ifdef DEBUG_STRESS_GC
+    collectGarbage(vm);
+#endif
+    if (vm->bytesAllocated > vm->nextGC) collectGarbage(vm);
+}
+
+void markObject(VM* vm, Obj* object) {
     if (object == NULL) return;
     if (object->isMarked) return;
 
@@ -47,27 +66,27 @@ void markObject(Obj* object) {
     wprintf(L"\n");
 #endif
     object->isMarked = true;
-    if (vm.grayCapacity < vm.grayCount + 1) {
-        vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);
-        vm.grayStack = (Obj**)realloc(vm.grayStack,sizeof(Obj*) * vm.grayCapacity);
+    if (vm->grayCapacity < vm->grayCount + 1) {
+        vm->grayCapacity = GROW_CAPACITY(vm->grayCapacity);
+        vm->grayStack = (Obj**)realloc(vm->grayStack,sizeof(Obj*) * vm->grayCapacity);
 
-        if (vm.grayStack == NULL) exit(1);
+        if (vm->grayStack == NULL) exit(1);
     }
 
-    vm.grayStack[vm.grayCount++] = object;
+    vm->grayStack[vm->grayCount++] = object;
 }
 
-void markValue(Value value) {
-    if (IS_OBJ(value)) markObject(AS_OBJ(value));
+void markValue(VM* vm, Value value) {
+    if (IS_OBJ(value)) markObject(vm, AS_OBJ(value));
 }
 
-static void markArray(ValueArray* array) {
+static void markArray(VM* vm, ValueArray* array) {
     for (int i = 0; i < array->count; i++) {
-        markValue(array->values[i]);
+        markValue(vm, array->values[i]);
     }
 }
 
-static void blackenObject(Obj* object) {
+static void blackenObject(VM* vm, Obj* object) {
 #ifdef DEBUG_LOG_GC
     wprintf(L"%p blacken ", (void*)object);
     printValue(OBJ_VAL(object));
@@ -77,127 +96,222 @@ static void blackenObject(Obj* object) {
     switch (object->type) {
         case OBJ_BOUND_METHOD: {
             ObjBoundMethod* bound = (ObjBoundMethod*)object;
-            markValue(bound->receiver);
-            markObject((Obj*)bound->method);
+            markValue(vm, bound->receiver);
+            markObject(vm, (Obj*)bound->method);
             break;
         }
         case OBJ_CLASS: {
             ObjClass* klass = (ObjClass*)object;
-            markObject((Obj*)klass->name);
-            markTable(&klass->methods);
+            markObject(vm, (Obj*)klass->name);
+            markTable(vm, &klass->methods);
             break;
         }
         case OBJ_CLOSURE: {
             ObjClosure* closure = (ObjClosure*)object;
-            markObject((Obj*)closure->function);
+            markObject(vm, (Obj*)closure->function);
             for (int i = 0; i < closure->upvalueCount; i++) {
-                markObject((Obj*)closure->upvalues[i]);
+                markObject(vm, (Obj*)closure->upvalues[i]);
             }
             break;
         }
         case OBJ_FUNCTION: {
             ObjFunction* function = (ObjFunction*)object;
-            markObject((Obj*)function->name);
-            markArray(&function->chunk.constants);
+            markObject(vm, (Obj*)function->name);
+            markObject(vm, (Obj*)function->module);
+            markArray(vm, &function->chunk.constants);
             break;
         }
         case OBJ_INSTANCE: {
             ObjInstance* instance = (ObjInstance*)object;
-            markObject((Obj*)instance->klass);
-            markTable(&instance->fields);
+            markObject(vm, (Obj*)instance->klass);
+            markTable(vm, &instance->fields);
             break;
         }
         case OBJ_LIST: {
             ObjList* list = (ObjList*)object;
             for (int i = 0; i < list->count; i++) {
-                markValue(list->items[i]);
+                markValue(vm, list->items[i]);
             }
             break;
         }
         case OBJ_UPVALUE:
-            markValue(((ObjUpvalue*)object)->closed);
+            markValue(vm, ((ObjUpvalue*)object)->closed);
+            break;
+        case OBJ_FIBER: {
+            ObjFiber* fiber = (ObjFiber*)object;
+            markObject(vm, (Obj*)fiber->closure);
+            for (Value* slot = fiber->stack; slot < fiber->stackTop; slot++) {
+                markValue(vm, *slot);
+            }
+            for (int i = 0; i < fiber->frameCount; i++) {
+                markObject(vm, (Obj*)fiber->frames[i].closure);
+            }
+            for (ObjUpvalue* upvalue = fiber->openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
+                markObject(vm, (Obj*)upvalue);
+            }
+            markObject(vm, (Obj*)fiber->caller);
+            markValue(vm, fiber->transfer);
+            break;
+        }
+        case OBJ_MODULE: {
+            ObjModule* module = (ObjModule*)object;
+            markObject(vm, (Obj*)module->path);
+            markObject(vm, (Obj*)module->body);
+            markTable(vm, &module->slots);
+            markArray(vm, &module->names);
+            markArray(vm, &module->values);
             break;
+        }
+        case OBJ_FILE:
+            markObject(vm, (Obj*)((ObjFile*)object)->input);
+            break;
+        case OBJ_BYTES:
+            markObject(vm, (Obj*)((ObjBytes*)object)->owner);
+            break;
+        case OBJ_CSV: {
+            ObjCsv* csv = (ObjCsv*)object;
+            markObject(vm, (Obj*)csv->input);
+            markObject(vm, (Obj*)csv->rowClass);
+            markTable(vm, &csv->header);
+            break;
+        }
+        case OBJ_REGEX:
+            markObject(vm, (Obj*)((ObjRegex*)object)->pattern);
+            break;
+        case OBJ_FOREIGN: {
+            ObjForeign* foreign = (ObjForeign*)object;
+            markObject(vm, (Obj*)foreign->klass);
+            if (foreign->type->trace != NULL) foreign->type->trace(vm, foreign->data);
+            break;
+        }
         case OBJ_NATIVE:
         case OBJ_STRING:
+        case OBJ_WORKER:
+        case OBJ_READER:
             break;
     }
 }
 
-static void freeObject(Obj* object) {
+static void freeObject(VM* vm, Obj* object) {
 #ifdef DEBUG_LOG_GC
     wprintf(L"%p free type %d\n", (void*)object, objType(object));
 #endif
 
     switch (object->type) {
         case OBJ_BOUND_METHOD:
-            FREE(ObjBoundMethod, object);
+            FREE(vm, ObjBoundMethod, object);
             break;
         case OBJ_CLASS: {
             ObjClass* klass = (ObjClass*)object;
-            freeTable(&klass->methods);
-            FREE(ObjClass, object);
+            freeTable(vm, &klass->methods);
+            FREE(vm, ObjClass, object);
             break;
         }
         case OBJ_CLOSURE: {
             ObjClosure* closure = (ObjClosure*)object;
-            FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->upvalueCount);
-            FREE(ObjClosure, object);
+            FREE_ARRAY(vm, ObjUpvalue*, closure->upvalues, closure->upvalueCount);
+            FREE(vm, ObjClosure, object);
             break;
         }
         case OBJ_FUNCTION: {
             ObjFunction* function = (ObjFunction*)object;
-            freeChunk(&function->chunk);
-            FREE(ObjFunction, object);
+            freeChunk(vm, &function->chunk);
+            FREE(vm, ObjFunction, object);
             break;
         }
         case OBJ_INSTANCE: {
             ObjInstance* instance = (ObjInstance*)object;
-            freeTable(&instance->fields);
-            FREE(ObjInstance, object);
+            freeTable(vm, &instance->fields);
+            FREE(vm, ObjInstance, object);
             break;
         }
-        case OBJ_NATIVE:
-            FREE(ObjNative, object);
+        case OBJ_NATIVE: {
+            ObjNative* native = (ObjNative*)object;
+            if (native->signature != NULL) freeSignature(vm, native->signature);
+            FREE(vm, ObjNative, object);
             break;
+        }
         case OBJ_STRING: {
             ObjString *string = (ObjString *) object;
-            FREE_ARRAY(wchar_t, string->chars, string->length + 1);
-            FREE(ObjString, object);
+            FREE_ARRAY(vm, wchar_t, string->chars, string->length + 1);
+            FREE(vm, ObjString, object);
             break;
         }
         case OBJ_LIST: {
             ObjList* list = (ObjList*)object;
-            FREE_ARRAY(Value*, list->items, list->count);
-            FREE(ObjList, object);
+            FREE_ARRAY(vm, Value*, list->items, list->count);
+            FREE(vm, ObjList, object);
             break;
         }
         case OBJ_UPVALUE:
-            FREE(ObjUpvalue, object);
+            FREE(vm, ObjUpvalue, object);
+            break;
+        case OBJ_FIBER: {
+            ObjFiber* fiber = (ObjFiber*)object;
+            FREE_ARRAY(vm, CallFrame, fiber->frames, FRAMES_MAX);
+            FREE_ARRAY(vm, Value, fiber->stack, fiber->stackCapacity);
+            FREE(vm, ObjFiber, object);
+            break;
+        }
+        case OBJ_WORKER:
+            releaseWorker(((ObjWorker*)object)->worker);
+            FREE(vm, ObjWorker, object);
+            break;
+        case OBJ_READER:
+            closeReader(vm, (ObjReader*)object);
+            FREE(vm, ObjReader, object);
+            break;
+        case OBJ_FILE:
+            // Whatever is still buffered is written before the file closes.
+            closeFile(vm, (ObjFile*)object);
+            FREE(vm, ObjFile, object);
+            break;
+        case OBJ_BYTES:
+            if (((ObjBytes*)object)->owner == NULL) freeBytes(vm, (ObjBytes*)object);
+            FREE(vm, ObjBytes, object);
+            break;
+        case OBJ_CSV:
+            freeCsv(vm, (ObjCsv*)object);
+            FREE(vm, ObjCsv, object);
+            break;
+        case OBJ_REGEX:
+            freeRegex(vm, (ObjRegex*)object);
+            FREE(vm, ObjRegex, object);
+            break;
+        case OBJ_FOREIGN: {
+            ObjForeign* foreign = (ObjForeign*)object;
+            if (foreign->type->finalize != NULL) foreign->type->finalize(foreign->data);
+            reallocate(vm, object, sizeof(ObjForeign) + foreign->size, 0);
             break;
+        }
+        case OBJ_MODULE: {
+            ObjModule* module = (ObjModule*)object;
+            freeTable(vm, &module->slots);
+            freeValueArray(vm, &module->names);
+            freeValueArray(vm, &module->values);
+            FREE(vm, ObjModule, object);
+            break;
+        }
     }
 }
 
-static void markRoots() {
-    for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
-        markValue(*slot);
-    }
-
-    for (int i = 0; i < vm.frameCount; i++) {
-        markObject((Obj*)vm.frames[i].closure);
-    }
-
-    for (ObjUpvalue* upvalue = vm.openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
-        markObject((Obj*)upvalue);
-    }
-
-    markTable(&vm.globals);
-    markCompilerRoots();
-    markObject((Obj*)vm.initString);
+static void markRoots(VM* vm) {
+    // The running fiber marks its own stack, frames and open upvalues, and
+    // through its caller chain every fiber waiting on it.
+    markObject(vm, (Obj*)vm->fiber);
+    markTable(vm, &vm->globals);
+    markTable(vm, &vm->modules);
+    markTable(vm, &vm->regexes);
+    markCompilerRoots(vm);
+    markEventLoop(vm);
+    markHost(vm);
+    markObject(vm, (Obj*)vm->initString);
+    markObject(vm, (Obj*)vm->input);
 }
 
-static void sweep() {
+static void sweep(VM* vm) {
     Obj* previous = NULL;
-    Obj* object = vm.objects;
+    Obj* object = vm->objects;
     while (object != NULL) {
         if (object->isMarked) {
             object->isMarked = false;
@@ -209,48 +323,48 @@ static void sweep() {
             if (previous != NULL) {
                 previous->next = object;
             } else {
-                vm.objects = object;
+                vm->objects = object;
             }
 
-            freeObject(unreached);
+            freeObject(vm, unreached);
         }
     }
 }
 
-static void traceReferences() {
-    while (vm.grayCount > 0) {
-        Obj* object = vm.grayStack[--vm.grayCount];
-        blackenObject(object);
+static void traceReferences(VM* vm) {
+    while (vm->grayCount > 0) {
+        Obj* object = vm->grayStack[--vm->grayCount];
+        blackenObject(vm, object);
     }
 }
 
-void collectGarbage() {
+void collectGarbage(VM* vm) {
 #ifdef DEBUG_LOG_GC
     wprintf(L"-- gc begin\n");
-    size_t before = vm.bytesAllocated;
+    size_t before = vm->bytesAllocated;
 #endif
 
-    markRoots();
-    traceReferences();
-    tableRemoveWhite(&vm.strings);
-    sweep();
+    markRoots(vm);
+    traceReferences(vm);
+    tableRemoveWhite(&vm->strings);
+    sweep(vm);
 
-    vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
+    vm->nextGC = vm->bytesAllocated * GC_HEAP_GROW_FACTOR;
 
 #ifdef DEBUG_LOG_GC
     wprintf(L"-- gc end\n");
     wprintf(L"   collected %zu bytes (from %zu to %zu) next at %zu\n",
-           before - vm.bytesAllocated, before, vm.bytesAllocated, vm.nextGC);
+           before - vm->bytesAllocated, before, vm->bytesAllocated, vm->nextGC);
 #endif
 }
 
-void freeObjects() {
-    Obj* object = vm.objects;
+void freeObjects(VM* vm) {
+    Obj* object = vm->objects;
     while (object != NULL) {
         Obj* next = object->next;
-        freeObject(object);
+        freeObject(vm, object);
         object = next;
     }
 
-    free(vm.grayStack);
+    free(vm->grayStack);
 }
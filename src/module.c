@@ -0,0 +1,80 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "module.h"
+#include "bytes.h"
+#include "compiler.h"
+#include "image.h"
+#include "source.h"
+
+// Returns the canonical path of the module [path] names, which is relative
+// to the directory of the file [importer], or to the working directory if
+// there is no file. Returns NULL if there is no such module.
+ObjString* resolveModule(VM* vm, const char* importer, const char* path) {
+    char joined[PATH_MAX];
+    const char* slash = importer == NULL ? NULL : strrchr(importer, '/');
+    int directory = path[0] == '/' || slash == NULL ? 0 : (int)(slash - importer + 1);
+    if (snprintf(joined, sizeof(joined), "%.*s%s", directory, importer, path) >= (int)sizeof(joined)) {
+        return NULL;
+    }
+
+    char resolved[PATH_MAX];
+    if (realpath(joined, resolved) == NULL) return NULL;
+    return copyUtf8(vm, resolved, (int)strlen(resolved));
+}
+
+static void addModule(VM* vm, ObjModule* module) {
+    push(vm, OBJ_VAL(module));
+    tableSet(vm, &vm->modules, module->path, OBJ_VAL(module));
+    pop(vm);
+}
+
+// Returns the module at the canonical [path], loading it if this VM hasn't
+// yet: from the cache beside it if that is up to date, or else by compiling
+// it and writing the cache. Returns NULL after reporting a compile error, or
+// if the module can't be read.
+ObjModule* loadModule(VM* vm, ObjString* path) {
+    Value loaded;
+    if (tableGet(&vm->modules, path, &loaded)) return AS_MODULE(loaded);
+
+    char file[PATH_MAX];
+    char cache[PATH_MAX + 1];
+    struct stat info;
+    if (!encodePath(path, file)) return NULL;
+    snprintf(cache, sizeof(cache), "%sc", file);
+    if (stat(file, &info) != 0) return NULL;
+
+    push(vm, OBJ_VAL(path));
+    ObjModule* module = loadModuleCache(vm, cache, &info);
+    if (module != NULL && module->path == path) {
+        addModule(vm, module);
+        pop(vm);
+        return module;
+    }
+
+    Source source;
+    if (!loadSource(file, &source)) {
+        pop(vm);
+        return NULL;
+    }
+    // Added before compiling, so an import that leads back here finds it.
+    module = newModule(vm, path);
+    addModule(vm, module);
+    pop(vm);
+    module->body = compileModule(vm, module, source.text, file);
+    freeSource(&source);
+
+    if (module->body == NULL) {
+        tableDelete(&vm->modules, path);
+        return NULL;
+    }
+    saveModuleCache(vm, module, cache, &info);
+    return module;
+}
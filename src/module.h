@@ -0,0 +1,15 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_MODULE_H
+#define QI_MODULE_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+ObjString* resolveModule(VM* vm, const char* importer, const char* path);
+ObjModule* loadModule(VM* vm, ObjString* path);
+
+#endif //QI_MODULE_H
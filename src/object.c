@@ -2,24 +2,27 @@
 // Created by Troy Zhong on 9/2/21.
 //
 
+#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "memory.h"
 #include "object.h"
+#include "scanner.h"
+#include "shared.h"
 #include "table.h"
 #include "value.h"
 #include "vm.h"
 
 #define ALLOCATE_OBJ(type, objectType) \
-    (type*)allocateObject(sizeof(type), objectType)
+    (type*)allocateObject(vm, sizeof(type), objectType)
 
-static Obj* allocateObject(size_t size, ObjType type) {
-    Obj* object = (Obj*)reallocate(NULL, 0, size);
+static Obj* allocateObject(VM* vm, size_t size, ObjType type) {
+    Obj* object = (Obj*)reallocate(vm, NULL, 0, size);
     object->type = type;
     object->isMarked = false;
-    object->next = vm.objects;
-    vm.objects = object;
+    object->next = vm->objects;
+    vm->objects = object;
 
 #ifdef DEBUG_LOG_GC
     wprintf(L"%p allocate %zu for %d\n", (void*)object, size, type);
@@ -28,29 +31,32 @@ static Obj* allocateObject(size_t size, ObjType type) {
     return object;
 }
 
-ObjBoundMethod* newBoundMethod(Value reciever, ObjClosure* method) {
+ObjBoundMethod* newBoundMethod(VM* vm, Value reciever, ObjClosure* method) {
     ObjBoundMethod* bound = ALLOCATE_OBJ(ObjBoundMethod, OBJ_BOUND_METHOD);
     bound->receiver = reciever;
     bound->method = method;
+    bound->native = NULL;
     return bound;
 }
 
-ObjBoundMethod* newBoundNative(Value reciever, ObjNative* native) {
+ObjBoundMethod* newBoundNative(VM* vm, Value reciever, ObjNative* native) {
     ObjBoundMethod* bound = ALLOCATE_OBJ(ObjBoundMethod, OBJ_BOUND_METHOD);
     bound->receiver = reciever;
+    bound->method = NULL;
     bound->native = native;
     return bound;
 }
 
-ObjClass* newClass(ObjString* name) {
+ObjClass* newClass(VM* vm, ObjString* name) {
     ObjClass* klass = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
     klass->name = name;
     initTable(&klass->methods);
+    klass->foreign = NULL;
     return klass;
 }
 
-ObjClosure* newClosure(ObjFunction* function) {
-    ObjUpvalue** upvalues = ALLOCATE(ObjUpvalue*, function->upvalueCount);
+ObjClosure* newClosure(VM* vm, ObjFunction* function) {
+    ObjUpvalue** upvalues = ALLOCATE(vm, ObjUpvalue*, function->upvalueCount);
     for (int i = 0; i < function->upvalueCount; i++) {
         upvalues[i] = NULL;
     }
@@ -62,16 +68,19 @@ ObjClosure* newClosure(ObjFunction* function) {
     return closure;
 }
 
-ObjFunction* newFunction() {
+ObjFunction* newFunction(VM* vm) {
     ObjFunction* function = ALLOCATE_OBJ(ObjFunction, OBJ_FUNCTION);
     function->arity = 0;
     function->upvalueCount = 0;
+    function->isGenerator = false;
+    function->writesUpvalues = false;
     function->name = NULL;
+    function->module = NULL;
     initChunk(&function->chunk);
     return function;
 }
 
-ObjInstance* newInstance(ObjClass* klass, bool isStatic) {
+ObjInstance* newInstance(VM* vm, ObjClass* klass, bool isStatic) {
     ObjInstance* instance = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
     instance->klass = klass;
     instance->isStatic = isStatic;
@@ -79,22 +88,146 @@ ObjInstance* newInstance(ObjClass* klass, bool isStatic) {
     return instance;
 }
 
-ObjNative* newNative(NativeFn function, int arity) {
+ObjNative* newNative(VM* vm, NativeFn function, int arity) {
     ObjNative* native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
     native->function = function;
     native->arity = arity;
+    native->signature = NULL;
+    native->extension = NULL;
     return native;
 }
 
-static ObjString* allocateString(wchar_t* chars, int length, uint32_t hash) {
+static const char* skipSpaces(const char* text) {
+    while (*text == ' ') text++;
+    return text;
+}
+
+static const char* parseParamType(const char* text, uint8_t* type) {
+    static const struct {
+        const char* name;
+        ParamType type;
+    } names[] = {
+        {"any", PARAM_ANY}, {"num", PARAM_NUMBER}, {"bool", PARAM_BOOL},
+        {"str", PARAM_STRING}, {"list", PARAM_LIST},
+    };
+    text = skipSpaces(text);
+    for (int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        size_t length = strlen(names[i].name);
+        if (strncmp(text, names[i].name, length) == 0 && !isalnum((unsigned char)text[length])) {
+            *type = names[i].type;
+            return skipSpaces(text + length);
+        }
+    }
+    return NULL;
+}
+
+const wchar_t* paramTypeName(uint8_t type) {
+    switch (type) {
+        case PARAM_NUMBER: return L"数字";
+        case PARAM_BOOL: return L"布尔";
+        case PARAM_STRING: return L"字符串";
+        case PARAM_LIST: return L"列表";
+        default: return L"任何";
+    }
+}
+
+static bool isNameEnd(char c) {
+    return c == '\0' || c == ' ' || c == ',' || c == ')' || c == '?' || c == '.';
+}
+
+// Reads "(num 底数, num 精度?) -> num", or returns NULL if it doesn't parse.
+// Without an arrow the result is any type.
+Signature* newSignature(VM* vm, const char* text) {
+    Signature parsed;
+    parsed.count = 0;
+    parsed.required = 0;
+    parsed.rest = false;
+    parsed.result = PARAM_ANY;
+    wchar_t names[SIGNATURE_MAX * 8];
+    int starts[SIGNATURE_MAX];
+    int length = 0;
+    bool optional = false;
+
+    text = skipSpaces(text);
+    if (*text++ != '(') return NULL;
+    text = skipSpaces(text);
+    if (*text != ')') {
+        for (;;) {
+            if (parsed.count == SIGNATURE_MAX || parsed.rest) return NULL;
+            int i = parsed.count++;
+            text = parseParamType(text, &parsed.params[i]);
+            if (text == NULL) return NULL;
+            starts[i] = -1;
+            if (!isNameEnd(*text)) {
+                starts[i] = length;
+                while (!isNameEnd(*text)) {
+                    if (length == sizeof(names) / sizeof(names[0]) - 1) return NULL;
+                    text += decodeUtf8(text, &names[length++]);
+                }
+                names[length++] = L'\0';
+                text = skipSpaces(text);
+            }
+            if (*text == '?') {
+                optional = true;
+                text = skipSpaces(text + 1);
+            } else if (strncmp(text, "...", 3) == 0) {
+                parsed.rest = true;
+                text = skipSpaces(text + 3);
+            } else if (optional) {
+                return NULL;
+            } else {
+                parsed.required++;
+            }
+            if (*text != ',') break;
+            text++;
+        }
+    }
+    if (*text++ != ')') return NULL;
+    text = skipSpaces(text);
+    if (strncmp(text, "->", 2) == 0) {
+        text = parseParamType(text + 2, &parsed.result);
+        if (text == NULL) return NULL;
+    }
+    if (*text != '\0') return NULL;
+
+    parsed.numeric = true;
+    for (int i = 0; i < parsed.count; i++) {
+        if (parsed.params[i] != PARAM_NUMBER) parsed.numeric = false;
+    }
+
+    Signature* signature = ALLOCATE(vm, Signature, 1);
+    *signature = parsed;
+    signature->nameLength = length;
+    signature->nameChars = length == 0 ? NULL : ALLOCATE(vm, wchar_t, length);
+    if (length > 0) memcpy(signature->nameChars, names, length * sizeof(wchar_t));
+    for (int i = 0; i < parsed.count; i++) {
+        signature->names[i] = starts[i] == -1 ? NULL : signature->nameChars + starts[i];
+    }
+    return signature;
+}
+
+void freeSignature(VM* vm, Signature* signature) {
+    if (signature->nameChars != NULL) FREE_ARRAY(vm, wchar_t, signature->nameChars, signature->nameLength);
+    FREE(vm, Signature, signature);
+}
+
+// The arity a native with [signature] checks first, or -1 if it takes a
+// range of arguments, which the signature checks instead.
+int signatureArity(const Signature* signature) {
+    return signature->required == signature->count && !signature->rest ? signature->count : -1;
+}
+
+static ObjString* allocateString(VM* vm, wchar_t* chars, int length, uint32_t hash) {
     ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
     string->length = length;
     string->chars = chars;
     string->hash = hash;
 
-    push(OBJ_VAL(string));
-    tableSet(&vm.strings, string, NIL_VAL);
-    pop();
+    push(vm, OBJ_VAL(string));
+    // The hash rides along as the value so lookups can skip most strings
+    // without following their pointers. See tableFindString().
+    tableSet(vm, &vm->strings, string, NUMBER_VAL((double)hash));
+    pop(vm);
 
     return string;
 }
@@ -108,24 +241,74 @@ static uint32_t hashString(const wchar_t* key, int length) {
     return hash;
 }
 
-ObjString* takeString(wchar_t* chars, int length) {
+ObjString* takeString(VM* vm, wchar_t* chars, int length) {
     uint32_t hash = hashString(chars, length);
-    ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+    ObjString* interned = findSharedString(vm, chars, length, hash);
+    if (interned == NULL) interned = tableFindString(&vm->strings, chars, length, hash);
     if (interned != NULL) {
-        FREE_ARRAY(wchar_t, chars, length + 1);
+        FREE_ARRAY(vm, wchar_t, chars, length + 1);
         return interned;
     }
-    return allocateString(chars, length, hash);
+    return allocateString(vm, chars, length, hash);
 }
 
-ObjString* copyString(const wchar_t* chars, int length) {
+ObjString* copyString(VM* vm, const wchar_t* chars, int length) {
     uint32_t hash = hashString(chars, length);
-    ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+    ObjString* interned = findSharedString(vm, chars, length, hash);
+    if (interned == NULL) interned = tableFindString(&vm->strings, chars, length, hash);
     if (interned != NULL) return interned;
-    wchar_t* heapChars = ALLOCATE(wchar_t, length + 1);
+    wchar_t* heapChars = ALLOCATE(vm, wchar_t, length + 1);
     memcpy(heapChars, chars, length * sizeof(wchar_t));
     heapChars[length] = L'\0';
-    return allocateString(heapChars, length, hash);
+    return allocateString(vm, heapChars, length, hash);
+}
+
+// Decodes [length] bytes of UTF-8 into a string. The bytes must be followed
+// by one that can't continue a sequence, such as a newline or a zero.
+ObjString* copyUtf8(VM* vm, const char* bytes, int length) {
+    const unsigned char* c = (const unsigned char*)bytes;
+    const unsigned char* end = c + length;
+
+    // Well-formed text has a character for each byte that doesn't continue
+    // a sequence. Malformed text may have more, and gets [length] instead.
+    int capacity = 0;
+    for (int i = 0; i < length; i++) capacity += (c[i] & 0xC0) != 0x80;
+    wchar_t* chars = ALLOCATE(vm, wchar_t, capacity + 1);
+
+    int count = 0;
+    while (c < end) {
+        if (count == capacity) {
+            chars = GROW_ARRAY(vm, wchar_t, chars, capacity + 1, length + 1);
+            capacity = length;
+        }
+        // Runs of ASCII go eight bytes at a time.
+        uint64_t word;
+        if (end - c >= 8 && capacity - count >= 8 &&
+            (memcpy(&word, c, 8), (word & 0x8080808080808080ull) == 0)) {
+            for (int i = 0; i < 8; i++) chars[count + i] = c[i];
+            count += 8;
+            c += 8;
+            continue;
+        }
+        if (*c < 0x80) {
+            chars[count++] = *c++;
+            continue;
+        }
+        // Well-formed three-byte sequences, which hold the CJK characters,
+        // skip the general decoder.
+        if ((c[0] & 0xF0) == 0xE0 && (c[1] & 0xC0) == 0x80 && (c[2] & 0xC0) == 0x80) {
+            uint32_t value = ((c[0] & 0x0F) << 12) | ((c[1] & 0x3F) << 6) | (c[2] & 0x3F);
+            if (value >= 0x800 && (value < 0xD800 || value > 0xDFFF)) {
+                chars[count++] = (wchar_t)value;
+                c += 3;
+                continue;
+            }
+        }
+        c += decodeUtf8((const char*)c, &chars[count++]);
+    }
+    if (count < capacity) chars = GROW_ARRAY(vm, wchar_t, chars, capacity + 1, count + 1);
+    chars[count] = L'\0';
+    return takeString(vm, chars, count);
 }
 
 ObjString* handleEscapeSequences(ObjString* string) {
@@ -194,7 +377,7 @@ bool isValidStringIndex(ObjString* string, int index) {
     return true;
 }
 
-ObjUpvalue* newUpvalue(Value* slot) {
+ObjUpvalue* newUpvalue(VM* vm, Value* slot) {
     ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
     upvalue->closed = NIL_VAL;
     upvalue->location = slot;
@@ -202,26 +385,7 @@ ObjUpvalue* newUpvalue(Value* slot) {
     return upvalue;
 }
 
-static void printfunction(ObjFunction* function) {
-    if (function->name == NULL) {
-        wprintf(L"《脚本》");
-        return;
-    }
-    wprintf(L"《功能 %ls》", function->name->chars);
-}
-
-static void printList(ObjList* list) {
-    wprintf(L"【");
-    for (int i = 0; i < list->count; i++) {
-        printValue(list->items[i]);
-        if (i < list->count - 1) {
-            wprintf(L"，");
-        }
-    }
-    wprintf(L"】");
-}
-
-ObjList* newList() {
+ObjList* newList(VM* vm) {
     ObjList* list = ALLOCATE_OBJ(ObjList, OBJ_LIST);
     list->items = NULL;
     list->count = 0;
@@ -229,12 +393,170 @@ ObjList* newList() {
     return list;
 }
 
-void insertToList(ObjList* list, Value value, int index) {
+ObjFiber* newFiber(VM* vm, ObjClosure* closure) {
+    // Allocate the fiber's frames and stack before the fiber itself so a
+    // collection triggered here can't see a half-initialized object.
+    CallFrame* frames = ALLOCATE(vm, CallFrame, FRAMES_MAX);
+    Value* stack = ALLOCATE(vm, Value, FIBER_STACK_MIN);
+
+    ObjFiber* fiber = ALLOCATE_OBJ(ObjFiber, OBJ_FIBER);
+    fiber->state = closure == NULL ? FIBER_RUNNING : FIBER_NEW;
+    fiber->closure = closure;
+    fiber->frames = frames;
+    fiber->frameCount = 0;
+    fiber->stack = stack;
+    fiber->stackTop = stack;
+    fiber->stackCapacity = FIBER_STACK_MIN;
+    fiber->openUpvalues = NULL;
+    fiber->caller = NULL;
+    fiber->transfer = NIL_VAL;
+    fiber->nativeCalls = 0;
+    return fiber;
+}
+
+ObjWorker* newWorker(VM* vm, struct Worker* worker) {
+    ObjWorker* handle = ALLOCATE_OBJ(ObjWorker, OBJ_WORKER);
+    handle->worker = worker;
+    return handle;
+}
+
+ObjModule* newModule(VM* vm, ObjString* path) {
+    ObjModule* module = ALLOCATE_OBJ(ObjModule, OBJ_MODULE);
+    module->path = path;
+    module->body = NULL;
+    module->executed = false;
+    initTable(&module->slots);
+    initValueArray(&module->names);
+    initValueArray(&module->values);
+    return module;
+}
+
+ObjReader* newReader(VM* vm, int fd, bool owned) {
+    ObjReader* reader = ALLOCATE_OBJ(ObjReader, OBJ_READER);
+    reader->fd = fd;
+    reader->owned = owned;
+    reader->ended = false;
+    reader->bytes = false;
+    reader->buffer = NULL;
+    reader->start = 0;
+    reader->end = 0;
+    reader->capacity = 0;
+    return reader;
+}
+
+ObjFile* newFile(VM* vm, int fd, bool readable, bool writable, bool bytes) {
+    ObjFile* file = ALLOCATE_OBJ(ObjFile, OBJ_FILE);
+    file->fd = fd;
+    file->readable = readable;
+    file->writable = writable;
+    file->bytes = bytes;
+    file->input = NULL;
+    file->output = NULL;
+    return file;
+}
+
+ObjCsv* newCsv(VM* vm, ObjReader* input, ObjClass* rowClass, char delimiter) {
+    ObjCsv* csv = ALLOCATE_OBJ(ObjCsv, OBJ_CSV);
+    csv->input = input;
+    csv->rowClass = rowClass;
+    csv->delimiter = delimiter;
+    csv->numbers = false;
+    csv->raw = false;
+    csv->began = false;
+    csv->records = 0;
+    csv->columns = 0;
+    initTable(&csv->header);
+    csv->slots = NULL;
+    csv->unquoted = NULL;
+    csv->unquotedCapacity = 0;
+    csv->chars = NULL;
+    csv->charsCapacity = 0;
+    return csv;
+}
+
+ObjRegex* newRegex(VM* vm, ObjString* pattern, struct Program* program) {
+    ObjRegex* regex = ALLOCATE_OBJ(ObjRegex, OBJ_REGEX);
+    regex->pattern = pattern;
+    regex->program = program;
+    return regex;
+}
+
+// Makes an instance of the foreign [klass] with [size] zero bytes of data.
+ObjForeign* newForeign(VM* vm, ObjClass* klass, size_t size) {
+    ObjForeign* foreign = (ObjForeign*)allocateObject(vm, sizeof(ObjForeign) + size, OBJ_FOREIGN);
+    foreign->klass = klass;
+    foreign->type = klass->foreign;
+    foreign->size = size;
+    memset(foreign->data, 0, size);
+    return foreign;
+}
+
+// Makes an array of [count] zero bytes.
+ObjBytes* newBytes(VM* vm, size_t count) {
+    uint8_t* data = ALLOCATE(vm, uint8_t, count);
+    if (count > 0) memset(data, 0, count);
+    return takeBytes(vm, data, count, count);
+}
+
+// Makes an array that owns [data], which must have been allocated with
+// ALLOCATE so the collector can free it.
+ObjBytes* takeBytes(VM* vm, uint8_t* data, size_t count, size_t capacity) {
+    ObjBytes* bytes = ALLOCATE_OBJ(ObjBytes, OBJ_BYTES);
+    bytes->owner = NULL;
+    bytes->offset = 0;
+    bytes->data = data;
+    bytes->count = count;
+    bytes->capacity = capacity;
+    return bytes;
+}
+
+ObjBytes* copyBytes(VM* vm, const void* data, size_t count) {
+    uint8_t* copy = ALLOCATE(vm, uint8_t, count);
+    if (count > 0) memcpy(copy, data, count);
+    return takeBytes(vm, copy, count, count);
+}
+
+// Makes a view of [count] bytes of [bytes] from [start]. A slice of a
+// slice views the original array directly.
+ObjBytes* sliceBytes(VM* vm, ObjBytes* bytes, size_t start, size_t count) {
+    ObjBytes* slice = ALLOCATE_OBJ(ObjBytes, OBJ_BYTES);
+    slice->owner = bytes->owner == NULL ? bytes : bytes->owner;
+    slice->offset = bytes->offset + start;
+    slice->data = NULL;
+    slice->count = count;
+    slice->capacity = 0;
+    return slice;
+}
+
+// Adds [count] bytes to the end of an array that isn't a slice. [data] may
+// point into the array itself.
+void appendBytes(VM* vm, ObjBytes* bytes, const void* data, size_t count) {
+    if (bytes->capacity - bytes->count < count) {
+        const uint8_t* source = (const uint8_t*)data;
+        bool inside = bytes->data != NULL && source >= bytes->data && source < bytes->data + bytes->capacity;
+        size_t position = inside ? (size_t)(source - bytes->data) : 0;
+
+        size_t capacity = GROW_CAPACITY(bytes->capacity);
+        if (capacity < bytes->count + count) capacity = bytes->count + count;
+        bytes->data = GROW_ARRAY(vm, uint8_t, bytes->data, bytes->capacity, capacity);
+        bytes->capacity = capacity;
+        if (inside) data = bytes->data + position;
+    }
+    if (count > 0) memmove(bytes->data + bytes->count, data, count);
+    bytes->count += count;
+}
+
+void freeBytes(VM* vm, ObjBytes* bytes) {
+    FREE_ARRAY(vm, uint8_t, bytes->data, bytes->capacity);
+    bytes->data = NULL;
+}
+
+void insertToList(VM* vm, ObjList* list, Value value, int index) {
     // Grow the array if necessary
     if (list->capacity < list->count + 1) {
         int oldCapacity = list->capacity;
         list->capacity = GROW_CAPACITY(oldCapacity);
-        list->items = GROW_ARRAY(Value, list->items, oldCapacity, list->capacity);
+        list->items = GROW_ARRAY(vm, Value, list->items, oldCapacity, list->capacity);
     }
     for (int i = list->count; i > index; i--) {
         list->items[i] = list->items[i - 1];
@@ -259,7 +581,7 @@ void deleteFromList(ObjList* list, int index) {
     list->count--;
 }
 
-static int partitionList(ObjList* list, int low, int high, ObjClosure* pred) {
+static int partitionList(VM* vm, ObjList* list, int low, int high, ObjClosure* pred) {
     Value pivot = indexFromList(list, high);
     int i = low - 1;
 
@@ -268,7 +590,7 @@ static int partitionList(ObjList* list, int low, int high, ObjClosure* pred) {
         if (pred) {
             Value val;
             Value args[2] = {indexFromList(list, j), pivot};
-            if (runClosure(pred, &val, args, 2) == INTERPRET_RUNTIME_ERROR)
+            if (runClosure(vm, pred, &val, args, 2) == INTERPRET_RUNTIME_ERROR)
                 return -1;
             res = !isFalsey(val);
         } else {
@@ -296,10 +618,10 @@ static int partitionList(ObjList* list, int low, int high, ObjClosure* pred) {
     return i + 1;
 }
 
-bool sortList(ObjList* list, int low, int high, ObjClosure* pred) {
+bool sortList(VM* vm, ObjList* list, int low, int high, ObjClosure* pred) {
     if (low < high) {
-        int pi = partitionList(list, low, high, pred);
-        if (pi == -1 || !sortList(list, low, pi - 1, pred) || !sortList(list, pi + 1, high, pred))
+        int pi = partitionList(vm, list, low, high, pred);
+        if (pi == -1 || !sortList(vm, list, low, pi - 1, pred) || !sortList(vm, list, pi + 1, high, pred))
             return false;
     }
     return true;
@@ -311,38 +633,3 @@ bool isValidListIndex(ObjList* list, int index) {
     }
     return true;
 }
-
-void printObject(Value value) {
-    switch (OBJ_TYPE(value)) {
-        case OBJ_BOUND_METHOD:
-            if (AS_BOUND_METHOD(value)->method)
-                printfunction(AS_BOUND_METHOD(value)->method->function);
-            else
-                wprintf(L"《静态方法》");
-            break;
-        case OBJ_CLASS:
-            wprintf(L"%ls", AS_CLASS(value)->name->chars);
-            break;
-        case OBJ_CLOSURE:
-            printfunction(AS_CLOSURE(value)->function);
-            break;
-        case OBJ_FUNCTION:
-            printfunction(AS_FUNCTION(value));
-            break;
-        case OBJ_INSTANCE:
-            wprintf(L"%ls 实例", AS_INSTANCE(value)->klass->name->chars);
-            break;
-        case OBJ_NATIVE:
-            wprintf(L"《静态方法》");
-            break;
-        case OBJ_STRING:
-            wprintf(L"%ls", AS_WCSTRING(value));
-            break;
-        case OBJ_UPVALUE:
-            wprintf(L"升值");
-            break;
-        case OBJ_LIST:
-            printList(AS_LIST(value));
-            break;
-    }
-}
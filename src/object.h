@@ -20,6 +20,15 @@
 #define IS_NATIVE(value)       isObjType(value, OBJ_NATIVE)
 #define IS_STRING(value)       isObjType(value, OBJ_STRING)
 #define IS_LIST(value)         isObjType(value, OBJ_LIST)
+#define IS_FIBER(value)        isObjType(value, OBJ_FIBER)
+#define IS_WORKER(value)       isObjType(value, OBJ_WORKER)
+#define IS_MODULE(value)       isObjType(value, OBJ_MODULE)
+#define IS_READER(value)       isObjType(value, OBJ_READER)
+#define IS_FILE(value)         isObjType(value, OBJ_FILE)
+#define IS_BYTES(value)        isObjType(value, OBJ_BYTES)
+#define IS_CSV(value)          isObjType(value, OBJ_CSV)
+#define IS_REGEX(value)        isObjType(value, OBJ_REGEX)
+#define IS_FOREIGN(value)      isObjType(value, OBJ_FOREIGN)
 
 #define AS_BOUND_METHOD(value) ((ObjBoundMethod*)AS_OBJ(value))
 #define AS_CLASS(value)        ((ObjClass*)AS_OBJ(value))
@@ -30,6 +39,18 @@
 #define AS_STRING(value)       ((ObjString*)AS_OBJ(value))
 #define AS_WCSTRING(value)     (((ObjString*)AS_OBJ(value))->chars)
 #define AS_LIST(value)         ((ObjList*)AS_OBJ(value))
+#define AS_FIBER(value)        ((ObjFiber*)AS_OBJ(value))
+#define AS_WORKER(value)       ((ObjWorker*)AS_OBJ(value))
+#define AS_MODULE(value)       ((ObjModule*)AS_OBJ(value))
+#define AS_READER(value)       ((ObjReader*)AS_OBJ(value))
+#define AS_FILE(value)         ((ObjFile*)AS_OBJ(value))
+#define AS_BYTES(value)        ((ObjBytes*)AS_OBJ(value))
+#define AS_CSV(value)          ((ObjCsv*)AS_OBJ(value))
+#define AS_REGEX(value)        ((ObjRegex*)AS_OBJ(value))
+#define AS_FOREIGN(value)      ((ObjForeign*)AS_OBJ(value))
+
+#define FRAMES_MAX 64
+#define FIBER_STACK_MIN (UINT8_COUNT * 2)
 
 typedef enum {
     OBJ_BOUND_METHOD,
@@ -40,7 +61,16 @@ typedef enum {
     OBJ_NATIVE,
     OBJ_STRING,
     OBJ_UPVALUE,
-    OBJ_LIST
+    OBJ_LIST,
+    OBJ_FIBER,
+    OBJ_WORKER,
+    OBJ_MODULE,
+    OBJ_READER,
+    OBJ_FILE,
+    OBJ_BYTES,
+    OBJ_CSV,
+    OBJ_REGEX,
+    OBJ_FOREIGN
 } ObjType;
 
 struct Obj {
@@ -53,16 +83,47 @@ typedef struct {
     Obj obj;
     int arity;
     int upvalueCount;
+    bool isGenerator;  // Contains 产出; calls return a fiber.
+    bool writesUpvalues;  // Assigns to a variable captured from outside.
     Chunk chunk;
     ObjString* name;
+    struct ObjModule* module;  // Whose variables OP_GET_MODULE and friends index, if any.
 } ObjFunction;
 
-typedef bool (*NativeFn)(int argCount, Value* args);
+typedef bool (*NativeFn)(VM* vm, int argCount, Value* args);
+
+#define SIGNATURE_MAX 16
+
+typedef enum {
+    PARAM_ANY,
+    PARAM_NUMBER,
+    PARAM_BOOL,
+    PARAM_STRING,
+    PARAM_LIST,
+} ParamType;
+
+// The types a native takes and returns, written like "(num, str) -> bool".
+// A parameter can have a name for the errors about it, as in "num 底数",
+// be optional, as in "num 精度?", or take all the arguments left, as in
+// "num...".
+typedef struct {
+    int count;
+    int required;         // The parameters before the first optional one.
+    bool rest;            // Whether the last parameter repeats.
+    bool numeric;         // Whether every parameter is a number, the common case.
+    uint8_t params[SIGNATURE_MAX];
+    uint8_t result;
+    wchar_t* names[SIGNATURE_MAX];   // Into [nameChars], or NULL if unnamed.
+    wchar_t* nameChars;
+    int nameLength;
+} Signature;
 
 typedef struct {
     Obj obj;
     int arity;
     NativeFn function;
+    Signature* signature;   // Checked by the VM before each call, if set.
+    void* extension;        // A QiNativeFn from an extension, called instead of [function].
 } ObjNative;
 
 struct ObjString {
@@ -90,6 +151,7 @@ typedef struct {
     Obj obj;
     ObjString* name;
     Table methods;
+    const struct QiForeignClass* foreign;   // Set for the classes of foreign objects.
 } ObjClass;
 
 typedef struct {
@@ -113,31 +175,199 @@ typedef struct {
     Value* items;
 } ObjList;
 
-ObjBoundMethod* newBoundMethod(Value receiver, ObjClosure* method);
-ObjBoundMethod* newBoundNative(Value reciever, ObjNative* native);
-ObjClass* newClass(ObjString* name);
-ObjClosure* newClosure(ObjFunction* function);
-ObjFunction* newFunction();
-ObjInstance* newInstance(ObjClass* klass, bool isStatic);
-ObjNative* newNative(NativeFn function, int arity);
-ObjString* takeString(wchar_t* chars, int length);
-ObjString* copyString(const wchar_t* chars, int length);
+typedef struct {
+    ObjClosure* closure;
+    uint8_t* ip;
+    Value* slots;
+    bool callClosure;
+} CallFrame;
+
+typedef enum {
+    FIBER_NEW,
+    FIBER_RUNNING,
+    FIBER_SUSPENDED,
+    FIBER_DONE,
+    FIBER_PREEMPTED,   // Stopped by the instruction budget between instructions.
+} FiberState;
+
+typedef struct ObjFiber {
+    Obj obj;
+    FiberState state;
+    ObjClosure* closure;
+
+    // Each fiber owns its call frames and value stack, so switching between
+    // fibers is just a matter of changing which one the VM points at.
+    CallFrame* frames;
+    int frameCount;
+    Value* stack;
+    Value* stackTop;
+    int stackCapacity;
+    ObjUpvalue* openUpvalues;
+
+    // The fiber that resumed this one, and the value passed across the switch.
+    struct ObjFiber* caller;
+    Value transfer;
+    // How many runClosure() calls are active on this fiber. A fiber can't be
+    // suspended while a native is waiting for one of its closures to return.
+    int nativeCalls;
+} ObjFiber;
+
+// A handle to a worker thread. The thread state itself is shared with the
+// worker's own VM and outlives this object if the thread is still running.
+typedef struct {
+    Obj obj;
+    struct Worker* worker;
+} ObjWorker;
+
+// A file loaded with 导入. Its top-level variables live in numbered slots
+// that the compiler resolves, both inside the module and for members
+// accessed through the name it is imported as.
+typedef struct ObjModule {
+    Obj obj;
+    ObjString* path;
+    ObjFunction* body;   // The top-level code, run by the first 导入 to reach it.
+    bool executed;
+    Table slots;         // Variable name to its slot number.
+    ValueArray names;    // Slot number to variable name.
+    ValueArray values;
+} ObjModule;
+
+// Reads lines from a file descriptor through a buffer that grows to hold
+// the longest line. [buffer] always has a zero byte after [end].
+typedef struct ObjReader {
+    Obj obj;
+    int fd;            // -1 once closed.
+    bool owned;        // Whether 关闭 and the collector close [fd].
+    bool ended;        // A read has returned nothing.
+    bool bytes;        // Reads return 字节 instead of decoding UTF-8.
+    char* buffer;
+    size_t start;      // The first byte not yet returned.
+    size_t end;        // One past the last byte read.
+    size_t capacity;   // Excluding the terminator.
+} ObjReader;
+
+// An open file. Reads go through [input] and writes through [output], and
+// each is brought back in line with the file position before the other is
+// used.
+typedef struct {
+    Obj obj;
+    int fd;              // -1 once closed.
+    bool readable;
+    bool writable;
+    bool bytes;          // Reads return 字节 instead of strings.
+    ObjReader* input;    // Made by the first read. Shares [fd].
+    struct Output* output;   // Made by the first write.
+} ObjFile;
+
+// A mutable array of bytes. A slice views part of another array's storage,
+// so a write through either is seen by both. Arrays never shrink, which
+// keeps every slice inside its owner.
+typedef struct ObjBytes {
+    Obj obj;
+    struct ObjBytes* owner;   // The array a slice views, or NULL.
+    size_t offset;            // Where a slice starts in its owner.
+    uint8_t* data;            // Unused by a slice.
+    size_t count;
+    size_t capacity;
+} ObjBytes;
+
+// Reads CSV records from [input], a file or text copied into memory. Once
+// a header is read, each row is an instance whose fields table starts as
+// a copy of [header], so no column name is hashed again.
+typedef struct {
+    Obj obj;
+    ObjReader* input;
+    ObjClass* rowClass;   // CSV。行.
+    char delimiter;
+    bool numbers;         // Fields that are numbers become numbers.
+    bool raw;             // Fields are 字节 instead of strings.
+    bool began;           // A byte order mark at the start is skipped.
+    int records;          // Records read so far, for errors.
+    int columns;          // 0 until a header is read.
+    Table header;         // Column names, each mapped to 空.
+    int* slots;           // Each column's entry in [header].
+    char* unquoted;       // Quoted fields with their quotes undone.
+    size_t unquotedCapacity;
+    wchar_t* chars;       // A field decoded, to look up or intern.
+    int charsCapacity;
+} ObjCsv;
+
+// A compiled regular expression. The program belongs to regex.c, and
+// keeps the DFA states built while searching for the next search.
+typedef struct {
+    Obj obj;
+    ObjString* pattern;
+    struct Program* program;
+} ObjRegex;
+
+// A value an extension defines, kept in [data] right after the header. The
+// class holds its methods and [type] the hooks the collector calls.
+typedef struct {
+    Obj obj;
+    ObjClass* klass;
+    const struct QiForeignClass* type;
+    size_t size;
+    _Alignas(16) uint8_t data[];
+} ObjForeign;
+
+ObjBoundMethod* newBoundMethod(VM* vm, Value receiver, ObjClosure* method);
+ObjBoundMethod* newBoundNative(VM* vm, Value reciever, ObjNative* native);
+ObjClass* newClass(VM* vm, ObjString* name);
+ObjClosure* newClosure(VM* vm, ObjFunction* function);
+ObjFunction* newFunction(VM* vm);
+ObjInstance* newInstance(VM* vm, ObjClass* klass, bool isStatic);
+ObjNative* newNative(VM* vm, NativeFn function, int arity);
+Signature* newSignature(VM* vm, const char* text);
+void freeSignature(VM* vm, Signature* signature);
+int signatureArity(const Signature* signature);
+const wchar_t* paramTypeName(uint8_t type);
+ObjString* takeString(VM* vm, wchar_t* chars, int length);
+ObjString* copyString(VM* vm, const wchar_t* chars, int length);
+ObjString* copyUtf8(VM* vm, const char* bytes, int length);
 ObjString* handleEscapeSequences(ObjString* string);
 void storeToString(ObjString* string, int index, wchar_t value);
 wchar_t indexFromString(ObjString* string, int index);
 bool isValidStringIndex(ObjString* string, int index);
-ObjUpvalue* newUpvalue(Value* slot);
-ObjList* newList();
-void insertToList(ObjList* list, Value value, int index);
+ObjUpvalue* newUpvalue(VM* vm, Value* slot);
+ObjList* newList(VM* vm);
+ObjFiber* newFiber(VM* vm, ObjClosure* closure);
+ObjWorker* newWorker(VM* vm, struct Worker* worker);
+ObjModule* newModule(VM* vm, ObjString* path);
+ObjReader* newReader(VM* vm, int fd, bool owned);
+ObjFile* newFile(VM* vm, int fd, bool readable, bool writable, bool bytes);
+ObjBytes* newBytes(VM* vm, size_t count);
+ObjBytes* takeBytes(VM* vm, uint8_t* data, size_t count, size_t capacity);
+ObjBytes* copyBytes(VM* vm, const void* data, size_t count);
+ObjBytes* sliceBytes(VM* vm, ObjBytes* bytes, size_t start, size_t count);
+void appendBytes(VM* vm, ObjBytes* bytes, const void* data, size_t count);
+void freeBytes(VM* vm, ObjBytes* bytes);
+ObjCsv* newCsv(VM* vm, ObjReader* input, ObjClass* rowClass, char delimiter);
+ObjRegex* newRegex(VM* vm, ObjString* pattern, struct Program* program);
+ObjForeign* newForeign(VM* vm, ObjClass* klass, size_t size);
+void insertToList(VM* vm, ObjList* list, Value value, int index);
 void storeToList(ObjList* list, int index, Value value);
 Value indexFromList(ObjList* list, int index);
 void deleteFromList(ObjList* list, int index);
-bool sortList(ObjList* list, int low, int high, ObjClosure* pred);
+bool sortList(VM* vm, ObjList* list, int low, int high, ObjClosure* pred);
 bool isValidListIndex(ObjList* list, int index);
-void printObject(Value value);
 
 static inline bool isObjType(Value value, ObjType type) {
     return IS_OBJ(value) && AS_OBJ(value)->type == type;
 }
 
+// Inline, since the VM checks every argument of a typed native with it.
+static inline bool hasParamType(Value value, uint8_t type) {
+    switch (type) {
+        case PARAM_NUMBER: return IS_NUMBER(value);
+        case PARAM_BOOL: return IS_BOOL(value);
+        case PARAM_STRING: return isObjType(value, OBJ_STRING);
+        case PARAM_LIST: return isObjType(value, OBJ_LIST);
+        default: return true;
+    }
+}
+
+static inline uint8_t* bytesData(ObjBytes* bytes) {
+    return bytes->owner == NULL ? bytes->data : bytes->owner->data + bytes->offset;
+}
+
 #endif //QI_OBJECT_H
@@ -0,0 +1,227 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "object.h"
+#include "output.h"
+
+void initOutput(Output* output, int fd) {
+    output->fd = fd;
+    output->lineBuffered = isatty(fd);
+    output->error = 0;
+    output->count = 0;
+}
+
+static void writeAll(Output* output, const char* bytes, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(output->fd, bytes, length);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            if (output->error == 0) output->error = written < 0 ? errno : EIO;
+            return;
+        }
+        bytes += written;
+        length -= written;
+    }
+}
+
+// Writes what is buffered. Returns false if any write has failed since
+// [error] was last cleared.
+bool flushOutput(Output* output) {
+    if (output->count > 0) writeAll(output, output->bytes, output->count);
+    output->count = 0;
+    return output->error == 0;
+}
+
+// Adds raw bytes. More than a buffer's worth is written straight from
+// [bytes] instead of being copied.
+void outputBytes(Output* output, const void* bytes, size_t length) {
+    if (length > OUTPUT_BUFFER - output->count) {
+        flushOutput(output);
+        if (length > OUTPUT_BUFFER) {
+            writeAll(output, bytes, length);
+            return;
+        }
+    }
+    memcpy(output->bytes + output->count, bytes, length);
+    output->count += (int)length;
+}
+
+void outputChars(Output* output, const wchar_t* chars, int length) {
+    bool newline = false;
+    for (int i = 0; i < length;) {
+        if (output->count > OUTPUT_BUFFER - 4) flushOutput(output);
+        // Encode as many characters as are sure to fit before checking again.
+        int stop = i + (OUTPUT_BUFFER - output->count) / 4;
+        if (stop > length) stop = length;
+        unsigned char* out = (unsigned char*)output->bytes + output->count;
+        for (; i < stop; i++) {
+            uint32_t c = (uint32_t)chars[i];
+            if (c < 0x80) {
+                // Like %ls, stop at a zero character; some strings are padded.
+                if (c == 0) {
+                    stop = length = i;
+                    break;
+                }
+                *out++ = (unsigned char)c;
+                newline |= c == '\n';
+                continue;
+            }
+            // Surrogates and values past the last code point can't be encoded.
+            if ((c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) c = 0xFFFD;
+            if (c < 0x800) {
+                *out++ = (unsigned char)(0xC0 | (c >> 6));
+                *out++ = (unsigned char)(0x80 | (c & 0x3F));
+            } else if (c < 0x10000) {
+                *out++ = (unsigned char)(0xE0 | (c >> 12));
+                *out++ = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+                *out++ = (unsigned char)(0x80 | (c & 0x3F));
+            } else {
+                *out++ = (unsigned char)(0xF0 | (c >> 18));
+                *out++ = (unsigned char)(0x80 | ((c >> 12) & 0x3F));
+                *out++ = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+                *out++ = (unsigned char)(0x80 | (c & 0x3F));
+            }
+        }
+        output->count = (int)(out - (unsigned char*)output->bytes);
+    }
+    if (newline && output->lineBuffered) flushOutput(output);
+}
+
+static void writeString(Output* output, const wchar_t* chars) {
+    outputChars(output, chars, (int)wcslen(chars));
+}
+
+static void writeNumber(Output* output, double number) {
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%g", number);
+    outputBytes(output, text, (size_t)length);
+}
+
+static void writeFunction(Output* output, ObjFunction* function) {
+    if (function->name == NULL) {
+        writeString(output, L"《脚本》");
+        return;
+    }
+    writeString(output, L"《功能 ");
+    outputChars(output, function->name->chars, function->name->length);
+    writeString(output, L"》");
+}
+
+static void writeList(Output* output, ObjList* list) {
+    writeString(output, L"【");
+    for (int i = 0; i < list->count; i++) {
+        outputValue(output, list->items[i]);
+        if (i < list->count - 1) {
+            writeString(output, L"，");
+        }
+    }
+    writeString(output, L"】");
+}
+
+static void writeObject(Output* output, Value value) {
+    switch (OBJ_TYPE(value)) {
+        case OBJ_BOUND_METHOD:
+            if (AS_BOUND_METHOD(value)->method)
+                writeFunction(output, AS_BOUND_METHOD(value)->method->function);
+            else
+                writeString(output, L"《静态方法》");
+            break;
+        case OBJ_CLASS:
+            outputChars(output, AS_CLASS(value)->name->chars, AS_CLASS(value)->name->length);
+            break;
+        case OBJ_CLOSURE:
+            writeFunction(output, AS_CLOSURE(value)->function);
+            break;
+        case OBJ_FUNCTION:
+            writeFunction(output, AS_FUNCTION(value));
+            break;
+        case OBJ_INSTANCE: {
+            ObjString* name = AS_INSTANCE(value)->klass->name;
+            outputChars(output, name->chars, name->length);
+            writeString(output, L" 实例");
+            break;
+        }
+        case OBJ_NATIVE:
+            writeString(output, L"《静态方法》");
+            break;
+        case OBJ_STRING:
+            outputChars(output, AS_STRING(value)->chars, AS_STRING(value)->length);
+            break;
+        case OBJ_UPVALUE:
+            writeString(output, L"升值");
+            break;
+        case OBJ_LIST:
+            writeList(output, AS_LIST(value));
+            break;
+        case OBJ_FIBER:
+            writeString(output, L"《纤程》");
+            break;
+        case OBJ_WORKER:
+            writeString(output, L"《工作者》");
+            break;
+        case OBJ_READER:
+            writeString(output, L"《读取器》");
+            break;
+        case OBJ_FILE:
+            writeString(output, L"《文件》");
+            break;
+        case OBJ_CSV:
+            writeString(output, L"《CSV》");
+            break;
+        case OBJ_FOREIGN: {
+            ObjString* name = AS_FOREIGN(value)->klass->name;
+            outputChars(output, name->chars, name->length);
+            writeString(output, L" 实例");
+            break;
+        }
+        case OBJ_REGEX:
+            writeString(output, L"《正则 ");
+            writeString(output, AS_REGEX(value)->pattern->chars);
+            writeString(output, L"》");
+            break;
+        case OBJ_BYTES: {
+            char text[48];
+            int length = snprintf(text, sizeof(text), "%zu", AS_BYTES(value)->count);
+            writeString(output, L"《字节 ");
+            outputBytes(output, text, (size_t)length);
+            writeString(output, L"》");
+            break;
+        }
+        case OBJ_MODULE: {
+            const wchar_t* name = wcsrchr(AS_MODULE(value)->path->chars, L'/');
+            writeString(output, L"《模块 ");
+            writeString(output, name == NULL ? AS_MODULE(value)->path->chars : name + 1);
+            writeString(output, L"》");
+            break;
+        }
+    }
+}
+
+void outputValue(Output* output, Value value) {
+#ifdef NAN_BOXING
+    if (IS_BOOL(value)) {
+        writeString(output, AS_BOOL(value) ? L"真" : L"假");
+    } else if (IS_NIL(value)) {
+        writeString(output, L"空");
+    } else if (IS_NUMBER(value)) {
+        writeNumber(output, AS_NUMBER(value));
+    } else if (IS_OBJ(value)) {
+        writeObject(output, value);
+    }
+#else
+    switch (value.type) {
+        case VAL_BOOL:
+            writeString(output, AS_BOOL(value) ? L"真" : L"假");
+            break;
+        case VAL_NIL: writeString(output, L"空"); break;
+        case VAL_NUMBER: writeNumber(output, AS_NUMBER(value)); break;
+        case VAL_OBJ: writeObject(output, value); break;
+    }
+#endif
+}
@@ -0,0 +1,32 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_OUTPUT_H
+#define QI_OUTPUT_H
+
+#include "common.h"
+#include "value.h"
+
+#define OUTPUT_BUFFER 8192
+
+// A VM's buffered standard output. Text is encoded to UTF-8 as it is added
+// and written with one system call when the buffer fills, when the VM is
+// freed or asked to flush, and after each newline if the output is a
+// terminal. Output that can't be written is dropped, and the errno of the
+// failure is kept in [error] until the owner reports and clears it.
+typedef struct Output {
+    int fd;
+    bool lineBuffered;   // Set when [fd] is a terminal.
+    int error;
+    int count;
+    char bytes[OUTPUT_BUFFER];
+} Output;
+
+void initOutput(Output* output, int fd);
+bool flushOutput(Output* output);
+void outputChars(Output* output, const wchar_t* chars, int length);
+void outputBytes(Output* output, const void* bytes, size_t length);
+void outputValue(Output* output, Value value);
+
+#endif //QI_OUTPUT_H
@@ -0,0 +1,188 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+// The interface for programs that embed Qi. A host creates a VM, compiles
+// or runs its scripts once, and then calls the functions they define as
+// often as it likes. Nothing else from the interpreter's headers is needed.
+//
+// Values the host keeps between calls are held through handles, which the
+// garbage collector treats as roots until they are released. Numbers,
+// booleans, 空 and strings cross the boundary by value.
+
+#ifndef QI_H
+#define QI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef struct VM QiVM;
+typedef struct QiHandle QiHandle;
+
+// Describes the data of a foreign object, which the VM allocates inline
+// and zeroes. [trace] marks the values the data refers to with qiMark, and
+// [finalize] releases what it owns when the object is collected; it can't
+// call into the VM or touch other foreign objects. Either may be NULL.
+typedef struct QiForeignClass {
+    size_t size;
+    void (*trace)(QiVM* vm, void* data);
+    void (*finalize)(void* data);
+} QiForeignClass;
+
+typedef enum {
+    QI_OK,
+    QI_COMPILE_ERROR,
+    QI_RUNTIME_ERROR,
+    QI_PAUSED,   // A budget callback paused the script; qiResume carries on.
+} QiResult;
+
+// What a budget callback wants done once the running code has used up its
+// budget.
+typedef enum {
+    QI_BUDGET_CONTINUE,   // Refill the budget and carry on.
+    QI_BUDGET_ABORT,      // Stop with a runtime error.
+    QI_BUDGET_PAUSE,      // Return QI_PAUSED from qiRun or qiResume.
+    QI_BUDGET_YIELD,      // Let the 事件 loop run its other tasks first.
+} QiBudgetAction;
+
+typedef QiBudgetAction (*QiBudgetFn)(QiVM* vm, void* data);
+
+typedef enum {
+    QI_NIL,
+    QI_BOOL,
+    QI_NUMBER,
+    QI_STRING,   // UTF-8, not necessarily terminated.
+    QI_HANDLE,   // Any other value, such as a list or an instance.
+    QI_FOREIGN,  // An object of a class from qiDefineForeignClass.
+} QiType;
+
+typedef struct {
+    QiType type;
+    union {
+        bool boolean;
+        double number;
+        struct {
+            const char* chars;
+            size_t length;
+        } string;
+        QiHandle* handle;
+        struct {
+            void* data;
+            const QiForeignClass* type;
+        } foreign;
+    } as;
+} QiValue;
+
+static inline QiValue qiNil(void) {
+    QiValue value = {.type = QI_NIL};
+    return value;
+}
+
+static inline QiValue qiBool(bool boolean) {
+    QiValue value = {.type = QI_BOOL};
+    value.as.boolean = boolean;
+    return value;
+}
+
+static inline QiValue qiNumber(double number) {
+    QiValue value = {.type = QI_NUMBER};
+    value.as.number = number;
+    return value;
+}
+
+static inline QiValue qiString(const char* chars) {
+    QiValue value = {.type = QI_STRING};
+    value.as.string.chars = chars;
+    value.as.string.length = strlen(chars);
+    return value;
+}
+
+static inline QiValue qiHandle(QiHandle* handle) {
+    QiValue value = {.type = QI_HANDLE};
+    value.as.handle = handle;
+    return value;
+}
+
+// Returns NULL when there isn't enough memory. Freeing the VM releases
+// every handle it still has.
+QiVM* qiNewVM(void);
+void qiFreeVM(QiVM* vm);
+
+// Compiles and runs [source]. Imports in it are relative to [path], or to
+// the working directory if it is NULL. Errors go to stderr.
+QiResult qiRun(QiVM* vm, const char* source, const char* path);
+
+// Carries on running the script a budget callback paused.
+QiResult qiResume(QiVM* vm);
+
+// Limits scripts that can't be trusted to finish. Each loop iteration and
+// each call uses up one of [budget], and when none is left [callback] is
+// asked what to do, with [data]. With no callback the script is aborted.
+// Pausing only works in code qiRun or qiResume started, and yielding only
+// in a task of 事件。运行; elsewhere both carry on. A budget of 0 means no
+// limit.
+void qiSetBudget(QiVM* vm, long long budget, QiBudgetFn callback, void* data);
+
+// Compiles [source] without running it, and returns it as a function that
+// takes no arguments, or NULL if it doesn't compile.
+QiHandle* qiCompile(QiVM* vm, const char* source, const char* path);
+
+// Returns a handle to the global [name], or NULL if there isn't one.
+QiHandle* qiGetGlobal(QiVM* vm, const char* name);
+
+// Returns a handle to [value], so that a string passed to many calls is
+// only converted once.
+QiHandle* qiHold(QiVM* vm, QiValue value);
+void qiRelease(QiVM* vm, QiHandle* handle);
+
+// Calls [function] with [argCount] arguments. A result that is a string
+// points into memory the VM owns, which stays valid until the next call;
+// a foreign object is kept alive until the next call returns, so it can be
+// passed to it; and a handle belongs to the host, which releases it.
+QiResult qiCall(QiVM* vm, QiHandle* function, int argCount, const QiValue* args, QiValue* result);
+
+// Calls [function] [count] times, the i-th time with the [argCount]
+// arguments that start at args[i * argCount], and puts what it returns in
+// results[i]. Stops at the first runtime error, leaving the results after
+// it 空.
+QiResult qiCallBatch(QiVM* vm, QiHandle* function, int argCount, const QiValue* args,
+                     int count, QiValue* results);
+
+// Extensions are shared libraries that 系统。加载扩展 opens. Each defines
+// qiExtensionInit, which is given the instance the script gets back and
+// defines natives on it. Returning false makes loading fail.
+bool qiExtensionInit(QiVM* vm, QiHandle* extension);
+
+// A native gets its arguments already checked against its signature, so
+// a "(num, str)" native can read args[0].as.number and args[1].as.string
+// straight away. Strings and handles among them last until it returns.
+// It puts what it returns in [result], or an error message string there
+// if it returns false.
+typedef bool (*QiNativeFn)(QiVM* vm, const QiValue* args, QiValue* result);
+
+// Defines the native [name] on [target], which is an extension, a class
+// from qiDefineClass or a foreign class, whose natives find the object they
+// are called on in args[-1]. The signature lists the types of the parameters and
+// of the result out of num, bool, str, list and any, such as
+// "(num, num) -> num". Returns false if the signature doesn't parse.
+bool qiDefineNative(QiVM* vm, QiHandle* target, const char* name, const char* signature,
+                    QiNativeFn function);
+
+// Defines [name] on [target] as a class of natives, which scripts reach as
+// 扩展。名字。方法（）, and returns it.
+QiHandle* qiDefineClass(QiVM* vm, QiHandle* target, const char* name);
+
+// Returns a class whose objects hold the data [type] describes, such as a
+// matrix or a bitset, with no fields table in between. Scripts only get
+// them from natives, and call the natives defined on the class as methods.
+QiHandle* qiDefineForeignClass(QiVM* vm, const char* name, const QiForeignClass* type);
+
+// Makes an object of the foreign class [klass]. It lasts until the native
+// making it returns, or the host's next call does, unless it is held.
+QiValue qiNewForeign(QiVM* vm, QiHandle* klass);
+
+// Marks [value] as still in use. Only trace hooks call it.
+void qiMark(QiVM* vm, QiValue value);
+
+#endif //QI_H
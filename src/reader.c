@@ -0,0 +1,365 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "core_module.h"
+#include "memory.h"
+#include "reader.h"
+#include "scanner.h"
+
+// Big enough that reading a large file takes few system calls.
+#define READ_BUFFER 262144
+
+ObjReader* standardInput(VM* vm) {
+    if (vm->input == NULL) vm->input = newReader(vm, STDIN_FILENO, false);
+    return vm->input;
+}
+
+void closeReader(VM* vm, ObjReader* reader) {
+    if (reader->owned && reader->fd >= 0) close(reader->fd);
+    reader->fd = -1;
+    FREE_ARRAY(vm, char, reader->buffer, reader->capacity + 1);
+    reader->buffer = NULL;
+    reader->start = 0;
+    reader->end = 0;
+    reader->capacity = 0;
+}
+
+// Makes room for at least [needed] unread bytes, moving the unread bytes
+// to the front of the buffer.
+static void reserve(VM* vm, ObjReader* reader, size_t needed) {
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if (needed <= reader->capacity) return;
+
+    size_t capacity = reader->capacity < READ_BUFFER ? READ_BUFFER : reader->capacity;
+    while (capacity < needed) capacity *= 2;
+    reader->buffer = GROW_ARRAY(vm, char, reader->buffer, reader->capacity + 1, capacity + 1);
+    reader->capacity = capacity;
+    reader->buffer[reader->end] = '\0';
+}
+
+// Reads more input after the unread bytes, growing the buffer if it is
+// full. Sets [ended] once there is nothing more to read.
+bool fillReader(VM* vm, ObjReader* reader, Value* args) {
+    reserve(vm, reader, reader->end - reader->start + 1);
+
+    ssize_t got;
+    do {
+        got = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+    } while (got < 0 && errno == EINTR);
+    if (got < 0) return nativeError(vm, args, L"读取失败：%s。", strerror(errno));
+
+    if (got == 0) reader->ended = true;
+    reader->end += got;
+    reader->buffer[reader->end] = '\0';
+    return true;
+}
+
+// Makes a reader over a copy of [length] bytes already in memory, for
+// parsers that read files and text the same way. It has no file, so it
+// starts out ended.
+ObjReader* textReader(VM* vm, const char* bytes, size_t length) {
+    ObjReader* reader = newReader(vm, -1, false);
+    push(vm, OBJ_VAL(reader));
+    reader->buffer = ALLOCATE(vm, char, length + 1);
+    memcpy(reader->buffer, bytes, length);
+    reader->buffer[length] = '\0';
+    reader->end = length;
+    reader->capacity = length;
+    reader->ended = true;
+    pop(vm);
+    return reader;
+}
+
+static bool checkOpen(VM* vm, ObjReader* reader, Value* args) {
+    if (reader->fd < 0) return nativeError(vm, args, L"读取器已关闭。");
+    return true;
+}
+
+static Value makeValue(VM* vm, ObjReader* reader, const char* bytes, size_t length) {
+    if (reader->bytes) return OBJ_VAL(copyBytes(vm, bytes, length));
+    return OBJ_VAL(copyUtf8(vm, bytes, (int)length));
+}
+
+// The reading functions below leave their result, or an error message, in
+// args[-1]. They don't touch args[-1] until they are done allocating, so
+// whatever it holds stays reachable.
+
+// Returns the next line without its line ending, or 空 at the end of the
+// input. The last line need not end with a newline.
+bool readLine(VM* vm, ObjReader* reader, Value* args) {
+    if (!checkOpen(vm, reader, args)) return false;
+
+    size_t scanned = 0;
+    for (;;) {
+        char* line = reader->buffer + reader->start;
+        size_t unread = reader->end - reader->start;
+        char* newline = unread == 0 ? NULL : memchr(line + scanned, '\n', unread - scanned);
+        if (newline != NULL) {
+            size_t length = newline - line;
+            reader->start += length + 1;
+            if (length > 0 && line[length - 1] == '\r') length--;
+            if (length > INT_MAX) return nativeError(vm, args, L"行太长。");
+            args[-1] = makeValue(vm, reader, line, length);
+            return true;
+        }
+        if (reader->ended) {
+            if (unread == 0) {
+                args[-1] = NIL_VAL;
+                return true;
+            }
+            if (unread > INT_MAX) return nativeError(vm, args, L"行太长。");
+            reader->start = reader->end;
+            args[-1] = makeValue(vm, reader, line, unread);
+            return true;
+        }
+
+        scanned = unread;
+        if (!fillReader(vm, reader, args)) return false;
+    }
+}
+
+// How many bytes a UTF-8 sequence starting with [lead] should have.
+static size_t sequenceLength(unsigned char lead) {
+    if ((lead & 0xE0) == 0xC0) return 2;
+    if ((lead & 0xF0) == 0xE0) return 3;
+    if ((lead & 0xF8) == 0xF0) return 4;
+    return 1;
+}
+
+// Finds how many bytes the next [count] characters take, reading on while
+// the last of them may be cut short. They are counted the way copyUtf8
+// decodes them.
+static bool measureText(VM* vm, ObjReader* reader, size_t count, size_t* length, Value* args) {
+    size_t chars = 0;
+    *length = 0;
+    for (;;) {
+        const char* bytes = reader->buffer + reader->start;
+        size_t unread = reader->end - reader->start;
+        while (chars < count && *length < unread) {
+            if (!reader->ended && *length + sequenceLength((unsigned char)bytes[*length]) > unread) break;
+            wchar_t c;
+            *length += decodeUtf8(bytes + *length, &c);
+            chars++;
+        }
+        if ((chars == count && unread > 0) || reader->ended) return true;
+        if (!fillReader(vm, reader, args)) return false;
+    }
+}
+
+// Returns up to [count] characters, or bytes when the reader reads 字节, or
+// 空 at the end of the input.
+bool readSome(VM* vm, ObjReader* reader, size_t count, Value* args) {
+    if (!checkOpen(vm, reader, args)) return false;
+    size_t length;
+    if (reader->bytes) {
+        if (count > INT_MAX) count = INT_MAX;
+        while (!reader->ended && reader->end - reader->start < count) {
+            if (!fillReader(vm, reader, args)) return false;
+        }
+        size_t unread = reader->end - reader->start;
+        length = unread < count ? unread : count;
+    } else {
+        if (count > INT_MAX / 4) count = INT_MAX / 4;
+        if (!measureText(vm, reader, count, &length, args)) return false;
+    }
+
+    if (reader->end == reader->start) {
+        args[-1] = NIL_VAL;
+        return true;
+    }
+    const char* bytes = reader->buffer + reader->start;
+    reader->start += length;
+    args[-1] = makeValue(vm, reader, bytes, length);
+    return true;
+}
+
+// Returns everything left in the input as one string.
+bool readAll(VM* vm, ObjReader* reader, Value* args) {
+    if (!checkOpen(vm, reader, args)) return false;
+
+    // Read a regular file in as few calls as its size allows.
+    struct stat info;
+    if (!reader->ended && fstat(reader->fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        off_t offset = lseek(reader->fd, 0, SEEK_CUR);
+        if (offset >= 0 && info.st_size > offset) {
+            reserve(vm, reader, reader->end - reader->start + (size_t)(info.st_size - offset) + 1);
+        }
+    }
+    while (!reader->ended) {
+        if (!fillReader(vm, reader, args)) return false;
+    }
+
+    size_t unread = reader->end - reader->start;
+    if (reader->bytes && unread > 0) {
+        // Hand the buffer over instead of copying it. The next read makes
+        // a new one.
+        reserve(vm, reader, unread);
+        ObjBytes* bytes = takeBytes(vm, (uint8_t*)reader->buffer, unread, reader->capacity + 1);
+        reader->buffer = NULL;
+        reader->capacity = 0;
+        reader->start = 0;
+        reader->end = 0;
+        args[-1] = OBJ_VAL(bytes);
+        return true;
+    }
+    if (unread > INT_MAX) return nativeError(vm, args, L"输入太长，无法放入一个字符串。");
+    const char* bytes = reader->buffer + reader->start;
+    reader->start = reader->end;
+    args[-1] = makeValue(vm, reader, bytes, unread);
+    return true;
+}
+
+// Reads into [bytes] from [offset], returning how many bytes were read or
+// 空 at the end of the input. Input already buffered is copied over;
+// otherwise the bytes are read straight into the array with one call.
+bool readInto(VM* vm, ObjReader* reader, ObjBytes* bytes, size_t offset, Value* args) {
+    if (!checkOpen(vm, reader, args)) return false;
+    size_t room = bytes->count - offset;
+    uint8_t* data = bytesData(bytes) + offset;
+
+    size_t unread = reader->end - reader->start;
+    if (unread > 0 || room == 0) {
+        size_t length = unread < room ? unread : room;
+        memcpy(data, reader->buffer + reader->start, length);
+        reader->start += length;
+        args[-1] = NUMBER_VAL((double)length);
+        return true;
+    }
+    if (reader->ended) {
+        args[-1] = NIL_VAL;
+        return true;
+    }
+
+    ssize_t got;
+    do {
+        got = read(reader->fd, data, room);
+    } while (got < 0 && errno == EINTR);
+    if (got < 0) return nativeError(vm, args, L"读取失败：%s。", strerror(errno));
+    if (got == 0) {
+        reader->ended = true;
+        args[-1] = NIL_VAL;
+        return true;
+    }
+    args[-1] = NUMBER_VAL((double)got);
+    return true;
+}
+
+// Returns whether everything has been read.
+bool readDone(VM* vm, ObjReader* reader, Value* args) {
+    if (reader->fd >= 0 && reader->start == reader->end && !reader->ended) {
+        if (!fillReader(vm, reader, args)) return false;
+    }
+    args[-1] = BOOL_VAL(reader->fd < 0 || reader->start == reader->end);
+    return true;
+}
+
+// Forgets whatever has been read ahead, after the file position moves.
+void discardInput(ObjReader* reader) {
+    reader->start = 0;
+    reader->end = 0;
+    reader->ended = false;
+    if (reader->buffer != NULL) reader->buffer[0] = '\0';
+}
+
+bool readerReadLineNative(VM* vm, int argCount, Value* args) {
+    return readLine(vm, AS_READER(args[-1]), args);
+}
+
+bool readerReadNative(VM* vm, int argCount, Value* args) {
+    if (!IS_NUMBER(args[0]) || AS_NUMBER(args[0]) < 1) {
+        return nativeError(vm, args, L"参数 1（数量）必须是正数。");
+    }
+    return readSome(vm, AS_READER(args[-1]), (size_t)AS_NUMBER(args[0]), args);
+}
+
+// Checks the arguments of 读入（字节，偏移）, for readers and files.
+bool getReadTarget(VM* vm, int argCount, Value* args, ObjBytes** bytes, size_t* offset) {
+    if (argCount < 1 || argCount > 2) {
+        return nativeError(vm, args, L"需要 1 到 2 个参数，但得到 %d。", argCount);
+    }
+    if (!IS_BYTES(args[0])) {
+        return nativeError(vm, args, L"参数 1（字节）的类型必须是「字节」，而不是「%ls」。", getType(args[0]));
+    }
+    *bytes = AS_BYTES(args[0]);
+    *offset = 0;
+    if (argCount == 2) {
+        if (!IS_NUMBER(args[1]) || AS_NUMBER(args[1]) < 0 || AS_NUMBER(args[1]) > (double)(*bytes)->count) {
+            return nativeError(vm, args, L"参数 2（偏移）不是有效索引。");
+        }
+        *offset = (size_t)AS_NUMBER(args[1]);
+    }
+    return true;
+}
+
+bool readerReadIntoNative(VM* vm, int argCount, Value* args) {
+    ObjBytes* bytes;
+    size_t offset;
+    if (!getReadTarget(vm, argCount, args, &bytes, &offset)) return false;
+    return readInto(vm, AS_READER(args[-1]), bytes, offset, args);
+}
+
+bool readerReadAllNative(VM* vm, int argCount, Value* args) {
+    return readAll(vm, AS_READER(args[-1]), args);
+}
+
+bool readerDoneNative(VM* vm, int argCount, Value* args) {
+    return readDone(vm, AS_READER(args[-1]), args);
+}
+
+// Closes the file. Standard input stays open so 系统。扫描 can still use it.
+bool readerCloseNative(VM* vm, int argCount, Value* args) {
+    ObjReader* reader = AS_READER(args[-1]);
+    if (reader->owned) closeReader(vm, reader);
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+static bool openNative(VM* vm, int argCount, Value* args) {
+    if (!IS_STRING(args[0])) {
+        return nativeError(vm, args, L"参数 1（路径）的类型必须是「字符串」，而不是「%ls」。", getType(args[0]));
+    }
+    char path[PATH_MAX];
+    if (!encodePath(AS_STRING(args[0]), path)) {
+        return nativeError(vm, args, L"无效的路径。");
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nativeError(vm, args, L"无法打开文件「%ls」：%s。", AS_STRING(args[0])->chars, strerror(errno));
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    args[-1] = OBJ_VAL(newReader(vm, fd, true));
+    return true;
+}
+
+static bool standardInputNative(VM* vm, int argCount, Value* args) {
+    args[-1] = OBJ_VAL(standardInput(vm));
+    return true;
+}
+
+void initReaderClass(VM* vm) {
+    push(vm, OBJ_VAL(copyString(vm, L"读取器", 3)));
+    ObjClass* readerClass = newClass(vm, AS_STRING(vm->fiber->stackTop[-1]));
+    pop(vm);
+    push(vm, OBJ_VAL(readerClass));
+    defineNative(vm, L"打开", openNative, 1, readerClass);
+    defineNative(vm, L"标准输入", standardInputNative, 0, readerClass);
+    ObjInstance* readerInstance = newInstance(vm, readerClass, true);
+    pop(vm);
+    push(vm, OBJ_VAL(readerInstance));
+    defineNativeInstance(vm, L"读取器", readerInstance);
+    pop(vm);
+}
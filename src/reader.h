@@ -0,0 +1,31 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_READER_H
+#define QI_READER_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+void initReaderClass(VM* vm);
+ObjReader* standardInput(VM* vm);
+void closeReader(VM* vm, ObjReader* reader);
+void discardInput(ObjReader* reader);
+ObjReader* textReader(VM* vm, const char* bytes, size_t length);
+bool fillReader(VM* vm, ObjReader* reader, Value* args);
+bool readLine(VM* vm, ObjReader* reader, Value* args);
+bool readSome(VM* vm, ObjReader* reader, size_t count, Value* args);
+bool readAll(VM* vm, ObjReader* reader, Value* args);
+bool readDone(VM* vm, ObjReader* reader, Value* args);
+bool readInto(VM* vm, ObjReader* reader, ObjBytes* bytes, size_t offset, Value* args);
+bool getReadTarget(VM* vm, int argCount, Value* args, ObjBytes** bytes, size_t* offset);
+bool readerReadLineNative(VM* vm, int argCount, Value* args);
+bool readerReadNative(VM* vm, int argCount, Value* args);
+bool readerReadIntoNative(VM* vm, int argCount, Value* args);
+bool readerReadAllNative(VM* vm, int argCount, Value* args);
+bool readerDoneNative(VM* vm, int argCount, Value* args);
+bool readerCloseNative(VM* vm, int argCount, Value* args);
+
+#endif //QI_READER_H
@@ -0,0 +1,1566 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+
+#include "core_module.h"
+#include "memory.h"
+#include "regex.h"
+
+// A pattern compiles to a Thompson NFA: a list of instructions where a
+// split carries on down two paths at once. A search first runs a DFA,
+// built lazily from sets of NFA instructions, to find whether any match
+// ends and where the earliest one does. Only then does a Pike VM walk the
+// same instructions, threads in priority order, to find the leftmost
+// match and its groups. Both are linear in the text; nothing backtracks.
+
+#define MAX_INSTRUCTIONS 20000
+#define MAX_REPEAT 1000
+#define MAX_GROUPS 100
+#define MAX_NESTING 200
+#define MAX_DFA_STATES 2048
+#define DFA_BUCKETS (MAX_DFA_STATES * 2)
+#define DFA_WIDE_CACHE 1024
+#define MAX_CACHED 256
+
+typedef enum {
+    RE_CHAR,       // Matches the character [x].
+    RE_ANY,        // Matches anything but a newline, or anything if [x].
+    RE_CLASS,      // Matches a character in class [x].
+    RE_MATCH,
+    RE_JMP,        // Goes on at [x].
+    RE_SPLIT,      // Goes on at [x], and with lower priority at [y].
+    RE_SAVE,       // Records the position in capture slot [x].
+    RE_BOL,        // ^
+    RE_EOL,        // $
+    RE_WORD,       // \b
+    RE_NOT_WORD,   // \B
+} Opcode;
+
+typedef struct {
+    uint8_t op;
+    int x;
+    int y;
+} Inst;
+
+typedef struct {
+    wchar_t low;
+    wchar_t high;
+} Range;
+
+#define CLASS_WORD 1
+#define CLASS_NOT_WORD 2
+#define CLASS_SPACE 4
+#define CLASS_NOT_SPACE 8
+
+typedef struct {
+    int start;            // Its first range in the program's [ranges].
+    int count;
+    uint8_t properties;   // \w, \W, \s and \S, which aren't ranges.
+    bool negated;
+    uint32_t ascii[4];    // Whether each ASCII character matches.
+} Class;
+
+typedef struct {
+    int* pcs;             // The NFA instructions it stands for, sorted.
+    int count;
+    uint32_t hash;
+    bool match;           // One of them is RE_MATCH.
+    int8_t endMatch;      // Whether a $ matches at the end, -1 until known.
+    int next[128];        // The state after each ASCII character, -1 until known.
+} DState;
+
+typedef struct {
+    int from;
+    wchar_t c;
+    int to;
+} WideEdge;
+
+typedef struct {
+    DState** states;
+    int count;
+    int capacity;
+    int buckets[DFA_BUCKETS];      // Indexes into [states], -1 when empty.
+    WideEdge wide[DFA_WIDE_CACHE]; // Recent steps over characters past ASCII.
+    int start;            // The state at the start of the text.
+    int restart;          // The state anywhere else, with no match under way.
+    bool failed;          // Too many states; the Pike VM does it all.
+} Dfa;
+
+typedef struct Program Program;
+
+typedef struct {
+    int* pcs;
+    int* caps;            // [slots] for each thread.
+    int count;
+    uint32_t mark;
+} Threads;
+
+struct Program {
+    Inst* code;
+    int length;
+    Range* ranges;
+    int rangeCount;
+    Class* classes;
+    int classCount;
+    int slots;            // Two for each group, the whole match being group 0.
+    bool fold;
+    bool multiline;
+    bool anchored;        // Only matches at the start of the text.
+    bool literal;         // Matches [prefix] and nothing else.
+    wchar_t* prefix;      // Text every match starts with.
+    int prefixLength;
+    bool firstAll;        // Any character can start a match, or none need be read.
+    bool firstWide;       // Characters past ASCII can start a match.
+    uint32_t first[4];    // The ASCII characters that can start a match.
+    Dfa* dfa;             // NULL when the pattern needs \b, or ^ or $ in multiline mode.
+
+    // Scratch space, kept between searches.
+    uint32_t* marks;
+    uint32_t mark;
+    int* stack;
+    int* set;
+    int* work;
+    int* caps;
+    Threads threads[2];
+};
+
+static void* growArray(void* array, int* capacity, size_t size) {
+    *capacity = *capacity < 8 ? 8 : *capacity * 2;
+    array = realloc(array, (size_t)*capacity * size);
+    if (array == NULL) exit(1);
+    return array;
+}
+
+static bool isWordChar(wchar_t c) {
+    return c == L'_' || iswalnum(c);
+}
+
+// Parsing
+
+typedef enum {
+    NODE_EMPTY,
+    NODE_CHAR,        // Matches [value].
+    NODE_ANY,
+    NODE_CLASS,       // Matches a character in class [value].
+    NODE_ASSERT,      // Checks the assertion with opcode [value].
+    NODE_CONCAT,      // Its children one after another.
+    NODE_ALTERNATE,   // One of its children, the first that works.
+    NODE_REPEAT,      // Its child [min] to [max] times, any number if [max] is -1.
+    NODE_GROUP,       // Its child, captured as group [value].
+} NodeType;
+
+typedef struct {
+    NodeType type;
+    int value;
+    int child;        // The first child, or -1.
+    int next;         // The next child of the same parent, or -1.
+    int min;
+    int max;
+    bool greedy;
+} Node;
+
+typedef struct {
+    const wchar_t* pattern;
+    int length;
+    int at;
+    int depth;
+    bool dotAll;
+    Node* nodes;
+    int nodeCount;
+    int nodeCapacity;
+    Program* program;
+    int codeCapacity;
+    int rangeCapacity;
+    int classCapacity;
+    const wchar_t* error;
+    int errorAt;
+} Compiler;
+
+static int fail(Compiler* compiler, int at, const wchar_t* message) {
+    if (compiler->error == NULL) {
+        compiler->error = message;
+        compiler->errorAt = at;
+    }
+    return -1;
+}
+
+static bool isDigit(wchar_t c) {
+    return c >= L'0' && c <= L'9';
+}
+
+static bool atEnd(Compiler* compiler) {
+    return compiler->at >= compiler->length;
+}
+
+static wchar_t peekChar(Compiler* compiler) {
+    return atEnd(compiler) ? L'\0' : compiler->pattern[compiler->at];
+}
+
+static int newNode(Compiler* compiler, NodeType type, int value) {
+    if (compiler->nodeCount == compiler->nodeCapacity) {
+        compiler->nodes = growArray(compiler->nodes, &compiler->nodeCapacity, sizeof(Node));
+    }
+    Node* node = &compiler->nodes[compiler->nodeCount];
+    node->type = type;
+    node->value = value;
+    node->child = -1;
+    node->next = -1;
+    node->min = 0;
+    node->max = 0;
+    node->greedy = true;
+    return compiler->nodeCount++;
+}
+
+// Ranges are added to the class made last.
+static int newCharClass(Compiler* compiler) {
+    Program* program = compiler->program;
+    if (program->classCount == compiler->classCapacity) {
+        program->classes = growArray(program->classes, &compiler->classCapacity, sizeof(Class));
+    }
+    Class* klass = &program->classes[program->classCount];
+    memset(klass, 0, sizeof(Class));
+    klass->start = program->rangeCount;
+    return program->classCount++;
+}
+
+static void addRange(Compiler* compiler, wchar_t low, wchar_t high) {
+    Program* program = compiler->program;
+    if (program->rangeCount == compiler->rangeCapacity) {
+        program->ranges = growArray(program->ranges, &compiler->rangeCapacity, sizeof(Range));
+    }
+    program->ranges[program->rangeCount++] = (Range){low, high};
+    program->classes[program->classCount - 1].count++;
+}
+
+// Adds \d, \w, \s or their opposites to the class made last. Returns
+// false for any other escape.
+static bool addEscapeClass(Compiler* compiler, wchar_t c) {
+    Class* klass = &compiler->program->classes[compiler->program->classCount - 1];
+    switch (c) {
+        case L'd': addRange(compiler, L'0', L'9'); return true;
+        case L'D':
+            addRange(compiler, 0, L'0' - 1);
+            addRange(compiler, L'9' + 1, 0x10FFFF);
+            return true;
+        case L'w': klass->properties |= CLASS_WORD; return true;
+        case L'W': klass->properties |= CLASS_NOT_WORD; return true;
+        case L's': klass->properties |= CLASS_SPACE; return true;
+        case L'S': klass->properties |= CLASS_NOT_SPACE; return true;
+        default: return false;
+    }
+}
+
+// The character an escape like \n or \. stands for, or -1 for a letter
+// or digit that isn't one.
+static int escapedChar(wchar_t c) {
+    switch (c) {
+        case L'n': return L'\n';
+        case L'r': return L'\r';
+        case L't': return L'\t';
+        case L'f': return L'\f';
+        case L'v': return L'\v';
+        default: return c < 0x80 && iswalnum(c) ? -1 : c;
+    }
+}
+
+static int parseAlternation(Compiler* compiler);
+
+static int parseClass(Compiler* compiler) {
+    int start = compiler->at - 1;
+    int index = newCharClass(compiler);
+    if (peekChar(compiler) == L'^') {
+        compiler->program->classes[index].negated = true;
+        compiler->at++;
+    }
+
+    bool first = true;
+    for (;;) {
+        if (atEnd(compiler)) return fail(compiler, start, L"字符类没有结束");
+        wchar_t c = compiler->pattern[compiler->at++];
+        if (c == L']' && !first) break;
+        first = false;
+
+        int low = c;
+        if (c == L'\\') {
+            if (atEnd(compiler)) return fail(compiler, compiler->at - 1, L"转义没有结束");
+            wchar_t escaped = compiler->pattern[compiler->at++];
+            if (addEscapeClass(compiler, escaped)) continue;
+            low = escapedChar(escaped);
+            if (low < 0) return fail(compiler, compiler->at - 2, L"未知的转义");
+        }
+        int high = low;
+        if (compiler->at + 1 < compiler->length && compiler->pattern[compiler->at] == L'-' &&
+            compiler->pattern[compiler->at + 1] != L']') {
+            int dash = compiler->at++;
+            high = compiler->pattern[compiler->at++];
+            if (high == L'\\') {
+                high = atEnd(compiler) ? -1 : escapedChar(compiler->pattern[compiler->at++]);
+            }
+            if (high < low) return fail(compiler, dash, L"字符范围无效");
+        }
+        addRange(compiler, (wchar_t)low, (wchar_t)high);
+    }
+    return newNode(compiler, NODE_CLASS, index);
+}
+
+static int parseAtom(Compiler* compiler) {
+    int start = compiler->at;
+    wchar_t c = compiler->pattern[compiler->at++];
+    switch (c) {
+        case L'(': {
+            if (++compiler->depth > MAX_NESTING) return fail(compiler, start, L"括号嵌套太深");
+            int group = 0;
+            if (peekChar(compiler) == L'?') {
+                if (compiler->at + 1 >= compiler->length || compiler->pattern[compiler->at + 1] != L':') {
+                    return fail(compiler, start, L"不支持的分组");
+                }
+                compiler->at += 2;
+            } else {
+                group = compiler->program->slots / 2;
+                if (group > MAX_GROUPS) return fail(compiler, start, L"分组太多");
+                compiler->program->slots += 2;
+            }
+            int inner = parseAlternation(compiler);
+            if (inner < 0) return -1;
+            if (peekChar(compiler) != L')') return fail(compiler, start, L"括号没有闭合");
+            compiler->at++;
+            compiler->depth--;
+            if (group == 0) return inner;
+            int node = newNode(compiler, NODE_GROUP, group);
+            compiler->nodes[node].child = inner;
+            return node;
+        }
+        case L'[':
+            return parseClass(compiler);
+        case L'.':
+            return newNode(compiler, NODE_ANY, 0);
+        case L'^':
+            return newNode(compiler, NODE_ASSERT, RE_BOL);
+        case L'$':
+            return newNode(compiler, NODE_ASSERT, RE_EOL);
+        case L'*':
+        case L'+':
+        case L'?':
+            return fail(compiler, start, L"量词前面没有可以重复的内容");
+        case L'\\': {
+            if (atEnd(compiler)) return fail(compiler, start, L"转义没有结束");
+            wchar_t escaped = compiler->pattern[compiler->at++];
+            if (escaped == L'b') return newNode(compiler, NODE_ASSERT, RE_WORD);
+            if (escaped == L'B') return newNode(compiler, NODE_ASSERT, RE_NOT_WORD);
+            if (wcschr(L"dDwWsS", escaped) != NULL) {
+                newCharClass(compiler);
+                addEscapeClass(compiler, escaped);
+                return newNode(compiler, NODE_CLASS, compiler->program->classCount - 1);
+            }
+            int value = escapedChar(escaped);
+            if (value < 0) {
+                return fail(compiler, start, escaped >= L'1' && escaped <= L'9' ? L"不支持反向引用" : L"未知的转义");
+            }
+            return newNode(compiler, NODE_CHAR, value);
+        }
+        default:
+            return newNode(compiler, NODE_CHAR, c);
+    }
+}
+
+// Reads a count of up to MAX_REPEAT, or a little past it to report.
+static int parseCount(Compiler* compiler) {
+    int count = 0;
+    while (isDigit(peekChar(compiler))) {
+        if (count <= MAX_REPEAT) count = count * 10 + (compiler->pattern[compiler->at] - L'0');
+        compiler->at++;
+    }
+    return count;
+}
+
+// Reads {m}, {m,} or {m,n}. Anything else isn't a quantifier, so the
+// brace is left to match itself.
+static bool parseBounds(Compiler* compiler, int* min, int* max) {
+    int start = compiler->at++;
+    if (!isDigit(peekChar(compiler))) {
+        compiler->at = start;
+        return false;
+    }
+    *min = parseCount(compiler);
+    *max = *min;
+    if (peekChar(compiler) == L',') {
+        compiler->at++;
+        *max = isDigit(peekChar(compiler)) ? parseCount(compiler) : -1;
+    }
+    if (peekChar(compiler) != L'}') {
+        compiler->at = start;
+        return false;
+    }
+    compiler->at++;
+    if (*min > MAX_REPEAT || *max > MAX_REPEAT) {
+        fail(compiler, start, L"重复次数太多");
+        return false;
+    }
+    if (*max != -1 && *max < *min) {
+        fail(compiler, start, L"重复次数的范围无效");
+        return false;
+    }
+    return true;
+}
+
+static bool atQuantifier(Compiler* compiler) {
+    wchar_t c = peekChar(compiler);
+    if (c == L'*' || c == L'+' || c == L'?') return true;
+    return c == L'{' && compiler->at + 1 < compiler->length && isDigit(compiler->pattern[compiler->at + 1]);
+}
+
+static int parseRepeat(Compiler* compiler) {
+    int atom = parseAtom(compiler);
+    if (atom < 0 || !atQuantifier(compiler)) return atom;
+
+    int start = compiler->at;
+    int min = 0;
+    int max = -1;
+    switch (compiler->pattern[compiler->at]) {
+        case L'*': compiler->at++; break;
+        case L'+': compiler->at++; min = 1; break;
+        case L'?': compiler->at++; max = 1; break;
+        default:
+            if (!parseBounds(compiler, &min, &max)) return compiler->error != NULL ? -1 : atom;
+            break;
+    }
+    NodeType type = compiler->nodes[atom].type;
+    if (type == NODE_ASSERT) return fail(compiler, start, L"量词前面没有可以重复的内容");
+    bool greedy = true;
+    if (peekChar(compiler) == L'?') {
+        greedy = false;
+        compiler->at++;
+    }
+    if (atQuantifier(compiler)) return fail(compiler, compiler->at, L"量词不能连用");
+
+    int node = newNode(compiler, NODE_REPEAT, 0);
+    compiler->nodes[node].child = atom;
+    compiler->nodes[node].min = min;
+    compiler->nodes[node].max = max;
+    compiler->nodes[node].greedy = greedy;
+    return node;
+}
+
+static int parseConcat(Compiler* compiler) {
+    int first = -1;
+    int last = -1;
+    while (!atEnd(compiler) && peekChar(compiler) != L'|' && peekChar(compiler) != L')') {
+        int node = parseRepeat(compiler);
+        if (node < 0) return -1;
+        if (first < 0) {
+            first = node;
+        } else {
+            compiler->nodes[last].next = node;
+        }
+        last = node;
+    }
+    if (first < 0) return newNode(compiler, NODE_EMPTY, 0);
+    if (first == last) return first;
+    int concat = newNode(compiler, NODE_CONCAT, 0);
+    compiler->nodes[concat].child = first;
+    return concat;
+}
+
+static int parseAlternation(Compiler* compiler) {
+    int first = parseConcat(compiler);
+    if (first < 0 || peekChar(compiler) != L'|') return first;
+    int last = first;
+    while (peekChar(compiler) == L'|') {
+        compiler->at++;
+        int node = parseConcat(compiler);
+        if (node < 0) return -1;
+        compiler->nodes[last].next = node;
+        last = node;
+    }
+    int alternate = newNode(compiler, NODE_ALTERNATE, 0);
+    compiler->nodes[alternate].child = first;
+    return alternate;
+}
+
+// Code generation
+
+static int emit(Compiler* compiler, Opcode op, int x, int y) {
+    Program* program = compiler->program;
+    if (compiler->error != NULL) return -1;
+    if (program->length == MAX_INSTRUCTIONS) return fail(compiler, 0, L"表达式太大");
+    if (program->length == compiler->codeCapacity) {
+        program->code = growArray(program->code, &compiler->codeCapacity, sizeof(Inst));
+    }
+    program->code[program->length] = (Inst){(uint8_t)op, x, y};
+    return program->length++;
+}
+
+// Points a split at [preferred] first and [other] second.
+static void setSplit(Compiler* compiler, int split, int preferred, int other, bool greedy) {
+    if (compiler->error != NULL) return;
+    compiler->program->code[split].x = greedy ? preferred : other;
+    compiler->program->code[split].y = greedy ? other : preferred;
+}
+
+static void emitNode(Compiler* compiler, int index);
+
+static void emitRepeat(Compiler* compiler, const Node* node) {
+    Program* program = compiler->program;
+    // x+ is one x and then a loop back for more, so one copy is left out.
+    int copies = node->max == -1 && node->min > 0 ? node->min - 1 : node->min;
+    for (int i = 0; i < copies; i++) emitNode(compiler, node->child);
+
+    if (node->max == -1 && node->min == 0) {
+        int split = emit(compiler, RE_SPLIT, 0, 0);
+        emitNode(compiler, node->child);
+        emit(compiler, RE_JMP, split, 0);
+        setSplit(compiler, split, split + 1, program->length, node->greedy);
+    } else if (node->max == -1) {
+        int loop = program->length;
+        emitNode(compiler, node->child);
+        int split = emit(compiler, RE_SPLIT, 0, 0);
+        setSplit(compiler, split, loop, split + 1, node->greedy);
+    } else {
+        // Each optional copy can skip to the end. The splits wait in a
+        // list threaded through their [y] until the end is known.
+        int pending = -1;
+        for (int i = node->min; i < node->max; i++) {
+            int split = emit(compiler, RE_SPLIT, 0, pending);
+            pending = split;
+            emitNode(compiler, node->child);
+        }
+        while (pending >= 0 && compiler->error == NULL) {
+            int next = program->code[pending].y;
+            setSplit(compiler, pending, pending + 1, program->length, node->greedy);
+            pending = next;
+        }
+    }
+}
+
+static void emitNode(Compiler* compiler, int index) {
+    if (compiler->error != NULL) return;
+    Program* program = compiler->program;
+    Node node = compiler->nodes[index];
+    switch (node.type) {
+        case NODE_EMPTY:
+            break;
+        case NODE_CHAR:
+            emit(compiler, RE_CHAR, program->fold ? (int)towlower(node.value) : node.value, 0);
+            break;
+        case NODE_ANY:
+            emit(compiler, RE_ANY, compiler->dotAll, 0);
+            break;
+        case NODE_CLASS:
+            emit(compiler, RE_CLASS, node.value, 0);
+            break;
+        case NODE_ASSERT:
+            emit(compiler, (Opcode)node.value, 0, 0);
+            break;
+        case NODE_CONCAT:
+            for (int child = node.child; child >= 0; child = compiler->nodes[child].next) {
+                emitNode(compiler, child);
+            }
+            break;
+        case NODE_ALTERNATE: {
+            // Jumps to the end wait in a list threaded through their [x].
+            int pending = -1;
+            for (int child = node.child; child >= 0; child = compiler->nodes[child].next) {
+                if (compiler->nodes[child].next < 0) {
+                    emitNode(compiler, child);
+                    break;
+                }
+                int split = emit(compiler, RE_SPLIT, 0, 0);
+                emitNode(compiler, child);
+                pending = emit(compiler, RE_JMP, pending, 0);
+                setSplit(compiler, split, split + 1, program->length, true);
+            }
+            while (pending >= 0 && compiler->error == NULL) {
+                int next = program->code[pending].x;
+                program->code[pending].x = program->length;
+                pending = next;
+            }
+            break;
+        }
+        case NODE_REPEAT:
+            emitRepeat(compiler, &node);
+            break;
+        case NODE_GROUP:
+            emit(compiler, RE_SAVE, node.value * 2, 0);
+            emitNode(compiler, node.child);
+            emit(compiler, RE_SAVE, node.value * 2 + 1, 0);
+            break;
+    }
+}
+
+// Appends the text every match of node [index] starts with to [prefix].
+// Returns whether that text is all the node can match.
+static bool addPrefix(Compiler* compiler, int index, wchar_t* prefix, int* length) {
+    Node* node = &compiler->nodes[index];
+    switch (node->type) {
+        case NODE_EMPTY:
+            return true;
+        case NODE_CHAR:
+            prefix[(*length)++] = (wchar_t)node->value;
+            return true;
+        case NODE_GROUP:
+            return addPrefix(compiler, node->child, prefix, length);
+        case NODE_CONCAT:
+            for (int child = node->child; child >= 0; child = compiler->nodes[child].next) {
+                if (!addPrefix(compiler, child, prefix, length)) return false;
+            }
+            return true;
+        case NODE_REPEAT:
+            if (node->min > 0) addPrefix(compiler, node->child, prefix, length);
+            return false;
+        default:
+            return false;
+    }
+}
+
+static bool startsWithBol(Compiler* compiler, int index) {
+    Node* node = &compiler->nodes[index];
+    switch (node->type) {
+        case NODE_ASSERT: return node->value == RE_BOL;
+        case NODE_GROUP:
+        case NODE_CONCAT: return startsWithBol(compiler, node->child);
+        default: return false;
+    }
+}
+
+static bool slowClassMatches(const Program* program, const Class* klass, wchar_t c) {
+    const Range* ranges = program->ranges + klass->start;
+    for (int i = 0; i < klass->count; i++) {
+        if (c >= ranges[i].low && c <= ranges[i].high) return true;
+    }
+    if ((klass->properties & CLASS_WORD) && isWordChar(c)) return true;
+    if ((klass->properties & CLASS_NOT_WORD) && !isWordChar(c)) return true;
+    if ((klass->properties & CLASS_SPACE) && iswspace(c)) return true;
+    if ((klass->properties & CLASS_NOT_SPACE) && !iswspace(c)) return true;
+    return false;
+}
+
+static bool classMatches(const Program* program, const Class* klass, wchar_t c) {
+    if (c >= 0 && c < 0x80) return klass->ascii[c >> 5] >> (c & 31) & 1;
+    bool found = slowClassMatches(program, klass, c);
+    if (!found && program->fold) {
+        found = slowClassMatches(program, klass, (wchar_t)towlower(c)) ||
+                slowClassMatches(program, klass, (wchar_t)towupper(c));
+    }
+    return found != klass->negated;
+}
+
+// Works out each class's ASCII bitmap, so the common case is one lookup.
+static void finishClasses(Program* program) {
+    for (int i = 0; i < program->classCount; i++) {
+        Class* klass = &program->classes[i];
+        for (wchar_t c = 0; c < 0x80; c++) {
+            bool found = slowClassMatches(program, klass, c);
+            if (!found && program->fold) {
+                found = slowClassMatches(program, klass, (wchar_t)towlower(c)) ||
+                        slowClassMatches(program, klass, (wchar_t)towupper(c));
+            }
+            if (found != klass->negated) klass->ascii[c >> 5] |= 1u << (c & 31);
+        }
+    }
+}
+
+static bool classIsAscii(const Program* program, const Class* klass) {
+    if (klass->negated || klass->properties != 0 || program->fold) return false;
+    for (int i = 0; i < klass->count; i++) {
+        if (program->ranges[klass->start + i].high >= 0x80) return false;
+    }
+    return true;
+}
+
+// Works out which characters a match can start with, going through every
+// assertion as if it held. Where no thread is under way, searching can
+// skip the characters that aren't among them.
+static void findFirst(Program* program) {
+    int* stack = program->stack;
+    int top = 0;
+    stack[top++] = 0;
+    uint32_t mark = ++program->mark;
+    while (top > 0 && !program->firstAll) {
+        int pc = stack[--top];
+        while (program->marks[pc] != mark) {
+            program->marks[pc] = mark;
+            const Inst* inst = &program->code[pc];
+            if (inst->op == RE_JMP) {
+                pc = inst->x;
+                continue;
+            } else if (inst->op == RE_SPLIT) {
+                stack[top++] = inst->y;
+                pc = inst->x;
+                continue;
+            } else if (inst->op == RE_SAVE || inst->op >= RE_BOL) {
+                pc++;
+                continue;
+            }
+
+            if (inst->op == RE_CHAR && inst->x < 0x80) {
+                program->first[inst->x >> 5] |= 1u << (inst->x & 31);
+                if (program->fold) {
+                    wint_t upper = towupper(inst->x);
+                    program->first[upper >> 5] |= 1u << (upper & 31);
+                    program->firstWide = true;
+                }
+            } else if (inst->op == RE_CHAR) {
+                program->firstWide = true;
+            } else if (inst->op == RE_CLASS) {
+                const Class* klass = &program->classes[inst->x];
+                for (int i = 0; i < 4; i++) program->first[i] |= klass->ascii[i];
+                if (!classIsAscii(program, klass)) program->firstWide = true;
+            } else {
+                // RE_ANY, or RE_MATCH with nothing read.
+                program->firstAll = true;
+            }
+            break;
+        }
+    }
+}
+
+// Skips characters that can't start a match.
+static int skipToFirst(const Program* program, const wchar_t* text, int length, int at) {
+    while (at < length) {
+        wchar_t c = text[at];
+        if (c >= 0 && c < 0x80 ? program->first[c >> 5] >> (c & 31) & 1 : program->firstWide) break;
+        at++;
+    }
+    return at;
+}
+
+static void freeDfa(Dfa* dfa) {
+    if (dfa == NULL) return;
+    for (int i = 0; i < dfa->count; i++) free(dfa->states[i]);
+    free(dfa->states);
+    free(dfa);
+}
+
+static void freeProgram(Program* program) {
+    if (program == NULL) return;
+    free(program->code);
+    free(program->ranges);
+    free(program->classes);
+    free(program->prefix);
+    freeDfa(program->dfa);
+    free(program->marks);
+    free(program->stack);
+    free(program->set);
+    free(program->work);
+    free(program->caps);
+    for (int i = 0; i < 2; i++) {
+        free(program->threads[i].pcs);
+        free(program->threads[i].caps);
+    }
+    free(program);
+}
+
+void freeRegex(VM* vm, ObjRegex* regex) {
+    freeProgram(regex->program);
+}
+
+static void* allocateScratch(size_t count, size_t size) {
+    void* memory = calloc(count == 0 ? 1 : count, size);
+    if (memory == NULL) exit(1);
+    return memory;
+}
+
+static Dfa* newDfa(Program* program);
+
+// Compiles [pattern], or returns NULL with the problem in [*error] and
+// where it is in [*errorAt].
+static Program* compile(const wchar_t* pattern, int length, bool fold, bool multiline, bool dotAll,
+                        const wchar_t** error, int* errorAt) {
+    Program* program = (Program*)allocateScratch(1, sizeof(Program));
+    program->fold = fold;
+    program->multiline = multiline;
+    program->slots = 2;
+
+    Compiler compiler;
+    memset(&compiler, 0, sizeof(Compiler));
+    compiler.pattern = pattern;
+    compiler.length = length;
+    compiler.dotAll = dotAll;
+    compiler.program = program;
+
+    int root = parseAlternation(&compiler);
+    if (root >= 0 && !atEnd(&compiler)) fail(&compiler, compiler.at, L"多余的右括号");
+    if (compiler.error == NULL) {
+        emit(&compiler, RE_SAVE, 0, 0);
+        emitNode(&compiler, root);
+        emit(&compiler, RE_SAVE, 1, 0);
+        emit(&compiler, RE_MATCH, 0, 0);
+    }
+    if (compiler.error != NULL) {
+        *error = compiler.error;
+        *errorAt = compiler.errorAt;
+        free(compiler.nodes);
+        freeProgram(program);
+        return NULL;
+    }
+
+    program->anchored = !multiline && startsWithBol(&compiler, root);
+    if (!fold) {
+        program->prefix = (wchar_t*)allocateScratch((size_t)length + 1, sizeof(wchar_t));
+        bool complete = addPrefix(&compiler, root, program->prefix, &program->prefixLength);
+        program->literal = complete && program->prefixLength > 0 && program->slots == 2;
+    }
+    free(compiler.nodes);
+    finishClasses(program);
+
+    program->marks = (uint32_t*)allocateScratch((size_t)program->length, sizeof(uint32_t));
+    program->stack = (int*)allocateScratch((size_t)program->length * 3 + 3, sizeof(int));
+    program->set = (int*)allocateScratch((size_t)program->length, sizeof(int));
+    program->work = (int*)allocateScratch((size_t)program->slots, sizeof(int));
+    program->caps = (int*)allocateScratch((size_t)program->slots, sizeof(int));
+    for (int i = 0; i < 2; i++) {
+        program->threads[i].pcs = (int*)allocateScratch((size_t)program->length, sizeof(int));
+        program->threads[i].caps = (int*)allocateScratch((size_t)program->length * program->slots, sizeof(int));
+    }
+
+    findFirst(program);
+
+    // The DFA tracks where it is in the text only as far as knowing the
+    // start and the end, which leaves out \b and multiline ^ and $.
+    bool dfaUsable = true;
+    for (int pc = 0; pc < program->length; pc++) {
+        uint8_t op = program->code[pc].op;
+        if (op == RE_WORD || op == RE_NOT_WORD || (multiline && (op == RE_BOL || op == RE_EOL))) {
+            dfaUsable = false;
+        }
+    }
+    if (dfaUsable && !program->literal) program->dfa = newDfa(program);
+    return program;
+}
+
+// Matching
+
+static inline bool consumes(const Program* program, const Inst* inst, wchar_t c) {
+    switch (inst->op) {
+        case RE_CHAR: return c == inst->x || (program->fold && (int)towlower(c) == inst->x);
+        case RE_ANY: return inst->x || c != L'\n';
+        case RE_CLASS: return classMatches(program, &program->classes[inst->x], c);
+        default: return false;
+    }
+}
+
+static bool assertionHolds(const Program* program, uint8_t op, const wchar_t* text, int length, int at) {
+    switch (op) {
+        case RE_BOL: return at == 0 || (program->multiline && text[at - 1] == L'\n');
+        case RE_EOL: return at == length || (program->multiline && text[at] == L'\n');
+        case RE_WORD:
+        case RE_NOT_WORD: {
+            bool before = at > 0 && isWordChar(text[at - 1]);
+            bool after = at < length && isWordChar(text[at]);
+            return (before != after) == (op == RE_WORD);
+        }
+        default: return false;
+    }
+}
+
+// Marks say which instructions a closure has been through. A fresh value
+// each time saves clearing them.
+static uint32_t nextMark(Program* program) {
+    if (++program->mark == 0) {
+        memset(program->marks, 0, (size_t)program->length * sizeof(uint32_t));
+        program->mark = 1;
+    }
+    return program->mark;
+}
+
+// Finds the next place the prefix starts. glibc's wmemchr is vectorized,
+// so looking for the first character skips most text many at a time.
+static const wchar_t* findPrefix(const Program* program, const wchar_t* text, int length) {
+    wchar_t first = program->prefix[0];
+    int rest = program->prefixLength - 1;
+    const wchar_t* end = text + length;
+    while (end - text > rest) {
+        const wchar_t* found = wmemchr(text, first, (size_t)(end - text - rest));
+        if (found == NULL) return NULL;
+        if (wmemcmp(found + 1, program->prefix + 1, (size_t)rest) == 0) return found;
+        text = found + 1;
+    }
+    return NULL;
+}
+
+// Adds the thread at [pc], with groups [caps], to [list], following
+// jumps, splits, saves and assertions at text position [at], so [list]
+// only holds instructions that consume a character, and RE_MATCH. Saves
+// are undone on the way back out, leaving [caps] as it was.
+static void addThread(Program* program, Threads* list, int pc, int* caps, const wchar_t* text, int length, int at) {
+    int* stack = program->stack;
+    int top = 0;
+    stack[top++] = pc;
+    stack[top++] = -1;
+    stack[top++] = 0;
+    while (top > 0) {
+        top -= 3;
+        int slot = stack[top + 1];
+        if (slot >= 0) {
+            caps[slot] = stack[top + 2];
+            continue;
+        }
+        pc = stack[top];
+        while (program->marks[pc] != list->mark) {
+            program->marks[pc] = list->mark;
+            const Inst* inst = &program->code[pc];
+            if (inst->op == RE_JMP) {
+                pc = inst->x;
+            } else if (inst->op == RE_SPLIT) {
+                stack[top++] = inst->y;
+                stack[top++] = -1;
+                stack[top++] = 0;
+                pc = inst->x;
+            } else if (inst->op == RE_SAVE) {
+                stack[top++] = 0;
+                stack[top++] = inst->x;
+                stack[top++] = caps[inst->x];
+                caps[inst->x] = at;
+                pc++;
+            } else if (inst->op >= RE_BOL) {
+                if (!assertionHolds(program, inst->op, text, length, at)) break;
+                pc++;
+            } else {
+                list->pcs[list->count] = pc;
+                memcpy(list->caps + list->count * program->slots, caps, (size_t)program->slots * sizeof(int));
+                list->count++;
+                break;
+            }
+        }
+    }
+}
+
+// Finds the leftmost match starting at or after [from], taking the way
+// through the pattern listed first, and fills [caps] with its groups.
+// With [full], the match must start at [from] and run to the end.
+static bool pikeSearch(Program* program, const wchar_t* text, int length, int from, bool full, int* caps) {
+    Threads* current = &program->threads[0];
+    Threads* next = &program->threads[1];
+    int slots = program->slots;
+    bool anchored = full || program->anchored;
+    bool matched = false;
+    if (program->anchored && from > 0) return false;
+
+    current->count = 0;
+    current->mark = nextMark(program);
+    for (int at = from; ; at++) {
+        if (!matched && (at == from || !anchored)) {
+            if (current->count == 0 && !anchored) {
+                int start = at;
+                if (program->prefixLength > 0) {
+                    const wchar_t* found = findPrefix(program, text + at, length - at);
+                    if (found == NULL) break;
+                    at = (int)(found - text);
+                } else if (!program->firstAll) {
+                    at = skipToFirst(program, text, length, at);
+                    if (at == length) break;
+                }
+                if (at != start) current->mark = nextMark(program);
+            }
+            for (int i = 0; i < slots; i++) program->work[i] = -1;
+            addThread(program, current, 0, program->work, text, length, at);
+        }
+        if (current->count == 0) {
+            if (matched || anchored || at >= length) break;
+            // No thread got past an assertion here; try the next place.
+            current->mark = nextMark(program);
+            continue;
+        }
+
+        next->count = 0;
+        next->mark = nextMark(program);
+        for (int i = 0; i < current->count; i++) {
+            const Inst* inst = &program->code[current->pcs[i]];
+            int* threadCaps = current->caps + i * slots;
+            if (inst->op == RE_MATCH) {
+                if (full && at != length) continue;
+                memcpy(caps, threadCaps, (size_t)slots * sizeof(int));
+                matched = true;
+                // The threads after this one are all worse matches.
+                break;
+            }
+            if (at < length && consumes(program, inst, text[at])) {
+                addThread(program, next, current->pcs[i] + 1, threadCaps, text, length, at + 1);
+            }
+        }
+        Threads* swap = current;
+        current = next;
+        next = swap;
+        if (at >= length) break;
+    }
+    return matched;
+}
+
+// The DFA
+
+static int compareInts(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Adds the instructions reachable from [pc] without reading a character
+// to the program's set, which has [count] already. $ stays in the set to
+// be checked at the end, unless [atEnd] says this is the end.
+static int addClosure(Program* program, int pc, bool atStart, bool atEnd, int count) {
+    int* stack = program->stack;
+    int top = 0;
+    stack[top++] = pc;
+    while (top > 0) {
+        pc = stack[--top];
+        while (program->marks[pc] != program->mark) {
+            program->marks[pc] = program->mark;
+            const Inst* inst = &program->code[pc];
+            if (inst->op == RE_JMP) {
+                pc = inst->x;
+            } else if (inst->op == RE_SPLIT) {
+                stack[top++] = inst->y;
+                pc = inst->x;
+            } else if (inst->op == RE_SAVE || (inst->op == RE_BOL && atStart) || (inst->op == RE_EOL && atEnd)) {
+                pc++;
+            } else if (inst->op == RE_BOL) {
+                break;
+            } else {
+                program->set[count++] = pc;
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+// Finds or makes the state for the [count] instructions in the set.
+// Returns -1 once there are too many states.
+static int addState(Program* program, int count) {
+    Dfa* dfa = program->dfa;
+    int* set = program->set;
+    qsort(set, (size_t)count, sizeof(int), compareInts);
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < count; i++) hash = (hash ^ (uint32_t)set[i]) * 16777619u;
+
+    int bucket = (int)(hash & (DFA_BUCKETS - 1));
+    while (dfa->buckets[bucket] >= 0) {
+        DState* state = dfa->states[dfa->buckets[bucket]];
+        if (state->hash == hash && state->count == count && memcmp(state->pcs, set, (size_t)count * sizeof(int)) == 0) {
+            return dfa->buckets[bucket];
+        }
+        bucket = (bucket + 1) & (DFA_BUCKETS - 1);
+    }
+    if (dfa->count == MAX_DFA_STATES) {
+        dfa->failed = true;
+        return -1;
+    }
+
+    DState* state = (DState*)malloc(sizeof(DState) + (size_t)count * sizeof(int));
+    if (state == NULL) exit(1);
+    state->pcs = (int*)(state + 1);
+    memcpy(state->pcs, set, (size_t)count * sizeof(int));
+    state->count = count;
+    state->hash = hash;
+    state->match = false;
+    for (int i = 0; i < count; i++) {
+        if (program->code[set[i]].op == RE_MATCH) state->match = true;
+    }
+    state->endMatch = -1;
+    memset(state->next, 0xff, sizeof(state->next));
+
+    if (dfa->count == dfa->capacity) dfa->states = growArray(dfa->states, &dfa->capacity, sizeof(DState*));
+    dfa->states[dfa->count] = state;
+    dfa->buckets[bucket] = dfa->count;
+    return dfa->count++;
+}
+
+static Dfa* newDfa(Program* program) {
+    Dfa* dfa = (Dfa*)allocateScratch(1, sizeof(Dfa));
+    memset(dfa->buckets, 0xff, sizeof(dfa->buckets));
+    for (int i = 0; i < DFA_WIDE_CACHE; i++) dfa->wide[i].from = -1;
+    program->dfa = dfa;
+    nextMark(program);
+    dfa->start = addState(program, addClosure(program, 0, true, false, 0));
+    nextMark(program);
+    dfa->restart = addState(program, addClosure(program, 0, false, false, 0));
+    return dfa;
+}
+
+// Makes the state after reading [c] in state [from]: every thread that
+// reads [c] moves past it, and a new match may start after it. Returns -1
+// once there are too many states.
+static int dfaStep(Program* program, int from, wchar_t c) {
+    Dfa* dfa = program->dfa;
+    DState* state = dfa->states[from];
+    nextMark(program);
+    int count = 0;
+    for (int i = 0; i < state->count; i++) {
+        int pc = state->pcs[i];
+        if (consumes(program, &program->code[pc], c)) count = addClosure(program, pc + 1, false, false, count);
+    }
+    count = addClosure(program, 0, false, false, count);
+    int next = addState(program, count);
+    if (next >= 0 && c >= 0 && c < 0x80) state->next[c] = next;
+    return next;
+}
+
+static bool matchesAtEnd(Program* program, int index, bool atStart) {
+    DState* state = program->dfa->states[index];
+    if (state->match) return true;
+    if (!atStart && state->endMatch >= 0) return state->endMatch;
+    nextMark(program);
+    int count = 0;
+    for (int i = 0; i < state->count; i++) {
+        int pc = state->pcs[i];
+        if (program->code[pc].op == RE_EOL) count = addClosure(program, pc + 1, atStart, true, count);
+    }
+    bool found = false;
+    for (int i = 0; i < count; i++) {
+        if (program->code[program->set[i]].op == RE_MATCH) found = true;
+    }
+    if (!atStart) state->endMatch = found;
+    return found;
+}
+
+// Returns where the earliest match starting at or after [from] ends, -1
+// if there is none, or -2 if the DFA has grown too big to use.
+static int dfaSearch(Program* program, const wchar_t* text, int length, int from) {
+    Dfa* dfa = program->dfa;
+    if (program->anchored && from > 0) return -1;
+    int current = from == 0 ? dfa->start : dfa->restart;
+    for (int at = from; ; at++) {
+        DState* state = dfa->states[current];
+        if (state->match) return at;
+        if (at == length) return matchesAtEnd(program, current, at == 0) ? at : -1;
+        if (current == dfa->restart) {
+            // Nothing is under way, so skip to where a match could start.
+            if (state->count == 0) return -1;
+            if (program->prefixLength > 0) {
+                const wchar_t* found = findPrefix(program, text + at, length - at);
+                if (found == NULL) return -1;
+                at = (int)(found - text);
+            } else if (!program->firstAll) {
+                at = skipToFirst(program, text, length, at);
+                if (at == length) return -1;
+            }
+        }
+
+        wchar_t c = text[at];
+        int next;
+        if (c >= 0 && c < 0x80) {
+            next = state->next[c];
+            if (next < 0) next = dfaStep(program, current, c);
+        } else {
+            WideEdge* edge = &dfa->wide[((uint32_t)current * 31u + (uint32_t)c) & (DFA_WIDE_CACHE - 1)];
+            if (edge->from == current && edge->c == c) {
+                next = edge->to;
+            } else {
+                next = dfaStep(program, current, c);
+                if (next >= 0) *edge = (WideEdge){current, c, next};
+            }
+        }
+        if (next < 0) return -2;
+        current = next;
+    }
+}
+
+static bool usesDfa(const Program* program) {
+    return program->dfa != NULL && !program->dfa->failed;
+}
+
+// Finds the leftmost match at or after [from] and fills [caps].
+static bool search(Program* program, const wchar_t* text, int length, int from, int* caps) {
+    if (program->literal) {
+        const wchar_t* found = findPrefix(program, text + from, length - from);
+        if (found == NULL) return false;
+        caps[0] = (int)(found - text);
+        caps[1] = caps[0] + program->prefixLength;
+        return true;
+    }
+    // The DFA can't say where the match starts or what its groups are,
+    // but it is quick to say there is no match at all.
+    if (usesDfa(program) && dfaSearch(program, text, length, from) == -1) return false;
+    return pikeSearch(program, text, length, from, false, caps);
+}
+
+// Whether there is a match anywhere, without finding its groups.
+static bool test(Program* program, const wchar_t* text, int length) {
+    if (program->literal) return findPrefix(program, text, length) != NULL;
+    if (usesDfa(program)) {
+        int end = dfaSearch(program, text, length, 0);
+        if (end != -2) return end >= 0;
+    }
+    return pikeSearch(program, text, length, 0, false, program->caps);
+}
+
+// Natives
+
+// Escapes leave a string's length as written, so measure to the end.
+static bool getText(VM* vm, Value* args, int index, const wchar_t** text, int* length) {
+    if (!IS_STRING(args[index])) {
+        return nativeError(vm, args, L"参数 %d（文本）的类型必须是「字符串」，而不是「%ls」。", index + 1, getType(args[index]));
+    }
+    ObjString* string = AS_STRING(args[index]);
+    *text = string->chars;
+    *length = (int)wcsnlen(string->chars, string->length);
+    return true;
+}
+
+// Reads the optional count or position after the required arguments.
+static bool getOptional(VM* vm, int argCount, Value* args, int required, const wchar_t* name, int* value) {
+    if (argCount < required || argCount > required + 1) {
+        return nativeError(vm, args, L"需要 %d 到 %d 个参数，但得到 %d。", required, required + 1, argCount);
+    }
+    *value = 0;
+    if (argCount == required) return true;
+    Value number = args[required];
+    if (!IS_NUMBER(number) || AS_NUMBER(number) < 0 || AS_NUMBER(number) != (int)AS_NUMBER(number)) {
+        return nativeError(vm, args, L"参数 %d（%ls）必须是一个非负整数。", required + 1, name);
+    }
+    *value = (int)AS_NUMBER(number);
+    return true;
+}
+
+static Value groupValue(VM* vm, const wchar_t* text, const int* caps, int group) {
+    int start = caps[group * 2];
+    int end = caps[group * 2 + 1];
+    if (start < 0 || end < 0) return NIL_VAL;
+    return OBJ_VAL(copyString(vm, text + start, end - start));
+}
+
+// The match and then each group, 空 for one that took no part. Only call
+// with the collector paused.
+static Value matchList(VM* vm, Program* program, const wchar_t* text, const int* caps) {
+    ObjList* list = newList(vm);
+    for (int group = 0; group < program->slots / 2; group++) {
+        insertToList(vm, list, groupValue(vm, text, caps, group), list->count);
+    }
+    return OBJ_VAL(list);
+}
+
+// Where to look for the next match: straight after this one, or one
+// further on after an empty match so it isn't found again.
+static int nextFrom(const int* caps) {
+    return caps[1] > caps[0] ? caps[1] : caps[1] + 1;
+}
+
+// 测试（文本） returns whether the pattern matches anywhere in the text.
+static bool testNative(VM* vm, int argCount, Value* args) {
+    const wchar_t* text;
+    int length;
+    if (!getText(vm, args, 0, &text, &length)) return false;
+    args[-1] = BOOL_VAL(test(AS_REGEX(args[-1])->program, text, length));
+    return true;
+}
+
+// 匹配（文本） matches the whole text, returning the groups or 空.
+static bool matchNative(VM* vm, int argCount, Value* args) {
+    const wchar_t* text;
+    int length;
+    if (!getText(vm, args, 0, &text, &length)) return false;
+    Program* program = AS_REGEX(args[-1])->program;
+    if (!pikeSearch(program, text, length, 0, true, program->caps)) {
+        args[-1] = NIL_VAL;
+        return true;
+    }
+    vm->gcPaused++;
+    args[-1] = matchList(vm, program, text, program->caps);
+    resumeGC(vm);
+    return true;
+}
+
+// 搜索（文本，开头） returns the groups of the first match at or after
+// the start, or 空.
+static bool searchNative(VM* vm, int argCount, Value* args) {
+    const wchar_t* text;
+    int length;
+    int from;
+    if (!getOptional(vm, argCount, args, 1, L"开头", &from)) return false;
+    if (!getText(vm, args, 0, &text, &length)) return false;
+    Program* program = AS_REGEX(args[-1])->program;
+    if (from > length || !search(program, text, length, from, program->caps)) {
+        args[-1] = NIL_VAL;
+        return true;
+    }
+    vm->gcPaused++;
+    args[-1] = matchList(vm, program, text, program->caps);
+    resumeGC(vm);
+    return true;
+}
+
+// 指数（文本，开头） returns where the first match at or after the start
+// begins, or -1.
+static bool indexNative(VM* vm, int argCount, Value* args) {
+    const wchar_t* text;
+    int length;
+    int from;
+    if (!getOptional(vm, argCount, args, 1, L"开头", &from)) return false;
+    if (!getText(vm, args, 0, &text, &length)) return false;
+    Program* program = AS_REGEX(args[-1])->program;
+    bool found = from <= length && search(program, text, length, from, program->caps);
+    args[-1] = NUMBER_VAL(found ? program->caps[0] : -1);
+    return true;
+}
+
+// 查找全部（文本） returns every match: the matched text if the pattern
+// has no groups, the group if it has one, and a list of groups otherwise.
+static bool findAllNative(VM* vm, int argCount, Value* args) {
+    const wchar_t* text;
+    int length;
+    if (!getText(vm, args, 0, &text, &length)) return false;
+    Program* program = AS_REGEX(args[-1])->program;
+    int* caps = program->caps;
+    int groups = program->slots / 2;
+
+    vm->gcPaused++;
+    ObjList* list = newList(vm);
+    for (int from = 0; from <= length && search(program, text, length, from, caps); from = nextFrom(caps)) {
+        Value value;
+        if (groups <= 2) {
+            value = groupValue(vm, text, caps, groups - 1);
+        } else {
+            ObjList* row = newList(vm);
+            for (int group = 1; group < groups; group++) {
+                insertToList(vm, row, groupValue(vm, text, caps, group), row->count);
+            }
+            value = OBJ_VAL(row);
+        }
+        insertToList(vm, list, value, list->count);
+    }
+    args[-1] = OBJ_VAL(list);
+    resumeGC(vm);
+    return true;
+}
+
+// 计数（文本） returns how many times the pattern matches.
+static bool countNative(VM* vm, int argCount, Value* args) {
+    const wchar_t* text;
+    int length;
+    if (!getText(vm, args, 0, &text, &length)) return false;
+    Program* program = AS_REGEX(args[-1])->program;
+    double count = 0;
+    for (int from = 0; from <= length && search(program, text, length, from, program->caps); from = nextFrom(program->caps)) {
+        count++;
+    }
+    args[-1] = NUMBER_VAL(count);
+    return true;
+}
+
+typedef struct {
+    wchar_t* chars;
+    int count;
+    int capacity;
+} Builder;
+
+static void append(Builder* builder, const wchar_t* chars, int count) {
+    while (builder->count + count > builder->capacity) {
+        builder->chars = growArray(builder->chars, &builder->capacity, sizeof(wchar_t));
+    }
+    wmemcpy(builder->chars + builder->count, chars, (size_t)count);
+    builder->count += count;
+}
+
+// 替换（文本，替换，次数） replaces matches, all of them unless a count is
+// given. In the replacement, $0 to $9 stand for the groups and $$ for $.
+static bool replaceNative(VM* vm, int argCount, Value* args) {
+    const wchar_t* text;
+    int length;
+    const wchar_t* replacement;
+    int replacementLength;
+    int limit;
+    if (!getOptional(vm, argCount, args, 2, L"次数", &limit)) return false;
+    if (!getText(vm, args, 0, &text, &length)) return false;
+    if (!IS_STRING(args[1])) {
+        return nativeError(vm, args, L"参数 2（替换）的类型必须是「字符串」，而不是「%ls」。", getType(args[1]));
+    }
+    replacement = AS_STRING(args[1])->chars;
+    replacementLength = (int)wcsnlen(replacement, AS_STRING(args[1])->length);
+    Program* program = AS_REGEX(args[-1])->program;
+    for (int i = 0; i + 1 < replacementLength; i++) {
+        if (replacement[i] != L'$') continue;
+        wchar_t c = replacement[++i];
+        if (c >= L'0' && c <= L'9' && c - L'0' >= program->slots / 2) {
+            return nativeError(vm, args, L"替换里的「$%lc」没有对应的分组。", c);
+        }
+    }
+
+    int* caps = program->caps;
+    Builder builder = {NULL, 0, 0};
+    int copied = 0;
+    int replaced = 0;
+    for (int from = 0; (limit == 0 || replaced < limit) && from <= length && search(program, text, length, from, caps);
+         from = nextFrom(caps)) {
+        append(&builder, text + copied, caps[0] - copied);
+        for (int i = 0; i < replacementLength; i++) {
+            wchar_t c = replacement[i];
+            if (c == L'$' && i + 1 < replacementLength) {
+                wchar_t next = replacement[i + 1];
+                if (next >= L'0' && next <= L'9') {
+                    int group = next - L'0';
+                    if (caps[group * 2] >= 0) {
+                        append(&builder, text + caps[group * 2], caps[group * 2 + 1] - caps[group * 2]);
+                    }
+                    i++;
+                    continue;
+                } else if (next == L'$') {
+                    i++;
+                }
+            }
+            append(&builder, &c, 1);
+        }
+        copied = caps[1];
+        replaced++;
+    }
+    append(&builder, text + copied, length - copied);
+    args[-1] = OBJ_VAL(copyString(vm, builder.chars == NULL ? L"" : builder.chars, builder.count));
+    free(builder.chars);
+    return true;
+}
+
+// 分割（文本，次数） splits the text wherever the pattern matches, at most
+// the given number of times. Empty matches don't split.
+static bool splitNative(VM* vm, int argCount, Value* args) {
+    const wchar_t* text;
+    int length;
+    int limit;
+    if (!getOptional(vm, argCount, args, 1, L"次数", &limit)) return false;
+    if (!getText(vm, args, 0, &text, &length)) return false;
+    Program* program = AS_REGEX(args[-1])->program;
+    int* caps = program->caps;
+
+    vm->gcPaused++;
+    ObjList* list = newList(vm);
+    int last = 0;
+    for (int from = 0; (limit == 0 || list->count < limit) && from <= length && search(program, text, length, from, caps);
+         from = nextFrom(caps)) {
+        if (caps[0] == caps[1]) continue;
+        insertToList(vm, list, OBJ_VAL(copyString(vm, text + last, caps[0] - last)), list->count);
+        last = caps[1];
+    }
+    insertToList(vm, list, OBJ_VAL(copyString(vm, text + last, length - last)), list->count);
+    args[-1] = OBJ_VAL(list);
+    resumeGC(vm);
+    return true;
+}
+
+typedef struct {
+    const wchar_t* name;
+    NativeFn function;
+    int arity;
+} RegexMethod;
+
+static const RegexMethod regexMethods[] = {
+    {L"测试", testNative, 1},
+    {L"匹配", matchNative, 1},
+    {L"搜索", searchNative, -1},
+    {L"指数", indexNative, -1},
+    {L"查找全部", findAllNative, 1},
+    {L"计数", countNative, 1},
+    {L"替换", replaceNative, -1},
+    {L"分割", splitNative, -1},
+};
+
+bool findRegexMethod(ObjString* name, NativeFn* function, int* arity) {
+    for (size_t i = 0; i < sizeof(regexMethods) / sizeof(regexMethods[0]); i++) {
+        if (wcscmp(name->chars, regexMethods[i].name) == 0) {
+            *function = regexMethods[i].function;
+            *arity = regexMethods[i].arity;
+            return true;
+        }
+    }
+    return false;
+}
+
+#define FLAG_FOLD 1
+#define FLAG_MULTILINE 2
+#define FLAG_DOT_ALL 4
+
+// 正则。编译（模式，标志） compiles a pattern, or returns the one already
+// compiled from it. The flags are i to ignore case, m for ^ and $ to
+// match at each line and s for . to match newlines too.
+static bool compileNative(VM* vm, int argCount, Value* args) {
+    if (argCount < 1 || argCount > 2) {
+        return nativeError(vm, args, L"需要 1 到 2 个参数，但得到 %d。", argCount);
+    }
+    if (!IS_STRING(args[0])) {
+        return nativeError(vm, args, L"参数 1（模式）的类型必须是「字符串」，而不是「%ls」。", getType(args[0]));
+    }
+    int flags = 0;
+    if (argCount == 2) {
+        if (!IS_STRING(args[1])) {
+            return nativeError(vm, args, L"参数 2（标志）的类型必须是「字符串」，而不是「%ls」。", getType(args[1]));
+        }
+        ObjString* string = AS_STRING(args[1]);
+        int length = (int)wcsnlen(string->chars, string->length);
+        for (int i = 0; i < length; i++) {
+            switch (string->chars[i]) {
+                case L'i': flags |= FLAG_FOLD; break;
+                case L'm': flags |= FLAG_MULTILINE; break;
+                case L's': flags |= FLAG_DOT_ALL; break;
+                default: return nativeError(vm, args, L"未知的正则表达式标志「%lc」。", string->chars[i]);
+            }
+        }
+    }
+
+    // Compiled patterns are kept by their flags and text, so compiling
+    // the same one in a loop costs a table lookup.
+    ObjString* pattern = AS_STRING(args[0]);
+    int length = (int)wcsnlen(pattern->chars, pattern->length);
+    wchar_t* key = (wchar_t*)malloc(((size_t)length + 1) * sizeof(wchar_t));
+    if (key == NULL) exit(1);
+    key[0] = (wchar_t)(L'0' + flags);
+    wmemcpy(key + 1, pattern->chars, (size_t)length);
+    push(vm, OBJ_VAL(copyString(vm, key, length + 1)));
+    free(key);
+    Value cached;
+    if (tableGet(&vm->regexes, AS_STRING(vm->fiber->stackTop[-1]), &cached)) {
+        pop(vm);
+        args[-1] = cached;
+        return true;
+    }
+
+    const wchar_t* error;
+    int errorAt;
+    Program* program = compile(pattern->chars, length, flags & FLAG_FOLD, flags & FLAG_MULTILINE, flags & FLAG_DOT_ALL,
+                               &error, &errorAt);
+    if (program == NULL) {
+        pop(vm);
+        return nativeError(vm, args, L"无效的正则表达式（位置 %d）：%ls。", errorAt, error);
+    }
+    ObjRegex* regex = newRegex(vm, pattern, program);
+    push(vm, OBJ_VAL(regex));
+    if (vm->regexes.count >= MAX_CACHED) {
+        freeTable(vm, &vm->regexes);
+        initTable(&vm->regexes);
+    }
+    tableSet(vm, &vm->regexes, AS_STRING(vm->fiber->stackTop[-2]), OBJ_VAL(regex));
+    pop(vm);
+    pop(vm);
+    args[-1] = OBJ_VAL(regex);
+    return true;
+}
+
+// 正则。转义（文本） escapes every character a pattern treats specially.
+static bool escapeNative(VM* vm, int argCount, Value* args) {
+    const wchar_t* text;
+    int length;
+    if (!getText(vm, args, 0, &text, &length)) return false;
+    Builder builder = {NULL, 0, 0};
+    for (int i = 0; i < length; i++) {
+        if (text[i] != L'\0' && wcschr(L"\\.^$|?*+()[]{}-", text[i]) != NULL) append(&builder, L"\\", 1);
+        append(&builder, text + i, 1);
+    }
+    args[-1] = OBJ_VAL(copyString(vm, builder.chars == NULL ? L"" : builder.chars, builder.count));
+    free(builder.chars);
+    return true;
+}
+
+void initRegexClass(VM* vm) {
+    push(vm, OBJ_VAL(copyString(vm, L"正则", 2)));
+    ObjClass* regexClass = newClass(vm, AS_STRING(vm->fiber->stackTop[-1]));
+    pop(vm);
+    push(vm, OBJ_VAL(regexClass));
+    defineNative(vm, L"编译", compileNative, -1, regexClass);
+    defineNative(vm, L"转义", escapeNative, 1, regexClass);
+    ObjInstance* regexInstance = newInstance(vm, regexClass, true);
+    pop(vm);
+    push(vm, OBJ_VAL(regexInstance));
+    defineNativeInstance(vm, L"正则", regexInstance);
+    pop(vm);
+}
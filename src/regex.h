@@ -0,0 +1,16 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_REGEX_H
+#define QI_REGEX_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+void initRegexClass(VM* vm);
+bool findRegexMethod(ObjString* name, NativeFn* function, int* arity);
+void freeRegex(VM* vm, ObjRegex* regex);
+
+#endif //QI_REGEX_H
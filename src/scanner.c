@@ -5,92 +5,226 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "common.h"
 #include "scanner.h"
+#include "unicode_table.h"
+
+void initScanner(Scanner* scanner, const char* source) {
+    scanner->start = source;
+    scanner->current = source;
+    scanner->end = source + strlen(source);
+    scanner->line = 1;
+}
+
+// Decodes the UTF-8 character at [bytes] into [codePoint] and returns how
+// many bytes it takes. A malformed sequence decodes as U+FFFD, one byte at
+// a time, and the terminator stops any sequence cut short.
+int decodeUtf8(const char* bytes, wchar_t* codePoint) {
+    const unsigned char* c = (const unsigned char*)bytes;
+    if (c[0] < 0x80) {
+        *codePoint = c[0];
+        return 1;
+    }
 
-typedef struct {
-    const wchar_t* start;
-    const wchar_t* current;
-    int line;
-} Scanner;
+    int length;
+    uint32_t value;
+    if ((c[0] & 0xE0) == 0xC0) {
+        length = 2;
+        value = c[0] & 0x1F;
+    } else if ((c[0] & 0xF0) == 0xE0) {
+        length = 3;
+        value = c[0] & 0x0F;
+    } else if ((c[0] & 0xF8) == 0xF0) {
+        length = 4;
+        value = c[0] & 0x07;
+    } else {
+        *codePoint = 0xFFFD;
+        return 1;
+    }
 
-Scanner scanner;
+    for (int i = 1; i < length; i++) {
+        if ((c[i] & 0xC0) != 0x80) {
+            *codePoint = 0xFFFD;
+            return 1;
+        }
+        value = (value << 6) | (c[i] & 0x3F);
+    }
 
-void initScanner(const wchar_t* source) {
-    scanner.start = source;
-    scanner.current = source;
-    scanner.line = 1;
+    // Reject overlong forms, surrogates and values past the last plane.
+    static const uint32_t smallest[] = {0, 0, 0x80, 0x800, 0x10000};
+    if (value < smallest[length] || (value >= 0xD800 && value <= 0xDFFF) || value > 0x10FFFF) {
+        *codePoint = 0xFFFD;
+        return 1;
+    }
+    *codePoint = (wchar_t)value;
+    return length;
 }
 
-static bool isAtEnd() {
-    return *scanner.current == L'\0';
+static bool isAtEnd(Scanner* scanner) {
+    return *scanner->current == '\0';
 }
 
-static wchar_t advance() {
-    scanner.current++;
-    return scanner.current[-1];
+// Most of a script is ASCII, which needs no decoding.
+static wchar_t advance(Scanner* scanner) {
+    unsigned char c = (unsigned char)*scanner->current;
+    if (c < 0x80) {
+        scanner->current++;
+        return c;
+    }
+    wchar_t codePoint;
+    scanner->current += decodeUtf8(scanner->current, &codePoint);
+    return codePoint;
 }
 
-static wchar_t peek() {
-    return *scanner.current;
+static wchar_t peek(Scanner* scanner) {
+    unsigned char c = (unsigned char)*scanner->current;
+    if (c < 0x80) return c;
+    wchar_t codePoint;
+    decodeUtf8(scanner->current, &codePoint);
+    return codePoint;
 }
 
-static wchar_t peekNext() {
-    if (isAtEnd()) return L'\0';
-    return scanner.current[1];
+static wchar_t peekNext(Scanner* scanner) {
+    if (isAtEnd(scanner)) return L'\0';
+    wchar_t codePoint;
+    const char* next = scanner->current + decodeUtf8(scanner->current, &codePoint);
+    decodeUtf8(next, &codePoint);
+    return codePoint;
 }
 
-static bool match(wchar_t expected) {
-    if (isAtEnd()) return false;
-    if (*scanner.current != expected) return false;
-    scanner.current++;
+static bool match(Scanner* scanner, wchar_t expected) {
+    if (isAtEnd(scanner)) return false;
+    if (peek(scanner) != expected) return false;
+    advance(scanner);
     return true;
 }
 
-static bool isAlpha(wchar_t ch) {
-    return ((unsigned int)ch >= 0x4E00u && (unsigned int)ch <= 0x2FA1F && !iswpunct(ch)) || iswalpha(ch);
+// Looks [c] up in the generated two-level table, which doesn't depend on
+// the locale the way iswalpha() does.
+static int identifierProperty(wchar_t c) {
+    uint32_t codePoint = (uint32_t)c;
+    if (codePoint > 0x10FFFF) return 0;
+    const uint8_t* block = identifierBlocks[identifierBlockIndex[codePoint >> 8]];
+    return (block[(codePoint & 0xFF) >> 2] >> ((codePoint & 3) * 2)) & 3;
 }
 
-static Token makeToken(TokenType type) {
+static bool isIdentifierStart(wchar_t c) {
+    return (identifierProperty(c) & IDENTIFIER_START) != 0;
+}
+
+static bool isIdentifierContinue(wchar_t c) {
+    return (identifierProperty(c) & IDENTIFIER_CONTINUE) != 0;
+}
+
+static bool isDigit(wchar_t c) {
+    return c >= L'0' && c <= L'9';
+}
+
+static bool isAsciiAlphanumeric(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+#ifdef __SSE2__
+// Returns a mask with a bit set for each of the 16 bytes in [low, high].
+static int bytesInRange(__m128i bytes, char low, char high) {
+    __m128i aboveLow = _mm_cmpgt_epi8(bytes, _mm_set1_epi8((char)(low - 1)));
+    __m128i belowHigh = _mm_cmplt_epi8(bytes, _mm_set1_epi8((char)(high + 1)));
+    return _mm_movemask_epi8(_mm_and_si128(aboveLow, belowHigh));
+}
+#endif
+
+// Skips a run of ASCII letters and digits, 16 bytes at a time where the
+// source is long enough. Bytes of multibyte characters are negative as
+// signed chars, so they end a run just like punctuation does.
+static void skipAsciiIdentifier(Scanner* scanner) {
+#ifdef __SSE2__
+    while (scanner->end - scanner->current >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)scanner->current);
+        // Setting bit 5 folds upper case onto lower case and leaves digits alone.
+        __m128i folded = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+        int mask = bytesInRange(folded, 'a', 'z') | bytesInRange(bytes, '0', '9');
+        if (mask != 0xFFFF) {
+            scanner->current += __builtin_ctz(~mask);
+            return;
+        }
+        scanner->current += 16;
+    }
+#endif
+    while (isAsciiAlphanumeric(*scanner->current)) scanner->current++;
+}
+
+// Skips a run of spaces, tabs and carriage returns the same way.
+static void skipBlanks(Scanner* scanner) {
+#ifdef __SSE2__
+    while (scanner->end - scanner->current >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)scanner->current);
+        __m128i blanks = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                                      _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')),
+                                                   _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))));
+        int mask = _mm_movemask_epi8(blanks);
+        if (mask != 0xFFFF) {
+            scanner->current += __builtin_ctz(~mask);
+            return;
+        }
+        scanner->current += 16;
+    }
+#endif
+    while (*scanner->current == ' ' || *scanner->current == '\t' || *scanner->current == '\r') {
+        scanner->current++;
+    }
+}
+
+static Token makeToken(Scanner* scanner, TokenType type) {
     Token token;
     token.type = type;
-    token.start = scanner.start;
-    token.length = (int)(scanner.current - scanner.start);
-    token.line = scanner.line;
+    token.start = scanner->start;
+    token.length = (int)(scanner->current - scanner->start);
+    token.line = scanner->line;
     return token;
 }
 
-static Token errorToken(const wchar_t* message) {
+static Token errorToken(Scanner* scanner, const char* message) {
     Token token;
     token.type = TOKEN_ERROR;
     token.start = message;
-    token.length = (int)wcslen(message);
-    token.line = scanner.line;
+    token.length = (int)strlen(message);
+    token.line = scanner->line;
     return token;
 }
 
-static void skipWhitespace() {
+// Comments are skipped a byte at a time rather than a character at a time:
+// no byte of a multibyte UTF-8 character can be mistaken for ASCII.
+static void skipWhitespace(Scanner* scanner) {
     for (;;) {
-        wchar_t c = peek();
-        switch (c) {
-            case L' ':
-            case L'\r':
-            case L'\t':
-                advance();
+        switch (*scanner->current) {
+            case ' ':
+            case '\r':
+            case '\t':
+                skipBlanks(scanner);
                 break;
-            case L'\n':
-                scanner.line++;
-                advance();
+            case '\n':
+                scanner->line++;
+                scanner->current++;
                 break;
-            case L'/':
-                if (peekNext() == L'/') {
+            case '/':
+                if (scanner->current[1] == '/') {
                     // A comment goes until the end of the line.
-                    while (peek() != L'\n' && !isAtEnd()) advance();
-                } else if (peekNext() == L'*') {
+                    const char* newline = memchr(scanner->current, '\n', scanner->end - scanner->current);
+                    scanner->current = newline != NULL ? newline : scanner->end;
+                } else if (scanner->current[1] == '*') {
                     // A multi-line comment goes until the end token.
-                    while (!isAtEnd()) {
-                        if (match(L'*') && match(L'/')) break;
-                        advance();
+                    scanner->current += 2;
+                    while (!isAtEnd(scanner)) {
+                        if (scanner->current[0] == '*' && scanner->current[1] == '/') {
+                            scanner->current += 2;
+                            break;
+                        }
+                        if (*scanner->current == '\n') scanner->line++;
+                        scanner->current++;
                     }
                 } else {
                     return;
@@ -102,86 +236,90 @@ static void skipWhitespace() {
     }
 }
 
-static TokenType checkKeyword(int start, int length, const wchar_t* rest, TokenType type) {
-    if (scanner.current - scanner.start == start + length
-    && memcmp(scanner.start + start, rest, length * sizeof(wchar_t)) == 0) {
+static TokenType checkKeyword(Scanner* scanner, const char* keyword, TokenType type) {
+    size_t length = strlen(keyword);
+    if ((size_t)(scanner->current - scanner->start) == length &&
+        memcmp(scanner->start, keyword, length) == 0) {
         return type;
     }
 
     return TOKEN_IDENTIFIER;
 }
 
-static TokenType identifierType() {
-    switch (scanner.start[0]) {
-        case L'打': return checkKeyword(1, 1, L"断", TOKEN_BREAK);
-        case L'继': return checkKeyword(1, 1, L"续", TOKEN_CONTINUE);
-        case L'类': return checkKeyword(1, 0, L"", TOKEN_CLASS);
-        case L'切': return checkKeyword(1, 1, L"换", TOKEN_SWITCH);
-        case L'案': return checkKeyword(1, 1, L"例", TOKEN_CASE);
-        case L'预': return checkKeyword(1, 1, L"设", TOKEN_DEFAULT);
-        case L'否': return checkKeyword(1, 1, L"则", TOKEN_ELSE);
-        case L'功': return checkKeyword(1, 1, L"能", TOKEN_FUN);
-        case L'而': return checkKeyword(1, 0, L"", TOKEN_WHILE);
-        case L'对': return checkKeyword(1, 1, L"于", TOKEN_FOR);
-        case L'如': return checkKeyword(1, 1, L"果", TOKEN_IF);
-        case L'空': return checkKeyword(1, 0, L"", TOKEN_NIL);
-        case L'返': return checkKeyword(1, 1, L"回", TOKEN_RETURN);
-        case L'超': return checkKeyword(1, 0, L"", TOKEN_SUPER);
-        case L'真': return checkKeyword(1, 0, L"", TOKEN_TRUE);
-        case L'假': return checkKeyword(1, 0, L"", TOKEN_FALSE);
-        case L'这': return checkKeyword(1, 0, L"", TOKEN_THIS);
-        case L'变': return checkKeyword(1, 1, L"量", TOKEN_VAR);
-        case L'和': return checkKeyword(1, 0, L"", TOKEN_AND);
-        case L'或': return checkKeyword(1, 0, L"", TOKEN_OR);
-        case L'等': return checkKeyword(1, 0, L"", TOKEN_EQUAL_EQUAL);
+static TokenType identifierType(Scanner* scanner) {
+    wchar_t first;
+    decodeUtf8(scanner->start, &first);
+    switch (first) {
+        case L'打': return checkKeyword(scanner, "打断", TOKEN_BREAK);
+        case L'继': return checkKeyword(scanner, "继续", TOKEN_CONTINUE);
+        case L'类': return checkKeyword(scanner, "类", TOKEN_CLASS);
+        case L'切': return checkKeyword(scanner, "切换", TOKEN_SWITCH);
+        case L'案': return checkKeyword(scanner, "案例", TOKEN_CASE);
+        case L'预': return checkKeyword(scanner, "预设", TOKEN_DEFAULT);
+        case L'否': return checkKeyword(scanner, "否则", TOKEN_ELSE);
+        case L'功': return checkKeyword(scanner, "功能", TOKEN_FUN);
+        case L'而': return checkKeyword(scanner, "而", TOKEN_WHILE);
+        case L'对': return checkKeyword(scanner, "对于", TOKEN_FOR);
+        case L'如': return checkKeyword(scanner, "如果", TOKEN_IF);
+        case L'空': return checkKeyword(scanner, "空", TOKEN_NIL);
+        case L'返': return checkKeyword(scanner, "返回", TOKEN_RETURN);
+        case L'超': return checkKeyword(scanner, "超", TOKEN_SUPER);
+        case L'真': return checkKeyword(scanner, "真", TOKEN_TRUE);
+        case L'假': return checkKeyword(scanner, "假", TOKEN_FALSE);
+        case L'这': return checkKeyword(scanner, "这", TOKEN_THIS);
+        case L'变': return checkKeyword(scanner, "变量", TOKEN_VAR);
+        case L'产': return checkKeyword(scanner, "产出", TOKEN_YIELD);
+        case L'导': return checkKeyword(scanner, "导入", TOKEN_IMPORT);
+        case L'和': return checkKeyword(scanner, "和", TOKEN_AND);
+        case L'或': return checkKeyword(scanner, "或", TOKEN_OR);
+        case L'等': return checkKeyword(scanner, "等", TOKEN_EQUAL_EQUAL);
         case L'不':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case L'等': return checkKeyword(2, 0, L"", TOKEN_BANG_EQUAL);
-                }
-            }
-            return checkKeyword(1, 0, L"", TOKEN_BANG);
+            if (checkKeyword(scanner, "不等", TOKEN_BANG_EQUAL) != TOKEN_IDENTIFIER) return TOKEN_BANG_EQUAL;
+            return checkKeyword(scanner, "不", TOKEN_BANG);
         case L'大':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case L'等': return checkKeyword(2, 0, L"", TOKEN_GREATER_EQUAL);
-                }
-            }
-            return checkKeyword(1, 0, L"", TOKEN_GREATER);
+            if (checkKeyword(scanner, "大等", TOKEN_GREATER_EQUAL) != TOKEN_IDENTIFIER) return TOKEN_GREATER_EQUAL;
+            return checkKeyword(scanner, "大", TOKEN_GREATER);
         case L'小':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case L'等': return checkKeyword(2, 0, L"", TOKEN_LESS_EQUAL);
-                }
-            }
-            return checkKeyword(1, 0, L"", TOKEN_LESS);
-        case L'位':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case L'不': return checkKeyword(2, 0, L"", TOKEN_BITWISE_NOT);
-                    case L'和': return checkKeyword(2, 0, L"", TOKEN_BITWISE_AND);
-                    case L'或': return checkKeyword(2, 0, L"", TOKEN_BITWISE_OR);
-                    case L'异': return checkKeyword(2, 1, L"或", TOKEN_BITWISE_XOR);
-                    case L'左': return checkKeyword(2, 1, L"移", TOKEN_BITWISE_LEFT_SHIFT);
-                    case L'右': return checkKeyword(2, 1, L"移", TOKEN_BITWISE_RIGHT_SHIFT);
-                }
+            if (checkKeyword(scanner, "小等", TOKEN_LESS_EQUAL) != TOKEN_IDENTIFIER) return TOKEN_LESS_EQUAL;
+            return checkKeyword(scanner, "小", TOKEN_LESS);
+        case L'位': {
+            static const struct {
+                const char* keyword;
+                TokenType type;
+            } bitwise[] = {
+                {"位不", TOKEN_BITWISE_NOT},
+                {"位和", TOKEN_BITWISE_AND},
+                {"位或", TOKEN_BITWISE_OR},
+                {"位异或", TOKEN_BITWISE_XOR},
+                {"位左移", TOKEN_BITWISE_LEFT_SHIFT},
+                {"位右移", TOKEN_BITWISE_RIGHT_SHIFT},
+            };
+            for (size_t i = 0; i < sizeof(bitwise) / sizeof(bitwise[0]); i++) {
+                TokenType type = checkKeyword(scanner, bitwise[i].keyword, bitwise[i].type);
+                if (type != TOKEN_IDENTIFIER) return type;
             }
             break;
+        }
     }
 
     return TOKEN_IDENTIFIER;
 }
 
-static Token identifier() {
-    while (isAlpha(peek()) || iswdigit(peek())) advance();
-    return makeToken(identifierType());
+static Token identifier(Scanner* scanner) {
+    for (;;) {
+        skipAsciiIdentifier(scanner);
+        wchar_t c = peek(scanner);
+        if (c < 0x80 || !isIdentifierContinue(c)) break;
+        advance(scanner);
+    }
+    return makeToken(scanner, identifierType(scanner));
 }
 
 // Reads the next character, which should be a hex digit (0-9, a-f, or A-F) and
 // returns its numeric value. If the character isn't a hex digit, returns -1.
-static int readHexDigit()
+static int readHexDigit(Scanner* scanner)
 {
-    wchar_t c = peek();
+    wchar_t c = peek(scanner);
     if (c >= L'0' && c <= L'9') return c - L'0';
     if (c >= L'a' && c <= L'f') return c - L'a' + 10;
     if (c >= L'A' && c <= L'F') return c - L'A' + 10;
@@ -189,125 +327,123 @@ static int readHexDigit()
     return -1;
 }
 
-static Token decimal() {
-    while (iswdigit(peek())) advance();
+static Token decimal(Scanner* scanner) {
+    while (isDigit(peek(scanner))) advance(scanner);
 
     // Look for a fractional part.
-    if (peek() == L'.' && iswdigit(peekNext())) {
+    if (peek(scanner) == L'.' && isDigit(peekNext(scanner))) {
         // Consume the ".".
-        advance();
-        while (iswdigit(peek())) advance();
+        advance(scanner);
+        while (isDigit(peek(scanner))) advance(scanner);
     }
 
     // Look for a scientific notation part.
-    if (match(L'e') || match(L'E')) {
+    if (match(scanner, L'e') || match(scanner, L'E')) {
         // Allow a single positive/negative exponent symbol.
-        if (!match(L'+')) {
-            match(L'-');
+        if (!match(scanner, L'+')) {
+            match(scanner, L'-');
         }
 
-        if (!iswdigit(peek())) {
-            return errorToken(L"无终止的科学记数法。");
+        if (!isDigit(peek(scanner))) {
+            return errorToken(scanner, "无终止的科学记数法。");
         }
 
-        while (iswdigit(peek())) advance();
+        while (isDigit(peek(scanner))) advance(scanner);
     }
 
-    return makeToken(TOKEN_DECIMAL);
+    return makeToken(scanner, TOKEN_DECIMAL);
 }
 
 // Finishes lexing an octal number literal.
-static Token octal() {
+static Token octal(Scanner* scanner) {
     // Skip past the `O` used to denote an octal literal.
-    advance();
+    advance(scanner);
 
     // Iterate over all the valid octal digits found.
-    while (peek() >= L'0' && peek() <= L'7') advance();
+    while (peek(scanner) >= L'0' && peek(scanner) <= L'7') advance(scanner);
 
-    return makeToken(TOKEN_OCTAL);
+    return makeToken(scanner, TOKEN_OCTAL);
 }
 
 // Finishes lexing a binary number literal.
-static Token binary() {
+static Token binary(Scanner* scanner) {
     // Skip past the `B` used to denote a binary literal.
-    advance();
+    advance(scanner);
 
     // Iterate over all the valid binary digits found.
-    while (peek() == L'0' || peek() == L'1') advance();
+    while (peek(scanner) == L'0' || peek(scanner) == L'1') advance(scanner);
 
-    return makeToken(TOKEN_BINARY);
+    return makeToken(scanner, TOKEN_BINARY);
 }
 
 // Finishes lexing a hexadecimal number literal.
-static Token hexadecimal() {
+static Token hexadecimal(Scanner* scanner) {
     // Skip past the `x` used to denote a hexadecimal literal.
-    advance();
+    advance(scanner);
 
     // Iterate over all the valid hexadecimal digits found.
-    while (readHexDigit() != -1) advance();
+    while (readHexDigit(scanner) != -1) advance(scanner);
 
-    return makeToken(TOKEN_HEXADECIMAL);
+    return makeToken(scanner, TOKEN_HEXADECIMAL);
 }
 
-static Token string() {
-    while (peek() != L'"' && !isAtEnd()) {
-        if (peek() == L'\n') scanner.line++;
-        else if (peek() == L'·') advance();
-        advance();
+static Token string(Scanner* scanner) {
+    while (peek(scanner) != L'"' && !isAtEnd(scanner)) {
+        if (peek(scanner) == L'\n') scanner->line++;
+        else if (peek(scanner) == L'·') advance(scanner);
+        advance(scanner);
     }
 
-    if (isAtEnd()) return errorToken(L"Unterminated string.");
+    if (isAtEnd(scanner)) return errorToken(scanner, "Unterminated string.");
 
     // The closing quote.
-    advance();
-    return makeToken(TOKEN_STRING);
+    advance(scanner);
+    return makeToken(scanner, TOKEN_STRING);
 }
 
-Token scanToken() {
-    skipWhitespace();
-    scanner.start = scanner.current;
+Token scanToken(Scanner* scanner) {
+    skipWhitespace(scanner);
+    scanner->start = scanner->current;
 
-    if (isAtEnd()) return makeToken(TOKEN_EOF);
+    if (isAtEnd(scanner)) return makeToken(scanner, TOKEN_EOF);
 
-    wchar_t c = advance();
+    wchar_t c = advance(scanner);
 
     switch (c) {
-        case L'（': return makeToken(TOKEN_LEFT_PAREN);
-        case L'）': return makeToken(TOKEN_RIGHT_PAREN);
+        case L'（': return makeToken(scanner, TOKEN_LEFT_PAREN);
+        case L'）': return makeToken(scanner, TOKEN_RIGHT_PAREN);
         case L'『':
-        case L'「': return makeToken(TOKEN_LEFT_BRACE);
+        case L'「': return makeToken(scanner, TOKEN_LEFT_BRACE);
         case L'』':
-        case L'」': return makeToken(TOKEN_RIGHT_BRACE);
-        case L'；': return makeToken(TOKEN_SEMICOLON);
-        case L'，': return makeToken(TOKEN_COMMA);
-        case L'。': return makeToken(TOKEN_DOT);
+        case L'」': return makeToken(scanner, TOKEN_RIGHT_BRACE);
+        case L'；': return makeToken(scanner, TOKEN_SEMICOLON);
+        case L'，': return makeToken(scanner, TOKEN_COMMA);
+        case L'。': return makeToken(scanner, TOKEN_DOT);
         case L'-':
-            return makeToken(match(L'=') ? TOKEN_MINUS_EQUAL
-            : match(L'-') ? TOKEN_MINUS_MINUS : TOKEN_MINUS);
+            return makeToken(scanner, match(scanner, L'=') ? TOKEN_MINUS_EQUAL
+            : match(scanner, L'-') ? TOKEN_MINUS_MINUS : TOKEN_MINUS);
         case L'+':
-            return makeToken(match(L'=') ? TOKEN_PLUS_EQUAL
-            : match(L'+') ? TOKEN_PLUS_PLUS : TOKEN_PLUS);
-        case L'/': return makeToken(TOKEN_SLASH);
-        case L'*': return makeToken(TOKEN_STAR);
-        case L'%': return makeToken(TOKEN_PERCENT);
-        case L'：': return makeToken(TOKEN_COLON);
-        case L'=': return makeToken(TOKEN_EQUAL);
-        case L'"': return string();
-        case L'【': return makeToken(TOKEN_LEFT_BRACKET);
-        case L'】': return makeToken(TOKEN_RIGHT_BRACKET);
+            return makeToken(scanner, match(scanner, L'=') ? TOKEN_PLUS_EQUAL
+            : match(scanner, L'+') ? TOKEN_PLUS_PLUS : TOKEN_PLUS);
+        case L'/': return makeToken(scanner, TOKEN_SLASH);
+        case L'*': return makeToken(scanner, TOKEN_STAR);
+        case L'%': return makeToken(scanner, TOKEN_PERCENT);
+        case L'：': return makeToken(scanner, TOKEN_COLON);
+        case L'=': return makeToken(scanner, TOKEN_EQUAL);
+        case L'"': return string(scanner);
+        case L'【': return makeToken(scanner, TOKEN_LEFT_BRACKET);
+        case L'】': return makeToken(scanner, TOKEN_RIGHT_BRACKET);
         case L'0':
-            switch (peek()) {
-                case L'x': return hexadecimal();
-                case L'O': return octal();
-                case L'B': return binary();
-                default: return decimal();
+            switch (peek(scanner)) {
+                case L'x': return hexadecimal(scanner);
+                case L'O': return octal(scanner);
+                case L'B': return binary(scanner);
+                default: return decimal(scanner);
             }
         default:
-            if (isAlpha(c)) return identifier();
-            if (iswdigit(c)) return decimal();
+            if (isIdentifierStart(c)) return identifier(scanner);
+            if (isDigit(c)) return decimal(scanner);
     }
 
-    return errorToken(L"意想不到的性格。");
+    return errorToken(scanner, "意想不到的性格。");
 }
-
-Scanner scanner;
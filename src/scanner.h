@@ -5,6 +5,8 @@
 #ifndef QI_SCANNER_H
 #define QI_SCANNER_H
 
+#include <wchar.h>
+
 typedef enum {
     // Single-character tokens.
     TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
@@ -29,7 +31,8 @@ typedef enum {
     TOKEN_FOR, TOKEN_FUN, TOKEN_IF, TOKEN_NIL, TOKEN_OR,
     TOKEN_RETURN, TOKEN_SUPER, TOKEN_THIS, TOKEN_TRUE,
     TOKEN_VAR, TOKEN_WHILE, TOKEN_CASE, TOKEN_DEFAULT,
-    TOKEN_SWITCH, TOKEN_CONTINUE, TOKEN_BREAK,
+    TOKEN_SWITCH, TOKEN_CONTINUE, TOKEN_BREAK, TOKEN_YIELD,
+    TOKEN_IMPORT,
     TOKEN_BITWISE_AND, TOKEN_BITWISE_OR, TOKEN_BITWISE_XOR,
     TOKEN_BITWISE_NOT, TOKEN_BITWISE_LEFT_SHIFT,
     TOKEN_BITWISE_RIGHT_SHIFT,
@@ -37,14 +40,23 @@ typedef enum {
     TOKEN_NEWLINE, TOKEN_ERROR, TOKEN_EOF,
 } TokenType;
 
+// Tokens point into the UTF-8 source; [length] is in bytes.
 typedef struct {
     TokenType type;
-    const wchar_t* start;
+    const char* start;
     int length;
     int line;
 } Token;
 
-void initScanner(const wchar_t* source);
-Token scanToken();
+typedef struct {
+    const char* start;
+    const char* current;
+    const char* end;
+    int line;
+} Scanner;
+
+void initScanner(Scanner* scanner, const char* source);
+int decodeUtf8(const char* bytes, wchar_t* codePoint);
+Token scanToken(Scanner* scanner);
 
 #endif //QI_SCANNER_H
@@ -0,0 +1,348 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "shared.h"
+#include "table.h"
+
+#define REQUEST_MAX 65536
+
+typedef struct {
+    const char* socketPath;
+    int workers;
+    int maxRequests;     // Requests a worker serves before it is replaced.
+    long maxMemory;      // Resident bytes after which a worker is replaced.
+    long budget;         // Loop edges and calls a request may make, or 0.
+    long timeout;        // Seconds a client may take to send or receive.
+    int scriptCount;
+    const char** scripts;
+} ServerOptions;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void onStop(int signal) {
+    (void)signal;
+    stopping = 1;
+}
+
+static bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+// Reads one newline-terminated request into [buffer], replacing the newline
+// with a terminator. Fails if the client goes quiet past the socket timeout.
+static bool readRequest(int fd, char* buffer) {
+    size_t length = 0;
+    while (length < REQUEST_MAX - 1) {
+        ssize_t got = read(fd, buffer + length, REQUEST_MAX - 1 - length);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        char* newline = memchr(buffer + length, '\n', got);
+        length += got;
+        if (newline != NULL) {
+            *newline = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+// Takes everything written to [fd] since the last call, leaving it empty.
+static char* drain(int fd, size_t* length) {
+    off_t size = lseek(fd, 0, SEEK_CUR);
+    char* data = (char*)malloc(size > 0 ? size : 1);
+    if (data == NULL) exit(1);
+    *length = pread(fd, data, size, 0) == size ? (size_t)size : 0;
+    if (ftruncate(fd, 0) != 0) exit(1);
+    lseek(fd, 0, SEEK_SET);
+    return data;
+}
+
+static ObjString* decode(VM* vm, const char* text) {
+    return copyUtf8(vm, text, (int)strlen(text));
+}
+
+// Arguments that read as numbers are passed as numbers, the rest as strings.
+static Value parseArgument(VM* vm, const char* text) {
+    char* end;
+    double number = strtod(text, &end);
+    if (*text != '\0' && *end == '\0') return NUMBER_VAL(number);
+    return OBJ_VAL(decode(vm, text));
+}
+
+static int callEntry(VM* vm, char* name, char* arguments) {
+    Value entry;
+    ObjString* entryName = decode(vm, name);
+    if (!tableGet(&vm->globals, entryName, &entry) || !IS_CLOSURE(entry)) {
+        fwprintf(stderr, L"没有名为「%ls」的功能。\n", entryName->chars);
+        return 70;
+    }
+    push(vm, entry);
+
+    Value args[UINT8_COUNT];
+    int argCount = 0;
+    for (char* argument = arguments; argument != NULL;) {
+        char* next = strchr(argument, '\t');
+        if (next != NULL) *next++ = '\0';
+        if (argCount == UINT8_COUNT) {
+            fwprintf(stderr, L"参数不能超过 %d 个。\n", UINT8_COUNT);
+            return 70;
+        }
+        args[argCount] = parseArgument(vm, argument);
+        push(vm, args[argCount++]);
+        argument = next;
+    }
+
+    Value result;
+    if (runClosure(vm, AS_CLOSURE(entry), &result, args, argCount) != INTERPRET_OK) return 70;
+    if (!IS_NIL(result)) {
+        outputValue(&vm->output, result);
+        outputChars(&vm->output, L"\n", 1);
+    }
+    return 0;
+}
+
+// Runs one request in a fresh VM: the script, then the entry function if
+// one was named. Returns the exit code `qi` would have given.
+static int handle(char* request, long budget) {
+    char* name = strchr(request, '\t');
+    char* arguments = NULL;
+    if (name != NULL) {
+        *name++ = '\0';
+        arguments = strchr(name, '\t');
+        if (arguments != NULL) *arguments++ = '\0';
+    }
+
+    VM* vm = newVM();
+    if (vm == NULL) {
+        fwprintf(stderr, L"没有足够的内存来启动虚拟机。\n");
+        return 74;
+    }
+    // With no callback an exhausted budget aborts the request.
+    setBudget(vm, budget, NULL, NULL);
+
+    int code = 0;
+    bool unreadable;
+    ObjFunction* function = loadSharedScript(vm, request, &unreadable);
+    if (function == NULL) {
+        code = unreadable ? 74 : 65;
+    } else if (interpretFunction(vm, function) != INTERPRET_OK) {
+        code = 70;
+    } else if (name != NULL) {
+        code = callEntry(vm, name, arguments);
+    }
+    freeVM(vm);
+    return code;
+}
+
+static long residentBytes(void) {
+    long pages = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file == NULL) return 0;
+    if (fscanf(file, "%*d %ld", &pages) != 1) pages = 0;
+    fclose(file);
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+// Serves requests until it is due to be replaced. Everything a request
+// prints goes to two in-memory files standing in for stdout and stderr.
+static void workerLoop(int listener, ServerOptions* options) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    int out = memfd_create("qi-stdout", 0);
+    int err = memfd_create("qi-stderr", 0);
+    if (out < 0 || err < 0 || dup2(out, STDOUT_FILENO) < 0 || dup2(err, STDERR_FILENO) < 0) exit(1);
+
+    char* request = (char*)malloc(REQUEST_MAX);
+    if (request == NULL) exit(1);
+
+    for (int served = 0; served < options->maxRequests;) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            exit(1);
+        }
+        // A client that never finishes its request, or never reads the
+        // reply, would otherwise hold this worker forever.
+        struct timeval timeout = {options->timeout, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        if (readRequest(client, request)) {
+            int code = handle(request, options->budget);
+            fflush(stdout);
+            fflush(stderr);
+
+            size_t outLength, errLength;
+            char* outData = drain(out, &outLength);
+            char* errData = drain(err, &errLength);
+            char header[64];
+            int headerLength = snprintf(header, sizeof(header), "%d %zu %zu\n", code, outLength, errLength);
+            // A client that went away just loses its response.
+            if (writeAll(client, header, headerLength) && writeAll(client, outData, outLength)) {
+                writeAll(client, errData, errLength);
+            }
+            free(outData);
+            free(errData);
+            served++;
+        }
+        close(client);
+
+        if (options->maxMemory > 0 && residentBytes() > options->maxMemory) break;
+    }
+    exit(0);
+}
+
+static pid_t spawnWorker(int listener, ServerOptions* options) {
+    pid_t pid = fork();
+    if (pid == 0) workerLoop(listener, options);
+    return pid;
+}
+
+// Builds the shared core and compiles the scripts named on the command line
+// into the shared heap before forking, so every worker starts with them.
+static void warm(ServerOptions* options) {
+    VM* core = newVM();
+    if (core == NULL) exit(74);
+    freeVM(core);
+    for (int i = 0; i < options->scriptCount; i++) {
+        VM* vm = newVM();
+        if (vm == NULL) exit(74);
+        bool unreadable;
+        ObjFunction* function = loadSharedScript(vm, options->scripts[i], &unreadable);
+        freeVM(vm);
+        if (function == NULL) exit(unreadable ? 74 : 65);
+    }
+}
+
+static bool parseCount(const char* text, long* count) {
+    char* end;
+    *count = strtol(text, &end, 10);
+    return *text != '\0' && *end == '\0' && *count > 0;
+}
+
+static bool parseOptions(int argc, const char* argv[], ServerOptions* options) {
+    options->socketPath = argv[0];
+    options->workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    options->maxRequests = 1000;
+    options->maxMemory = 256L * 1024 * 1024;
+    options->budget = 0;
+    options->timeout = 10;
+    options->scriptCount = 0;
+    options->scripts = argv + 1;
+
+    int i = 1;
+    for (; i + 1 < argc && strncmp(argv[i], "--", 2) == 0; i += 2) {
+        long value;
+        if (!parseCount(argv[i + 1], &value)) return false;
+        if (strcmp(argv[i], "--workers") == 0) {
+            options->workers = (int)value;
+        } else if (strcmp(argv[i], "--max-requests") == 0) {
+            options->maxRequests = (int)value;
+        } else if (strcmp(argv[i], "--max-memory") == 0) {
+            options->maxMemory = value * 1024 * 1024;
+        } else if (strcmp(argv[i], "--budget") == 0) {
+            options->budget = value;
+        } else if (strcmp(argv[i], "--timeout") == 0) {
+            options->timeout = value;
+        } else {
+            return false;
+        }
+    }
+    if (i < argc && strncmp(argv[i], "--", 2) == 0) return false;
+
+    options->scripts = argv + i;
+    options->scriptCount = argc - i;
+    if (options->workers < 1) options->workers = 1;
+    return true;
+}
+
+int serve(int argc, const char* argv[]) {
+    ServerOptions options;
+    if (argc < 1 || !parseOptions(argc, argv, &options)) {
+        fwprintf(stderr, L"用法：qi --serve【套接字路径】【--workers 数】【--max-requests 数】【--max-memory 兆字节】【--budget 数】【--timeout 秒】【脚本路径…】\n");
+        return 64;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(options.socketPath) >= sizeof(address.sun_path)) {
+        fwprintf(stderr, L"套接字路径「%s」太长。\n", options.socketPath);
+        return 64;
+    }
+    strcpy(address.sun_path, options.socketPath);
+
+    warm(&options);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(options.socketPath);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        fwprintf(stderr, L"无法监听套接字「%s」。\n", options.socketPath);
+        return 74;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onStop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t* workers = (pid_t*)malloc(sizeof(pid_t) * options.workers);
+    if (workers == NULL) exit(1);
+    for (int i = 0; i < options.workers; i++) workers[i] = spawnWorker(listener, &options);
+
+    // Replace workers as they retire or crash until asked to stop. Workers
+    // that couldn't be forked are tried again each time one exits, or after
+    // a pause once none are left to wait for.
+    while (!stopping) {
+        pid_t pid = waitpid(-1, NULL, 0);
+        if (pid < 0) {
+            if (errno == ECHILD) sleep(1);
+            else continue;
+        }
+        for (int i = 0; i < options.workers; i++) {
+            if ((workers[i] == pid || workers[i] < 0) && !stopping) {
+                workers[i] = spawnWorker(listener, &options);
+            }
+        }
+    }
+
+    for (int i = 0; i < options.workers; i++) {
+        if (workers[i] > 0) kill(workers[i], SIGTERM);
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {}
+    close(listener);
+    unlink(options.socketPath);
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,13 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_SERVER_H
+#define QI_SERVER_H
+
+#include "common.h"
+#include "vm.h"
+
+int serve(int argc, const char* argv[]);
+
+#endif //QI_SERVER_H
@@ -0,0 +1,292 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "shared.h"
+#include "source.h"
+#include "memory.h"
+#include "table.h"
+
+// One generation of the shared string table. A generation never changes
+// once it is published: sharing more strings publishes a new, larger one.
+// Older generations are kept because VMs created earlier still read them.
+struct SharedStrings {
+    int id;
+    int count;
+    int capacity;
+    ObjString** strings;
+    struct SharedStrings* previous;
+};
+
+typedef struct SharedScript {
+    char* path;
+    struct timespec modified;
+    off_t size;
+    ObjFunction* function;
+    int generation;   // The oldest string generation that can run it.
+    struct SharedScript* next;
+} SharedScript;
+
+static pthread_once_t coreOnce = PTHREAD_ONCE_INIT;
+static Table coreGlobals;
+static ObjString* coreInitString;
+// Every core object in the order the bootstrap VM allocated it, so images
+// can refer to them by position.
+static Obj** coreObjects;
+static int coreObjectCount;
+static uint32_t coreFingerprint = 2166136261u;
+
+// Readers only ever load these; writers hold writeLock.
+static _Atomic(SharedStrings*) latestStrings = NULL;
+static _Atomic(SharedScript*) scripts = NULL;
+static pthread_mutex_t writeLock = PTHREAD_MUTEX_INITIALIZER;
+
+static ObjString* lookup(SharedStrings* table, const wchar_t* chars, int length, uint32_t hash) {
+    if (table == NULL) return NULL;
+
+    uint32_t index = hash & (table->capacity - 1);
+    for (;;) {
+        ObjString* string = table->strings[index];
+        if (string == NULL) return NULL;
+        if (string->length == length && string->hash == hash &&
+            memcmp(string->chars, chars, length * sizeof(wchar_t)) == 0) {
+            return string;
+        }
+        index = (index + 1) & (table->capacity - 1);
+    }
+}
+
+static void insert(SharedStrings* table, ObjString* string) {
+    uint32_t index = string->hash & (table->capacity - 1);
+    while (table->strings[index] != NULL) index = (index + 1) & (table->capacity - 1);
+    table->strings[index] = string;
+    table->count++;
+}
+
+// Publishes a generation with the latest one's strings plus [added].
+static SharedStrings* publishStrings(ObjString** added, int addedCount) {
+    SharedStrings* previous = atomic_load_explicit(&latestStrings, memory_order_acquire);
+    int count = (previous == NULL ? 0 : previous->count) + addedCount;
+    int capacity = 8;
+    while (capacity < count * 2) capacity *= 2;
+
+    SharedStrings* table = (SharedStrings*)malloc(sizeof(SharedStrings));
+    if (table == NULL) exit(1);
+    table->strings = (ObjString**)calloc(capacity, sizeof(ObjString*));
+    if (table->strings == NULL) exit(1);
+    table->id = previous == NULL ? 0 : previous->id + 1;
+    table->count = 0;
+    table->capacity = capacity;
+    table->previous = previous;
+
+    if (previous != NULL) {
+        for (int i = 0; i < previous->capacity; i++) {
+            if (previous->strings[i] != NULL) insert(table, previous->strings[i]);
+        }
+    }
+    for (int i = 0; i < addedCount; i++) insert(table, added[i]);
+
+    atomic_store_explicit(&latestStrings, table, memory_order_release);
+    return table;
+}
+
+// Takes every marked object off the VM's object list. Outside of a
+// collection the only marked objects are the ones just moved here.
+static void unlinkShared(VM* vm) {
+    Obj** link = &vm->objects;
+    while (*link != NULL) {
+        if ((*link)->isMarked) {
+            *link = (*link)->next;
+        } else {
+            link = &(*link)->next;
+        }
+    }
+}
+
+static void buildCore(void) {
+    pthread_mutex_lock(&writeLock);
+    VM* vm = newBareVM();
+    if (vm == NULL) exit(1);
+    initCoreModules(vm);
+
+    // Everything the bootstrap VM holds besides its root fiber is core.
+    int capacity = 0;
+    for (Obj* object = vm->objects; object != NULL; object = object->next) capacity++;
+    coreObjects = (Obj**)malloc(sizeof(Obj*) * capacity);
+    if (coreObjects == NULL) exit(1);
+    for (Obj* object = vm->objects; object != NULL; object = object->next) {
+        if (object == (Obj*)vm->fiber) continue;
+        object->isMarked = true;
+        coreObjects[coreObjectCount++] = object;
+        coreFingerprint = (coreFingerprint ^ object->type) * 16777619;
+        if (object->type == OBJ_STRING) {
+            coreFingerprint = (coreFingerprint ^ ((ObjString*)object)->hash) * 16777619;
+        }
+    }
+
+    ObjString** added = (ObjString**)malloc(sizeof(ObjString*) * (vm->strings.count + 1));
+    if (added == NULL) exit(1);
+    int addedCount = 0;
+    for (int i = 0; i < vm->strings.capacity; i++) {
+        ObjString* key = vm->strings.entries[i].key;
+        if (key != NULL) added[addedCount++] = key;
+    }
+    publishStrings(added, addedCount);
+    free(added);
+
+    unlinkShared(vm);
+    coreGlobals = vm->globals;
+    coreInitString = vm->initString;
+    initTable(&vm->globals);
+    freeVM(vm);
+    pthread_mutex_unlock(&writeLock);
+}
+
+void loadSharedCore(VM* vm) {
+    pthread_once(&coreOnce, buildCore);
+    vm->sharedStrings = atomic_load_explicit(&latestStrings, memory_order_acquire);
+    vm->initString = coreInitString;
+    tableAddAll(vm, &coreGlobals, &vm->globals);
+}
+
+// Whether [name] is one of the globals every VM starts with.
+bool isCoreGlobal(ObjString* name) {
+    Value value;
+    return tableGet(&coreGlobals, name, &value);
+}
+
+Obj** sharedCoreObjects(int* count, uint32_t* fingerprint) {
+    pthread_once(&coreOnce, buildCore);
+    *count = coreObjectCount;
+    *fingerprint = coreFingerprint;
+    return coreObjects;
+}
+
+ObjString* findSharedString(VM* vm, const wchar_t* chars, int length, uint32_t hash) {
+    return lookup(vm->sharedStrings, chars, length, hash);
+}
+
+ObjFunction* findSharedScript(VM* vm, const char* path) {
+    struct stat info;
+    if (stat(path, &info) != 0) return NULL;
+
+    SharedScript* script = atomic_load_explicit(&scripts, memory_order_acquire);
+    for (; script != NULL; script = script->next) {
+        if (strcmp(script->path, path) != 0) continue;
+        // A script edited since it was shared is compiled again.
+        if (script->size != info.st_size ||
+            script->modified.tv_sec != info.st_mtim.tv_sec ||
+            script->modified.tv_nsec != info.st_mtim.tv_nsec) return NULL;
+        // Strings shared after this VM started aren't visible to it.
+        if (vm->sharedStrings == NULL || script->generation > vm->sharedStrings->id) return NULL;
+        return script->function;
+    }
+    return NULL;
+}
+
+typedef struct {
+    ObjString** strings;
+    int count;
+    int capacity;
+} StringList;
+
+// Returns the shared string [string] should be replaced by, queueing it to
+// be shared if there is none yet.
+static ObjString* shareString(SharedStrings* latest, StringList* added, ObjString* string) {
+    if (string == NULL || string->obj.isMarked) return string;
+    ObjString* shared = lookup(latest, string->chars, string->length, string->hash);
+    if (shared != NULL) return shared;
+
+    if (added->capacity < added->count + 1) {
+        added->capacity = GROW_CAPACITY(added->capacity);
+        added->strings = (ObjString**)realloc(added->strings, sizeof(ObjString*) * added->capacity);
+        if (added->strings == NULL) exit(1);
+    }
+    string->obj.isMarked = true;
+    added->strings[added->count++] = string;
+    return string;
+}
+
+// Moves the script [function] and everything it references into the shared
+// heap. The VM must not have run anything yet: its only strings are the
+// compiler's, so switching it to the new string generation can't leave it
+// with two copies of the same string.
+void shareScript(VM* vm, const char* path, ObjFunction* function) {
+    struct stat info;
+    if (stat(path, &info) != 0) return;
+
+    pthread_mutex_lock(&writeLock);
+    SharedStrings* latest = atomic_load_explicit(&latestStrings, memory_order_acquire);
+    StringList added = {NULL, 0, 0};
+    int functionCount = 0;
+    int functionCapacity = 8;
+    ObjFunction** functions = (ObjFunction**)malloc(sizeof(ObjFunction*) * functionCapacity);
+    if (functions == NULL) exit(1);
+
+    function->obj.isMarked = true;
+    functions[functionCount++] = function;
+    while (functionCount > 0) {
+        ObjFunction* current = functions[--functionCount];
+        current->name = shareString(latest, &added, current->name);
+        ValueArray* constants = &current->chunk.constants;
+        for (int i = 0; i < constants->count; i++) {
+            Value constant = constants->values[i];
+            if (IS_STRING(constant)) {
+                constants->values[i] = OBJ_VAL(shareString(latest, &added, AS_STRING(constant)));
+            } else if (IS_FUNCTION(constant) && !AS_OBJ(constant)->isMarked) {
+                AS_OBJ(constant)->isMarked = true;
+                if (functionCapacity < functionCount + 1) {
+                    functionCapacity = GROW_CAPACITY(functionCapacity);
+                    functions = (ObjFunction**)realloc(functions, sizeof(ObjFunction*) * functionCapacity);
+                    if (functions == NULL) exit(1);
+                }
+                functions[functionCount++] = AS_FUNCTION(constant);
+            }
+        }
+    }
+    free(functions);
+
+    vm->sharedStrings = publishStrings(added.strings, added.count);
+    for (int i = 0; i < added.count; i++) tableDelete(&vm->strings, added.strings[i]);
+    free(added.strings);
+    unlinkShared(vm);
+
+    SharedScript* script = (SharedScript*)malloc(sizeof(SharedScript));
+    if (script == NULL) exit(1);
+    script->path = strdup(path);
+    script->modified = info.st_mtim;
+    script->size = info.st_size;
+    script->function = function;
+    script->generation = vm->sharedStrings->id;
+    script->next = atomic_load_explicit(&scripts, memory_order_relaxed);
+    atomic_store_explicit(&scripts, script, memory_order_release);
+    pthread_mutex_unlock(&writeLock);
+}
+
+// Returns the shared compiled copy of the script at [path], compiling and
+// sharing it first if needed. Returns NULL after reporting a compile error,
+// or with [unreadable] set when the file can't be read.
+ObjFunction* loadSharedScript(VM* vm, const char* path, bool* unreadable) {
+    *unreadable = false;
+    ObjFunction* function = findSharedScript(vm, path);
+    if (function != NULL) return function;
+
+    Source source;
+    if (!loadSource(path, &source)) {
+        fwprintf(stderr, L"无法打开文件「%s」。\n", path);
+        *unreadable = true;
+        return NULL;
+    }
+    function = compileSource(vm, source.text, path);
+    freeSource(&source);
+    if (function != NULL) shareScript(vm, path, function);
+    return function;
+}
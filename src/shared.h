@@ -0,0 +1,32 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_SHARED_H
+#define QI_SHARED_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+// The shared heap holds objects that every VM in the process can read but
+// none may change or collect: the interned strings and core classes built
+// once at startup, and scripts compiled for worker threads. Shared objects
+// are never on a VM's object list and stay marked for good, so a VM's
+// collector neither traces nor sweeps them.
+typedef struct SharedStrings SharedStrings;
+
+// Outside of a collection only shared objects are marked.
+static inline bool isShared(Obj* object) {
+    return object->isMarked;
+}
+
+void loadSharedCore(VM* vm);
+bool isCoreGlobal(ObjString* name);
+Obj** sharedCoreObjects(int* count, uint32_t* fingerprint);
+ObjString* findSharedString(VM* vm, const wchar_t* chars, int length, uint32_t hash);
+ObjFunction* findSharedScript(VM* vm, const char* path);
+void shareScript(VM* vm, const char* path, ObjFunction* function);
+ObjFunction* loadSharedScript(VM* vm, const char* path, bool* unreadable);
+
+#endif //QI_SHARED_H
@@ -0,0 +1,102 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.h"
+
+#define READ_CHUNK 65536
+
+// Maps [length] bytes of [fd] followed by at least one zero byte. The file
+// is mapped over the start of a larger anonymous mapping, whose remaining
+// pages read as zeros, so the text is terminated even when its length is a
+// multiple of the page size.
+static bool mapFile(int fd, size_t length, Source* source) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t capacity = (length / page + 1) * page;
+    char* region = mmap(NULL, capacity, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) return false;
+    if (mmap(region, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(region, capacity);
+        return false;
+    }
+    madvise(region, length, MADV_SEQUENTIAL);
+
+    source->text = region;
+    source->length = length;
+    source->capacity = capacity;
+    source->mapped = true;
+    return true;
+}
+
+// Reads everything left in [fd], for pipes and other files that can't be
+// mapped.
+static bool readAll(int fd, Source* source) {
+    size_t capacity = READ_CHUNK;
+    size_t length = 0;
+    char* text = (char*)malloc(capacity);
+    if (text == NULL) return false;
+
+    for (;;) {
+        if (capacity - length < READ_CHUNK + 1) {
+            capacity *= 2;
+            char* grown = (char*)realloc(text, capacity);
+            if (grown == NULL) {
+                free(text);
+                return false;
+            }
+            text = grown;
+        }
+        ssize_t got = read(fd, text + length, capacity - length - 1);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            free(text);
+            return false;
+        }
+        if (got == 0) break;
+        length += got;
+    }
+    text[length] = '\0';
+
+    source->text = text;
+    source->length = length;
+    source->capacity = capacity;
+    source->mapped = false;
+    return true;
+}
+
+// Loads the whole of [fd], which must be at its start.
+bool readSource(int fd, Source* source) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) return false;
+    if (S_ISREG(info.st_mode) && info.st_size > 0 && mapFile(fd, (size_t)info.st_size, source)) return true;
+    return readAll(fd, source);
+}
+
+// Loads the script at [path], or standard input if [path] is "-".
+bool loadSource(const char* path, Source* source) {
+    bool standardInput = strcmp(path, "-") == 0;
+    int fd = standardInput ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    bool loaded = readSource(fd, source);
+    if (!standardInput) close(fd);
+    return loaded;
+}
+
+void freeSource(Source* source) {
+    if (source->mapped) {
+        munmap(source->text, source->capacity);
+    } else {
+        free(source->text);
+    }
+    source->text = NULL;
+}
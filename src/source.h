@@ -0,0 +1,23 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_SOURCE_H
+#define QI_SOURCE_H
+
+#include "common.h"
+
+// A script's or file's text, terminated by a zero byte. Regular files are mapped
+// rather than read, so the compiler scans the page cache directly.
+typedef struct {
+    char* text;
+    size_t length;     // Excluding the terminator.
+    size_t capacity;   // Bytes mapped or allocated.
+    bool mapped;
+} Source;
+
+bool readSource(int fd, Source* source);
+bool loadSource(const char* path, Source* source);
+void freeSource(Source* source);
+
+#endif //QI_SOURCE_H
@@ -4,9 +4,11 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "object.h"
 #include "memory.h"
+#include "output.h"
 #include "value.h"
 
 void initValueArray(ValueArray* array) {
@@ -15,43 +17,30 @@ void initValueArray(ValueArray* array) {
     array->count = 0;
 }
 
-void writeValueArray(ValueArray* array, Value value) {
+void writeValueArray(VM* vm, ValueArray* array, Value value) {
     if (array->capacity < array->count + 1) {
         int oldCapacity = array->capacity;
         array->capacity = GROW_CAPACITY(oldCapacity);
-        array->values = GROW_ARRAY(Value, array->values, oldCapacity, array->capacity);
+        array->values = GROW_ARRAY(vm, Value, array->values, oldCapacity, array->capacity);
     }
 
     array->values[array->count] = value;
     array->count++;
 }
 
-void freeValueArray(ValueArray* array) {
-    FREE_ARRAY(Value, array->values, array->capacity);
+void freeValueArray(VM* vm, ValueArray* array) {
+    FREE_ARRAY(vm, Value, array->values, array->capacity);
     initValueArray(array);
 }
 
+// Prints straight to standard output, for debugging output that isn't
+// tied to a VM.
 void printValue(Value value) {
-#ifdef NAN_BOXING
-    if (IS_BOOL(value)) {
-        wprintf(AS_BOOL(value) ? L"真" : L"假");
-    } else if (IS_NIL(value)) {
-        wprintf(L"空");
-    } else if (IS_NUMBER(value)) {
-        wprintf(L"%g", AS_NUMBER(value));
-    } else if (IS_OBJ(value)) {
-        printObject(value);
-    }
-#else
-    switch (value.type) {
-        case VAL_BOOL:
-            wprintf(AS_BOOL(value) ? L"真" : L"假");
-            break;
-        case VAL_NIL: wprintf(L"空"); break;
-        case VAL_NUMBER: wprintf(L"%g", AS_NUMBER(value)); break;
-        case VAL_OBJ: printObject(value); break;
-    }
-#endif
+    Output output;
+    initOutput(&output, STDOUT_FILENO);
+    fflush(stdout);
+    outputValue(&output, value);
+    flushOutput(&output);
 }
 
 bool valuesEqual(Value a, Value b) {
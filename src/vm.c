@@ -8,7 +8,9 @@
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#include <wctype.h>
 #include <math.h>
+#include <unistd.h>
 
 #include "common.h"
 #include "compiler.h"
@@ -17,104 +19,192 @@
 #include "memory.h"
 #include "vm.h"
 #include "core_module.h"
-
-VM vm;
-
-static void resetStack() {
-    vm.stackTop = vm.stack;
-    vm.frameCount = 0;
-    vm.openUpvalues = NULL;
+#include "event_loop.h"
+#include "worker.h"
+#include "shared.h"
+#include "module.h"
+#include "reader.h"
+#include "file.h"
+#include "bytes.h"
+#include "json.h"
+#include "csv.h"
+#include "regex.h"
+#include "embed.h"
+
+static void resetStack(ObjFiber* fiber) {
+    fiber->stackTop = fiber->stack;
+    fiber->frameCount = 0;
+    fiber->openUpvalues = NULL;
+    fiber->nativeCalls = 0;
 }
 
-static void runtimeError(const wchar_t* format, ...) {
+static void runtimeError(VM* vm, const wchar_t* format, ...) {
+    // Whatever the script printed comes before the error.
+    flushOutput(&vm->output);
+
     va_list args;
     va_start(args, format);
     vfwprintf(stderr, format, args);
     va_end(args);
-    fputs("\n", stderr);
-
-    for (int i = vm.frameCount - 1; i >= 0; i--) {
-        CallFrame* frame = &vm.frames[i];
-        ObjFunction* function = frame->closure->function;
-        size_t instruction = frame->ip - function->chunk.code - 1;
-        fwprintf(stderr, L"【行 %d】在 ", function->chunk.lines[instruction]);
-        if (function->name == NULL) {
-            fwprintf(stderr, L"脚本\n");
-        } else {
-            fwprintf(stderr, L"%ls（）\n", function->name->chars);
+    fwprintf(stderr, L"\n");
+
+    // Print the trace of every fiber from the failing one back to the root,
+    // then unwind them all; an error always aborts the whole resume chain.
+    for (ObjFiber* fiber = vm->fiber; fiber != NULL; fiber = fiber->caller) {
+        for (int i = fiber->frameCount - 1; i >= 0; i--) {
+            CallFrame* frame = &fiber->frames[i];
+            ObjFunction* function = frame->closure->function;
+            size_t instruction = frame->ip - function->chunk.code - 1;
+            fwprintf(stderr, L"【行 %d】在 ", function->chunk.lines[instruction]);
+            if (function->name == NULL) {
+                fwprintf(stderr, L"脚本\n");
+            } else {
+                fwprintf(stderr, L"%ls（）\n", function->name->chars);
+            }
         }
     }
 
-    resetStack();
+    ObjFiber* fiber = vm->fiber;
+    while (fiber != NULL) {
+        ObjFiber* caller = fiber->caller;
+        resetStack(fiber);
+        if (fiber->closure != NULL) fiber->state = FIBER_DONE;
+        fiber->caller = NULL;
+        vm->fiber = fiber;
+        fiber = caller;
+    }
 }
 
-void defineNativeInstance(wchar_t* name, ObjInstance* instance) {
-    push(OBJ_VAL(copyString(name, (int)wcslen(name))));
-    push(OBJ_VAL(instance));
-    tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
-    pop();
-    pop();
+void defineNativeInstance(VM* vm, wchar_t* name, ObjInstance* instance) {
+    push(vm, OBJ_VAL(copyString(vm, name, (int)wcslen(name))));
+    push(vm, OBJ_VAL(instance));
+    tableSet(vm, &vm->globals, AS_STRING(vm->fiber->stackTop[-2]), vm->fiber->stackTop[-1]);
+    pop(vm);
+    pop(vm);
 }
 
-void defineNative(const wchar_t* name, NativeFn function, int arity, ObjClass* klass) {
-    push(OBJ_VAL(copyString(name, (int)wcslen(name))));
-    push(OBJ_VAL(newNative(function, arity)));
-    tableSet(&klass->methods, AS_STRING(vm.stack[0]), vm.stack[1]);
-    pop();
-    pop();
+void defineNative(VM* vm, const wchar_t* name, NativeFn function, int arity, ObjClass* klass) {
+    push(vm, OBJ_VAL(copyString(vm, name, (int)wcslen(name))));
+    push(vm, OBJ_VAL(newNative(vm, function, arity)));
+    tableSet(vm, &klass->methods, AS_STRING(vm->fiber->stackTop[-2]), vm->fiber->stackTop[-1]);
+    pop(vm);
+    pop(vm);
 }
 
-void defineProperty(const wchar_t* name, Value value, ObjInstance* instance) {
-    push(OBJ_VAL(copyString(name, (int)wcslen(name))));
-    push(value);
-    tableSet(&instance->fields, AS_STRING(vm.stack[0]), vm.stack[1]);
-    pop();
-    pop();
+// Defines a native whose arguments the VM checks against [signature], such
+// as "(num 底数, num 次方) -> num", so the native can use them straight away.
+void defineTypedNative(VM* vm, const wchar_t* name, NativeFn function, const char* signature, ObjClass* klass) {
+    Signature* parsed = newSignature(vm, signature);
+    if (parsed == NULL) {
+        fwprintf(stderr, L"「%ls」的签名无效。\n", name);
+        exit(1);
+    }
+    push(vm, OBJ_VAL(copyString(vm, name, (int)wcslen(name))));
+    ObjNative* native = newNative(vm, function, signatureArity(parsed));
+    native->signature = parsed;
+    push(vm, OBJ_VAL(native));
+    tableSet(vm, &klass->methods, AS_STRING(vm->fiber->stackTop[-2]), vm->fiber->stackTop[-1]);
+    pop(vm);
+    pop(vm);
 }
 
-void initVM() {
-    resetStack();
-    vm.objects = NULL;
-    vm.bytesAllocated = 0;
-    vm.nextGC = 1024 * 1024;
-
-    vm.grayCount = 0;
-    vm.grayCapacity = 0;
-    vm.grayStack = NULL;
+void defineProperty(VM* vm, const wchar_t* name, Value value, ObjInstance* instance) {
+    push(vm, OBJ_VAL(copyString(vm, name, (int)wcslen(name))));
+    push(vm, value);
+    tableSet(vm, &instance->fields, AS_STRING(vm->fiber->stackTop[-2]), vm->fiber->stackTop[-1]);
+    pop(vm);
+    pop(vm);
+}
 
-    initTable(&vm.globals);
-    initTable(&vm.strings);
+// Creates a VM with nothing in it but its root fiber.
+VM* newBareVM() {
+    VM* vm = (VM*)malloc(sizeof(VM));
+    if (vm == NULL) return NULL;
+
+    vm->fiber = NULL;
+    vm->objects = NULL;
+    vm->bytesAllocated = 0;
+    vm->nextGC = 1024 * 1024;
+
+    vm->grayCount = 0;
+    vm->grayCapacity = 0;
+    vm->grayStack = NULL;
+    vm->gcPaused = 0;
+
+    initTable(&vm->globals);
+    initTable(&vm->modules);
+    initTable(&vm->regexes);
+    initTable(&vm->strings);
+
+    vm->parser = NULL;
+    vm->eventLoop = NULL;
+    vm->worker = NULL;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    vm->startTime = now.tv_sec + now.tv_nsec / 1e9;
+    vm->initString = NULL;
+    vm->sharedStrings = NULL;
+    vm->host = NULL;
+    vm->input = NULL;
+    vm->markValue = true;
+    setBudget(vm, 0, NULL, NULL);
+    initOutput(&vm->output, STDOUT_FILENO);
+
+    // The root fiber has no closure; it runs whatever interpret() is given.
+    vm->fiber = newFiber(vm, NULL);
+    return vm;
+}
 
-    vm.initString = NULL;
-    vm.initString = copyString(L"初始化", 3);
-    vm.markValue = true;
+// Builds the core classes. Only run once, for the shared heap.
+void initCoreModules(VM* vm) {
+    vm->initString = copyString(vm, L"初始化", 3);
+    initCoreClass(vm);
+    initEventClass(vm);
+    initWorkerClass(vm);
+    initReaderClass(vm);
+    initFileClass(vm);
+    initBytesClass(vm);
+    initJsonClass(vm);
+    initCsvClass(vm);
+    initRegexClass(vm);
+}
 
-    initCoreClass();
+VM* newVM() {
+    VM* vm = newBareVM();
+    if (vm == NULL) return NULL;
+    loadSharedCore(vm);
+    return vm;
 }
 
-void freeVM() {
-    freeTable(&vm.globals);
-    freeTable(&vm.strings);
-    vm.initString = NULL;
-    freeObjects();
+void freeVM(VM* vm) {
+    flushOutput(&vm->output);
+    freeEventLoop(vm);
+    freeHost(vm);
+    freeTable(vm, &vm->globals);
+    freeTable(vm, &vm->modules);
+    freeTable(vm, &vm->regexes);
+    freeTable(vm, &vm->strings);
+    vm->initString = NULL;
+    freeObjects(vm);
+    free(vm);
 }
 
 bool isFalsey(Value value) {
     return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
 }
 
-void push(Value value) {
-    *vm.stackTop = value;
-    vm.stackTop++;
+void push(VM* vm, Value value) {
+    *vm->fiber->stackTop = value;
+    vm->fiber->stackTop++;
 }
 
-Value pop() {
-    vm.stackTop--;
-    return *vm.stackTop;
+Value pop(VM* vm) {
+    vm->fiber->stackTop--;
+    return *vm->fiber->stackTop;
 }
 
-static Value peek(int distance) {
-    return vm.stackTop[-1 - distance];
+static Value peek(VM* vm, int distance) {
+    return vm->fiber->stackTop[-1 - distance];
 }
 
 static bool containsChar(wchar_t* input, wchar_t c) {
@@ -124,119 +214,217 @@ static bool containsChar(wchar_t* input, wchar_t c) {
     return false;
 }
 
-static bool call(ObjClosure* closure, int argCount) {
+// Grows the fiber's stack so that at least [needed] more slots are free,
+// rebasing every pointer into the old block.
+static void ensureStack(VM* vm, ObjFiber* fiber, int needed) {
+    int count = (int)(fiber->stackTop - fiber->stack);
+    if (count + needed <= fiber->stackCapacity) return;
+
+    int oldCapacity = fiber->stackCapacity;
+    int capacity = oldCapacity;
+    while (capacity < count + needed) capacity = GROW_CAPACITY(capacity);
+
+    Value* oldStack = fiber->stack;
+    fiber->stack = GROW_ARRAY(vm, Value, fiber->stack, oldCapacity, capacity);
+    fiber->stackCapacity = capacity;
+    if (fiber->stack == oldStack) return;
+
+    fiber->stackTop = fiber->stack + count;
+    for (int i = 0; i < fiber->frameCount; i++) {
+        fiber->frames[i].slots = fiber->stack + (fiber->frames[i].slots - oldStack);
+    }
+    for (ObjUpvalue* upvalue = fiber->openUpvalues; upvalue != NULL; upvalue = upvalue->next) {
+        upvalue->location = fiber->stack + (upvalue->location - oldStack);
+    }
+}
+
+// Moves the callee and its arguments onto a fresh fiber with the
+// generator's frame already pushed, and leaves that fiber in the callee slot.
+static void callGenerator(VM* vm, ObjClosure* closure, int argCount) {
+    ObjFiber* fiber = newFiber(vm, closure);
+    Value* args = vm->fiber->stackTop - argCount - 1;
+    for (int i = 0; i <= argCount; i++) {
+        fiber->stack[i] = args[i];
+    }
+    fiber->stackTop = fiber->stack + argCount + 1;
+
+    CallFrame* frame = &fiber->frames[fiber->frameCount++];
+    frame->closure = closure;
+    frame->callClosure = false;
+    frame->ip = closure->function->chunk.code;
+    frame->slots = fiber->stack;
+
+    vm->fiber->stackTop -= argCount;
+    vm->fiber->stackTop[-1] = OBJ_VAL(fiber);
+}
+
+static bool call(VM* vm, ObjClosure* closure, int argCount) {
     if (argCount != closure->function->arity) {
-        runtimeError(L"需要 %d 个参数，但得到 %d。", closure->function->arity, argCount);
+        runtimeError(vm, L"需要 %d 个参数，但得到 %d。", closure->function->arity, argCount);
         return false;
     }
 
-    if (vm.frameCount == FRAMES_MAX) {
-        runtimeError(L"堆栈溢出。");
+    if (closure->function->isGenerator) {
+        callGenerator(vm, closure, argCount);
+        return true;
+    }
+
+    if (vm->fiber->frameCount == FRAMES_MAX) {
+        runtimeError(vm, L"堆栈溢出。");
         return false;
     }
 
-    CallFrame* frame = &vm.frames[vm.frameCount++];
+    CallFrame* frame = &vm->fiber->frames[vm->fiber->frameCount++];
     frame->closure = closure;
+    frame->callClosure = false;
     frame->ip = closure->function->chunk.code;
-    frame->slots = vm.stackTop - argCount - 1;
+    frame->slots = vm->fiber->stackTop - argCount - 1;
+    ensureStack(vm, vm->fiber, UINT8_COUNT);
     return true;
 }
 
-static bool callValue(Value callee, int argCount) {
+static bool callValue(VM* vm, Value callee, int argCount) {
     if (IS_OBJ(callee)) {
         switch (OBJ_TYPE(callee)) {
             case OBJ_BOUND_METHOD: {
                 ObjBoundMethod* bound = AS_BOUND_METHOD(callee);
-                vm.stackTop[-argCount - 1] = bound->receiver;
-                return call(bound->method, argCount);
+                vm->fiber->stackTop[-argCount - 1] = bound->receiver;
+                return call(vm, bound->method, argCount);
             }
             case OBJ_CLASS: {
                 ObjClass* klass = AS_CLASS(callee);
-                vm.stackTop[-argCount - 1] = OBJ_VAL(newInstance(klass, false));
+                vm->fiber->stackTop[-argCount - 1] = OBJ_VAL(newInstance(vm, klass, false));
                 Value initializer;
-                if (tableGet(&klass->methods, vm.initString, &initializer)) {
-                    return call(AS_CLOSURE(initializer), argCount);
+                if (tableGet(&klass->methods, vm->initString, &initializer)) {
+                    return call(vm, AS_CLOSURE(initializer), argCount);
                 } else if (argCount != 0) {
-                    runtimeError(L"需要 0 个参数，但得到 %d。", argCount);
+                    runtimeError(vm, L"需要 0 个参数，但得到 %d。", argCount);
                     return false;
                 }
                 return true;
             }
             case OBJ_CLOSURE:
-                return call(AS_CLOSURE(callee), argCount);
+                return call(vm, AS_CLOSURE(callee), argCount);
             default:
                 break; // Non-callable object type.
         }
     }
-    runtimeError(L"只能调用功能和类。");
+    runtimeError(vm, L"只能调用功能和类。");
     return false;
 }
 
-static bool invokeFromClass(ObjClass* klass, bool isStatic, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+// Reports why checkArguments() failed, away from the path every call takes.
+static bool argumentError(VM* vm, Signature* signature, int argCount, Value* args) {
+    if (argCount < signature->required || (argCount > signature->count && !signature->rest)) {
+        if (signature->rest) {
+            runtimeError(vm, L"需要至少 %d 个参数，但得到 %d。", signature->required, argCount);
+        } else {
+            runtimeError(vm, L"需要 %d 到 %d 个参数，但得到 %d。", signature->required, signature->count, argCount);
+        }
+        return false;
+    }
+    for (int i = 0; i < argCount; i++) {
+        int param = i < signature->count ? i : signature->count - 1;
+        if (hasParamType(args[i], signature->params[param])) continue;
+        if (signature->names[param] != NULL) {
+            runtimeError(vm, L"参数 %d（%ls）的类型必须是「%ls」，而不是「%ls」。", i + 1,
+                         signature->names[param], paramTypeName(signature->params[param]), getType(args[i]));
+        } else {
+            runtimeError(vm, L"参数 %d 的类型必须是「%ls」，而不是「%ls」。",
+                         i + 1, paramTypeName(signature->params[param]), getType(args[i]));
+        }
+        return false;
+    }
+    return true;
+}
+
+// Checks the arguments of a native with a signature, so that the native
+// itself doesn't have to. Its arity has been checked if it has a fixed one.
+static inline bool checkArguments(VM* vm, Signature* signature, int argCount, Value* args) {
+    if (argCount < signature->required || (argCount > signature->count && !signature->rest)) {
+        return argumentError(vm, signature, argCount, args);
+    }
+    if (signature->numeric) {
+        for (int i = 0; i < argCount; i++) {
+            if (!IS_NUMBER(args[i])) return argumentError(vm, signature, argCount, args);
+        }
+        return true;
+    }
+    for (int i = 0; i < argCount; i++) {
+        int param = i < signature->count ? i : signature->count - 1;
+        if (!hasParamType(args[i], signature->params[param])) return argumentError(vm, signature, argCount, args);
+    }
+    return true;
+}
+
+static bool invokeFromClass(VM* vm, ObjClass* klass, bool isStatic, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
     Value method;
     if (!tableGet(&klass->methods, name, &method)) {
         frame->ip = ip;
-        runtimeError(L"未定义的属性「%ls」。", name->chars);
+        runtimeError(vm, L"未定义的属性「%ls」。", name->chars);
         return false;
     }
-    if (!isStatic) return call(AS_CLOSURE(method), argCount);
+    if (!isStatic) return call(vm, AS_CLOSURE(method), argCount);
 
     ObjNative* native = AS_NATIVE(method);
     if (native->arity != -1 && argCount != native->arity) {
-        runtimeError(L"需要 %d 个参数，但得到 %d。", native->arity, argCount);
+        runtimeError(vm, L"需要 %d 个参数，但得到 %d。", native->arity, argCount);
         return false;
     }
-    if (native->function(argCount, vm.stackTop - argCount)) {
-        vm.stackTop -= argCount;
+    Value* args = vm->fiber->stackTop - argCount;
+    if (native->signature != NULL && !checkArguments(vm, native->signature, argCount, args)) return false;
+    if (native->extension != NULL ? callExtension(vm, native, argCount, args)
+                                  : native->function(vm, argCount, args)) {
+        vm->fiber->stackTop -= argCount;
         return true;
     } else {
-        if (vm.frameCount != 0) runtimeError(AS_STRING(vm.stackTop[-argCount - 1])->chars);
+        if (vm->fiber->frameCount != 0) runtimeError(vm, L"%ls", AS_STRING(vm->fiber->stackTop[-argCount - 1])->chars);
         return false;
     }
 }
 
-static bool invokeInstance(const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+static bool invokeInstance(VM* vm, const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
     ObjInstance* instance = AS_INSTANCE(*receiver);
 
     Value value;
     if (tableGet(&instance->fields, name, &value)) {
-        vm.stackTop[-argCount - 1] = value;
-        return callValue(value, argCount);
+        vm->fiber->stackTop[-argCount - 1] = value;
+        return callValue(vm, value, argCount);
     }
 
-    return invokeFromClass(instance->klass, instance->isStatic, name, argCount, frame, ip);
+    return invokeFromClass(vm, instance->klass, instance->isStatic, name, argCount, frame, ip);
 }
 
-static bool invokeString(const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+static bool invokeString(VM* vm, const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
     if (wcscmp(name->chars, L"长度") == 0) {
         // Returns the length of the string
         if (argCount != 0) {
             frame->ip = ip;
-            runtimeError(L"需要 0 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 0 个参数，但得到 %d。", argCount);
             return false;
         }
 
-        vm.stackTop -= argCount + 1;
-        push(NUMBER_VAL(AS_STRING(*receiver)->length));
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, NUMBER_VAL(AS_STRING(*receiver)->length));
         return true;
     } else if (wcscmp(name->chars, L"指数") == 0) {
         // Returns the index of the first char matching the input string
         ObjString* str = AS_STRING(*receiver);
         if (argCount != 1) {
             frame->ip = ip;
-            runtimeError(L"需要 1 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 1 个参数，但得到 %d。", argCount);
             return false;
-        } else if (!IS_STRING(peek(argCount - 1))) {
+        } else if (!IS_STRING(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
-        ObjString* search = AS_STRING(peek(argCount - 1));
+        ObjString* search = AS_STRING(peek(vm, argCount - 1));
         wchar_t* found = wcsstr(str->chars, search->chars);
-        vm.stackTop -= argCount + 1;
+        vm->fiber->stackTop -= argCount + 1;
 
-        push(NUMBER_VAL(found == NULL ? -1 : found - str->chars));
+        push(vm, NUMBER_VAL(found == NULL ? -1 : found - str->chars));
 
         return true;
     } else if (wcscmp(name->chars, L"计数") == 0) {
@@ -244,15 +432,15 @@ static bool invokeString(const Value* receiver, ObjString* name, int argCount, C
         ObjString* str = AS_STRING(*receiver);
         if (argCount != 1) {
             frame->ip = ip;
-            runtimeError(L"需要 1 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 1 个参数，但得到 %d。", argCount);
             return false;
-        } else if (!IS_STRING(peek(argCount - 1))) {
+        } else if (!IS_STRING(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
-        ObjString* search = AS_STRING(peek(argCount - 1));
+        ObjString* search = AS_STRING(peek(vm, argCount - 1));
         double count = 0;
         const wchar_t* tmp = wcsstr(str->chars, search->chars);
         while (tmp) {
@@ -260,9 +448,9 @@ static bool invokeString(const Value* receiver, ObjString* name, int argCount, C
             tmp++;
             tmp = wcsstr(tmp, search->chars);
         }
-        vm.stackTop -= argCount + 1;
+        vm->fiber->stackTop -= argCount + 1;
 
-        push(NUMBER_VAL(count));
+        push(vm, NUMBER_VAL(count));
 
         return true;
     } else if (wcscmp(name->chars, L"拆分") == 0) {
@@ -270,29 +458,29 @@ static bool invokeString(const Value* receiver, ObjString* name, int argCount, C
         ObjString* str = AS_STRING(*receiver);
         if (argCount != 1) {
             frame->ip = ip;
-            runtimeError(L"需要 1 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 1 个参数，但得到 %d。", argCount);
             return false;
-        } else if (!IS_STRING(peek(argCount - 1))) {
+        } else if (!IS_STRING(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
-        ObjString* search = AS_STRING(peek(argCount - 1));
-        ObjList* list = newList();
+        ObjString* search = AS_STRING(peek(vm, argCount - 1));
+        ObjList* list = newList(vm);
         wchar_t *last, *token, *tmp, *toFree;
         toFree = tmp = wcsdup(str->chars);
 
         token = wcstok(tmp, search->chars, &last);
         while (token != NULL) {
-            insertToList(list, OBJ_VAL(copyString(token, wcslen(token))), list->count);
+            insertToList(vm, list, OBJ_VAL(copyString(vm, token, wcslen(token))), list->count);
             token = wcstok(NULL, search->chars, &last);
         }
 
         free(toFree);
-        vm.stackTop -= argCount + 1;
+        vm->fiber->stackTop -= argCount + 1;
 
-        push(OBJ_VAL(list));
+        push(vm, OBJ_VAL(list));
 
         return true;
     } else if (wcscmp(name->chars, L"替换") == 0) {
@@ -300,20 +488,20 @@ static bool invokeString(const Value* receiver, ObjString* name, int argCount, C
         ObjString* str = AS_STRING(*receiver);
         if (argCount != 2) {
             frame->ip = ip;
-            runtimeError(L"需要 2 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 2 个参数，但得到 %d。", argCount);
             return false;
-        } else if (!IS_STRING(peek(argCount - 1))) {
+        } else if (!IS_STRING(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
-        } else if (!IS_STRING(peek(argCount - 2))) {
+        } else if (!IS_STRING(peek(vm, argCount - 2))) {
             frame->ip = ip;
-            runtimeError(L"参数 2（结尾）的类型必须时「字符串」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 2（结尾）的类型必须时「字符串」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
-        ObjString* old = AS_STRING(peek(argCount - 1));
-        ObjString* new = AS_STRING(peek(argCount - 2));
+        ObjString* old = AS_STRING(peek(vm, argCount - 1));
+        ObjString* new = AS_STRING(peek(vm, argCount - 2));
         wchar_t *buff, *next;
         buff = wcsdup(str->chars);
         int pos;
@@ -340,8 +528,8 @@ static bool invokeString(const Value* receiver, ObjString* name, int argCount, C
             }
         }
 
-        vm.stackTop -= argCount + 1;
-        push(OBJ_VAL(copyString(buff, wcslen(buff))));
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, OBJ_VAL(copyString(vm, buff, wcslen(buff))));
 
         return true;
     } else if (wcscmp(name->chars, L"修剪") == 0) {
@@ -349,22 +537,22 @@ static bool invokeString(const Value* receiver, ObjString* name, int argCount, C
         const wchar_t* str = AS_STRING(*receiver)->chars;
         if (argCount > 1) {
             frame->ip = ip;
-            runtimeError(L"需要 0 到 1 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 0 到 1 个参数，但得到 %d。", argCount);
             return false;
-        } else if (argCount == 1 && !IS_STRING(peek(argCount - 1))) {
+        } else if (argCount == 1 && !IS_STRING(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
-        wchar_t* remove = argCount ? AS_STRING(peek(argCount - 1))->chars : NULL;
+        wchar_t* remove = argCount ? AS_STRING(peek(vm, argCount - 1))->chars : NULL;
         const wchar_t* end;
         size_t res_size;
         while(containsChar(remove, (wchar_t)*str)) str++;
 
         if(*str == 0) {
-            vm.stackTop -= argCount + 1;
-            push(OBJ_VAL(copyString(0, 1)));
+            vm->fiber->stackTop -= argCount + 1;
+            push(vm, OBJ_VAL(copyString(vm, 0, 1)));
             return true;
         }
 
@@ -373,49 +561,49 @@ static bool invokeString(const Value* receiver, ObjString* name, int argCount, C
         end++;
 
         res_size = (end - str) < wcslen(str)-1 ? (end - str) : wcslen(str)-1;
-        vm.stackTop -= argCount + 1;
-        push(OBJ_VAL(copyString(str, res_size)));
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, OBJ_VAL(copyString(vm, str, res_size)));
         return true;
     } else if (wcscmp(name->chars, L"修剪始") == 0) {
         // Returns a string with whitespace or chars of given string removed from the start of the input string
         const wchar_t* str = AS_STRING(*receiver)->chars;
         if (argCount > 1) {
             frame->ip = ip;
-            runtimeError(L"需要 0 到 1 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 0 到 1 个参数，但得到 %d。", argCount);
             return false;
-        } else if (argCount == 1 && !IS_STRING(peek(argCount - 1))) {
+        } else if (argCount == 1 && !IS_STRING(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
-        wchar_t* remove = argCount ? AS_STRING(peek(argCount - 1))->chars : NULL;
+        wchar_t* remove = argCount ? AS_STRING(peek(vm, argCount - 1))->chars : NULL;
         size_t res_size;
         while(containsChar(remove, (wchar_t)*str)) str++;
 
         if(*str == 0) {
-            vm.stackTop -= argCount + 1;
-            push(OBJ_VAL(copyString(0, 1)));
+            vm->fiber->stackTop -= argCount + 1;
+            push(vm, OBJ_VAL(copyString(vm, 0, 1)));
             return true;
         }
 
-        vm.stackTop -= argCount + 1;
-        push(OBJ_VAL(copyString(str, wcslen(str))));
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, OBJ_VAL(copyString(vm, str, wcslen(str))));
         return true;
     } else if (wcscmp(name->chars, L"修剪端") == 0) {
         // Returns a string with whitespace or chars of given string removed from the end of the input string
         const wchar_t* str = AS_STRING(*receiver)->chars;
         if (argCount > 1) {
             frame->ip = ip;
-            runtimeError(L"需要 0 到 1 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 0 到 1 个参数，但得到 %d。", argCount);
             return false;
-        } else if (argCount == 1 && !IS_STRING(peek(argCount - 1))) {
+        } else if (argCount == 1 && !IS_STRING(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（开头）的类型必须时「字符串」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
-        wchar_t* remove = argCount ? AS_STRING(peek(argCount - 1))->chars : NULL;
+        wchar_t* remove = argCount ? AS_STRING(peek(vm, argCount - 1))->chars : NULL;
         const wchar_t* end;
         size_t res_size;
 
@@ -424,19 +612,19 @@ static bool invokeString(const Value* receiver, ObjString* name, int argCount, C
         end++;
 
         res_size = (end - str) < wcslen(str)-1 ? (end - str) : wcslen(str)-1;
-        vm.stackTop -= argCount + 1;
-        push(OBJ_VAL(copyString(str, res_size)));
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, OBJ_VAL(copyString(vm, str, res_size)));
         return true;
     } else if (wcscmp(name->chars, L"大写") == 0) {
         // Returns a string where all characters are in upper case.
         ObjString* str = AS_STRING(*receiver);
         if (argCount != 0) {
             frame->ip = ip;
-            runtimeError(L"需要 0 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 0 个参数，但得到 %d。", argCount);
             return false;
         }
 
-        wchar_t* chars = ALLOCATE(wchar_t, str->length + 1);
+        wchar_t* chars = ALLOCATE(vm, wchar_t, str->length + 1);
         wcscpy(chars, str->chars);
         chars[str->length + 1] = L'\0';
         wchar_t* c = chars;
@@ -444,21 +632,21 @@ static bool invokeString(const Value* receiver, ObjString* name, int argCount, C
             *c = towupper(*c);
             c++;
         }
-        ObjString* result = takeString(chars, str->length + 1);
+        ObjString* result = takeString(vm, chars, str->length + 1);
 
-        vm.stackTop -= argCount + 1;
-        push(OBJ_VAL(result));
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, OBJ_VAL(result));
         return true;
     } else if (wcscmp(name->chars, L"小写") == 0) {
         // Returns a string where all characters are in lower case.
         ObjString* str = AS_STRING(*receiver);
         if (argCount != 0) {
             frame->ip = ip;
-            runtimeError(L"需要 0 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 0 个参数，但得到 %d。", argCount);
             return false;
         }
 
-        wchar_t* chars = ALLOCATE(wchar_t, str->length + 1);
+        wchar_t* chars = ALLOCATE(vm, wchar_t, str->length + 1);
         wcscpy(chars, str->chars);
         chars[str->length + 1] = L'\0';
         wchar_t* c = chars;
@@ -466,80 +654,80 @@ static bool invokeString(const Value* receiver, ObjString* name, int argCount, C
             *c = towlower(*c);
             c++;
         }
-        ObjString* result = takeString(chars, str->length + 1);
+        ObjString* result = takeString(vm, chars, str->length + 1);
 
-        vm.stackTop -= argCount + 1;
-        push(OBJ_VAL(result));
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, OBJ_VAL(result));
         return true;
     } else if (wcscmp(name->chars, L"子串") == 0) {
         // Returns a part of a string between given indexes
         if (argCount != 2) {
             frame->ip = ip;
-            runtimeError(L"需要 2 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 2 个参数，但得到 %d。", argCount);
             return false;
-        } else if (!IS_NUMBER(peek(argCount - 1))) {
+        } else if (!IS_NUMBER(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（开头）的类型必须时「数字」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（开头）的类型必须时「数字」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
-        } else if (!IS_NUMBER(peek(argCount - 2))) {
+        } else if (!IS_NUMBER(peek(vm, argCount - 2))) {
             frame->ip = ip;
-            runtimeError(L"参数 2（结尾）的类型必须时「数字」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 2（结尾）的类型必须时「数字」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
         ObjString* str = AS_STRING(*receiver);
-        int begin = AS_NUMBER(peek(argCount - 1));
-        int end = AS_NUMBER(peek(argCount - 2));
+        int begin = AS_NUMBER(peek(vm, argCount - 1));
+        int end = AS_NUMBER(peek(vm, argCount - 2));
         if (begin < 0) begin = str->length + begin;
         if (end < 0) end = str->length + end;
 
         if (!isValidStringIndex(str, begin)) {
             frame->ip = ip;
-            runtimeError(L"参数 1 不是有效索引。");
+            runtimeError(vm, L"参数 1 不是有效索引。");
             return false;
         } else if (!isValidStringIndex(str, end - 1)) { // Ending index is exclusive
             frame->ip = ip;
-            runtimeError(L"参数 2 不是有效索引。");
+            runtimeError(vm, L"参数 2 不是有效索引。");
             return false;
         } else if (end < begin) {
             frame->ip = ip;
-            runtimeError(L"结束索引不能在开始索引之前。");
+            runtimeError(vm, L"结束索引不能在开始索引之前。");
             return false;
         }
 
-        wchar_t* chars = ALLOCATE(wchar_t, end - begin + 1);
+        wchar_t* chars = ALLOCATE(vm, wchar_t, end - begin + 1);
         memcpy( chars, &str->chars[begin], (end - begin) * sizeof(wchar_t) );
         chars[end - begin] = L'\0';
-        ObjString* result = takeString(chars, end - begin + 1);
+        ObjString* result = takeString(vm, chars, end - begin + 1);
 
-        vm.stackTop -= argCount + 1;
-        push(OBJ_VAL(result));
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, OBJ_VAL(result));
         return true;
     }
     frame->ip = ip;
-    runtimeError(L"未定义的属性「%ls」。", name->chars);
+    runtimeError(vm, L"未定义的属性「%ls」。", name->chars);
     return false;
 }
 
-static bool invokeList(const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+static bool invokeList(VM* vm, const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
     if (wcscmp(name->chars, L"推") == 0) {
         // Push a value to the end of a list increasing the list's length by 1
         if (argCount != 1) {
             frame->ip = ip;
-            runtimeError(L"需要 1 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 1 个参数，但得到 %d。", argCount);
             return false;
         }
         ObjList *list = AS_LIST(*receiver);
-        Value item = peek(argCount - 1);
-        insertToList(list, item, list->count);
-        vm.stackTop -= argCount + 1;
-        push(NIL_VAL);
+        Value item = peek(vm, argCount - 1);
+        insertToList(vm, list, item, list->count);
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, NIL_VAL);
         return true;
     } else if (wcscmp(name->chars, L"弹") == 0) {
         // Pop a value from the end of a list decreasing the list's length by 1
         if (argCount != 0) {
             frame->ip = ip;
-            runtimeError(L"需要 0 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 0 个参数，但得到 %d。", argCount);
             return false;
         }
 
@@ -547,181 +735,460 @@ static bool invokeList(const Value* receiver, ObjString* name, int argCount, Cal
 
         if (!isValidListIndex(list, list->count - 1)) {
             frame->ip = ip;
-            runtimeError(L"无法从空列表中弹出。");
+            runtimeError(vm, L"无法从空列表中弹出。");
             return false;
         }
 
         deleteFromList(list, list->count - 1);
-        vm.stackTop -= argCount + 1;
-        push(NIL_VAL);
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, NIL_VAL);
         return true;
     } else if (wcscmp(name->chars, L"插") == 0) {
         // Insert a value to the specified index of a list increasing the list's length by 1
         if (argCount != 2) {
             frame->ip = ip;
-            runtimeError(L"需要 2 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 2 个参数，但得到 %d。", argCount);
             return false;
-        } else if (!IS_NUMBER(peek(argCount - 1))) {
+        } else if (!IS_NUMBER(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（索引）的类型必须时「数字」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（索引）的类型必须时「数字」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
         ObjList *list = AS_LIST(*receiver);
-        int index = AS_NUMBER(peek(argCount - 1));
+        int index = AS_NUMBER(peek(vm, argCount - 1));
         if (index < 0) index = list->count + index;
-        Value item = peek(argCount - 2);
+        Value item = peek(vm, argCount - 2);
 
         if (!isValidListIndex(list, index)) {
             frame->ip = ip;
-            runtimeError(L"参数 1 不是有效索引");
+            runtimeError(vm, L"参数 1 不是有效索引");
             return false;
         }
 
-        insertToList(list, item, index);
-        vm.stackTop -= argCount + 1;
-        push(NIL_VAL);
+        insertToList(vm, list, item, index);
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, NIL_VAL);
         return true;
     } else if (wcscmp(name->chars, L"删") == 0) {
         // Delete an item from a list at the given index.
         if (argCount != 1) {
             frame->ip = ip;
-            runtimeError(L"需要 1 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 1 个参数，但得到 %d。", argCount);
             return false;
-        } else if (!IS_NUMBER(peek(argCount - 1))) {
+        } else if (!IS_NUMBER(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（索引）的类型必须时「数字」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（索引）的类型必须时「数字」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
         ObjList* list = AS_LIST(*receiver);
-        int index = AS_NUMBER(peek(argCount - 1));
+        int index = AS_NUMBER(peek(vm, argCount - 1));
         if (index < 0) index = list->count + index;
 
         if (!isValidListIndex(list, index)) {
             frame->ip = ip;
-            runtimeError(L"参数 1 不是有效索引。");
+            runtimeError(vm, L"参数 1 不是有效索引。");
             return false;
         }
 
         deleteFromList(list, index);
-        vm.stackTop -= argCount + 1;
-        push(NIL_VAL);
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, NIL_VAL);
         return true;
     } else if (wcscmp(name->chars, L"长度") == 0) {
         // Returns the length of the list
         if (argCount != 0) {
             frame->ip = ip;
-            runtimeError(L"需要 0 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 0 个参数，但得到 %d。", argCount);
             return false;
         }
-        vm.stackTop -= argCount + 1;
-        push(NUMBER_VAL(AS_LIST(*receiver)->count));
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, NUMBER_VAL(AS_LIST(*receiver)->count));
         return true;
     } else if (wcscmp(name->chars, L"过滤") == 0) {
         // Filters the list based on the given function
         if (argCount != 1) {
             frame->ip = ip;
-            runtimeError(L"需要 1 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 1 个参数，但得到 %d。", argCount);
             return false;
-        } else if (!IS_CLOSURE(peek(argCount - 1))) {
+        } else if (!IS_CLOSURE(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（测试）的类型必须时「关闭」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（测试）的类型必须时「关闭」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
 
         ObjList* list = AS_LIST(*receiver);
-        ObjList* filtered = newList();
-        ObjClosure* closure = AS_CLOSURE(peek(argCount - 1));
+        ObjList* filtered = newList(vm);
+        ObjClosure* closure = AS_CLOSURE(peek(vm, argCount - 1));
 
         if (closure->function->arity != 1) {
             frame->ip = ip;
-            runtimeError(L"输入功能需要 1 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"输入功能需要 1 个参数，但得到 %d。", argCount);
             return false;
         }
         for (int i = 0; i < list->count; i++) {
             Value ret;
             Value argArr[1] = {indexFromList(list, i)};
-            if (runClosure(closure, &ret, argArr, 1) != INTERPRET_OK) {
+            if (runClosure(vm, closure, &ret, argArr, 1) != INTERPRET_OK) {
                 return false;
             }
-            if (!isFalsey(ret)) insertToList(filtered, indexFromList(list, i), filtered->count);
+            if (!isFalsey(ret)) insertToList(vm, filtered, indexFromList(list, i), filtered->count);
         }
 
-        vm.stackTop -= argCount + 1;
-        push(OBJ_VAL(filtered));
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, OBJ_VAL(filtered));
+        return true;
+    } else if (wcscmp(name->chars, L"并行映射") == 0) {
+        // Maps the list with the given function on several threads
+        if (argCount != 2) {
+            frame->ip = ip;
+            runtimeError(vm, L"需要 2 个参数，但得到 %d。", argCount);
+            return false;
+        }
+        if (!listParallelMapNative(vm, argCount, vm->fiber->stackTop - argCount)) {
+            frame->ip = ip;
+            runtimeError(vm, L"%ls", AS_STRING(vm->fiber->stackTop[-argCount - 1])->chars);
+            return false;
+        }
+        vm->fiber->stackTop -= argCount;
         return true;
     } else if (wcscmp(name->chars, L"排序") == 0) {
         // Sorts the list based on the given function or in ascending order
         if (argCount > 1) {
             frame->ip = ip;
-            runtimeError(L"需要 0 或 1 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"需要 0 或 1 个参数，但得到 %d。", argCount);
             return false;
-        } else if (argCount == 1 && !IS_CLOSURE(peek(argCount - 1))) {
+        } else if (argCount == 1 && !IS_CLOSURE(peek(vm, argCount - 1))) {
             frame->ip = ip;
-            runtimeError(L"参数 1（测试）的类型必须时「关闭」，而不是「%ls」。", getType(vm.stackTop[-argCount]));
+            runtimeError(vm, L"参数 1（测试）的类型必须时「关闭」，而不是「%ls」。", getType(vm->fiber->stackTop[-argCount]));
             return false;
         }
 
         ObjList* list = AS_LIST(*receiver);
-        ObjClosure* closure = argCount == 1 ? AS_CLOSURE(peek(argCount - 1)) : NULL;
+        ObjClosure* closure = argCount == 1 ? AS_CLOSURE(peek(vm, argCount - 1)) : NULL;
 
         if (closure && closure->function->arity != 2) {
             frame->ip = ip;
-            runtimeError(L"输入功能需要 2 个参数，但得到 %d。", argCount);
+            runtimeError(vm, L"输入功能需要 2 个参数，但得到 %d。", argCount);
             return false;
         }
 
-        if (!sortList(list, 0, list->count - 1, closure))
+        if (!sortList(vm, list, 0, list->count - 1, closure))
             return false;
 
-        vm.stackTop -= argCount + 1;
-        push(OBJ_VAL(list));
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, OBJ_VAL(list));
         return true;
     }
 
     frame->ip = ip;
-    runtimeError(L"未定义的属性「%ls」。", name->chars);
+    runtimeError(vm, L"未定义的属性「%ls」。", name->chars);
     return false;
 }
 
-static bool invoke(ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
-    Value receiver = peek(argCount);
+static InterpretResult run(VM* vm);
+
+// Switches to [fiber] and runs it until it yields or returns. The value it
+// hands back is left in fiber->transfer.
+InterpretResult resumeFiber(VM* vm, ObjFiber* fiber, Value value) {
+    fiber->caller = vm->fiber;
+    vm->fiber = fiber;
+
+    if (fiber->state == FIBER_NEW && fiber->frameCount == 0) {
+        int arity = fiber->closure->function->arity;
+        push(vm, OBJ_VAL(fiber->closure));
+        if (arity == 1) push(vm, value);
+        if (!call(vm, fiber->closure, arity)) return INTERPRET_RUNTIME_ERROR;
+    } else if (fiber->state == FIBER_SUSPENDED) {
+        // Replace the pending result of 纤程。让出 or 产出 with the resume value.
+        // A preempted fiber has no pending result and just carries on.
+        fiber->stackTop[-1] = value;
+    }
+    fiber->state = FIBER_RUNNING;
+
+    InterpretResult result = run(vm);
+    if (result != INTERPRET_OK) return result;
+
+    if (fiber->state == FIBER_RUNNING) fiber->state = FIBER_DONE;
+    vm->fiber = fiber->caller;
+    fiber->caller = NULL;
+    return INTERPRET_OK;
+}
+
+static bool invokeFiber(VM* vm, const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+    ObjFiber* fiber = AS_FIBER(*receiver);
+    if (wcscmp(name->chars, L"恢复") == 0) {
+        // Runs the fiber until its next 让出 and returns the yielded value
+        if (argCount > 1) {
+            frame->ip = ip;
+            runtimeError(vm, L"需要 0 或 1 个参数，但得到 %d。", argCount);
+            return false;
+        } else if (fiber->state == FIBER_DONE) {
+            frame->ip = ip;
+            runtimeError(vm, L"无法恢复已完成的纤程。");
+            return false;
+        } else if (fiber->state == FIBER_RUNNING) {
+            frame->ip = ip;
+            runtimeError(vm, L"纤程已在运行。");
+            return false;
+        }
+
+        Value value = argCount == 1 ? peek(vm, 0) : NIL_VAL;
+        if (resumeFiber(vm, fiber, value) != INTERPRET_OK) return false;
+
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, fiber->transfer);
+        fiber->transfer = NIL_VAL;
+        return true;
+    } else if (wcscmp(name->chars, L"下一个") == 0) {
+        // Returns the generator's next value, or 空 once it has finished
+        if (argCount != 0) {
+            frame->ip = ip;
+            runtimeError(vm, L"需要 0 个参数，但得到 %d。", argCount);
+            return false;
+        } else if (fiber->state == FIBER_RUNNING) {
+            frame->ip = ip;
+            runtimeError(vm, L"纤程已在运行。");
+            return false;
+        }
+
+        Value result = NIL_VAL;
+        if (fiber->state != FIBER_DONE) {
+            if (resumeFiber(vm, fiber, NIL_VAL) != INTERPRET_OK) return false;
+            result = fiber->transfer;
+            fiber->transfer = NIL_VAL;
+        }
+
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, result);
+        return true;
+    } else if (wcscmp(name->chars, L"完成") == 0) {
+        // Returns whether the fiber has run to completion
+        if (argCount != 0) {
+            frame->ip = ip;
+            runtimeError(vm, L"需要 0 个参数，但得到 %d。", argCount);
+            return false;
+        }
+
+        vm->fiber->stackTop -= argCount + 1;
+        push(vm, BOOL_VAL(fiber->state == FIBER_DONE));
+        return true;
+    }
+
+    frame->ip = ip;
+    runtimeError(vm, L"未定义的属性「%ls」。", name->chars);
+    return false;
+}
+
+// Calls a native method on the receiver below its [argCount] arguments,
+// leaving the result in the receiver's place. An [arity] of -1 lets the
+// method check its own arguments.
+static bool callNativeMethod(VM* vm, NativeFn method, int arity, int argCount, CallFrame* frame, uint8_t* ip) {
+    if (arity != -1 && argCount != arity) {
+        frame->ip = ip;
+        runtimeError(vm, L"需要 %d 个参数，但得到 %d。", arity, argCount);
+        return false;
+    }
+    if (!method(vm, argCount, vm->fiber->stackTop - argCount)) {
+        frame->ip = ip;
+        runtimeError(vm, L"%ls", AS_STRING(vm->fiber->stackTop[-argCount - 1])->chars);
+        return false;
+    }
+    vm->fiber->stackTop -= argCount;
+    return true;
+}
+
+static bool invokeWorker(VM* vm, const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+    NativeFn method;
+    int arity;
+    if (wcscmp(name->chars, L"发送") == 0) {
+        // Sends a copy of the value to the worker
+        method = workerSendNative;
+        arity = 1;
+    } else if (wcscmp(name->chars, L"接收") == 0) {
+        // Waits for the next value the worker sends back
+        method = workerReceiveNative;
+        arity = 0;
+    } else if (wcscmp(name->chars, L"加入") == 0) {
+        // Waits for the worker to finish and returns its result
+        method = workerJoinNative;
+        arity = 0;
+    } else {
+        frame->ip = ip;
+        runtimeError(vm, L"未定义的属性「%ls」。", name->chars);
+        return false;
+    }
+
+    return callNativeMethod(vm, method, arity, argCount, frame, ip);
+}
+
+static bool invokeReader(VM* vm, const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+    NativeFn method;
+    int arity = 0;
+    if (wcscmp(name->chars, L"读行") == 0 || wcscmp(name->chars, L"下一个") == 0) {
+        // Returns the next line, or 空 at the end, like a generator
+        method = readerReadLineNative;
+    } else if (wcscmp(name->chars, L"读") == 0) {
+        // Returns up to the given number of bytes
+        method = readerReadNative;
+        arity = 1;
+    } else if (wcscmp(name->chars, L"读入") == 0) {
+        // Reads into a 字节 and returns how many bytes were read
+        method = readerReadIntoNative;
+        arity = -1;
+    } else if (wcscmp(name->chars, L"读全部") == 0) {
+        // Returns everything not yet read
+        method = readerReadAllNative;
+    } else if (wcscmp(name->chars, L"完成") == 0) {
+        // Returns whether every line has been read
+        method = readerDoneNative;
+    } else if (wcscmp(name->chars, L"关闭") == 0) {
+        method = readerCloseNative;
+    } else {
+        frame->ip = ip;
+        runtimeError(vm, L"未定义的属性「%ls」。", name->chars);
+        return false;
+    }
+
+    return callNativeMethod(vm, method, arity, argCount, frame, ip);
+}
+
+static bool invokeFile(VM* vm, const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+    NativeFn method;
+    int arity;
+    if (!findFileMethod(name, &method, &arity)) {
+        frame->ip = ip;
+        runtimeError(vm, L"未定义的属性「%ls」。", name->chars);
+        return false;
+    }
+    return callNativeMethod(vm, method, arity, argCount, frame, ip);
+}
+
+static bool invokeBytes(VM* vm, const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+    NativeFn method;
+    int arity;
+    if (!findBytesMethod(name, &method, &arity)) {
+        frame->ip = ip;
+        runtimeError(vm, L"未定义的属性「%ls」。", name->chars);
+        return false;
+    }
+    return callNativeMethod(vm, method, arity, argCount, frame, ip);
+}
+
+static bool invokeCsv(VM* vm, const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+    NativeFn method;
+    int arity;
+    if (!findCsvMethod(name, &method, &arity)) {
+        frame->ip = ip;
+        runtimeError(vm, L"未定义的属性「%ls」。", name->chars);
+        return false;
+    }
+    return callNativeMethod(vm, method, arity, argCount, frame, ip);
+}
+
+static bool invokeRegex(VM* vm, const Value* receiver, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+    NativeFn method;
+    int arity;
+    if (!findRegexMethod(name, &method, &arity)) {
+        frame->ip = ip;
+        runtimeError(vm, L"未定义的属性「%ls」。", name->chars);
+        return false;
+    }
+    return callNativeMethod(vm, method, arity, argCount, frame, ip);
+}
+
+static bool getModuleMember(VM* vm, ObjModule* module, ObjString* name, Value* value) {
+    Value slot;
+    if (!tableGet(&module->slots, name, &slot)) {
+        runtimeError(vm, L"模块没有成员「%ls」。", name->chars);
+        return false;
+    }
+    *value = module->values.values[(int)AS_NUMBER(slot)];
+    return true;
+}
+
+static bool invoke(VM* vm, ObjString* name, int argCount, CallFrame* frame, uint8_t* ip) {
+    Value receiver = peek(vm, argCount);
 
     if (IS_INSTANCE(receiver)) {
-        return invokeInstance(&receiver, name, argCount, frame, ip);
+        return invokeInstance(vm, &receiver, name, argCount, frame, ip);
     } else if (IS_STRING(receiver)) {
-        return invokeString(&receiver, name, argCount, frame, ip);
+        return invokeString(vm, &receiver, name, argCount, frame, ip);
     } else if (IS_LIST(receiver)) {
-        return invokeList(&receiver, name, argCount, frame, ip);
+        return invokeList(vm, &receiver, name, argCount, frame, ip);
+    } else if (IS_FIBER(receiver)) {
+        return invokeFiber(vm, &receiver, name, argCount, frame, ip);
+    } else if (IS_WORKER(receiver)) {
+        return invokeWorker(vm, &receiver, name, argCount, frame, ip);
+    } else if (IS_READER(receiver)) {
+        return invokeReader(vm, &receiver, name, argCount, frame, ip);
+    } else if (IS_FILE(receiver)) {
+        return invokeFile(vm, &receiver, name, argCount, frame, ip);
+    } else if (IS_BYTES(receiver)) {
+        return invokeBytes(vm, &receiver, name, argCount, frame, ip);
+    } else if (IS_CSV(receiver)) {
+        return invokeCsv(vm, &receiver, name, argCount, frame, ip);
+    } else if (IS_REGEX(receiver)) {
+        return invokeRegex(vm, &receiver, name, argCount, frame, ip);
+    } else if (IS_FOREIGN(receiver)) {
+        return invokeFromClass(vm, AS_FOREIGN(receiver)->klass, true, name, argCount, frame, ip);
+    } else if (IS_MODULE(receiver)) {
+        Value member;
+        frame->ip = ip;
+        if (!getModuleMember(vm, AS_MODULE(receiver), name, &member)) return false;
+        vm->fiber->stackTop[-argCount - 1] = member;
+        return callValue(vm, member, argCount);
     }
 
     frame->ip = ip;
-    runtimeError(L"只有实例、字符串和列表有方法。");
+    runtimeError(vm, L"只有实例、字符串、列表、纤程、工作者、读取器、文件、字节、CSV 读取器、正则表达式和外部对象有方法。");
     return false;
 }
 
-static bool bindMethod(ObjClass* klass, ObjString* name, CallFrame* frame, uint8_t* ip) {
+static bool bindMethod(VM* vm, ObjClass* klass, ObjString* name, CallFrame* frame, uint8_t* ip) {
     Value method;
     if (!tableGet(&klass->methods, name, &method)) {
         frame->ip = ip;
-        runtimeError(L"未定义的属性「%ls」。", name->chars);
+        runtimeError(vm, L"未定义的属性「%ls」。", name->chars);
         return false;
     }
     ObjBoundMethod* bound;
     if (IS_NATIVE(method))
-        bound = newBoundNative(peek(0), AS_NATIVE(method));
+        bound = newBoundNative(vm, peek(vm, 0), AS_NATIVE(method));
     else
-        bound = newBoundMethod(peek(0), AS_CLOSURE(method));
-    pop();
-    push(OBJ_VAL(bound));
+        bound = newBoundMethod(vm, peek(vm, 0), AS_CLOSURE(method));
+    pop(vm);
+    push(vm, OBJ_VAL(bound));
     return true;
 }
 
-static ObjUpvalue* captureUpvalue(Value* local) {
+// Replaces the receiver on top of the stack with its property [name].
+static bool getProperty(VM* vm, ObjString* name, CallFrame* frame, uint8_t* ip) {
+    Value receiver = peek(vm, 0);
+    if (IS_MODULE(receiver)) {
+        frame->ip = ip;
+        return getModuleMember(vm, AS_MODULE(receiver), name, &vm->fiber->stackTop[-1]);
+    }
+    if (!IS_INSTANCE(receiver)) {
+        frame->ip = ip;
+        runtimeError(vm, L"只有实例有属性。");
+        return false;
+    }
+
+    ObjInstance* instance = AS_INSTANCE(receiver);
+    Value value;
+    if (tableGet(&instance->fields, name, &value)) {
+        vm->fiber->stackTop[-1] = value;
+        return true;
+    }
+    return bindMethod(vm, instance->klass, name, frame, ip);
+}
+
+static ObjUpvalue* captureUpvalue(VM* vm, Value* local) {
     ObjUpvalue* prevUpvalue = NULL;
-    ObjUpvalue* upvalue = vm.openUpvalues;
+    ObjUpvalue* upvalue = vm->fiber->openUpvalues;
     while (upvalue != NULL && upvalue->location > local) {
         prevUpvalue = upvalue;
         upvalue = upvalue->next;
@@ -731,46 +1198,85 @@ static ObjUpvalue* captureUpvalue(Value* local) {
         return upvalue;
     }
 
-    ObjUpvalue* createdUpvalue = newUpvalue(local);
+    ObjUpvalue* createdUpvalue = newUpvalue(vm, local);
     createdUpvalue->next = upvalue;
 
     if (prevUpvalue == NULL) {
-        vm.openUpvalues = createdUpvalue;
+        vm->fiber->openUpvalues = createdUpvalue;
     } else {
         prevUpvalue->next = createdUpvalue;
     }
     return createdUpvalue;
 }
 
-static void closeUpvalues(const Value* last) {
-    while (vm.openUpvalues != NULL && vm.openUpvalues->location >= last) {
-        ObjUpvalue* upvalue = vm.openUpvalues;
+static void closeUpvalues(VM* vm, const Value* last) {
+    while (vm->fiber->openUpvalues != NULL && vm->fiber->openUpvalues->location >= last) {
+        ObjUpvalue* upvalue = vm->fiber->openUpvalues;
         upvalue->closed = *upvalue->location;
         upvalue->location = &upvalue->closed;
-        vm.openUpvalues = upvalue->next;
+        vm->fiber->openUpvalues = upvalue->next;
     }
 }
 
-static void defineMethod(ObjString* name) {
-    Value method = peek(0);
-    ObjClass* klass = AS_CLASS(peek(1));
-    tableSet(&klass->methods, name, method);
-    pop();
+static void defineMethod(VM* vm, ObjString* name) {
+    Value method = peek(vm, 0);
+    ObjClass* klass = AS_CLASS(peek(vm, 1));
+    tableSet(vm, &klass->methods, name, method);
+    pop(vm);
 }
 
-static ObjString* concatenate(ObjString* a, ObjString* b) {
+static ObjString* concatenate(VM* vm, ObjString* a, ObjString* b) {
     int length = a->length + b->length;
-    wchar_t* chars = ALLOCATE(wchar_t, length + 1);
+    wchar_t* chars = ALLOCATE(vm, wchar_t, length + 1);
     memcpy(chars, a->chars, a->length * sizeof(wchar_t));
     memcpy(chars + a->length, b->chars, b->length * sizeof(wchar_t));
     chars[length] = L'\0';
 
-    ObjString* result = takeString(chars, length);
+    ObjString* result = takeString(vm, chars, length);
     return result;
 }
 
-static InterpretResult run() {
-    CallFrame* frame = &vm.frames[vm.frameCount - 1];
+// Gives the running code [budget] more loop edges and calls before
+// [callback] decides whether it may go on. A budget of 0 means no limit.
+void setBudget(VM* vm, int64_t budget, BudgetFn callback, void* data) {
+    vm->budget = budget;
+    vm->fuel = budget > 0 ? budget : INT64_MAX;
+    vm->onBudget = callback;
+    vm->budgetData = data;
+}
+
+// Called when the fuel runs out with the frame's ip just past the current
+// instruction. Returns true with [result] set if run() has to stop. A pause
+// or yield backs up to the instruction so resuming executes it again.
+static bool budgetExpired(VM* vm, InterpretResult* result) {
+    vm->fuel = vm->budget > 0 ? vm->budget : INT64_MAX;
+    BudgetAction action = vm->onBudget == NULL ? BUDGET_ABORT : vm->onBudget(vm, vm->budgetData);
+
+    // Only the outermost run() can hand control back to the embedder.
+    ObjFiber* fiber = vm->fiber;
+    if (action == BUDGET_PAUSE && (fiber->closure != NULL || fiber->nativeCalls > 0)) return false;
+    if (action == BUDGET_YIELD && !preemptTask(vm)) return false;
+
+    switch (action) {
+        case BUDGET_CONTINUE:
+            return false;
+        case BUDGET_ABORT:
+            runtimeError(vm, L"超出指令预算。");
+            *result = INTERPRET_RUNTIME_ERROR;
+            return true;
+        case BUDGET_PAUSE:
+            *result = INTERPRET_PAUSED;
+            break;
+        case BUDGET_YIELD:
+            *result = INTERPRET_OK;
+            break;
+    }
+    fiber->frames[fiber->frameCount - 1].ip--;
+    return true;
+}
+
+static InterpretResult run(VM* vm) {
+    CallFrame* frame = &vm->fiber->frames[vm->fiber->frameCount - 1];
     register uint8_t* ip = frame->ip;
 
 #define READ_BYTE() (*ip++)
@@ -784,42 +1290,53 @@ static InterpretResult run() {
 #define READ_STRING() AS_STRING(READ_CONSTANT())
 #define BINARY_OP(valueType, op) \
     do { \
-      if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
+      if (!IS_NUMBER(peek(vm, 0)) || !IS_NUMBER(peek(vm, 1))) { \
         frame->ip = ip; \
-        runtimeError(L"操作数必须是数字。"); \
+        runtimeError(vm, L"操作数必须是数字。"); \
         return INTERPRET_RUNTIME_ERROR; \
       } \
-      double b = AS_NUMBER(pop()); \
-      double a = AS_NUMBER(pop()); \
-      push(valueType(a op b)); \
+      double b = AS_NUMBER(pop(vm)); \
+      double a = AS_NUMBER(pop(vm)); \
+      push(vm, valueType(a op b)); \
     } while (false)
 #define BINARY_BITWISE_OP(valueType, op) \
     do { \
-      if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
+      if (!IS_NUMBER(peek(vm, 0)) || !IS_NUMBER(peek(vm, 1))) { \
         frame->ip = ip; \
-        runtimeError(L"操作数必须是数字。"); \
+        runtimeError(vm, L"操作数必须是数字。"); \
         return INTERPRET_RUNTIME_ERROR; \
       } \
-      int32_t b = (int32_t)AS_NUMBER(pop()); \
-      int32_t a = (int32_t)AS_NUMBER(pop()); \
-      push(valueType(a op b)); \
+      int32_t b = (int32_t)AS_NUMBER(pop(vm)); \
+      int32_t a = (int32_t)AS_NUMBER(pop(vm)); \
+      push(vm, valueType(a op b)); \
     } while (false)
 #define BINARY_FUNC_OP(valueType, op) \
     do { \
-      if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
+      if (!IS_NUMBER(peek(vm, 0)) || !IS_NUMBER(peek(vm, 1))) { \
         frame->ip = ip; \
-        runtimeError(L"操作数必须是数字。"); \
+        runtimeError(vm, L"操作数必须是数字。"); \
         return INTERPRET_RUNTIME_ERROR; \
       } \
-      double b = AS_NUMBER(pop()); \
-      double a = AS_NUMBER(pop());    \
-      push(valueType(op(a, b))); \
+      double b = AS_NUMBER(pop(vm)); \
+      double a = AS_NUMBER(pop(vm));    \
+      push(vm, valueType(op(a, b))); \
+    } while (false)
+
+// Spends one unit of fuel. Only loop edges and calls do, which is enough to
+// stop any runaway script and keeps straight-line code free of the check.
+#define CHECK_BUDGET() \
+    do { \
+      if (--vm->fuel <= 0) { \
+        InterpretResult stop; \
+        frame->ip = ip; \
+        if (budgetExpired(vm, &stop)) return stop; \
+      } \
     } while (false)
 
     for(;;) {
 #ifdef DEBUG_TRACE_EXECUTION
         wprintf(L"          ");
-        for (Value *slot = vm.stack; slot < vm.stackTop; slot++) {
+        for (Value *slot = vm->fiber->stack; slot < vm->fiber->stackTop; slot++) {
             wprintf(L"[ ");
             printValue(*slot);
             wprintf(L" ]");
@@ -831,123 +1348,175 @@ static InterpretResult run() {
         switch (READ_BYTE()) {
             case OP_CONSTANT: {
                 Value constant = READ_CONSTANT();
-                push(constant);
+                push(vm, constant);
                 break;
             }
             case OP_NIL:
-                push(NIL_VAL);
+                push(vm, NIL_VAL);
                 break;
             case OP_TRUE:
-                push(BOOL_VAL(true));
+                push(vm, BOOL_VAL(true));
                 break;
             case OP_FALSE:
-                push(BOOL_VAL(false));
+                push(vm, BOOL_VAL(false));
                 break;
             case OP_POP:
-                pop();
+                pop(vm);
                 break;
             case OP_SET_LOCAL: {
                 uint8_t slot = READ_BYTE();
-                frame->slots[slot] = peek(0);
+                frame->slots[slot] = peek(vm, 0);
                 break;
             }
             case OP_GET_LOCAL: {
                 uint8_t slot = READ_BYTE();
-                push(frame->slots[slot]);
+                push(vm, frame->slots[slot]);
                 break;
             }
             case OP_GET_GLOBAL: {
                 ObjString *name = READ_STRING();
                 Value value;
-                if (!tableGet(&vm.globals, name, &value)) {
+                if (!tableGet(&vm->globals, name, &value)) {
                     frame->ip = ip;
-                    runtimeError(L"未定义的变量「%ls」。", name->chars);
+                    runtimeError(vm, L"未定义的变量「%ls」。", name->chars);
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(value);
+                push(vm, value);
                 break;
             }
             case OP_DEFINE_GLOBAL: {
                 ObjString *name = READ_STRING();
-                tableSet(&vm.globals, name, peek(0));
-                pop();
+                tableSet(vm, &vm->globals, name, peek(vm, 0));
+                pop(vm);
                 break;
             }
             case OP_SET_GLOBAL: {
                 ObjString *name = READ_STRING();
 
-                if (tableSet(&vm.globals, name, peek(0))) {
-                    tableDelete(&vm.globals, name);
+                if (tableSet(vm, &vm->globals, name, peek(vm, 0))) {
+                    tableDelete(&vm->globals, name);
                     frame->ip = ip;
-                    runtimeError(L"未定义的变量「%ls」。", name->chars);
+                    runtimeError(vm, L"未定义的变量「%ls」。", name->chars);
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                break;
+            }
+            case OP_GET_MODULE:
+                push(vm, frame->closure->function->module->values.values[READ_BYTE()]);
+                break;
+            case OP_DEFINE_MODULE:
+                frame->closure->function->module->values.values[READ_BYTE()] = pop(vm);
+                break;
+            case OP_SET_MODULE:
+                frame->closure->function->module->values.values[READ_BYTE()] = peek(vm, 0);
+                break;
+            case OP_GET_MODULE_MEMBER: {
+                ObjString* name = READ_STRING();
+                uint8_t slot = READ_BYTE();
+                // The slot was looked up when the importer was compiled. The
+                // name check catches the variable having been rebound, or
+                // the module having changed, since then.
+                Value receiver = peek(vm, 0);
+                if (IS_MODULE(receiver) && slot < AS_MODULE(receiver)->names.count &&
+                    AS_STRING(AS_MODULE(receiver)->names.values[slot]) == name) {
+                    vm->fiber->stackTop[-1] = AS_MODULE(receiver)->values.values[slot];
+                    break;
+                }
+                if (!getProperty(vm, name, frame, ip)) return INTERPRET_RUNTIME_ERROR;
+                break;
+            }
+            case OP_IMPORT: {
+                ObjString* path = READ_STRING();
+                frame->ip = ip;
+                ObjModule* module = loadModule(vm, path);
+                if (module == NULL) {
+                    runtimeError(vm, L"无法导入模块「%ls」。", path->chars);
                     return INTERPRET_RUNTIME_ERROR;
                 }
+                push(vm, OBJ_VAL(module));
+                if (module->executed) {
+                    push(vm, NIL_VAL);
+                    break;
+                }
+
+                // The body runs as an ordinary call and leaves its result,
+                // nil, above the module.
+                module->executed = true;
+                ObjClosure* body = newClosure(vm, module->body);
+                push(vm, OBJ_VAL(body));
+                if (!call(vm, body, 0)) return INTERPRET_RUNTIME_ERROR;
+                frame = &vm->fiber->frames[vm->fiber->frameCount - 1];
+                ip = frame->ip;
                 break;
             }
             case OP_GET_UPVALUE: {
                 uint8_t slot = READ_BYTE();
-                push(*frame->closure->upvalues[slot]->location);
+                push(vm, *frame->closure->upvalues[slot]->location);
                 break;
             }
             case OP_SET_UPVALUE: {
                 uint8_t slot = READ_BYTE();
-                *frame->closure->upvalues[slot]->location = peek(0);
+                *frame->closure->upvalues[slot]->location = peek(vm, 0);
                 break;
             }
             case OP_GET_PROPERTY: {
-                if (!IS_INSTANCE(peek(0))) {
-                    frame->ip = ip;
-                    runtimeError(L"只有实例有属性。");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
-                ObjInstance *instance = AS_INSTANCE(peek(0));
                 ObjString *name = READ_STRING();
+                if (!IS_INSTANCE(peek(vm, 0))) {
+                    if (!getProperty(vm, name, frame, ip)) return INTERPRET_RUNTIME_ERROR;
+                    break;
+                }
+                ObjInstance *instance = AS_INSTANCE(peek(vm, 0));
 
                 Value value;
                 if (tableGet(&instance->fields, name, &value)) {
-                    pop(); // Instance.
-                    push(value);
+                    pop(vm); // Instance.
+                    push(vm, value);
                     break;
                 }
 
-                if (!bindMethod(instance->klass, name, frame, ip)) {
+                if (!bindMethod(vm, instance->klass, name, frame, ip)) {
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 break;
             }
             case OP_SET_PROPERTY: {
-                if (!IS_INSTANCE(peek(1))) {
+                if (IS_MODULE(peek(vm, 1))) {
                     frame->ip = ip;
-                    runtimeError(L"只有实例有字段。");
+                    runtimeError(vm, L"模块的变量只能在模块内修改。");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                if (!IS_INSTANCE(peek(vm, 1))) {
+                    frame->ip = ip;
+                    runtimeError(vm, L"只有实例有字段。");
                     return INTERPRET_RUNTIME_ERROR;
                 }
 
-                ObjInstance *instance = AS_INSTANCE(peek(1));
+                ObjInstance *instance = AS_INSTANCE(peek(vm, 1));
                 if (instance->isStatic) {
                     frame->ip = ip;
-                    runtimeError(L"不能修改常量属性。");
+                    runtimeError(vm, L"不能修改常量属性。");
                     return INTERPRET_RUNTIME_ERROR;
                 }
 
-                tableSet(&instance->fields, READ_STRING(), peek(0));
-                Value value = pop();
-                pop();
-                push(value);
+                tableSet(vm, &instance->fields, READ_STRING(), peek(vm, 0));
+                Value value = pop(vm);
+                pop(vm);
+                push(vm, value);
                 break;
             }
             case OP_GET_SUPER: {
                 ObjString *name = READ_STRING();
-                ObjClass *superclass = AS_CLASS(pop());
+                ObjClass *superclass = AS_CLASS(pop(vm));
 
-                if (!bindMethod(superclass, name, frame, ip)) {
+                if (!bindMethod(vm, superclass, name, frame, ip)) {
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 break;
             }
             case OP_EQUAL: {
-                Value b = pop();
-                Value a = pop();
-                push(BOOL_VAL(valuesEqual(a, b)));
+                Value b = pop(vm);
+                Value a = pop(vm);
+                push(vm, BOOL_VAL(valuesEqual(a, b)));
                 break;
             }
             case OP_GREATER:
@@ -957,20 +1526,20 @@ static InterpretResult run() {
                 BINARY_OP(BOOL_VAL, <);
                 break;
             case OP_ADD:
-                if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
-                    ObjString* b = AS_STRING(peek(0));
-                    ObjString* a = AS_STRING(peek(1));
-                    ObjString* result = concatenate(a, b);
-                    pop();
-                    pop();
-                    push(OBJ_VAL(result));
-                } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
-                    double b = AS_NUMBER(pop());
-                    double a = AS_NUMBER(pop());
-                    push(NUMBER_VAL(a + b));
+                if (IS_STRING(peek(vm, 0)) && IS_STRING(peek(vm, 1))) {
+                    ObjString* b = AS_STRING(peek(vm, 0));
+                    ObjString* a = AS_STRING(peek(vm, 1));
+                    ObjString* result = concatenate(vm, a, b);
+                    pop(vm);
+                    pop(vm);
+                    push(vm, OBJ_VAL(result));
+                } else if (IS_NUMBER(peek(vm, 0)) && IS_NUMBER(peek(vm, 1))) {
+                    double b = AS_NUMBER(pop(vm));
+                    double a = AS_NUMBER(pop(vm));
+                    push(vm, NUMBER_VAL(a + b));
                 } else {
                     frame->ip = ip;
-                    runtimeError(L"操作数必须是两个数字或两个字符串。");
+                    runtimeError(vm, L"操作数必须是两个数字或两个字符串。");
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 break;
@@ -1002,40 +1571,40 @@ static InterpretResult run() {
                 BINARY_BITWISE_OP(NUMBER_VAL, >>);
                 break;
             case OP_NOT:
-                push(BOOL_VAL(isFalsey(pop())));
+                push(vm, BOOL_VAL(isFalsey(pop(vm))));
                 break;
             case OP_NEGATE:
-                if (!IS_NUMBER(peek(0))) {
+                if (!IS_NUMBER(peek(vm, 0))) {
                     frame->ip = ip;
-                    runtimeError(L"操作数必须是数字。");
+                    runtimeError(vm, L"操作数必须是数字。");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(NUMBER_VAL(-AS_NUMBER(pop())));
+                push(vm, NUMBER_VAL(-AS_NUMBER(pop(vm))));
                 break;
             case OP_BITWISE_NOT:
-                if (!IS_NUMBER(peek(0))) {
+                if (!IS_NUMBER(peek(vm, 0))) {
                     frame->ip = ip;
-                    runtimeError(L"操作数必须是数字。");
+                    runtimeError(vm, L"操作数必须是数字。");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(NUMBER_VAL(~(int32_t)AS_NUMBER(pop())));
+                push(vm, NUMBER_VAL(~(int32_t)AS_NUMBER(pop(vm))));
                 break;
             case OP_INCREMENT: {
-                if (!IS_NUMBER(peek(0))) {
+                if (!IS_NUMBER(peek(vm, 0))) {
                     frame->ip = ip;
-                    runtimeError(L"操作数必须是数字。");
+                    runtimeError(vm, L"操作数必须是数字。");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(NUMBER_VAL(AS_NUMBER(pop()) + 1));
+                push(vm, NUMBER_VAL(AS_NUMBER(pop(vm)) + 1));
                 break;
             }
             case OP_DECREMENT: {
-                if (!IS_NUMBER(peek(0))) {
+                if (!IS_NUMBER(peek(vm, 0))) {
                     frame->ip = ip;
-                    runtimeError(L"操作数必须是数字。");
+                    runtimeError(vm, L"操作数必须是数字。");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                push(NUMBER_VAL(AS_NUMBER(pop()) - 1));
+                push(vm, NUMBER_VAL(AS_NUMBER(pop(vm)) - 1));
                 break;
             }
             case OP_JUMP: {
@@ -1045,56 +1614,63 @@ static InterpretResult run() {
             }
             case OP_JUMP_IF_FALSE: {
                 uint16_t offset = READ_SHORT();
-                if (isFalsey(peek(0))) ip += offset;
+                if (isFalsey(peek(vm, 0))) ip += offset;
                 break;
             }
             case OP_LOOP: {
+                CHECK_BUDGET();
                 uint16_t offset = READ_SHORT();
                 ip -= offset;
                 break;
             }
             case OP_CALL: {
+                CHECK_BUDGET();
                 int argCount = READ_BYTE();
                 frame->ip = ip;
-                if (!callValue(peek(argCount), argCount)) {
+                if (!callValue(vm, peek(vm, argCount), argCount)) {
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                frame = &vm.frames[vm.frameCount - 1];
+                frame = &vm->fiber->frames[vm->fiber->frameCount - 1];
                 ip = frame->ip;
                 break;
             }
             case OP_INVOKE: {
+                CHECK_BUDGET();
                 ObjString *method = READ_STRING();
                 int argCount = READ_BYTE();
                 frame->ip = ip;
-                if (!invoke(method, argCount, frame, ip)) {
+                if (!invoke(vm, method, argCount, frame, ip)) {
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                frame = &vm.frames[vm.frameCount - 1];
+                // 纤程。让出 suspends the running fiber; hand control back to
+                // whoever resumed it.
+                if (vm->fiber->state == FIBER_SUSPENDED) return INTERPRET_OK;
+                frame = &vm->fiber->frames[vm->fiber->frameCount - 1];
                 ip = frame->ip;
                 break;
             }
             case OP_SUPER_INVOKE: {
+                CHECK_BUDGET();
                 ObjString *method = READ_STRING();
                 int argCount = READ_BYTE();
                 frame->ip = ip;
-                ObjClass *superclass = AS_CLASS(pop());
-                if (!invokeFromClass(superclass, false, method, argCount, frame, ip)) {
+                ObjClass *superclass = AS_CLASS(pop(vm));
+                if (!invokeFromClass(vm, superclass, false, method, argCount, frame, ip)) {
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                frame = &vm.frames[vm.frameCount - 1];
+                frame = &vm->fiber->frames[vm->fiber->frameCount - 1];
                 ip = frame->ip;
                 break;
             }
             case OP_CLOSURE: {
                 ObjFunction *function = AS_FUNCTION(READ_CONSTANT());
-                ObjClosure *closure = newClosure(function);
-                push(OBJ_VAL(closure));
+                ObjClosure *closure = newClosure(vm, function);
+                push(vm, OBJ_VAL(closure));
                 for (int i = 0; i < closure->upvalueCount; i++) {
                     uint8_t isLocal = READ_BYTE();
                     uint8_t index = READ_BYTE();
                     if (isLocal) {
-                        closure->upvalues[i] = captureUpvalue(frame->slots + index);
+                        closure->upvalues[i] = captureUpvalue(vm, frame->slots + index);
                     } else {
                         closure->upvalues[i] = frame->closure->upvalues[index];
                     }
@@ -1102,80 +1678,88 @@ static InterpretResult run() {
                 break;
             }
             case OP_CLOSE_UPVALUE:
-                closeUpvalues(vm.stackTop - 1);
-                pop();
+                closeUpvalues(vm, vm->fiber->stackTop - 1);
+                pop(vm);
                 break;
             case OP_RETURN: {
-                Value result = pop();
-                closeUpvalues(frame->slots);
-                vm.frameCount--;
+                Value result = pop(vm);
+                closeUpvalues(vm, frame->slots);
+                vm->fiber->frameCount--;
 
-                if (vm.frameCount == 0) {
-                    pop();
+                if (frame->callClosure) {
+                    vm->fiber->stackTop = frame->slots;
+                    push(vm, result);
                     return INTERPRET_OK;
-                } else if (frame->callClosure) {
-                    push(result);
-                    frame->callClosure = false;
+                } else if (vm->fiber->frameCount == 0) {
+                    pop(vm);
+                    vm->fiber->transfer = result;
                     return INTERPRET_OK;
                 }
 
-                vm.stackTop = frame->slots;
-                push(result);
-                frame = &vm.frames[vm.frameCount - 1];
+                vm->fiber->stackTop = frame->slots;
+                push(vm, result);
+                frame = &vm->fiber->frames[vm->fiber->frameCount - 1];
                 ip = frame->ip;
                 break;
             }
+            case OP_YIELD:
+                // Generators always run as the bottom frame of their own
+                // fiber, so suspending just returns to whoever resumed it.
+                frame->ip = ip;
+                vm->fiber->transfer = peek(vm, 0);
+                vm->fiber->state = FIBER_SUSPENDED;
+                return INTERPRET_OK;
             case OP_CLASS:
-                push(OBJ_VAL(newClass(READ_STRING())));
+                push(vm, OBJ_VAL(newClass(vm, READ_STRING())));
                 break;
             case OP_INHERIT: {
-                Value superclass = peek(1);
+                Value superclass = peek(vm, 1);
                 if (!IS_CLASS(superclass)) {
                     frame->ip = ip;
-                    runtimeError(L"超类必须是个类。");
+                    runtimeError(vm, L"超类必须是个类。");
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                ObjClass *subclass = AS_CLASS(peek(0));
-                tableAddAll(&AS_CLASS(superclass)->methods, &subclass->methods);
-                pop(); // Subclass.
+                ObjClass *subclass = AS_CLASS(peek(vm, 0));
+                tableAddAll(vm, &AS_CLASS(superclass)->methods, &subclass->methods);
+                pop(vm); // Subclass.
                 break;
             }
             case OP_METHOD:
-                defineMethod(READ_STRING());
+                defineMethod(vm, READ_STRING());
                 break;
-            case OP_DUP: push(peek(0)); break;
-            case OP_DOUBLE_DUP: push(peek(1)); push(peek(1)); break;
+            case OP_DUP: push(vm, peek(vm, 0)); break;
+            case OP_DOUBLE_DUP: push(vm, peek(vm, 1)); push(vm, peek(vm, 1)); break;
             case OP_BUILD_LIST: {
                 // Stack before: [item1, item2, ..., itemN] and after: [list]
-                ObjList* list = newList();
+                ObjList* list = newList(vm);
                 uint8_t itemCount = READ_BYTE();
 
                 // Add items to list
-                push(OBJ_VAL(list)); // So list isn't sweeped by GC in insertToList
+                push(vm, OBJ_VAL(list)); // So list isn't sweeped by GC in insertToList
                 for (int i = itemCount; i > 0; i--) {
-                    insertToList(list, peek(i), list->count);
+                    insertToList(vm, list, peek(vm, i), list->count);
                 }
-                pop();
+                pop(vm);
 
                 // Pop items from stack
                 while (itemCount-- > 0) {
-                    pop();
+                    pop(vm);
                 }
 
-                push(OBJ_VAL(list));
+                push(vm, OBJ_VAL(list));
                 break;
             }
             case OP_INDEX_SUBSCR: {
                 // Stack before: [list, index] and after: [index(list, index)]
-                Value index = pop();
-                Value obj = pop();
+                Value index = pop(vm);
+                Value obj = pop(vm);
 
                 if (IS_STRING(obj)) {
                     ObjString *objString = AS_STRING(obj);
 
                     if (!IS_NUMBER(index)) {
                         frame->ip = ip;
-                        runtimeError(L"字符串索引不是数字。");
+                        runtimeError(vm, L"字符串索引不是数字。");
                         return INTERPRET_RUNTIME_ERROR;
                     }
                     int numIndex = AS_NUMBER(index);
@@ -1183,19 +1767,20 @@ static InterpretResult run() {
 
                     if (!isValidStringIndex(objString, numIndex)) {
                         frame->ip = ip;
-                        runtimeError(L"字符串索引超出范围。");
+                        runtimeError(vm, L"字符串索引超出范围。");
                         return INTERPRET_RUNTIME_ERROR;
                     }
-                    wchar_t* result = ALLOCATE(wchar_t, 1);
+                    wchar_t* result = ALLOCATE(vm, wchar_t, 2);
                     result[0] = indexFromString(objString, numIndex);
-                    push(OBJ_VAL(takeString(result, 1)));
+                    result[1] = L'\0';
+                    push(vm, OBJ_VAL(takeString(vm, result, 1)));
                     break;
                 } else if (IS_LIST(obj)) {
                     ObjList *objList = AS_LIST(obj);
 
                     if (!IS_NUMBER(index)) {
                         frame->ip = ip;
-                        runtimeError(L"列表索引不是数字。");
+                        runtimeError(vm, L"列表索引不是数字。");
                         return INTERPRET_RUNTIME_ERROR;
                     }
                     int numIndex = AS_NUMBER(index);
@@ -1203,35 +1788,51 @@ static InterpretResult run() {
 
                     if (!isValidListIndex(objList, numIndex)) {
                         frame->ip = ip;
-                        runtimeError(L"列表索引超出范围。");
+                        runtimeError(vm, L"列表索引超出范围。");
                         return INTERPRET_RUNTIME_ERROR;
                     }
 
                     Value result = indexFromList(objList, numIndex);
-                    push(result);
+                    push(vm, result);
+                    break;
+                } else if (IS_BYTES(obj)) {
+                    ObjBytes* bytes = AS_BYTES(obj);
+                    size_t byte;
+
+                    if (!IS_NUMBER(index)) {
+                        frame->ip = ip;
+                        runtimeError(vm, L"字节索引不是数字。");
+                        return INTERPRET_RUNTIME_ERROR;
+                    } else if (!getByteIndex(index, bytes->count, &byte)) {
+                        frame->ip = ip;
+                        runtimeError(vm, L"字节索引超出范围。");
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+
+                    push(vm, NUMBER_VAL(bytesData(bytes)[byte]));
                     break;
                 }
 
                 frame->ip = ip;
-                runtimeError(L"无效类型索引到。");
+                runtimeError(vm, L"无效类型索引到。");
                 return INTERPRET_RUNTIME_ERROR;
             }
             case OP_STORE_SUBSCR: {
                 // Stack before: [list, index, item] and after: [item]
-                Value item = pop();
-                Value index = pop();
-                Value obj = pop();
+                Value item = pop(vm);
+                Value index = pop(vm);
+                Value obj = pop(vm);
 
                 if (IS_STRING(obj)) {
                     ObjString* objString = AS_STRING(obj);
 
                     if (!IS_NUMBER(index)) {
                         frame->ip = ip;
-                        runtimeError(L"字符串索引不是数字。");
+                        runtimeError(vm, L"字符串索引不是数字。");
                         return INTERPRET_RUNTIME_ERROR;
                     } else if (!IS_STRING(item)) {
                         frame->ip = ip;
-                        runtimeError(L"字符串中只能存储字符。");
+                        runtimeError(vm, L"字符串中只能存储字符。");
                         return INTERPRET_RUNTIME_ERROR;
                     }
 
@@ -1241,24 +1842,29 @@ static InterpretResult run() {
 
                     if (!isValidStringIndex(objString, numIndex)) {
                         frame->ip = ip;
-                        runtimeError(L"字符串索引无效。");
+                        runtimeError(vm, L"字符串索引无效。");
+                        return INTERPRET_RUNTIME_ERROR;
+                    } else if (isShared((Obj*)objString)) {
+                        // Every thread reads it, and other VMs have it interned.
+                        frame->ip = ip;
+                        runtimeError(vm, L"不能修改共享的字符串「%ls」。", objString->chars);
                         return INTERPRET_RUNTIME_ERROR;
                     } else if (wcslen(itemString->chars) != 1) {
                         frame->ip = ip;
-                        runtimeError(
+                        runtimeError(vm, 
                                 L"期望长度为 1 的字符串，但长度为 %d。", wcslen(itemString->chars));
                         return INTERPRET_RUNTIME_ERROR;
                     }
 
                     storeToString(objString, numIndex, itemString->chars[0]);
-                    push(item);
+                    push(vm, item);
                     break;
                 } else if (IS_LIST(obj)) {
                     ObjList *objList = AS_LIST(obj);
 
                     if (!IS_NUMBER(index)) {
                         frame->ip = ip;
-                        runtimeError(L"列表索引不是数字。");
+                        runtimeError(vm, L"列表索引不是数字。");
                         return INTERPRET_RUNTIME_ERROR;
                     }
                     int numIndex = AS_NUMBER(index);
@@ -1266,17 +1872,39 @@ static InterpretResult run() {
 
                     if (!isValidListIndex(objList, numIndex)) {
                         frame->ip = ip;
-                        runtimeError(L"列表索引无效。");
+                        runtimeError(vm, L"列表索引无效。");
                         return INTERPRET_RUNTIME_ERROR;
                     }
 
                     storeToList(objList, numIndex, item);
-                    push(item);
+                    push(vm, item);
+                    break;
+                } else if (IS_BYTES(obj)) {
+                    ObjBytes* bytes = AS_BYTES(obj);
+                    size_t byte;
+
+                    if (!IS_NUMBER(index)) {
+                        frame->ip = ip;
+                        runtimeError(vm, L"字节索引不是数字。");
+                        return INTERPRET_RUNTIME_ERROR;
+                    } else if (!getByteIndex(index, bytes->count, &byte)) {
+                        frame->ip = ip;
+                        runtimeError(vm, L"字节索引无效。");
+                        return INTERPRET_RUNTIME_ERROR;
+                    } else if (!IS_NUMBER(item) || AS_NUMBER(item) != floor(AS_NUMBER(item)) ||
+                               AS_NUMBER(item) < 0 || AS_NUMBER(item) > 255) {
+                        frame->ip = ip;
+                        runtimeError(vm, L"字节中只能存储 0 到 255 的整数。");
+                        return INTERPRET_RUNTIME_ERROR;
+                    }
+
+                    bytesData(bytes)[byte] = (uint8_t)AS_NUMBER(item);
+                    push(vm, item);
                     break;
                 }
 
                 frame->ip = ip;
-                runtimeError(L"无法存储值：变量不是字符串或列表。");
+                runtimeError(vm, L"无法存储值：变量不是字符串、列表或字节。");
                 return INTERPRET_RUNTIME_ERROR;
             }
         }
@@ -1288,31 +1916,53 @@ static InterpretResult run() {
 #undef READ_STRING
 #undef BINARY_FUNC_OP
 #undef BINARY_OP
+#undef CHECK_BUDGET
 }
 
-InterpretResult runClosure(ObjClosure* closure, Value* value, Value args[], int argCount) {
+InterpretResult runClosure(VM* vm, ObjClosure* closure, Value* value, Value args[], int argCount) {
+    push(vm, OBJ_VAL(closure));
     for (int i = 0; i < argCount; i++) {
-        push(args[i]);
+        push(vm, args[i]);
+    }
+    if (!call(vm, closure, argCount)) return INTERPRET_RUNTIME_ERROR;
+    if (closure->function->isGenerator) {
+        *value = pop(vm);
+        return INTERPRET_OK;
     }
-    call(closure, argCount);
-    vm.frames[vm.frameCount - 1].callClosure = true;
-    InterpretResult result = run();
-    *value = pop();
-    vm.stackTop -= argCount;
+    vm->fiber->frames[vm->fiber->frameCount - 1].callClosure = true;
+    vm->fiber->nativeCalls++;
+    InterpretResult result = run(vm);
+    // A runtime error has already unwound the stack.
+    if (result != INTERPRET_OK) return result;
+    vm->fiber->nativeCalls--;
+    *value = pop(vm);
     return result;
 }
 
-InterpretResult interpret(const char* source) {
-    wchar_t* wsource = ALLOCATE(wchar_t, strlen(source) + 1);
-    mbstowcs(wsource, source, strlen(source) + 1);
-    ObjFunction* function = compile(wsource);
+ObjFunction* compileSource(VM* vm, const char* source, const char* path) {
+    return compile(vm, source, path);
+}
+
+// Runs [source]. Imports in it are relative to the file it was read from,
+// [path], or to the working directory if it is NULL.
+InterpretResult interpret(VM* vm, const char* source, const char* path) {
+    ObjFunction* function = compileSource(vm, source, path);
     if (function == NULL) return INTERPRET_COMPILE_ERROR;
+    return interpretFunction(vm, function);
+}
+
+// Carries on running whatever the root fiber was doing, such as a program
+// just loaded from an image.
+InterpretResult continueInterpret(VM* vm) {
+    return run(vm);
+}
 
-    push(OBJ_VAL(function));
-    ObjClosure* closure = newClosure(function);
-    pop();
-    push(OBJ_VAL(closure));
-    call(closure, 0);
+InterpretResult interpretFunction(VM* vm, ObjFunction* function) {
+    push(vm, OBJ_VAL(function));
+    ObjClosure* closure = newClosure(vm, function);
+    pop(vm);
+    push(vm, OBJ_VAL(closure));
+    call(vm, closure, 0);
 
-    return run();
+    return run(vm);
 }
\ No newline at end of file
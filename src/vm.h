@@ -7,29 +7,26 @@
 
 #include "chunk.h"
 #include "object.h"
+#include "output.h"
 #include "table.h"
 #include "value.h"
 
-#define FRAMES_MAX 64
-#define STACK_MAX (FRAMES_MAX * UINT8_COUNT)
-
-typedef struct {
-    ObjClosure* closure;
-    uint8_t* ip;
-    Value* slots;
-    bool callClosure;
-} CallFrame;
+typedef enum {
+    BUDGET_CONTINUE,   // Refill the budget and carry on.
+    BUDGET_ABORT,      // Stop with a runtime error.
+    BUDGET_PAUSE,      // Return INTERPRET_PAUSED; continueInterpret() resumes.
+    BUDGET_YIELD,      // Let the event loop run its other tasks first.
+} BudgetAction;
 
-typedef struct {
-    CallFrame frames[FRAMES_MAX];
-    int frameCount;
+typedef BudgetAction (*BudgetFn)(VM* vm, void* data);
 
-    Value stack[STACK_MAX];
-    Value* stackTop;
+struct VM {
+    ObjFiber* fiber;
     Table globals;
+    Table modules;   // Canonical path to each module this VM has loaded.
+    Table regexes;   // Compiled patterns, keyed by their flags and text.
     Table strings;
     ObjString* initString;
-    ObjUpvalue* openUpvalues;
 
     size_t bytesAllocated;
     size_t nextGC;
@@ -38,24 +35,48 @@ typedef struct {
     int grayCapacity;
     Obj** grayStack;
     bool markValue;
-} VM;
+    int gcPaused;   // Set while a native builds objects that are all live.
+
+    struct Parser* parser;
+    struct EventLoop* eventLoop;
+    struct Worker* worker;   // Set when this VM runs on a worker thread.
+    struct SharedStrings* sharedStrings;   // The shared heap as this VM sees it.
+    struct Host* host;   // Handles held by a program embedding this VM, see qi.h.
+    double startTime;
+
+    // Loop edges and calls left before [onBudget] is asked what to do.
+    int64_t fuel;
+    int64_t budget;
+    BudgetFn onBudget;
+    void* budgetData;
+
+    Output output;   // What 打印 and 打印行 write to standard output.
+    ObjReader* input;   // Standard input, once something reads it.
+};
 
 typedef enum {
     INTERPRET_OK,
     INTERPRET_COMPILE_ERROR,
     INTERPRET_RUNTIME_ERROR,
+    INTERPRET_PAUSED,
 } InterpretResult;
 
-extern VM vm;
-
-void initVM();
-void freeVM();
+VM* newBareVM();
+void initCoreModules(VM* vm);
+VM* newVM();
+void freeVM(VM* vm);
 bool isFalsey(Value value);
-InterpretResult runClosure(ObjClosure* closure, Value* value, Value args[], int argCount);
-InterpretResult interpret(const char* source);
-void push(Value value);
-Value pop();
-void defineNativeInstance(wchar_t* name, ObjInstance* instance);
-void defineNative(const wchar_t* name, NativeFn function, int arity, ObjClass* klass);
-void defineProperty(const wchar_t* name, Value value, ObjInstance* instance);
+InterpretResult runClosure(VM* vm, ObjClosure* closure, Value* value, Value args[], int argCount);
+InterpretResult resumeFiber(VM* vm, ObjFiber* fiber, Value value);
+ObjFunction* compileSource(VM* vm, const char* source, const char* path);
+InterpretResult interpret(VM* vm, const char* source, const char* path);
+InterpretResult interpretFunction(VM* vm, ObjFunction* function);
+InterpretResult continueInterpret(VM* vm);
+void setBudget(VM* vm, int64_t budget, BudgetFn callback, void* data);
+void push(VM* vm, Value value);
+Value pop(VM* vm);
+void defineNativeInstance(VM* vm, wchar_t* name, ObjInstance* instance);
+void defineNative(VM* vm, const wchar_t* name, NativeFn function, int arity, ObjClass* klass);
+void defineTypedNative(VM* vm, const wchar_t* name, NativeFn function, const char* signature, ObjClass* klass);
+void defineProperty(VM* vm, const wchar_t* name, Value value, ObjInstance* instance);
 #endif //QI_VM_H
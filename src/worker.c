@@ -0,0 +1,701 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "worker.h"
+#include "memory.h"
+#include "bytes.h"
+#include "core_module.h"
+#include "shared.h"
+
+// Lists nested deeper than this are assumed to be cyclic.
+#define MESSAGE_MAX_DEPTH 64
+
+typedef enum {
+    MSG_NIL,
+    MSG_BOOL,
+    MSG_NUMBER,
+    MSG_STRING,
+    MSG_LIST,
+    MSG_FUNCTION,
+} MessageType;
+
+// A value copied out of one VM's heap so it can be rebuilt in another.
+// Messages are plain malloc'd trees: they belong to neither VM's GC.
+typedef struct Message {
+    MessageType type;
+    union {
+        bool boolean;
+        double number;
+        struct {
+            wchar_t* chars;
+            int length;
+        } string;
+        struct {
+            struct Message** items;
+            int count;
+        } list;
+        struct {
+            int arity;
+            int upvalueCount;
+            bool isGenerator;
+            struct Message* name;
+            uint8_t* code;
+            int* lines;
+            int count;
+            struct Message** constants;
+            int constantCount;
+        } function;
+    } as;
+} Message;
+
+// One link of a single-producer, single-consumer queue. The queue always
+// holds a stub node at its head; a node's message is taken when it becomes
+// the new stub.
+typedef struct QueueNode {
+    Message* message;
+    _Atomic(struct QueueNode*) next;
+} QueueNode;
+
+typedef struct {
+    QueueNode* head;   // Only touched by the consumer.
+    QueueNode* tail;   // Only touched by the producer.
+    sem_t available;   // Counts queued messages so receivers can sleep.
+} Queue;
+
+struct Worker {
+    pthread_t thread;
+    atomic_int refs;     // The handle in the parent VM plus the thread.
+    bool joined;
+
+    Queue inbox;         // Parent to worker.
+    Queue outbox;        // Worker to parent.
+
+    char* path;          // Script to run, or NULL to call [entry].
+    Message* entry;
+    Message* args;       // A MSG_LIST of arguments for [entry].
+
+    Message* result;     // The entry's return value, once the thread exits.
+    bool failed;
+};
+
+static Message* newMessage(MessageType type) {
+    Message* message = (Message*)malloc(sizeof(Message));
+    if (message == NULL) exit(1);
+    message->type = type;
+    return message;
+}
+
+static void freeMessage(Message* message) {
+    if (message == NULL) return;
+    switch (message->type) {
+        case MSG_STRING:
+            free(message->as.string.chars);
+            break;
+        case MSG_LIST:
+            for (int i = 0; i < message->as.list.count; i++) freeMessage(message->as.list.items[i]);
+            free(message->as.list.items);
+            break;
+        case MSG_FUNCTION:
+            freeMessage(message->as.function.name);
+            free(message->as.function.code);
+            free(message->as.function.lines);
+            for (int i = 0; i < message->as.function.constantCount; i++) {
+                freeMessage(message->as.function.constants[i]);
+            }
+            free(message->as.function.constants);
+            break;
+        default:
+            break;
+    }
+    free(message);
+}
+
+static Message* stringMessage(ObjString* string) {
+    Message* message = newMessage(MSG_STRING);
+    size_t size = sizeof(wchar_t) * (string->length + 1);
+    message->as.string.chars = (wchar_t*)malloc(size);
+    if (message->as.string.chars == NULL) exit(1);
+    memcpy(message->as.string.chars, string->chars, size);
+    message->as.string.length = string->length;
+    return message;
+}
+
+// Copies [value] out of the VM. On failure returns NULL and leaves the
+// offending type in [*badType].
+static Message* serialize(Value value, int depth, const wchar_t** badType);
+
+static Message* serializeFunction(ObjFunction* function, int depth, const wchar_t** badType) {
+    // Its module's variables stay behind in this VM.
+    if (function->module != NULL) {
+        *badType = L"模块中的功能";
+        return NULL;
+    }
+    Message* message = newMessage(MSG_FUNCTION);
+    Chunk* chunk = &function->chunk;
+    message->as.function.arity = function->arity;
+    message->as.function.upvalueCount = function->upvalueCount;
+    message->as.function.isGenerator = function->isGenerator;
+    message->as.function.name = function->name == NULL ? NULL : stringMessage(function->name);
+    message->as.function.count = chunk->count;
+    message->as.function.code = (uint8_t*)malloc(chunk->count);
+    message->as.function.lines = (int*)malloc(sizeof(int) * chunk->count);
+    message->as.function.constantCount = 0;
+    message->as.function.constants = (Message**)malloc(sizeof(Message*) * chunk->constants.count);
+    if (message->as.function.code == NULL || message->as.function.lines == NULL ||
+        message->as.function.constants == NULL) exit(1);
+    memcpy(message->as.function.code, chunk->code, chunk->count);
+    memcpy(message->as.function.lines, chunk->lines, sizeof(int) * chunk->count);
+
+    for (int i = 0; i < chunk->constants.count; i++) {
+        Message* constant = serialize(chunk->constants.values[i], depth + 1, badType);
+        if (constant == NULL) {
+            freeMessage(message);
+            return NULL;
+        }
+        message->as.function.constants[message->as.function.constantCount++] = constant;
+    }
+    return message;
+}
+
+static Message* serialize(Value value, int depth, const wchar_t** badType) {
+    if (depth > MESSAGE_MAX_DEPTH) {
+        *badType = L"嵌套过深的列表";
+        return NULL;
+    }
+
+    if (IS_NIL(value)) return newMessage(MSG_NIL);
+    if (IS_BOOL(value)) {
+        Message* message = newMessage(MSG_BOOL);
+        message->as.boolean = AS_BOOL(value);
+        return message;
+    }
+    if (IS_NUMBER(value)) {
+        Message* message = newMessage(MSG_NUMBER);
+        message->as.number = AS_NUMBER(value);
+        return message;
+    }
+    if (IS_STRING(value)) return stringMessage(AS_STRING(value));
+    if (IS_LIST(value)) {
+        ObjList* list = AS_LIST(value);
+        Message* message = newMessage(MSG_LIST);
+        message->as.list.count = 0;
+        message->as.list.items = (Message**)malloc(sizeof(Message*) * (list->count + 1));
+        if (message->as.list.items == NULL) exit(1);
+        for (int i = 0; i < list->count; i++) {
+            Message* item = serialize(list->items[i], depth + 1, badType);
+            if (item == NULL) {
+                freeMessage(message);
+                return NULL;
+            }
+            message->as.list.items[message->as.list.count++] = item;
+        }
+        return message;
+    }
+    // Functions are only sent as the nested constants of a worker's entry
+    // function; the entry closure itself is checked by the caller.
+    if (IS_FUNCTION(value)) return serializeFunction(AS_FUNCTION(value), depth, badType);
+
+    *badType = getType(value);
+    return NULL;
+}
+
+// Rebuilds [message] in [vm]. String buffers are adopted rather than copied,
+// so the message must not be used again afterwards.
+static Value deserialize(VM* vm, Message* message) {
+    switch (message->type) {
+        case MSG_NIL: return NIL_VAL;
+        case MSG_BOOL: return BOOL_VAL(message->as.boolean);
+        case MSG_NUMBER: return NUMBER_VAL(message->as.number);
+        case MSG_STRING: {
+            // The buffer was malloc'd by the sender; account for it here so
+            // this VM's GC can free it like any of its own strings.
+            int length = message->as.string.length;
+            vm->bytesAllocated += sizeof(wchar_t) * (length + 1);
+            wchar_t* chars = message->as.string.chars;
+            message->as.string.chars = NULL;
+            return OBJ_VAL(takeString(vm, chars, length));
+        }
+        case MSG_LIST: {
+            ObjList* list = newList(vm);
+            push(vm, OBJ_VAL(list));
+            for (int i = 0; i < message->as.list.count; i++) {
+                Value item = deserialize(vm, message->as.list.items[i]);
+                push(vm, item);
+                insertToList(vm, list, item, list->count);
+                pop(vm);
+            }
+            pop(vm);
+            return OBJ_VAL(list);
+        }
+        case MSG_FUNCTION: {
+            ObjFunction* function = newFunction(vm);
+            push(vm, OBJ_VAL(function));
+            function->arity = message->as.function.arity;
+            function->upvalueCount = message->as.function.upvalueCount;
+            if (message->as.function.name != NULL) {
+                function->name = AS_STRING(deserialize(vm, message->as.function.name));
+            }
+            for (int i = 0; i < message->as.function.count; i++) {
+                writeChunk(vm, &function->chunk, message->as.function.code[i], message->as.function.lines[i]);
+            }
+            for (int i = 0; i < message->as.function.constantCount; i++) {
+                Value constant = deserialize(vm, message->as.function.constants[i]);
+                push(vm, constant);
+                addConstant(vm, &function->chunk, constant);
+                pop(vm);
+            }
+            function->isGenerator = message->as.function.isGenerator;
+            pop(vm);
+            return OBJ_VAL(function);
+        }
+    }
+    return NIL_VAL;
+}
+
+static void initQueue(Queue* queue) {
+    QueueNode* stub = (QueueNode*)malloc(sizeof(QueueNode));
+    if (stub == NULL) exit(1);
+    stub->message = NULL;
+    atomic_init(&stub->next, NULL);
+    queue->head = stub;
+    queue->tail = stub;
+    sem_init(&queue->available, 0, 0);
+}
+
+static void freeQueue(Queue* queue) {
+    QueueNode* node = queue->head;
+    while (node != NULL) {
+        QueueNode* next = atomic_load_explicit(&node->next, memory_order_relaxed);
+        freeMessage(node->message);
+        free(node);
+        node = next;
+    }
+    sem_destroy(&queue->available);
+}
+
+static void enqueue(Queue* queue, Message* message) {
+    QueueNode* node = (QueueNode*)malloc(sizeof(QueueNode));
+    if (node == NULL) exit(1);
+    node->message = message;
+    atomic_init(&node->next, NULL);
+    // Publishing the link is the only point the consumer can observe.
+    atomic_store_explicit(&queue->tail->next, node, memory_order_release);
+    queue->tail = node;
+    sem_post(&queue->available);
+}
+
+static Message* dequeue(Queue* queue) {
+    while (sem_wait(&queue->available) != 0);
+    QueueNode* stub = queue->head;
+    QueueNode* next = atomic_load_explicit(&stub->next, memory_order_acquire);
+    Message* message = next->message;
+    next->message = NULL;
+    queue->head = next;
+    free(stub);
+    return message;
+}
+
+static Worker* newWorkerState() {
+    Worker* worker = (Worker*)malloc(sizeof(Worker));
+    if (worker == NULL) exit(1);
+    atomic_init(&worker->refs, 2);
+    worker->joined = false;
+    initQueue(&worker->inbox);
+    initQueue(&worker->outbox);
+    worker->path = NULL;
+    worker->entry = NULL;
+    worker->args = NULL;
+    worker->result = NULL;
+    worker->failed = false;
+    return worker;
+}
+
+static void unrefWorker(Worker* worker) {
+    if (atomic_fetch_sub(&worker->refs, 1) != 1) return;
+    freeQueue(&worker->inbox);
+    freeQueue(&worker->outbox);
+    free(worker->path);
+    freeMessage(worker->entry);
+    freeMessage(worker->args);
+    freeMessage(worker->result);
+    free(worker);
+}
+
+// Called when the parent's handle is collected. A thread that was never
+// joined is detached so it cleans up after itself.
+void releaseWorker(Worker* worker) {
+    if (!worker->joined) {
+        pthread_detach(worker->thread);
+        worker->joined = true;
+    }
+    unrefWorker(worker);
+}
+
+static InterpretResult runEntry(VM* vm, Worker* worker) {
+    ObjFunction* function = AS_FUNCTION(deserialize(vm, worker->entry));
+    push(vm, OBJ_VAL(function));
+    ObjClosure* closure = newClosure(vm, function);
+    pop(vm);
+    push(vm, OBJ_VAL(closure));
+    // Define the function under its own name so it can recurse.
+    if (function->name != NULL) tableSet(vm, &vm->globals, function->name, OBJ_VAL(closure));
+
+    Value args[UINT8_COUNT];
+    int argCount = worker->args->as.list.count;
+    for (int i = 0; i < argCount; i++) {
+        args[i] = deserialize(vm, worker->args->as.list.items[i]);
+        push(vm, args[i]);
+    }
+
+    Value result;
+    InterpretResult status = runClosure(vm, closure, &result, args, argCount);
+    if (status != INTERPRET_OK) return status;
+
+    const wchar_t* badType = NULL;
+    worker->result = serialize(result, 0, &badType);
+    if (worker->result == NULL) {
+        fwprintf(stderr, L"无法发送类型为「%ls」的值。\n", badType);
+        return INTERPRET_RUNTIME_ERROR;
+    }
+    return INTERPRET_OK;
+}
+
+static void* workerMain(void* argument) {
+    Worker* worker = (Worker*)argument;
+    VM* vm = newVM();
+    InterpretResult status = INTERPRET_RUNTIME_ERROR;
+    if (vm != NULL) {
+        vm->worker = worker;
+        if (worker->path != NULL) {
+            // Workers running the same script share one compiled copy.
+            bool unreadable;
+            ObjFunction* function = loadSharedScript(vm, worker->path, &unreadable);
+            if (function == NULL && !unreadable) status = INTERPRET_COMPILE_ERROR;
+            if (function != NULL) status = interpretFunction(vm, function);
+        } else {
+            status = runEntry(vm, worker);
+        }
+        freeVM(vm);
+    }
+
+    worker->failed = status != INTERPRET_OK;
+    fflush(stdout);
+    unrefWorker(worker);
+    return NULL;
+}
+
+static bool createNative(VM* vm, int argCount, Value* args) {
+    if (argCount < 1) {
+        return nativeError(vm, args, L"需要至少 1 个参数，但得到 %d。", argCount);
+    }
+
+    Worker* worker;
+    if (IS_STRING(args[0])) {
+        if (argCount != 1) {
+            return nativeError(vm, args, L"运行脚本的工作者不接受参数，但得到 %d。", argCount - 1);
+        }
+        ObjString* path = AS_STRING(args[0]);
+        int length = (int)wcsnlen(path->chars, path->length);
+        size_t size = utf8Size(path->chars, length);
+        worker = newWorkerState();
+        worker->path = (char*)malloc(size + 1);
+        if (worker->path == NULL) exit(1);
+        encodeUtf8(path->chars, length, (uint8_t*)worker->path);
+        worker->path[size] = '\0';
+    } else if (IS_CLOSURE(args[0])) {
+        ObjClosure* closure = AS_CLOSURE(args[0]);
+        if (closure->upvalueCount > 0) {
+            return nativeError(vm, args, L"工作者功能不能捕获外部变量。");
+        }
+        if (closure->function->arity != argCount - 1) {
+            return nativeError(vm, args, L"工作者功能需要 %d 个参数，但得到 %d。",
+                               closure->function->arity, argCount - 1);
+        }
+
+        const wchar_t* badType = NULL;
+        Message* entry = serializeFunction(closure->function, 0, &badType);
+        Message* list = newMessage(MSG_LIST);
+        list->as.list.count = 0;
+        list->as.list.items = (Message**)malloc(sizeof(Message*) * argCount);
+        if (list->as.list.items == NULL) exit(1);
+        for (int i = 1; entry != NULL && i < argCount; i++) {
+            Message* item = serialize(args[i], 0, &badType);
+            if (item == NULL) break;
+            list->as.list.items[list->as.list.count++] = item;
+        }
+        if (entry == NULL || list->as.list.count != argCount - 1) {
+            freeMessage(entry);
+            freeMessage(list);
+            return nativeError(vm, args, L"无法发送类型为「%ls」的值。", badType);
+        }
+        worker = newWorkerState();
+        worker->entry = entry;
+        worker->args = list;
+    } else {
+        return nativeError(vm, args,
+                           L"参数 1（功能）的类型必须是「关闭」或「字符串」，而不是「%ls」。", getType(args[0]));
+    }
+
+    // Print what the parent has so far before anything the worker does.
+    flushOutput(&vm->output);
+    if (pthread_create(&worker->thread, NULL, workerMain, worker) != 0) {
+        atomic_store(&worker->refs, 1);
+        unrefWorker(worker);
+        return nativeError(vm, args, L"无法创建工作者线程。");
+    }
+    args[-1] = OBJ_VAL(newWorker(vm, worker));
+    return true;
+}
+
+static bool sendTo(VM* vm, Value* args, Queue* queue, Value value) {
+    const wchar_t* badType = NULL;
+    Message* message = serialize(value, 0, &badType);
+    if (message == NULL) return nativeError(vm, args, L"无法发送类型为「%ls」的值。", badType);
+    // Whatever the receiver prints after this must come after our output.
+    flushOutput(&vm->output);
+    enqueue(queue, message);
+    args[-1] = NIL_VAL;
+    return true;
+}
+
+static Value receiveFrom(VM* vm, Queue* queue) {
+    Message* message = dequeue(queue);
+    Value value = deserialize(vm, message);
+    freeMessage(message);
+    return value;
+}
+
+// 工作者。发送 and 工作者。接收 talk to the parent from inside a worker.
+static bool parentSendNative(VM* vm, int argCount, Value* args) {
+    if (vm->worker == NULL) return nativeError(vm, args, L"只能在工作者中发送给父线程。");
+    return sendTo(vm, args, &vm->worker->outbox, args[0]);
+}
+
+static bool parentReceiveNative(VM* vm, int argCount, Value* args) {
+    if (vm->worker == NULL) return nativeError(vm, args, L"只能在工作者中从父线程接收。");
+    args[-1] = receiveFrom(vm, &vm->worker->inbox);
+    return true;
+}
+
+// The methods on a worker handle; args[-1] holds the handle.
+bool workerSendNative(VM* vm, int argCount, Value* args) {
+    return sendTo(vm, args, &AS_WORKER(args[-1])->worker->inbox, args[0]);
+}
+
+bool workerReceiveNative(VM* vm, int argCount, Value* args) {
+    args[-1] = receiveFrom(vm, &AS_WORKER(args[-1])->worker->outbox);
+    return true;
+}
+
+bool workerJoinNative(VM* vm, int argCount, Value* args) {
+    Worker* worker = AS_WORKER(args[-1])->worker;
+    if (!worker->joined) {
+        pthread_join(worker->thread, NULL);
+        worker->joined = true;
+    }
+    if (worker->failed) return nativeError(vm, args, L"工作者因错误而终止。");
+
+    if (worker->result == NULL) {
+        args[-1] = NIL_VAL;
+    } else {
+        args[-1] = deserialize(vm, worker->result);
+        freeMessage(worker->result);
+        worker->result = NULL;
+    }
+    return true;
+}
+
+// One slice of a 并行映射 call, mapped on its own thread and VM.
+typedef struct {
+    pthread_t thread;
+    bool threaded;
+    Message* function;
+    Message* upvalues;        // A MSG_LIST of the captured values.
+    Message* items;           // A MSG_LIST slice of the input list.
+    Message* results;         // The mapped values, in order.
+    const wchar_t* badType;   // Set when a result couldn't be sent back.
+    bool failed;
+} MapTask;
+
+static Message* listMessage(Value* items, int count, const wchar_t** badType) {
+    Message* message = newMessage(MSG_LIST);
+    message->as.list.count = 0;
+    message->as.list.items = (Message**)malloc(sizeof(Message*) * (count + 1));
+    if (message->as.list.items == NULL) exit(1);
+    for (int i = 0; i < count; i++) {
+        Message* item = serialize(items[i], 0, badType);
+        if (item == NULL) {
+            freeMessage(message);
+            return NULL;
+        }
+        message->as.list.items[message->as.list.count++] = item;
+    }
+    return message;
+}
+
+static void* mapTaskMain(void* argument) {
+    MapTask* task = (MapTask*)argument;
+    task->failed = true;
+    VM* vm = newVM();
+    if (vm == NULL) return NULL;
+
+    ObjFunction* function = AS_FUNCTION(deserialize(vm, task->function));
+    push(vm, OBJ_VAL(function));
+    ObjClosure* closure = newClosure(vm, function);
+    pop(vm);
+    push(vm, OBJ_VAL(closure));
+    if (function->name != NULL) tableSet(vm, &vm->globals, function->name, OBJ_VAL(closure));
+    // The captured copies arrive as upvalues that are already closed.
+    for (int i = 0; i < closure->upvalueCount; i++) {
+        push(vm, deserialize(vm, task->upvalues->as.list.items[i]));
+        ObjUpvalue* upvalue = newUpvalue(vm, NULL);
+        upvalue->closed = pop(vm);
+        upvalue->location = &upvalue->closed;
+        closure->upvalues[i] = upvalue;
+    }
+
+    int count = task->items->as.list.count;
+    task->results = newMessage(MSG_LIST);
+    task->results->as.list.count = 0;
+    task->results->as.list.items = (Message**)malloc(sizeof(Message*) * (count + 1));
+    if (task->results->as.list.items == NULL) exit(1);
+    bool failed = false;
+    for (int i = 0; i < count && !failed; i++) {
+        Value arg = deserialize(vm, task->items->as.list.items[i]);
+        push(vm, arg);
+        Value result;
+        if (runClosure(vm, closure, &result, &arg, 1) != INTERPRET_OK) {
+            failed = true;
+            break;
+        }
+        pop(vm);
+        Message* message = serialize(result, 0, &task->badType);
+        if (message == NULL) {
+            failed = true;
+        } else {
+            task->results->as.list.items[task->results->as.list.count++] = message;
+        }
+    }
+
+    freeVM(vm);
+    fflush(stdout);
+    task->failed = failed;
+    return NULL;
+}
+
+static void freeMapTasks(MapTask* tasks, int count) {
+    for (int i = 0; i < count; i++) {
+        freeMessage(tasks[i].function);
+        freeMessage(tasks[i].upvalues);
+        freeMessage(tasks[i].items);
+        freeMessage(tasks[i].results);
+    }
+    free(tasks);
+}
+
+// 列表。并行映射（功能，线程数）; args[-1] holds the list.
+bool listParallelMapNative(VM* vm, int argCount, Value* args) {
+    if (!IS_CLOSURE(args[0])) {
+        return nativeError(vm, args, L"参数 1（功能）的类型必须是「关闭」，而不是「%ls」。", getType(args[0]));
+    } else if (!IS_NUMBER(args[1])) {
+        return nativeError(vm, args, L"参数 2（线程数）的类型必须是「数字」，而不是「%ls」。", getType(args[1]));
+    }
+
+    ObjList* list = AS_LIST(args[-1]);
+    ObjClosure* closure = AS_CLOSURE(args[0]);
+    int threadCount = (int)AS_NUMBER(args[1]);
+    if (threadCount < 1) return nativeError(vm, args, L"线程数必须至少为 1。");
+    if (closure->function->arity != 1) {
+        return nativeError(vm, args, L"输入功能需要 1 个参数，但得到 %d。", closure->function->arity);
+    }
+    // Each thread gets its own copy of the captured variables, so writes to
+    // them could never be seen by the caller or by the other threads.
+    if (closure->function->writesUpvalues) {
+        return nativeError(vm, args, L"并行映射的功能不能修改捕获的变量。");
+    }
+
+    Value captured[UINT8_COUNT];
+    for (int i = 0; i < closure->upvalueCount; i++) captured[i] = *closure->upvalues[i]->location;
+    if (threadCount > list->count) threadCount = list->count;
+
+    // Copy everything out of this VM before starting any thread, since the
+    // threads adopt their messages' strings.
+    MapTask* tasks = (MapTask*)calloc(threadCount > 0 ? threadCount : 1, sizeof(MapTask));
+    if (tasks == NULL) exit(1);
+    for (int i = 0; i < threadCount; i++) {
+        MapTask* task = &tasks[i];
+        int start = (int)((long)list->count * i / threadCount);
+        int end = (int)((long)list->count * (i + 1) / threadCount);
+        const wchar_t* badType = NULL;
+        task->function = serializeFunction(closure->function, 0, &badType);
+        if (task->function != NULL) {
+            task->upvalues = listMessage(captured, closure->upvalueCount, &badType);
+            if (task->upvalues == NULL) {
+                freeMapTasks(tasks, threadCount);
+                return nativeError(vm, args, L"无法复制类型为「%ls」的捕获变量。", badType);
+            }
+            task->items = listMessage(list->items + start, end - start, &badType);
+        }
+        if (task->function == NULL || task->items == NULL) {
+            freeMapTasks(tasks, threadCount);
+            return nativeError(vm, args, L"无法发送类型为「%ls」的值。", badType);
+        }
+    }
+
+    flushOutput(&vm->output);
+    for (int i = 0; i < threadCount; i++) {
+        tasks[i].threaded = pthread_create(&tasks[i].thread, NULL, mapTaskMain, &tasks[i]) == 0;
+        if (!tasks[i].threaded) mapTaskMain(&tasks[i]);
+    }
+    bool failed = false;
+    const wchar_t* badType = NULL;
+    for (int i = 0; i < threadCount; i++) {
+        if (tasks[i].threaded) pthread_join(tasks[i].thread, NULL);
+        if (tasks[i].failed) {
+            failed = true;
+            if (badType == NULL) badType = tasks[i].badType;
+        }
+    }
+    if (failed) {
+        freeMapTasks(tasks, threadCount);
+        if (badType != NULL) return nativeError(vm, args, L"无法发送类型为「%ls」的值。", badType);
+        return nativeError(vm, args, L"并行映射因错误而终止。");
+    }
+
+    ObjList* mapped = newList(vm);
+    push(vm, OBJ_VAL(mapped));
+    for (int i = 0; i < threadCount; i++) {
+        Message* results = tasks[i].results;
+        for (int j = 0; j < results->as.list.count; j++) {
+            push(vm, deserialize(vm, results->as.list.items[j]));
+            insertToList(vm, mapped, vm->fiber->stackTop[-1], mapped->count);
+            pop(vm);
+        }
+    }
+    freeMapTasks(tasks, threadCount);
+    args[-1] = pop(vm);
+    return true;
+}
+
+void initWorkerClass(VM* vm) {
+    push(vm, OBJ_VAL(copyString(vm, L"工作者", 3)));
+    ObjClass* workerClass = newClass(vm, AS_STRING(vm->fiber->stackTop[-1]));
+    pop(vm);
+    push(vm, OBJ_VAL(workerClass));
+    defineNative(vm, L"创建", createNative, -1, workerClass);
+    defineNative(vm, L"发送", parentSendNative, 1, workerClass);
+    defineNative(vm, L"接收", parentReceiveNative, 0, workerClass);
+    ObjInstance* workerInstance = newInstance(vm, workerClass, true);
+    pop(vm);
+    push(vm, OBJ_VAL(workerInstance));
+    defineNativeInstance(vm, L"工作者", workerInstance);
+    pop(vm);
+}
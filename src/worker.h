@@ -0,0 +1,21 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+#ifndef QI_WORKER_H
+#define QI_WORKER_H
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+typedef struct Worker Worker;
+
+void initWorkerClass(VM* vm);
+void releaseWorker(Worker* worker);
+bool workerSendNative(VM* vm, int argCount, Value* args);
+bool workerReceiveNative(VM* vm, int argCount, Value* args);
+bool workerJoinNative(VM* vm, int argCount, Value* args);
+bool listParallelMapNative(VM* vm, int argCount, Value* args);
+
+#endif //QI_WORKER_H
@@ -0,0 +1,140 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+// Drives a VM through qi.h the way a host program does. CMake builds it as
+// qi_embed_test and ctest runs it; it prints what failed and exits with 1.
+
+#include <locale.h>
+#include <stdio.h>
+#include "qi.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (false)
+
+// Each call makes a box and then enough garbage for the collector to run
+// before the next one, which must not take the boxes already returned.
+static const char* script =
+    "变量 扩展 = 系统。加载扩展（\"" TEST_EXTENSION "\"）\n"
+    "功能 装（值）「\n"
+    "  变量 盒 = 扩展。盒子（值）\n"
+    "  变量 垃圾 = 【】\n"
+    "  对于（变量 i = 0；i 小 5000；i++）垃圾。推（【i】）\n"
+    "  返回 盒\n"
+    "」\n"
+    "功能 取（盒）「返回 盒。值（）」\n"
+    "功能 释放了（）「返回 扩展。已释放（）」\n";
+
+static void testForeignResults(QiVM* vm) {
+    QiHandle* box = qiGetGlobal(vm, "装");
+    QiHandle* read = qiGetGlobal(vm, "取");
+    QiHandle* freed = qiGetGlobal(vm, "释放了");
+
+    QiValue args[20], results[20];
+    for (int i = 0; i < 20; i++) {
+        args[i] = qiNumber(i);
+    }
+    CHECK(qiCallBatch(vm, box, 1, args, 20, results) == QI_OK);
+    QiValue count;
+    CHECK(qiCall(vm, freed, 0, NULL, &count) == QI_OK);
+    CHECK(count.type == QI_NUMBER && count.as.number == 0);
+    for (int i = 0; i < 20; i++) {
+        CHECK(results[i].type == QI_FOREIGN && *(double*)results[i].as.foreign.data == i);
+    }
+
+    // A result lasts through the next call, so it can be passed to it.
+    QiValue single;
+    CHECK(qiCall(vm, box, 1, &args[7], &single) == QI_OK);
+    QiValue value;
+    CHECK(qiCall(vm, read, 1, &single, &value) == QI_OK);
+    CHECK(value.type == QI_NUMBER && value.as.number == 7);
+
+    qiRelease(vm, box);
+    qiRelease(vm, read);
+    qiRelease(vm, freed);
+}
+
+static QiBudgetAction pause(QiVM* vm, void* data) {
+    (void)vm;
+    (*(int*)data)++;
+    return QI_BUDGET_PAUSE;
+}
+
+static void testBudget(QiVM* vm) {
+    // With no callback a loop that never ends is aborted.
+    qiSetBudget(vm, 1000, NULL, NULL);
+    CHECK(qiRun(vm, "而（真）「」", NULL) == QI_RUNTIME_ERROR);
+
+    // A paused script carries on where it stopped.
+    int pauses = 0;
+    qiSetBudget(vm, 1000, pause, &pauses);
+    QiResult result = qiRun(vm, "变量 和数 = 0 对于（变量 i = 0；i 小 10000；i++）和数 = 和数 + i", NULL);
+    while (result == QI_PAUSED) {
+        result = qiResume(vm);
+    }
+    CHECK(result == QI_OK);
+    CHECK(pauses >= 10);
+    qiSetBudget(vm, 0, NULL, NULL);
+
+    CHECK(qiRun(vm, "功能 读和（）「返回 和数」", NULL) == QI_OK);
+    QiHandle* read = qiGetGlobal(vm, "读和");
+    QiValue sum;
+    CHECK(qiCall(vm, read, 0, NULL, &sum) == QI_OK);
+    CHECK(sum.type == QI_NUMBER && sum.as.number == 49995000);
+    qiRelease(vm, read);
+}
+
+static QiBudgetAction yield(QiVM* vm, void* data) {
+    (void)vm;
+    (void)data;
+    return QI_BUDGET_YIELD;
+}
+
+// A task that never waits is preempted by the budget, and the timer of a
+// sleeping one still fires while it runs.
+static const char* tasks =
+    "变量 醒了 = 假\n"
+    "变量 看到 = 假\n"
+    "功能 睡者（）「\n"
+    "  事件。睡眠（0.05）\n"
+    "  醒了 = 真\n"
+    "」\n"
+    "功能 忙者（）「\n"
+    "  变量 i = 0\n"
+    "  而（不 醒了 和 i 小 30000000）i = i + 1\n"
+    "  看到 = 醒了\n"
+    "」\n"
+    "事件。启动（睡者）\n"
+    "事件。启动（忙者）\n"
+    "事件。运行（）\n"
+    "功能 看到了（）「返回 看到」\n";
+
+static void testYield(QiVM* vm) {
+    qiSetBudget(vm, 100000, yield, NULL);
+    CHECK(qiRun(vm, tasks, NULL) == QI_OK);
+    qiSetBudget(vm, 0, NULL, NULL);
+    QiHandle* seen = qiGetGlobal(vm, "看到了");
+    QiValue value;
+    CHECK(qiCall(vm, seen, 0, NULL, &value) == QI_OK);
+    CHECK(value.type == QI_BOOL && value.as.boolean);
+    qiRelease(vm, seen);
+}
+
+int main(void) {
+    setlocale(LC_ALL, "C.UTF-8");
+    QiVM* vm = qiNewVM();
+    CHECK(vm != NULL);
+    CHECK(qiRun(vm, script, NULL) == QI_OK);
+    testForeignResults(vm);
+    testBudget(vm);
+    testYield(vm);
+    qiFreeVM(vm);
+    return failures == 0 ? 0 : 1;
+}
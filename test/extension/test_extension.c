@@ -0,0 +1,103 @@
+//
+// Created by Troy Zhong on 10/17/26.
+//
+
+// The extension the tests in this directory load. CMake builds it next to
+// the interpreter as libqi_test_extension.so.
+
+#include "qi.h"
+
+typedef struct {
+    double value;
+} Box;
+
+// Refers to a box, which its trace hook keeps alive.
+typedef struct {
+    QiValue box;
+} Ref;
+
+static QiHandle* boxClass;
+static QiHandle* refClass;
+static int finalized = 0;
+
+static void finalizeBox(void* data) {
+    finalized++;
+}
+
+static void traceRef(QiVM* vm, void* data) {
+    qiMark(vm, ((Ref*)data)->box);
+}
+
+static const QiForeignClass boxType = {sizeof(Box), NULL, finalizeBox};
+static const QiForeignClass refType = {sizeof(Ref), traceRef, NULL};
+
+static bool hypotenuse(QiVM* vm, const QiValue* args, QiValue* result) {
+    double a = args[0].as.number;
+    double b = args[1].as.number;
+    *result = qiNumber(a * a + b * b);
+    return true;
+}
+
+static bool add(QiVM* vm, const QiValue* args, QiValue* result) {
+    *result = qiNumber(args[0].as.number + (args[1].type == QI_NIL ? 100 : args[1].as.number));
+    return true;
+}
+
+static bool wrongType(QiVM* vm, const QiValue* args, QiValue* result) {
+    *result = qiString("不是数字");
+    return true;
+}
+
+static bool fail(QiVM* vm, const QiValue* args, QiValue* result) {
+    *result = qiString("坏了");
+    return false;
+}
+
+static bool apply(QiVM* vm, const QiValue* args, QiValue* result) {
+    QiValue arg = qiString("回调");
+    return qiCall(vm, args[0].as.handle, 1, &arg, result) == QI_OK;
+}
+
+static bool newBox(QiVM* vm, const QiValue* args, QiValue* result) {
+    *result = qiNewForeign(vm, boxClass);
+    ((Box*)result->as.foreign.data)->value = args[0].as.number;
+    return true;
+}
+
+static bool boxValue(QiVM* vm, const QiValue* args, QiValue* result) {
+    *result = qiNumber(((Box*)args[-1].as.foreign.data)->value);
+    return true;
+}
+
+static bool newRef(QiVM* vm, const QiValue* args, QiValue* result) {
+    *result = qiNewForeign(vm, refClass);
+    ((Ref*)result->as.foreign.data)->box = args[-1];
+    return true;
+}
+
+static bool refValue(QiVM* vm, const QiValue* args, QiValue* result) {
+    Box* box = ((Ref*)args[-1].as.foreign.data)->box.as.foreign.data;
+    *result = qiNumber(box->value);
+    return true;
+}
+
+static bool finalizedCount(QiVM* vm, const QiValue* args, QiValue* result) {
+    *result = qiNumber(finalized);
+    return true;
+}
+
+bool qiExtensionInit(QiVM* vm, QiHandle* extension) {
+    boxClass = qiDefineForeignClass(vm, "盒子", &boxType);
+    refClass = qiDefineForeignClass(vm, "引用", &refType);
+    return qiDefineNative(vm, extension, "平方和", "(num, num) -> num", hypotenuse) &&
+           qiDefineNative(vm, extension, "加", "(num 甲, num 乙?) -> num", add) &&
+           qiDefineNative(vm, extension, "错型", "() -> num", wrongType) &&
+           qiDefineNative(vm, extension, "失败", "()", fail) &&
+           qiDefineNative(vm, extension, "应用", "(any 功能) -> any", apply) &&
+           qiDefineNative(vm, extension, "盒子", "(num 值) -> any", newBox) &&
+           qiDefineNative(vm, extension, "已释放", "() -> num", finalizedCount) &&
+           qiDefineNative(vm, boxClass, "值", "() -> num", boxValue) &&
+           qiDefineNative(vm, boxClass, "引用", "() -> any", newRef) &&
+           qiDefineNative(vm, refClass, "值", "() -> num", refValue) &&
+           !qiDefineNative(vm, extension, "坏", "(num...)", add);
+}
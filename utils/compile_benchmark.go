@@ -0,0 +1,78 @@
+package main
+
+import (
+	`bufio`
+	`flag`
+	`fmt`
+	`os`
+	`os/exec`
+	`path/filepath`
+	`time`
+)
+
+// Measures how fast qi loads and compiles a large generated script, in MB/s.
+// Usage: go run compile_benchmark.go [-size MB] [-trials n] [interpreters...]
+//
+// The script is one function that is never called, so running it costs
+// nothing and the time is all loading and compiling. Its body mixes ASCII
+// and CJK names, operators and comments in blocks that only use locals, so
+// no chunk runs out of constants however large the script gets.
+
+func main() {
+	size := flag.Int("size", 50, "size of the generated script in MB")
+	trials := flag.Int("trials", 5, "runs per interpreter; the best is kept")
+	flag.Parse()
+
+	interpreters := flag.Args()
+	if len(interpreters) == 0 { interpreters = []string{"../src/cmake-build-release/qi"} }
+
+	script := filepath.Join(os.TempDir(), fmt.Sprintf("qi_compile_benchmark_%d.qi", os.Getpid()))
+	bytes := generate(script, *size * 1024 * 1024)
+	defer os.Remove(script)
+	megabytes := float64(bytes) / (1024 * 1024)
+	fmt.Printf("script: %.1f MB\n", megabytes)
+
+	for _, interpreter := range interpreters {
+		best := 9999.
+		for trial := 0; trial < *trials; trial++ {
+			elapsed := runTrial(interpreter, script)
+			if elapsed < best { best = elapsed }
+		}
+		fmt.Printf("  %30s  best %.3fs  %.1f MB/s\n", interpreter, best, megabytes / best)
+	}
+}
+
+func generate(path string, size int) int {
+	file, err := os.Create(path)
+	if err != nil {
+		fmt.Println(err.Error())
+		os.Exit(1)
+	}
+	defer file.Close()
+	writer := bufio.NewWriter(file)
+	defer writer.Flush()
+
+	written, _ := writer.WriteString("功能 未调用（）「\n")
+	for written < size {
+		n, _ := writer.WriteString(`  「
+    变量 generatedValue = 真   // a generated line of ASCII text
+    变量 生成的标识符 = generatedValue 和 不 假 或 空 等 空
+    /* 生成的注释 */ 生成的标识符 = generatedValue 或 生成的标识符
+  」
+`)
+		written += n
+	}
+	n, _ := writer.WriteString("」\n")
+	return written + n
+}
+
+func runTrial(interpreter string, script string) float64 {
+	cmd := exec.Command(interpreter, script)
+	cmd.Stderr = os.Stderr
+	start := time.Now()
+	if err := cmd.Run(); err != nil {
+		fmt.Println(err.Error())
+		os.Exit(1)
+	}
+	return time.Since(start).Seconds()
+}
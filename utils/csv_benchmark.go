@@ -0,0 +1,128 @@
+package main
+
+import (
+	`bufio`
+	`flag`
+	`fmt`
+	`math`
+	`math/rand`
+	`os`
+	`os/exec`
+	`path/filepath`
+	`strconv`
+	`strings`
+	`time`
+)
+
+// Measures how fast qi reads a large CSV file with the CSV class, in MB/s,
+// next to Python's csv module when python3 is around.
+// Usage: go run csv_benchmark.go [-size MB] [-trials n] [interpreters...]
+//
+// The file has a header and rows of ids, CJK names, cities from a short
+// list, prices and quoted comments. Each interpreter reads it three ways:
+// as lists of strings, as header-keyed rows with numbers converted, and as
+// raw 字节 fields.
+
+const qiScript = `变量 表 = CSV。打开（"%[1]s"）%[2]s
+%[3]s
+变量 数 = 0
+变量 行 = 表。下一个（）
+而（行 不等 空）「
+  数 = 数 + 1
+  行 = 表。下一个（）
+」
+系统。打印行（数）
+`
+
+const pythonScript = `import csv, sys
+with open(sys.argv[1], newline='', encoding='utf-8') as file:
+    rows = csv.DictReader(file) if sys.argv[2] == 'header' else csv.reader(file)
+    count = sum(1 for _ in rows)
+print(count - (sys.argv[2] != 'header'))
+`
+
+func main() {
+	size := flag.Int("size", 1024, "size of the generated file in MB")
+	trials := flag.Int("trials", 1, "runs per way of reading; the best is kept")
+	flag.Parse()
+
+	interpreters := flag.Args()
+	if len(interpreters) == 0 { interpreters = []string{"../src/cmake-build-release/qi"} }
+
+	directory, err := os.MkdirTemp("", "qi_csv_benchmark")
+	check(err)
+	defer os.RemoveAll(directory)
+	input := filepath.Join(directory, "input.csv")
+	rows := generate(input, *size * 1024 * 1024)
+	info, err := os.Stat(input)
+	check(err)
+	megabytes := float64(info.Size()) / (1024 * 1024)
+	fmt.Printf("file: %.1f MB, %d rows\n", megabytes, rows)
+
+	report := func(name string, cmd func() *exec.Cmd) {
+		best := 99999.
+		for trial := 0; trial < *trials; trial++ {
+			run := cmd()
+			run.Stderr = os.Stderr
+			start := time.Now()
+			output, err := run.Output()
+			check(err)
+			if elapsed := time.Since(start).Seconds(); elapsed < best { best = elapsed }
+			// qi prints numbers with %g, so compare them as numbers.
+			if counted, _ := strconv.ParseFloat(strings.TrimSpace(string(output)), 64); math.Abs(counted - float64(rows)) > float64(rows) * 1e-5 {
+				fmt.Printf("%s counted %s rows\n", name, strings.TrimSpace(string(output)))
+				os.Exit(1)
+			}
+		}
+		fmt.Printf("  %-45s  best %.2fs  %.1f MB/s\n", name, best, megabytes / best)
+	}
+
+	if python, err := exec.LookPath("python3"); err == nil {
+		script := filepath.Join(directory, "benchmark.py")
+		check(os.WriteFile(script, []byte(pythonScript), 0644))
+		for _, way := range []string{"lists", "header"} {
+			report("python3 csv " + way, func() *exec.Cmd { return exec.Command(python, script, input, way) })
+		}
+	}
+	ways := []struct{ name, options, header string }{
+		{"lists", "", "表。下一个（）"},
+		{"header", "。转数字（）", "表。表头（）"},
+		{"raw", "。原始（）", "表。下一个（）"},
+	}
+	for _, interpreter := range interpreters {
+		for _, way := range ways {
+			script := filepath.Join(directory, way.name + ".qi")
+			check(os.WriteFile(script, []byte(fmt.Sprintf(qiScript, input, way.options, way.header)), 0644))
+			report(interpreter + " " + way.name, func() *exec.Cmd { return exec.Command(interpreter, script) })
+		}
+	}
+}
+
+func generate(path string, size int) int {
+	file, err := os.Create(path)
+	check(err)
+	defer file.Close()
+	writer := bufio.NewWriter(file)
+	defer writer.Flush()
+
+	random := rand.New(rand.NewSource(1))
+	cities := []string{"北京", "上海", "广州", "深圳", "Toronto", "San Francisco", "東京"}
+	names := []string{"张", "王", "李", "赵", "陈", "Smith", "García"}
+	written, _ := fmt.Fprintln(writer, "编号,姓名,城市,价格,数量,备注")
+	rows := 0
+	for ; written < size; rows++ {
+		comment := "无"
+		if rows % 5 == 0 { comment = "\"说 \"\"你好\"\", 然后离开\"" }
+		n, _ := fmt.Fprintf(writer, "%d,%s%d,%s,%.2f,%d,%s\n", rows, names[random.Intn(len(names))], random.Intn(1000),
+			cities[random.Intn(len(cities))], random.Float64() * 1000, random.Intn(100), comment)
+		written += n
+	}
+	return rows
+}
+
+func check(err error) {
+	if err != nil {
+		fmt.Println(err.Error())
+		os.Exit(1)
+	}
+}
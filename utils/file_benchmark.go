@@ -0,0 +1,116 @@
+package main
+
+import (
+	`bufio`
+	`flag`
+	`fmt`
+	`os`
+	`os/exec`
+	`path/filepath`
+	`strings`
+	`time`
+)
+
+// Measures how fast qi copies a large text file with the 文件 class, in MB/s,
+// next to `cat` doing the same copy.
+// Usage: go run file_benchmark.go [-size MB] [-trials n] [interpreters...]
+//
+// The file has log-like lines mixing ASCII and CJK text. Each interpreter
+// copies it twice: whole, with 文件。读取 and 文件。写入, and line by line,
+// with 读行 and 写行.
+
+const wholeCopy = `文件。写入（"%[2]s"，文件。读取（"%[1]s"））
+`
+
+const lineCopy = `变量 输入 = 文件。打开（"%[1]s"）
+变量 输出 = 文件。打开（"%[2]s"，"写"）
+变量 行 = 输入。读行（）
+而（行 不等 空）「
+  输出。写行（行）
+  行 = 输入。读行（）
+」
+输出。关闭（）
+`
+
+func main() {
+	size := flag.Int("size", 200, "size of the generated file in MB")
+	trials := flag.Int("trials", 3, "runs per copy; the best is kept")
+	flag.Parse()
+
+	interpreters := flag.Args()
+	if len(interpreters) == 0 { interpreters = []string{"../src/cmake-build-release/qi"} }
+
+	directory, err := os.MkdirTemp("", "qi_file_benchmark")
+	check(err)
+	defer os.RemoveAll(directory)
+	input := filepath.Join(directory, "input.log")
+	output := filepath.Join(directory, "output.log")
+	bytes := generate(input, *size * 1024 * 1024)
+	megabytes := float64(bytes) / (1024 * 1024)
+	fmt.Printf("file: %.1f MB\n", megabytes)
+
+	report := func(name string, run func()) {
+		best := 9999.
+		for trial := 0; trial < *trials; trial++ {
+			os.Remove(output)
+			start := time.Now()
+			run()
+			if elapsed := time.Since(start).Seconds(); elapsed < best { best = elapsed }
+			verify(input, output)
+		}
+		fmt.Printf("  %-45s  best %.3fs  %.1f MB/s\n", name, best, megabytes / best)
+	}
+
+	report("cat", func() {
+		file, err := os.Create(output)
+		check(err)
+		defer file.Close()
+		cmd := exec.Command("cat", input)
+		cmd.Stdout = file
+		check(cmd.Run())
+	})
+	for _, interpreter := range interpreters {
+		for _, copy := range []struct{ name, script string }{{"whole", wholeCopy}, {"lines", lineCopy}} {
+			script := filepath.Join(directory, copy.name + ".qi")
+			check(os.WriteFile(script, []byte(fmt.Sprintf(copy.script, input, output)), 0644))
+			report(interpreter + " " + copy.name, func() {
+				cmd := exec.Command(interpreter, script)
+				cmd.Stderr = os.Stderr
+				check(cmd.Run())
+			})
+		}
+	}
+}
+
+func generate(path string, size int) int {
+	file, err := os.Create(path)
+	check(err)
+	defer file.Close()
+	writer := bufio.NewWriter(file)
+	defer writer.Flush()
+
+	written := 0
+	for i := 0; written < size; i++ {
+		n, _ := fmt.Fprintf(writer, "2026-10-17 12:%02d:%02d 信息 请求 /api/v1/项目/%d 完成，用时 %dms\n", i / 60 % 60, i % 60, i, i % 997)
+		written += n
+	}
+	return written
+}
+
+func verify(input string, output string) {
+	a, err := os.Stat(input)
+	check(err)
+	b, err := os.Stat(output)
+	check(err)
+	if a.Size() != b.Size() {
+		fmt.Println(strings.Join([]string{"copy of", input, "has the wrong size"}, " "))
+		os.Exit(1)
+	}
+}
+
+func check(err error) {
+	if err != nil {
+		fmt.Println(err.Error())
+		os.Exit(1)
+	}
+}
@@ -0,0 +1,153 @@
+package main
+
+import (
+	`bufio`
+	`flag`
+	`fmt`
+	`math/rand`
+	`os`
+	`os/exec`
+	`path/filepath`
+	`strconv`
+	`strings`
+)
+
+// Measures how fast qi parses and serializes JSON with JSON。解析 and
+// JSON。编码, in MB/s, next to Python's json module when python3 is around.
+// Usage: go run json_benchmark.go [-corpus dir] [-trials n] [interpreters...]
+//
+// The corpus is twitter.json and canada.json from the usual JSON benchmark
+// suites if -corpus has them, and generated look-alikes otherwise: one full
+// of short strings, many in CJK, and one full of coordinates.
+
+const qiScript = `变量 文本 = 文件。读取（"%[1]s"，"字节"）
+变量 值 = JSON。解析（文本）
+变量 解析 = 9999
+变量 编码 = 9999
+对于（变量 i = 0；i 小 %[2]d；i = i + 1）「
+  变量 开始 = 系统。时钟（）
+  值 = JSON。解析（文本）
+  解析 = 数字。最小（解析，系统。时钟（） - 开始）
+  开始 = 系统。时钟（）
+  JSON。编码（值）
+  编码 = 数字。最小（编码，系统。时钟（） - 开始）
+」
+系统。打印行（解析）
+系统。打印行（编码）
+`
+
+const pythonScript = `import json, sys, time
+text = open(sys.argv[1], 'rb').read()
+parse = encode = 9999
+for _ in range(int(sys.argv[2])):
+    start = time.perf_counter()
+    value = json.loads(text)
+    parse = min(parse, time.perf_counter() - start)
+    start = time.perf_counter()
+    json.dumps(value, ensure_ascii=False).encode()
+    encode = min(encode, time.perf_counter() - start)
+print(parse)
+print(encode)
+`
+
+func main() {
+	corpus := flag.String("corpus", "", "directory holding twitter.json and canada.json")
+	trials := flag.Int("trials", 10, "parses and encodings per file; the best is kept")
+	flag.Parse()
+
+	interpreters := flag.Args()
+	if len(interpreters) == 0 { interpreters = []string{"../src/cmake-build-release/qi"} }
+
+	directory, err := os.MkdirTemp("", "qi_json_benchmark")
+	check(err)
+	defer os.RemoveAll(directory)
+
+	files := []struct{ name string; generate func(string) }{
+		{"twitter.json", generateTweets},
+		{"canada.json", generateCoordinates},
+	}
+	for _, file := range files {
+		path := filepath.Join(*corpus, file.name)
+		if _, err := os.Stat(path); *corpus == "" || err != nil {
+			path = filepath.Join(directory, file.name)
+			file.generate(path)
+		}
+		info, err := os.Stat(path)
+		check(err)
+		megabytes := float64(info.Size()) / (1024 * 1024)
+		fmt.Printf("%s: %.2f MB\n", path, megabytes)
+
+		report := func(name string, cmd *exec.Cmd) {
+			cmd.Stderr = os.Stderr
+			output, err := cmd.Output()
+			check(err)
+			times := strings.Fields(string(output))
+			parse, _ := strconv.ParseFloat(times[0], 64)
+			encode, _ := strconv.ParseFloat(times[1], 64)
+			fmt.Printf("  %-40s  parse %7.1f MB/s  encode %7.1f MB/s\n", name, megabytes / parse, megabytes / encode)
+		}
+
+		if python, err := exec.LookPath("python3"); err == nil {
+			script := filepath.Join(directory, "benchmark.py")
+			check(os.WriteFile(script, []byte(pythonScript), 0644))
+			report("python3 json", exec.Command(python, script, path, strconv.Itoa(*trials)))
+		}
+		for _, interpreter := range interpreters {
+			script := filepath.Join(directory, "json.qi")
+			check(os.WriteFile(script, []byte(fmt.Sprintf(qiScript, path, *trials)), 0644))
+			report(interpreter, exec.Command(interpreter, script))
+		}
+	}
+}
+
+// Writes about 400KB of status updates shaped like twitter.json.
+func generateTweets(path string) {
+	file, err := os.Create(path)
+	check(err)
+	defer file.Close()
+	writer := bufio.NewWriter(file)
+	defer writer.Flush()
+
+	random := rand.New(rand.NewSource(1))
+	words := []string{"今天", "天气", "很好", "the", "quick", "brown", "fox", "你好", "世界", "齐语言", "@user", "#json", "😀"}
+	fmt.Fprint(writer, "{\"statuses\": [")
+	for i := 0; i < 600; i++ {
+		if i > 0 { fmt.Fprint(writer, ",") }
+		text := make([]string, 8 + random.Intn(12))
+		for j := range text { text[j] = words[random.Intn(len(words))] }
+		fmt.Fprintf(writer, "\n  {\"id\": %d, \"id_str\": \"%d\", \"text\": %s, \"truncated\": false,", 505874924095815681 + i, 505874924095815681 + i, strconv.Quote(strings.Join(text, " ")))
+		fmt.Fprintf(writer, " \"user\": {\"id\": %d, \"name\": \"用户%d\", \"screen_name\": \"user_%d\", \"location\": \"東京\", \"followers_count\": %d, \"verified\": %t,", random.Intn(1 << 30), i, i, random.Intn(100000), i % 7 == 0)
+		fmt.Fprintf(writer, " \"profile_image_url\": \"http:\\/\\/pbs.twimg.com\\/profile_images\\/%d\\/normal.jpeg\", \"description\": \"\\u30e1\\u30fc\\u30eb \\\"quoted\\\" line\\nbreak\"},", random.Intn(1 << 30))
+		fmt.Fprintf(writer, " \"retweet_count\": %d, \"favorite_count\": %d, \"entities\": {\"hashtags\": [], \"urls\": [], \"user_mentions\": [{\"id\": %d, \"indices\": [0, 10]}]}, \"geo\": null, \"lang\": \"ja\"}", random.Intn(500), random.Intn(500), random.Intn(1 << 30))
+	}
+	fmt.Fprint(writer, "\n]}\n")
+}
+
+// Writes about 2MB of polygon coordinates shaped like canada.json.
+func generateCoordinates(path string) {
+	file, err := os.Create(path)
+	check(err)
+	defer file.Close()
+	writer := bufio.NewWriter(file)
+	defer writer.Flush()
+
+	random := rand.New(rand.NewSource(1))
+	fmt.Fprint(writer, "{\"type\": \"FeatureCollection\", \"features\": [{\"type\": \"Feature\", \"properties\": {\"name\": \"Canada\"}, \"geometry\": {\"type\": \"Polygon\", \"coordinates\": [")
+	for ring := 0; ring < 50; ring++ {
+		if ring > 0 { fmt.Fprint(writer, ",") }
+		fmt.Fprint(writer, "[")
+		for point := 0; point < 1000; point++ {
+			if point > 0 { fmt.Fprint(writer, ",") }
+			fmt.Fprintf(writer, "[%s,%s]", strconv.FormatFloat(-141 + random.Float64() * 90, 'f', 15, 64), strconv.FormatFloat(41 + random.Float64() * 42, 'f', 15, 64))
+		}
+		fmt.Fprint(writer, "]")
+	}
+	fmt.Fprint(writer, "]}}]}\n")
+}
+
+func check(err error) {
+	if err != nil {
+		fmt.Println(err.Error())
+		os.Exit(1)
+	}
+}
@@ -0,0 +1,152 @@
+package main
+
+import (
+	`bufio`
+	`flag`
+	`fmt`
+	`math`
+	`math/rand`
+	`os`
+	`os/exec`
+	`path/filepath`
+	`strconv`
+	`strings`
+	`time`
+)
+
+// Measures how fast qi searches a large log with 正则, in MB/s, next to
+// Python's re module when python3 is around.
+// Usage: go run regex_benchmark.go [-size MB] [-trials n] [interpreters...]
+//
+// The log has lines of timestamps, levels, workers, requests, statuses
+// and timings, some with CJK messages. Each pattern is run over every line
+// the way a log-parsing script would, except the last, which counts the
+// matches in the whole file read as one string.
+
+type pattern struct {
+	name, regex, method string
+	whole               bool
+}
+
+var patterns = []pattern{
+	{"literal", `ERROR`, "测试", false},
+	{"status", ` 5\d\d `, "测试", false},
+	{"groups", `(GET|POST) (/api/\w+)/(\d+) (\d{3}) (\d+)ms`, "搜索", false},
+	{"alternation", `timeout|refused`, "测试", false},
+	{"whole file", `\d+ms`, "计数", true},
+}
+
+const qiLines = `变量 正则式 = 正则。编译（"%[2]s"）
+变量 日志 = 读取器。打开（"%[1]s"）
+变量 数 = 0
+变量 行 = 日志。读行（）
+而（行 不等 空）「
+  变量 结果 = 正则式。%[3]s（行）
+  如果（结果 不等 空 和 结果 不等 假）数 = 数 + 1
+  行 = 日志。读行（）
+」
+系统。打印行（数）
+`
+
+const qiWhole = `变量 正则式 = 正则。编译（"%[2]s"）
+系统。打印行（正则式。计数（文件。读取（"%[1]s"）））
+`
+
+const pythonScript = `import re, sys
+pattern = re.compile(sys.argv[2])
+if sys.argv[3] == 'whole':
+    with open(sys.argv[1], encoding='utf-8') as file:
+        print(len(pattern.findall(file.read())))
+else:
+    with open(sys.argv[1], encoding='utf-8') as file:
+        print(sum(1 for line in file if pattern.search(line)))
+`
+
+func main() {
+	size := flag.Int("size", 64, "size of the generated log in MB")
+	trials := flag.Int("trials", 1, "runs per pattern; the best is kept")
+	flag.Parse()
+
+	interpreters := flag.Args()
+	if len(interpreters) == 0 { interpreters = []string{"../src/cmake-build-release/qi"} }
+
+	directory, err := os.MkdirTemp("", "qi_regex_benchmark")
+	check(err)
+	defer os.RemoveAll(directory)
+	input := filepath.Join(directory, "input.log")
+	generate(input, *size * 1024 * 1024)
+	info, err := os.Stat(input)
+	check(err)
+	megabytes := float64(info.Size()) / (1024 * 1024)
+	fmt.Printf("log: %.1f MB\n", megabytes)
+
+	python, pythonErr := exec.LookPath("python3")
+	script := filepath.Join(directory, "benchmark.py")
+	check(os.WriteFile(script, []byte(pythonScript), 0644))
+
+	for _, p := range patterns {
+		fmt.Printf("%s: %s\n", p.name, p.regex)
+		expected := ""
+		report := func(name string, cmd func() *exec.Cmd) {
+			best := 99999.
+			for trial := 0; trial < *trials; trial++ {
+				run := cmd()
+				run.Stderr = os.Stderr
+				start := time.Now()
+				output, err := run.Output()
+				check(err)
+				if elapsed := time.Since(start).Seconds(); elapsed < best { best = elapsed }
+				// qi prints numbers with %g, so compare them as numbers.
+				counted, _ := strconv.ParseFloat(strings.TrimSpace(string(output)), 64)
+				if want, err := strconv.ParseFloat(expected, 64); err == nil && math.Abs(counted - want) > want * 1e-5 {
+					fmt.Printf("%s counted %s, not %s\n", name, strings.TrimSpace(string(output)), expected)
+					os.Exit(1)
+				}
+				if expected == "" { expected = strings.TrimSpace(string(output)) }
+			}
+			fmt.Printf("  %-45s  best %.2fs  %.1f MB/s\n", name, best, megabytes / best)
+		}
+
+		if pythonErr == nil {
+			way := "lines"
+			if p.whole { way = "whole" }
+			report("python3 re", func() *exec.Cmd { return exec.Command(python, script, input, p.regex, way) })
+		}
+		for _, interpreter := range interpreters {
+			qi := filepath.Join(directory, "regex.qi")
+			source := fmt.Sprintf(qiLines, input, p.regex, p.method)
+			if p.whole { source = fmt.Sprintf(qiWhole, input, p.regex) }
+			check(os.WriteFile(qi, []byte(source), 0644))
+			report(interpreter, func() *exec.Cmd { return exec.Command(interpreter, qi) })
+		}
+	}
+}
+
+func generate(path string, size int) {
+	file, err := os.Create(path)
+	check(err)
+	defer file.Close()
+	writer := bufio.NewWriter(file)
+	defer writer.Flush()
+
+	random := rand.New(rand.NewSource(1))
+	levels := []string{"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"}
+	methods := []string{"GET", "GET", "POST", "PUT"}
+	resources := []string{"users", "orders", "items", "订单"}
+	statuses := []int{200, 200, 200, 201, 304, 404, 500, 503}
+	messages := []string{"ok", "connection refused", "upstream timeout", "缓存命中", "用户已登录", "slow query"}
+	for written := 0; written < size; {
+		n, _ := fmt.Fprintf(writer, "2026-10-17 %02d:%02d:%02d.%03d %s [worker-%d] %s /api/%s/%d %d %dms %s\n",
+			random.Intn(24), random.Intn(60), random.Intn(60), random.Intn(1000), levels[random.Intn(len(levels))],
+			random.Intn(16), methods[random.Intn(len(methods))], resources[random.Intn(len(resources))], random.Intn(100000),
+			statuses[random.Intn(len(statuses))], random.Intn(2000), messages[random.Intn(len(messages))])
+		written += n
+	}
+}
+
+func check(err error) {
+	if err != nil {
+		fmt.Println(err.Error())
+		os.Exit(1)
+	}
+}
@@ -0,0 +1,116 @@
+package main
+
+import (
+	`bufio`
+	`flag`
+	`fmt`
+	`io`
+	`net`
+	`os`
+	`os/exec`
+	`path/filepath`
+	`sort`
+	`strings`
+	`sync`
+	`time`
+)
+
+// Load-tests `qi --serve` against starting a new `qi` process per request.
+// Usage: go run serve_benchmark.go [-interpreter path] [-requests n] [-concurrency n] [benchmark]
+
+func main() {
+	interpreter := flag.String("interpreter", "../src/cmake-build-release/qi", "qi binary to test")
+	requests := flag.Int("requests", 2000, "requests to send")
+	concurrency := flag.Int("concurrency", 8, "clients sending at once, and server workers")
+	flag.Parse()
+
+	benchmark := "request"
+	if flag.NArg() > 0 { benchmark = flag.Arg(0) }
+	script, _ := filepath.Abs(filepath.Join("..", "test", "benchmark", "qi", benchmark + ".qi"))
+
+	socket := filepath.Join(os.TempDir(), fmt.Sprintf("qi_serve_benchmark_%d.sock", os.Getpid()))
+	server := exec.Command(*interpreter, "--serve", socket, "--workers", fmt.Sprint(*concurrency), script)
+	server.Stderr = os.Stderr
+	if err := server.Start(); err != nil {
+		fmt.Println(err.Error())
+		os.Exit(1)
+	}
+	defer server.Process.Signal(os.Interrupt)
+	waitForSocket(socket)
+
+	served := runLoad(*requests, *concurrency, func() error { return request(socket, script) })
+	spawned := runLoad(*requests, *concurrency, func() error { return exec.Command(*interpreter, script).Run() })
+
+	report("qi --serve", served)
+	report("qi per request", spawned)
+	fmt.Printf("  --serve handles %.2fx the requests per second\n", served.perSecond / spawned.perSecond)
+}
+
+type result struct {
+	perSecond float64
+	latencies []time.Duration
+}
+
+func waitForSocket(socket string) {
+	for i := 0; i < 100; i++ {
+		if connection, err := net.Dial("unix", socket); err == nil {
+			connection.Close()
+			return
+		}
+		time.Sleep(50 * time.Millisecond)
+	}
+	fmt.Println("server did not start")
+	os.Exit(1)
+}
+
+// Sends one request and checks it ran cleanly.
+func request(socket string, script string) error {
+	connection, err := net.Dial("unix", socket)
+	if err != nil { return err }
+	defer connection.Close()
+
+	if _, err := io.WriteString(connection, script + "\n"); err != nil { return err }
+	reader := bufio.NewReader(connection)
+	header, err := reader.ReadString('\n')
+	if err != nil { return err }
+	var code, outLength, errLength int
+	if _, err := fmt.Sscanf(strings.TrimSpace(header), "%d %d %d", &code, &outLength, &errLength); err != nil { return err }
+	if _, err := io.CopyN(io.Discard, reader, int64(outLength + errLength)); err != nil { return err }
+	if code != 0 { return fmt.Errorf("request exited with %d", code) }
+	return nil
+}
+
+func runLoad(requests int, concurrency int, send func() error) result {
+	latencies := make([]time.Duration, requests)
+	next := make(chan int)
+	var group sync.WaitGroup
+	start := time.Now()
+
+	for i := 0; i < concurrency; i++ {
+		group.Add(1)
+		go func() {
+			defer group.Done()
+			for index := range next {
+				sent := time.Now()
+				if err := send(); err != nil {
+					fmt.Println(err.Error())
+					os.Exit(1)
+				}
+				latencies[index] = time.Since(sent)
+			}
+		}()
+	}
+	for i := 0; i < requests; i++ { next <- i }
+	close(next)
+	group.Wait()
+
+	elapsed := time.Since(start).Seconds()
+	sort.Slice(latencies, func(a, b int) bool { return latencies[a] < latencies[b] })
+	return result{float64(requests) / elapsed, latencies}
+}
+
+func report(name string, r result) {
+	p50 := r.latencies[len(r.latencies) / 2]
+	p99 := r.latencies[len(r.latencies) * 99 / 100]
+	fmt.Printf("  %-16s %8.0f requests/s  p50 %v  p99 %v\n", name, r.perSecond, p50, p99)
+}
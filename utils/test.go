@@ -5,12 +5,15 @@ import (
 	`bytes`
 	`flag`
 	`fmt`
+	`io`
+	`net`
 	`os`
 	`os/exec`
 	`path/filepath`
 	`regexp`
 	`strconv`
 	`strings`
+	`time`
 )
 
 var green = "\u001b[32m"
@@ -28,6 +31,8 @@ var expectedRuntimeErrorPattern, _ = regexp.Compile(`// 期待运行时错误：
 var syntaxErrorPattern, _ = regexp.Compile(`【.*行 (\d+)】(错误.+)`)
 var stackTracePattern, _ = regexp.Compile(`【行 (\d+)】`)
 var nonTestPattern, _ = regexp.Compile(`// 不考`)
+var imagePattern, _ = regexp.Compile(`// 映像：(.+)`)
+var resumedOutputPattern, _ = regexp.Compile(`// 恢复后期待：(.*)`)
 
 var passed int
 var failed int
@@ -47,6 +52,13 @@ func main() {
 		os.Exit(1)
 	}
 
+	// The tests in test/extension load extensions built next to the
+	// interpreter by name.
+	directory, err := filepath.Abs(filepath.Dir(interpreter))
+	if err == nil {
+		os.Setenv("LD_LIBRARY_PATH", directory)
+	}
+
 	if !runSuite() {
 		os.Exit(1)
 	}
@@ -62,6 +74,7 @@ func runSuite() bool {
 		runTest(path)
 		fmt.Printf("\r\033[K")
 	}
+	runServeTests()
 
 
 
@@ -119,6 +132,11 @@ type Test struct {
 
 	expectedExitCode int
 
+	// An image the test saves, which is resumed with --image afterwards.
+	image string
+
+	resumedOutput []ExpectedOutput
+
 	failures []string
 }
 
@@ -163,6 +181,19 @@ func parse(test Test) (Test, bool) {
 		match := nonTestPattern.FindStringSubmatch(line)
 		if len(match) != 0 { return test, false }
 
+		match = imagePattern.FindStringSubmatch(line)
+		if len(match) != 0 {
+			test.image = match[1]
+			continue
+		}
+
+		match = resumedOutputPattern.FindStringSubmatch(line)
+		if len(match) != 0 {
+			test.resumedOutput = append(test.resumedOutput, ExpectedOutput{lineNum, match[1]})
+			expectations++
+			continue
+		}
+
 		match = expectedOutputPattern.FindStringSubmatch(line)
 		if len(match) != 0  {
 			test.expectedOutput = append(test.expectedOutput, ExpectedOutput{lineNum, match[1]})
@@ -235,9 +266,57 @@ func run(test Test) []string {
 
 	test = validateExitCode(test, exitCode, errorLines)
 	test = validateOutput(test, outputLines)
+	if test.image != "" {
+		test = validateImage(test)
+	}
 	return test.failures
 }
 
+func runImage(path string) (string, string, int) {
+	cmd := exec.Command(interpreter, "--image", path)
+	var outb, errb bytes.Buffer
+	exitCode := 0
+	cmd.Stdout = &outb
+	cmd.Stderr = &errb
+	if err := cmd.Run(); err != nil {
+		exitError, ok := err.(*exec.ExitError)
+		if ok {
+			exitCode = exitError.ExitCode()
+		}
+	}
+	return outb.String(), errb.String(), exitCode
+}
+
+// Resumes the image the test saved and checks what it prints, then checks
+// that a copy with one byte changed is refused rather than run.
+func validateImage(test Test) Test {
+	output, errors, exitCode := runImage(test.image)
+	if exitCode != 0 {
+		test = fail(test, fmt.Sprintf("Expected resuming %s to succeed and got return code %d. Stderr:",
+			test.image, exitCode), strings.Split(errors, "\n"))
+	}
+	resumed := test
+	resumed.expectedOutput = test.resumedOutput
+	test = validateOutput(resumed, strings.Split(output, "\n"))
+
+	image, err := os.ReadFile(test.image)
+	if err != nil {
+		return fail(test, err.Error())
+	}
+	corrupt := test.image + ".corrupt"
+	image[len(image) / 2] ^= 0x10
+	if err := os.WriteFile(corrupt, image, 0644); err != nil {
+		return fail(test, err.Error())
+	}
+	_, errors, exitCode = runImage(corrupt)
+	os.Remove(corrupt)
+	if exitCode != 74 {
+		test = fail(test, fmt.Sprintf("Expected a damaged image to be refused with return code 74 and got %d. Stderr:",
+			exitCode), strings.Split(errors, "\n"))
+	}
+	return test
+}
+
 func validateRuntimeError(test Test, errorLines []string) Test {
 	if len(errorLines) < 2 {
 		test = fail(test, fmt.Sprintf("Expected runtime error '%s' and got none.", test.expectedRuntimeError))
@@ -358,6 +437,108 @@ func validateOutput(test Test, outputLines []string) Test {
 	return test
 }
 
+// Starts `qi --serve` with a budget and sends it requests for the scripts
+// in test/serve, checking the `code outLen errLen` header of each reply and
+// that exactly that much output follows it.
+func runServeTests() {
+	socket := filepath.Join(os.TempDir(), fmt.Sprintf("qi_test_serve_%d.sock", os.Getpid()))
+	server := exec.Command(interpreter, "--serve", socket, "--workers", "1", "--budget", "1000000", "--timeout", "1")
+	if err := server.Start(); err != nil {
+		reportServeTest("serve", []string{err.Error()})
+		return
+	}
+	defer func() {
+		server.Process.Signal(os.Interrupt)
+		server.Wait()
+	}()
+	if !waitForSocket(socket) {
+		reportServeTest("serve", []string{"The server did not start."})
+		return
+	}
+
+	greet, _ := filepath.Abs("../test/serve/greet.qi")
+	forever, _ := filepath.Abs("../test/serve/forever.qi")
+	reportServeTest("serve: script", checkServe(socket, greet, 0, "已加载\n", ""))
+	reportServeTest("serve: entry function", checkServe(socket, greet + "\t问候\t世界", 0, "已加载\n你好，世界\n", ""))
+	reportServeTest("serve: budget", checkServe(socket, forever, 70, "", "超出指令预算。"))
+	reportServeTest("serve: after budget", checkServe(socket, greet, 0, "已加载\n", ""))
+
+	// A client that never sends its request only holds the worker until the
+	// timeout.
+	if idle, err := net.Dial("unix", socket); err == nil {
+		defer idle.Close()
+	}
+	reportServeTest("serve: after idle client", checkServe(socket, greet, 0, "已加载\n", ""))
+}
+
+func waitForSocket(socket string) bool {
+	for i := 0; i < 100; i++ {
+		if connection, err := net.Dial("unix", socket); err == nil {
+			connection.Close()
+			return true
+		}
+		time.Sleep(50 * time.Millisecond)
+	}
+	return false
+}
+
+// Sends [request] and returns what was wrong with the reply. Only the first
+// line of stderr is compared, ahead of the stack trace.
+func checkServe(socket string, request string, code int, output string, errorLine string) []string {
+	connection, err := net.Dial("unix", socket)
+	if err != nil {
+		return []string{err.Error()}
+	}
+	defer connection.Close()
+	connection.SetDeadline(time.Now().Add(10 * time.Second))
+	if _, err := io.WriteString(connection, request + "\n"); err != nil {
+		return []string{err.Error()}
+	}
+
+	reader := bufio.NewReader(connection)
+	header, err := reader.ReadString('\n')
+	if err != nil {
+		return []string{fmt.Sprintf("Expected a header and got '%s'.", header)}
+	}
+	var gotCode, outLength, errLength int
+	if _, err := fmt.Sscanf(header, "%d %d %d\n", &gotCode, &outLength, &errLength); err != nil {
+		return []string{fmt.Sprintf("Expected 'code outLen errLen' and got '%s'.", strings.TrimSpace(header))}
+	}
+	body, err := io.ReadAll(reader)
+	if err != nil {
+		return []string{err.Error()}
+	}
+
+	var failures []string
+	if len(body) != outLength + errLength {
+		return append(failures, fmt.Sprintf("The header announced %d bytes and %d followed.", outLength + errLength, len(body)))
+	}
+	if gotCode != code {
+		failures = append(failures, fmt.Sprintf("Expected code %d and got %d.", code, gotCode))
+	}
+	if string(body[:outLength]) != output {
+		failures = append(failures, fmt.Sprintf("Expected output '%s' and got '%s'.", output, body[:outLength]))
+	}
+	stderr := string(body[outLength:])
+	if errorLine == "" && stderr != "" || errorLine != "" && strings.Split(stderr, "\n")[0] != errorLine {
+		failures = append(failures, fmt.Sprintf("Expected error '%s' and got '%s'.", errorLine, stderr))
+	}
+	return failures
+}
+
+func reportServeTest(name string, failures []string) {
+	expectations++
+	if len(failures) == 0 {
+		passed++
+		return
+	}
+	failed++
+	fmt.Printf("%sFAIL%s %s\n", red, resetColor, name)
+	for _, failure := range failures {
+		fmt.Printf("     %s%s%s\n", red, failure, resetColor)
+	}
+}
+
 func fail(test Test, message string, lines ...[]string) Test {
 	test.failures = append(test.failures, message)
 	if len(lines) != 0 {
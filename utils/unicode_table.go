@@ -0,0 +1,93 @@
+package main
+
+import (
+	`fmt`
+	`os`
+	`strings`
+	`unicode`
+)
+
+// Generates src/unicode_table.h, the scanner's table of which characters
+// may start or continue an identifier.
+// Usage: go run unicode_table.go > ../src/unicode_table.h
+//
+// A character may start an identifier if it is a letter or letter number.
+// Unassigned code points in the CJK range count too, so ideographs added
+// in later Unicode versions keep working. A character may continue an
+// identifier if it may start one, or if it is a decimal digit or a
+// combining mark.
+
+const (
+	identifierStart = 1
+	identifierContinue = 2
+	blockSize = 256
+	cjkFirst = 0x4E00
+	cjkLast = 0x2FA1F
+)
+
+func property(r rune) int {
+	unassigned := !unicode.In(r, unicode.L, unicode.M, unicode.N, unicode.P, unicode.S, unicode.Z, unicode.C)
+	start := unicode.IsLetter(r) || unicode.Is(unicode.Nl, r) || (r >= cjkFirst && r <= cjkLast && unassigned)
+	if start { return identifierStart | identifierContinue }
+	if unicode.Is(unicode.Nd, r) || unicode.Is(unicode.Mn, r) || unicode.Is(unicode.Mc, r) {
+		return identifierContinue
+	}
+	return 0
+}
+
+func main() {
+	var blocks []string
+	blockIndex := make(map[string]int)
+	var index []int
+
+	for first := rune(0); first <= unicode.MaxRune; first += blockSize {
+		// Two bits per character, four characters per byte.
+		packed := make([]string, blockSize / 4)
+		for i := 0; i < blockSize / 4; i++ {
+			value := 0
+			for j := 0; j < 4; j++ {
+				value |= property(first + rune(i * 4 + j)) << (j * 2)
+			}
+			packed[i] = fmt.Sprintf("0x%02x", value)
+		}
+		block := strings.Join(packed, ",")
+		if _, found := blockIndex[block]; !found {
+			blockIndex[block] = len(blocks)
+			blocks = append(blocks, block)
+		}
+		index = append(index, blockIndex[block])
+	}
+
+	if len(blocks) > 256 {
+		fmt.Fprintln(os.Stderr, "too many distinct blocks for a uint8_t index")
+		os.Exit(1)
+	}
+
+	fmt.Println("// Generated by utils/unicode_table.go from Unicode " + unicode.Version + ". Do not edit.")
+	fmt.Println()
+	fmt.Println("#ifndef QI_UNICODE_TABLE_H")
+	fmt.Println("#define QI_UNICODE_TABLE_H")
+	fmt.Println()
+	fmt.Println("#include <stdint.h>")
+	fmt.Println()
+	fmt.Println("#define IDENTIFIER_START 1")
+	fmt.Println("#define IDENTIFIER_CONTINUE 2")
+	fmt.Println()
+	fmt.Printf("// Which of the %d distinct blocks below each run of %d code points uses.\n", len(blocks), blockSize)
+	fmt.Printf("static const uint8_t identifierBlockIndex[%d] = {\n", len(index))
+	for i := 0; i < len(index); i += 16 {
+		var row []string
+		for j := i; j < i + 16 && j < len(index); j++ { row = append(row, fmt.Sprint(index[j])) }
+		fmt.Printf("    %s,\n", strings.Join(row, ","))
+	}
+	fmt.Println("};")
+	fmt.Println()
+	fmt.Println("// The properties of each code point in a block, two bits apiece.")
+	fmt.Printf("static const uint8_t identifierBlocks[%d][%d] = {\n", len(blocks), blockSize / 4)
+	for _, block := range blocks {
+		fmt.Printf("    {%s},\n", block)
+	}
+	fmt.Println("};")
+	fmt.Println()
+	fmt.Println("#endif //QI_UNICODE_TABLE_H")
+}